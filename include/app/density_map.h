@@ -0,0 +1,79 @@
+#ifndef DENSITY_MAP_H
+#define DENSITY_MAP_H
+
+#include "raylib.h"
+#include "simulation.h"
+#include "vector.h"
+
+#include <stdint.h>
+
+// Most threads splatting one map
+#define DENSITY_MAP_MAX_THREADS 8
+// Entries of the colour ramp the tone mapped density looks up
+#define DENSITY_MAP_RAMP_SIZE 256
+
+// What each particle adds to the pixel under its centre
+typedef enum {
+    DENSITY_WEIGHT_MASS,
+    // Every particle and tracer adds one
+    DENSITY_WEIGHT_COUNT,
+} DensityWeight;
+
+// One particle or tracer landing on the map: the pixel under it and what it
+// adds there
+typedef struct
+{
+    uint32_t pixel;
+    float weight;
+} DensitySplat;
+
+// Threads rendering maps, kept from one render to the next
+typedef struct DensityPool DensityPool;
+
+// Screen sized heat map of the particles, rendered on the CPU. The map is cut
+// into one band of rows per thread. Each thread sorts its share of the
+// particles into splats by the band they land in, then owns a band while its
+// splats are added and tone mapped, so no two threads ever write the same
+// memory and the scratch grows with the particles rather than with the
+// screen. The density is mapped through a log curve running from the
+// lightest to the densest pixel, so faint dust and heavy clumps stay apart,
+// then through a colour ramp into pixels ready to upload or save.
+typedef struct
+{
+    int width;
+    int height;
+    uint32_t thread_count;
+    float *density;
+    Color *pixels;
+    Color ramp[DENSITY_MAP_RAMP_SIZE];
+
+    // Pixel under each particle and tracer of a render, and their splats
+    // sorted by band, for item_capacity of them
+    uint32_t *pixel_of;
+    DensitySplat *splats;
+    uint64_t item_capacity;
+
+    DensityPool *pool;
+} DensityMap;
+
+// Create a map of the given size, splatting on up to thread_count threads, 0
+// meaning one per processor
+DensityMap density_map_init(int width, int height, uint32_t thread_count);
+
+// Fit the map to a new size
+void density_map_resize(DensityMap *map, int width, int height);
+
+// Stop the map's threads and release its memory
+void density_map_deinit(DensityMap *map);
+
+// Render the particles and tracers seen through the camera into the map's
+// pixels. Tracers have no mass and are only counted with DENSITY_WEIGHT_COUNT.
+void density_map_render(DensityMap *map, Camera2D camera,
+                        const Particle *particles, uint64_t particle_count,
+                        const Vec2 *tracers, uint64_t tracer_count,
+                        DensityWeight weight);
+
+// The map's pixels as an image, owned by the map
+Image density_map_image(const DensityMap *map);
+
+#endif // DENSITY_MAP_H
@@ -0,0 +1,98 @@
+#ifndef FRAME_EXPORT_H
+#define FRAME_EXPORT_H
+
+#include "raylib.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Most encoding threads of one exporter
+#define FRAME_EXPORT_MAX_WORKERS 16
+// Frame buffers beyond one per worker, so the next frame can be drawn while
+// every worker is busy
+#define FRAME_EXPORT_SPARE_BUFFERS 2
+
+typedef enum {
+    FRAME_FORMAT_PNG,
+    // Binary portable pixmap, much faster to write than PNG but uncompressed
+    FRAME_FORMAT_PPM,
+} FrameFormat;
+
+// One frame waiting to be encoded
+typedef struct
+{
+    Color *pixels;
+    uint64_t frame;
+} FrameJob;
+
+// Totals of an export, see frame_exporter_stop
+typedef struct
+{
+    uint64_t frames;
+    uint64_t failed;
+    // Wall time from start to stop and time spent encoding summed over the
+    // workers, larger than the wall time when encoding overlaps
+    double seconds;
+    double encode_seconds;
+} FrameExportStats;
+
+// Writes numbered image files on a pool of worker threads. The caller draws
+// into a buffer taken with frame_exporter_acquire and hands it back with
+// frame_exporter_submit. A worker then encodes it while the caller moves on,
+// and returns the buffer to the pool once the file is written. The caller
+// only waits when every buffer is in flight.
+typedef struct
+{
+    const char *directory;
+    FrameFormat format;
+    int width;
+    int height;
+
+    pthread_t workers[FRAME_EXPORT_MAX_WORKERS];
+    uint32_t worker_count;
+    pthread_mutex_t lock;
+    pthread_cond_t job_ready;
+    pthread_cond_t buffer_free;
+    bool stopping;
+
+    // Buffers not in use, and jobs in submission order in a ring. Both hold
+    // at most buffer_count entries.
+    Color **buffers;
+    Color **free_buffers;
+    uint32_t buffer_count;
+    uint32_t free_count;
+    FrameJob *jobs;
+    uint32_t job_head;
+    uint32_t job_count;
+
+    FrameExportStats stats;
+    double start_time;
+} FrameExporter;
+
+// Start an exporter writing width by height frames into the directory, which
+// is created if missing. worker_count 0 uses one worker per processor. The
+// directory string must outlive the exporter.
+FrameExporter *frame_exporter_start(const char *directory, FrameFormat format,
+                                    int width, int height,
+                                    uint32_t worker_count);
+
+// Take a free frame buffer, waiting for a worker to finish one if needed
+Color *frame_exporter_acquire(FrameExporter *exporter);
+
+// Queue a buffer taken from the exporter to be written as the numbered frame
+void frame_exporter_submit(FrameExporter *exporter, Color *pixels,
+                           uint64_t frame);
+
+// Write every queued frame, stop the workers and release the exporter
+FrameExportStats frame_exporter_stop(FrameExporter *exporter);
+
+// Fill a frame with one colour
+void frame_clear(Color *pixels, int width, int height, Color color);
+
+// Blend a disc in screen space into a frame. Discs smaller than a pixel are
+// blended into the pixel under their centre by the area they cover.
+void frame_fill_circle(Color *pixels, int width, int height, float x, float y,
+                       float radius, Color color);
+
+#endif // FRAME_EXPORT_H
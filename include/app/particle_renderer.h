@@ -0,0 +1,70 @@
+#ifndef PARTICLE_RENDERER_H
+#define PARTICLE_RENDERER_H
+
+#include "raylib.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Instances the GPU buffer starts with, it doubles when a frame needs more
+#define PARTICLE_RENDERER_INITIAL_CAPACITY 4096
+// Size in pixels of the disc texture used by the fallback path
+#define PARTICLE_RENDERER_DISC_SIZE 64
+
+// One circle to draw, laid out as the instanced vertex attributes read it
+typedef struct
+{
+    float x;
+    float y;
+    float radius;
+    Color color;
+} ParticleInstance;
+
+// Draws many circles at once. Circles are collected on the CPU every frame
+// and drawn with a single instanced draw call of a quad, cut to a disc by the
+// fragment shader. Where instancing is not available (OpenGL 2.1 and ES 2.0
+// contexts) the circles are drawn as textured quads through the rlgl batch
+// instead, a few thousand per draw call. Both paths run on software GL such as
+// Mesa llvmpipe.
+typedef struct
+{
+    ParticleInstance *instances;
+    uint64_t count;
+    uint64_t capacity;
+
+    bool instanced;
+    unsigned int shader;
+    int mvp_location;
+    unsigned int vao;
+    unsigned int quad_buffer;
+    unsigned int instance_buffer;
+    uint64_t instance_buffer_capacity;
+
+    // Disc drawn on each quad by the fallback path
+    Texture2D disc;
+} ParticleRenderer;
+
+// Create the renderer, after the window has been opened
+ParticleRenderer particle_renderer_init(void);
+
+// Release the renderer's GPU and CPU memory
+void particle_renderer_deinit(ParticleRenderer *renderer);
+
+// Make room for count more circles
+void particle_renderer_reserve(ParticleRenderer *renderer, uint64_t count);
+
+// Queue a circle for the next flush
+static inline void particle_renderer_push(ParticleRenderer *renderer, float x,
+                                          float y, float radius, Color color) {
+    if (renderer->count == renderer->capacity) {
+        particle_renderer_reserve(renderer, 1);
+    }
+    renderer->instances[renderer->count++] =
+        (ParticleInstance){x, y, radius, color};
+}
+
+// Draw every queued circle with the current transform, inside BeginMode2D,
+// and empty the queue
+void particle_renderer_flush(ParticleRenderer *renderer);
+
+#endif // PARTICLE_RENDERER_H
@@ -0,0 +1,185 @@
+#ifndef SIM_THREAD_H
+#define SIM_THREAD_H
+
+#include "arena_allocator.h"
+#include "bitset.h"
+#include "checkpoint.h"
+#include "command.h"
+#include "simulation.h"
+#include "trajectory.h"
+#include "vector.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Number of snapshot buffers: one being written, one being read and one
+// holding the latest complete snapshot between them
+#define SIM_THREAD_SNAPSHOT_COUNT 3
+// Flag set on the shared snapshot index when it has not been read yet
+#define SIM_THREAD_SNAPSHOT_FRESH 4u
+// Number of commands that can wait for the simulation thread in each ring
+#define SIM_THREAD_COMMAND_CAPACITY 1024
+// Default number of commands executed before each step, the rest wait for
+// the following steps so a burst of commands cannot stall the simulation
+#define SIM_THREAD_DEFAULT_COMMAND_BUDGET 256
+
+// Copy of the simulation state that rendering needs, taken after a step
+typedef struct
+{
+    Particle *particles;
+    uint64_t particle_count;
+    uint64_t particle_capacity;
+    // Grid over the copied particles for selection queries, see
+    // spatial_grid_query_box and spatial_grid_query_circle
+    SpatialGrid grid;
+    Vec2 *tracers;
+    uint64_t tracer_count;
+    uint64_t tracer_capacity;
+    // Copy of the trails, its capacity is the trails its memory holds
+    TrailSet trails;
+    Integrator integrator;
+    uint64_t step;
+    // See Simulation.still_version
+    uint64_t still_version;
+} SimulationSnapshot;
+
+// A simulation stepped on its own thread. The thread owns the simulation and
+// its arena, other threads only talk to it through commands and read it
+// through snapshots.
+typedef struct
+{
+    pthread_t thread;
+    atomic_bool running;
+    Simulation simulation;
+    ArenaAllocator *frame_arena;
+    double time_step;
+    uint64_t step;
+
+    // Commands executed on the simulation thread with the SimThread as their
+    // context: a single producer ring for the UI thread and a multiple
+    // producer ring reserved for every other thread
+    SpscCommandRing *commands;
+    MpscCommandRing *shared_commands;
+    atomic_uint command_budget;
+
+    // Triple buffered snapshots. The writer owns back, the reader owns front
+    // and the third index is exchanged atomically between them, together
+    // with SIM_THREAD_SNAPSHOT_FRESH when it holds a snapshot not yet read.
+    SimulationSnapshot snapshots[SIM_THREAD_SNAPSHOT_COUNT];
+    atomic_uint latest;
+    uint32_t back;
+    uint32_t front;
+
+    // Recording of the steps while one is running, fed after every publish
+    TrajectoryRecorder *recorder;
+    // Periodic checkpoints, taken after every publish while the interval is
+    // not zero
+    Checkpointer checkpointer;
+} SimThread;
+
+// Start stepping the simulation on a new thread every time_step seconds of
+// real time. The thread takes ownership of the simulation and the frame arena.
+SimThread *sim_thread_start(Simulation simulation, ArenaAllocator *frame_arena,
+                            double time_step);
+
+// Stop the thread and release the simulation, its arena and the snapshots
+void sim_thread_stop(SimThread *sim_thread);
+
+// Queue a command for the simulation thread, copying its payload. Only the
+// thread that started the simulation thread may call this. Fails if the ring
+// is full or the payload does not fit in a ring command.
+CommandStatus sim_thread_submit(SimThread *sim_thread,
+                                RingCommandFunction execute,
+                                const void *payload, size_t size);
+
+// Queue a command for the simulation thread from any thread. Reserved for
+// producers other than the UI thread, such as scripts or IPC. None exist
+// yet, so the app only uses sim_thread_submit and the shared ring is drained
+// empty every step.
+CommandStatus sim_thread_submit_shared(SimThread *sim_thread,
+                                       RingCommandFunction execute,
+                                       const void *payload, size_t size);
+
+// Set how many commands run before each step, across both rings. Reserved
+// like sim_thread_submit_shared, the app keeps
+// SIM_THREAD_DEFAULT_COMMAND_BUDGET.
+void sim_thread_set_command_budget(SimThread *sim_thread, uint32_t budget);
+
+// Latest complete snapshot. Never blocks, and the snapshot stays valid until
+// the next call from the same thread. Only one thread may read snapshots.
+const SimulationSnapshot *sim_thread_snapshot(SimThread *sim_thread);
+
+// Queue adding a particle
+CommandStatus sim_thread_spawn_particle(SimThread *sim_thread,
+                                        Particle particle);
+
+// Queue filling a circle with tracers at rest, see scenario_dust
+CommandStatus sim_thread_spawn_dust(SimThread *sim_thread, Vec2 center,
+                                    double radius, uint32_t count,
+                                    uint32_t seed);
+
+// Queue switching the integrator
+CommandStatus sim_thread_set_integrator(SimThread *sim_thread,
+                                        Integrator integrator);
+
+// Queue saving the simulation to a file, see save_state_write. The path must
+// outlive the command.
+CommandStatus sim_thread_save(SimThread *sim_thread, const char *path);
+
+// Queue replacing the simulation with one saved in a file, see
+// save_state_read. Indices of particles change, so selections made before the
+// next snapshot are stale. The path must outlive the command.
+CommandStatus sim_thread_load(SimThread *sim_thread, const char *path);
+
+// Queue starting to record every TRAJECTORY_DEFAULT_INTERVAL-th step into a
+// trajectory file, or stopping the recording if one is running. The path
+// must outlive the command.
+CommandStatus sim_thread_toggle_recording(SimThread *sim_thread,
+                                          const char *path);
+
+// Queue starting to write a checkpoint into a save file every interval
+// steps, see Checkpointer, or stopping the checkpoints if they are running.
+// Each checkpoint prints how long it paused the simulation. The path must
+// outlive the command.
+CommandStatus sim_thread_toggle_checkpoints(SimThread *sim_thread,
+                                            const char *path,
+                                            uint64_t interval,
+                                            CheckpointMode mode);
+
+// Queue pinning or releasing the selected particles. The selection commands
+// copy the selection, whose bits are indices into the latest snapshot, and
+// apply it in a single pass over the particles. An empty selection queues
+// nothing.
+CommandStatus sim_thread_pin_selection(SimThread *sim_thread,
+                                       const Bitset *selection, bool is_static);
+
+// Queue moving the selected particles by the offset
+CommandStatus sim_thread_translate_selection(SimThread *sim_thread,
+                                             const Bitset *selection,
+                                             Vec2 offset);
+
+// Queue setting the velocity of the selected particles
+CommandStatus sim_thread_set_selection_velocity(SimThread *sim_thread,
+                                                const Bitset *selection,
+                                                Vec2 velocity);
+
+// Queue multiplying the density of the selected particles
+CommandStatus sim_thread_scale_selection_density(SimThread *sim_thread,
+                                                 const Bitset *selection,
+                                                 double factor);
+
+// Queue removing the selected particles. Indices of the particles after them
+// change, so selections made before the next snapshot are stale.
+CommandStatus sim_thread_delete_selection(SimThread *sim_thread,
+                                          const Bitset *selection);
+
+// Queue starting or dropping trails for the selected particles. Once every
+// trail is taken further particles get none.
+CommandStatus sim_thread_trail_selection(SimThread *sim_thread,
+                                         const Bitset *selection,
+                                         bool has_trail);
+
+#endif // SIM_THREAD_H
@@ -0,0 +1,71 @@
+#ifndef SPLAT_BINS_H
+#define SPLAT_BINS_H
+
+#include "particle_renderer.h"
+#include "raylib.h"
+
+#include <stdint.h>
+
+// Width in pixels of the square screen area one splat stands for
+#define SPLAT_BIN_PIXELS 2
+// Faintest splat, so a lone grain of dust stays visible
+#define SPLAT_MIN_ALPHA 0.25f
+
+// Bins over the screen collecting circles smaller than a pixel. Each bin
+// draws as one splat at the weighted centre of what fell into it, in the
+// colour of its heaviest circle, as opaque as the circles' total area would
+// make it. Only the bins touched since the last flush are visited.
+typedef struct
+{
+    int columns;
+    int rows;
+    float *weight;
+    float *x;
+    float *y;
+    float *area;
+    float *max_weight;
+    Color *color;
+    uint32_t *touched;
+    uint32_t touched_count;
+} SplatBins;
+
+// Fit the bins to the screen, dropping anything not yet flushed
+void splat_bins_resize(SplatBins *bins, int screen_width, int screen_height);
+
+// Release the memory of the bins
+void splat_bins_deinit(SplatBins *bins);
+
+// Add a circle at a screen position, with a weight of zero or more and its
+// area in square pixels. Circles off the screen are ignored.
+static inline void splat_bins_add(SplatBins *bins, float screen_x,
+                                  float screen_y, float world_x, float world_y,
+                                  float weight, float area, Color color) {
+    if (!(screen_x >= 0 && screen_y >= 0)) {
+        return;
+    }
+    int column = (int)(screen_x / SPLAT_BIN_PIXELS);
+    int row = (int)(screen_y / SPLAT_BIN_PIXELS);
+    if (column >= bins->columns || row >= bins->rows) {
+        return;
+    }
+
+    // Empty bins have a negative heaviest weight
+    uint32_t bin = (uint32_t)(row * bins->columns + column);
+    if (bins->max_weight[bin] < 0) {
+        bins->touched[bins->touched_count++] = bin;
+    }
+    bins->weight[bin] += weight;
+    bins->x[bin] += world_x * weight;
+    bins->y[bin] += world_y * weight;
+    bins->area[bin] += area;
+    if (weight > bins->max_weight[bin]) {
+        bins->max_weight[bin] = weight;
+        bins->color[bin] = color;
+    }
+}
+
+// Queue one splat per touched bin on the renderer and empty the bins
+void splat_bins_flush(SplatBins *bins, ParticleRenderer *renderer,
+                      Camera2D camera);
+
+#endif // SPLAT_BINS_H
@@ -0,0 +1,39 @@
+#ifndef STILL_LAYER_H
+#define STILL_LAYER_H
+
+#include "raylib.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Screen sized drawing of the particles that do not move, static or asleep,
+// kept in a render texture. It is only redrawn when the camera moves, the
+// screen is resized or the simulation's still_version changes, every other
+// frame it is drawn as one texture in place of clearing the screen.
+typedef struct
+{
+    RenderTexture2D target;
+    bool is_valid;
+    // What the texture was drawn for
+    uint64_t version;
+    Camera2D camera;
+} StillLayer;
+
+// Whether the layer has to be redrawn for this version, camera and screen
+bool still_layer_is_stale(const StillLayer *layer, uint64_t version,
+                          Camera2D camera);
+
+// Start redrawing the layer in the camera's world space, sizing it to the
+// screen. Must be followed by still_layer_end.
+void still_layer_begin(StillLayer *layer, Camera2D camera);
+
+// Finish redrawing the layer, which is now current for the version
+void still_layer_end(StillLayer *layer, uint64_t version, Camera2D camera);
+
+// Draw the layer over the whole screen, outside BeginMode2D
+void still_layer_draw(const StillLayer *layer);
+
+// Release the layer's texture
+void still_layer_deinit(StillLayer *layer);
+
+#endif // STILL_LAYER_H
@@ -5,11 +5,22 @@
 
 #include <stdbool.h>
 
+// Longest time between two clicks that still counts as a double click
+#define USER_INPUT_DOUBLE_CLICK_TIME 0.3
+
 typedef struct {
     bool mouse_left_pressed;
     bool mouse_left_released;
+    // The current or just released press is the second click of a double
+    // click
+    bool mouse_double_clicked;
+    bool shift_down;
+    bool ctrl_down;
     Vector2 mouse_start;
     Vector2 mouse_current;
+    // Mouse position in the previous frame
+    Vector2 mouse_previous;
+    double last_press_time;
 } UserInput;
 
 // Collect input from the user
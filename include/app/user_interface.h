@@ -1,6 +1,7 @@
 #ifndef USER_INTERFACE_H
 #define USER_INTERFACE_H
 
+#include "bitset.h"
 #include "user_input.h"
 
 /*
@@ -36,6 +37,8 @@ Click to set action: select, move, spawn, etc...
 a. click: particle info appears: size, mass, etc
 b. drag: set particle radius
 c. release: spawn particle with radius and corresponding mass
+- dust mode: release fills the dragged circle with massless tracers
+- pin mode: release spawns a static particle that never moves
 */
 
 typedef enum {
@@ -46,24 +49,43 @@ typedef enum {
 
 typedef enum {
     SELECT_MODE_BOX,
+    SELECT_MODE_CIRCLE,
     // ...
 } SelectMode;
 
 typedef enum {
     MOVE_MODE_POSITION,
+    MOVE_MODE_VELOCITY,
     // ...
 } MoveMode;
 
 typedef enum {
     SPAWN_MODE_SINGLE,
+    // Fill the dragged circle with massless tracer particles
+    SPAWN_MODE_DUST,
+    // Spawn a particle that is pinned in place
+    SPAWN_MODE_STATIC,
     // ...
 } SpawnMode;
 
+// How the simulation is drawn
+typedef enum {
+    RENDER_MODE_PARTICLES,
+    // Heat map of the mass, or of the number of particles, under each pixel
+    RENDER_MODE_DENSITY_MASS,
+    RENDER_MODE_DENSITY_COUNT,
+} RenderMode;
+
 typedef struct {
     UITool current_tool;
     SelectMode select_mode;
     MoveMode move_mode;
     SpawnMode spawn_mode;
+    RenderMode render_mode;
+    // Selected particles, one bit per particle of the latest snapshot
+    Bitset selection;
+    // Whether the particle being spawned would overlap another one
+    bool spawn_overlaps;
 } UIState;
 
 bool draw_ui(UIState *state);
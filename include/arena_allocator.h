@@ -7,6 +7,8 @@ typedef struct ArenaAllocator ArenaAllocator;
 
 ArenaAllocator *init_arena(size_t size);
 void deinit_arena(ArenaAllocator *arena);
+// Allocations that do not fit the buffer get memory of their own until the
+// next reset, which grows the buffer to fit them. NULL if out of memory.
 void *arena_alloc(ArenaAllocator *arena, size_t size);
 void reset_arena(ArenaAllocator *arena);
 
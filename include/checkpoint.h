@@ -0,0 +1,90 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "simulation.h"
+#include "vector.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Longest checkpoint path
+#define CHECKPOINT_PATH_SIZE 1024
+
+typedef enum
+{
+    // A child process forked at the step writes the checkpoint from its copy
+    // on write view of the memory. The simulation only waits for the fork.
+    // The child makes only system calls, so it is safe to fork while other
+    // threads hold locks.
+    CHECKPOINT_MODE_FORK,
+    // The particles and tracers are copied and a thread writes the copy. The
+    // simulation waits for the copy.
+    CHECKPOINT_MODE_THREAD,
+} CheckpointMode;
+
+// Totals of the checkpoints taken so far
+typedef struct
+{
+    uint64_t started;
+    uint64_t written;
+    uint64_t failed;
+    // Checkpoints that were due while the previous one was still being
+    // written, and forks that failed and were taken with a thread instead
+    uint64_t skipped;
+    uint64_t fallbacks;
+    // Time the simulation waited to start checkpoints
+    double last_pause_seconds;
+    double max_pause_seconds;
+    double total_pause_seconds;
+} CheckpointStats;
+
+// Writes a save file of the simulation every interval steps without holding
+// up the steps for the write, see save_state_write. Each checkpoint is
+// written to a temporary file next to the path and renamed over it once
+// complete, so the path always holds the last complete checkpoint.
+typedef struct
+{
+    char path[CHECKPOINT_PATH_SIZE];
+    char temporary_path[CHECKPOINT_PATH_SIZE];
+    uint64_t interval;
+    CheckpointMode mode;
+
+    // Checkpoint being written, by the child or by the thread
+    bool is_writing;
+    pid_t child;
+    pthread_t thread;
+    atomic_bool thread_done;
+    bool thread_written;
+    // Copy the thread writes. Its particles and tracers live in memory kept
+    // from one checkpoint to the next, the tracer positions followed by
+    // their velocities.
+    Simulation copy;
+    Particle *particles;
+    uint64_t particle_capacity;
+    Vec2 *tracers;
+    uint64_t tracer_capacity;
+    // Scratch the forked child writes through, allocated before the first
+    // fork since the child cannot allocate
+    void *scratch;
+
+    CheckpointStats stats;
+} Checkpointer;
+
+// Set up checkpoints of the given mode into path every interval steps.
+// Returns false if the path is too long.
+bool checkpointer_init(Checkpointer *checkpointer, const char *path,
+                       uint64_t interval, CheckpointMode mode);
+
+// Collect a finished checkpoint and start the next one if the step is due
+// and none is being written. Call between steps. Returns true if a
+// checkpoint started, its pause is in stats.last_pause_seconds.
+bool checkpointer_step(Checkpointer *checkpointer,
+                       const Simulation *simulation, uint64_t step);
+
+// Wait for the checkpoint being written and release the copy's memory
+void checkpointer_deinit(Checkpointer *checkpointer);
+
+#endif // CHECKPOINT_H
@@ -1,142 +1,277 @@
 #ifndef COMMAND_H
 #define COMMAND_H
 
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 // Status codes for command execution
 typedef enum { COMMAND_SUCCESS, COMMAND_FAILURE } CommandStatus;
 
-// Struct representing a command
-typedef struct {
-  CommandStatus (*execute)(void *); // Function pointer to execute the command
-  void *data; // Pointer to the data the command operates on
-} Command;
-
-// CommandQueue structure
-typedef struct {
-  Command **commands; // Array of Command pointers
-  int size;           // Total size of the queue (capacity)
-  int count;          // Current number of commands in the queue
-  int head;           // Index of the front of the queue
-  int tail;           // Index of the rear of the queue
-} CommandQueue;
-
-// Function prototypes
-
-// Create a new command with the given execute function and data
-Command *create_command(CommandStatus (*execute)(void *), void *data);
+// Lock-free command rings. Commands are stored by value in a fixed array of
+// slots, with their payload copied inline, so queueing a command allocates
+// nothing. The single producer ring is the fast path for one thread feeding
+// another, the multiple producer ring lets any number of threads feed one
+// consumer. Both are drained by a single consumer thread.
 
-// Free a command
-void free_command(Command *command);
+// Largest payload a ring command can carry inline, enough for a whole particle
+#define COMMAND_PAYLOAD_SIZE 96
+// Size the ring indices are padded to, so producer and consumer do not share
+// a cache line
+#define COMMAND_CACHE_LINE 64
 
-// Create a new command queue with a fixed size
-CommandQueue *create_command_queue(int size);
+// Command stored in a ring, executed with the consumer's context
+typedef CommandStatus (*RingCommandFunction)(void *context,
+                                             const void *payload);
 
-// Free a command queue
-void free_command_queue(CommandQueue *queue);
-
-// Add a command to the queue
-CommandStatus enqueue_command(CommandQueue *queue, Command *command);
+typedef struct {
+  RingCommandFunction execute;
+  alignas(max_align_t) unsigned char payload[COMMAND_PAYLOAD_SIZE];
+} RingCommand;
 
-// Process the next command in the queue
-CommandStatus dequeue_and_execute_command(CommandQueue *queue);
+// Ring with one producer and one consumer thread
+typedef struct {
+  alignas(COMMAND_CACHE_LINE) atomic_size_t head; // Next slot to drain
+  alignas(COMMAND_CACHE_LINE) atomic_size_t tail; // Next slot to fill
+  alignas(COMMAND_CACHE_LINE) RingCommand *slots;
+  size_t mask; // Capacity - 1, the capacity is a power of two
+} SpscCommandRing;
+
+// Slot of a multiple producer ring. The sequence tells producers and the
+// consumer whose turn it is to use the slot.
+typedef struct {
+  atomic_size_t sequence;
+  RingCommand command;
+} MpscCommandSlot;
 
-// Process all commands in the queue
-CommandStatus process_all_commands(CommandQueue *queue);
+// Ring with any number of producer threads and one consumer thread
+typedef struct {
+  alignas(COMMAND_CACHE_LINE) atomic_size_t enqueue_position;
+  alignas(COMMAND_CACHE_LINE) size_t dequeue_position;
+  alignas(COMMAND_CACHE_LINE) MpscCommandSlot *slots;
+  size_t mask;
+} MpscCommandRing;
+
+// Create a single producer ring, rounding the capacity up to a power of two
+SpscCommandRing *create_spsc_command_ring(size_t capacity);
+
+// Free a single producer ring, dropping any commands still in it
+void free_spsc_command_ring(SpscCommandRing *ring);
+
+// Copy a command into the ring. Fails if the ring is full or the payload is
+// larger than COMMAND_PAYLOAD_SIZE. Only the producer thread may push.
+CommandStatus spsc_command_ring_push(SpscCommandRing *ring,
+                                     RingCommandFunction execute,
+                                     const void *payload, size_t size);
+
+// Execute up to budget queued commands in order, returns how many ran. Only
+// the consumer thread may drain.
+size_t spsc_command_ring_drain(SpscCommandRing *ring, void *context,
+                               size_t budget);
+
+// Create a multiple producer ring, rounding the capacity up to a power of two
+MpscCommandRing *create_mpsc_command_ring(size_t capacity);
+
+// Free a multiple producer ring, dropping any commands still in it
+void free_mpsc_command_ring(MpscCommandRing *ring);
+
+// Copy a command into the ring from any thread. Fails if the ring is full or
+// the payload is larger than COMMAND_PAYLOAD_SIZE.
+CommandStatus mpsc_command_ring_push(MpscCommandRing *ring,
+                                     RingCommandFunction execute,
+                                     const void *payload, size_t size);
+
+// Execute up to budget queued commands in order, returns how many ran. Only
+// the consumer thread may drain.
+size_t mpsc_command_ring_drain(MpscCommandRing *ring, void *context,
+                               size_t budget);
 
 #endif // COMMAND_H
 
 #ifdef COMMAND_IMPLEMENTATION
 
-// Create a new command
-Command *create_command(CommandStatus (*execute)(void *), void *data) {
-  Command *cmd = (Command *)malloc(sizeof(Command));
-  if (!cmd) {
-    return NULL; // Memory allocation failure
+// Smallest power of two holding at least capacity elements
+static size_t command_ring_capacity(size_t capacity) {
+  size_t power = 1;
+  while (power < capacity) {
+    power *= 2;
   }
-  cmd->execute = execute;
-  cmd->data = data;
-  return cmd;
+  return power;
 }
 
-// Free a command
-void free_command(Command *command) {
-  if (command) {
-    free(command); // Only free the command, not the data it operates on
-  }
-}
-
-// Create a new command queue
-CommandQueue *create_command_queue(int size) {
-  CommandQueue *queue = (CommandQueue *)malloc(sizeof(CommandQueue));
-  if (!queue) {
-    return NULL; // Memory allocation failure
+// Create a single producer ring
+SpscCommandRing *create_spsc_command_ring(size_t capacity) {
+  capacity = command_ring_capacity(capacity);
+  SpscCommandRing *ring = aligned_alloc(
+      COMMAND_CACHE_LINE,
+      (sizeof(SpscCommandRing) + COMMAND_CACHE_LINE - 1) /
+          COMMAND_CACHE_LINE * COMMAND_CACHE_LINE);
+  if (!ring) {
+    return NULL;
   }
 
-  queue->commands = (Command **)malloc(sizeof(Command *) * size);
-  if (!queue->commands) {
-    free(queue);
+  ring->slots = malloc(sizeof(RingCommand) * capacity);
+  if (!ring->slots) {
+    free(ring);
     return NULL;
   }
-
-  queue->size = size;
-  queue->count = 0;
-  queue->head = 0;
-  queue->tail = 0;
-
-  return queue;
+  ring->mask = capacity - 1;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  return ring;
 }
 
-// Free a command queue
-void free_command_queue(CommandQueue *queue) {
-  if (queue) {
-    free(queue->commands); // Free the array of command pointers
-    free(queue);           // Free the queue itself
+// Free a single producer ring
+void free_spsc_command_ring(SpscCommandRing *ring) {
+  if (ring) {
+    free(ring->slots);
+    free(ring);
   }
 }
 
-// Add a command to the queue
-CommandStatus enqueue_command(CommandQueue *queue, Command *command) {
-  if (queue->count >= queue->size) {
-    return COMMAND_FAILURE; // Queue is full
+// Copy a command into a single producer ring
+CommandStatus spsc_command_ring_push(SpscCommandRing *ring,
+                                     RingCommandFunction execute,
+                                     const void *payload, size_t size) {
+  if (size > COMMAND_PAYLOAD_SIZE) {
+    return COMMAND_FAILURE;
   }
 
-  queue->commands[queue->tail] = command;
-  queue->tail = (queue->tail + 1) % queue->size;
-  queue->count++;
+  // Only the producer writes the tail, the head is the consumer's
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  if (tail - head > ring->mask) {
+    return COMMAND_FAILURE; // Ring is full
+  }
 
+  RingCommand *slot = &ring->slots[tail & ring->mask];
+  slot->execute = execute;
+  if (size > 0) {
+    memcpy(slot->payload, payload, size);
+  }
+  atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
   return COMMAND_SUCCESS;
 }
 
-// Process and execute the next command in the queue
-CommandStatus dequeue_and_execute_command(CommandQueue *queue) {
-  if (queue->count == 0) {
-    return COMMAND_FAILURE; // Queue is empty
+// Execute queued commands of a single producer ring
+size_t spsc_command_ring_drain(SpscCommandRing *ring, void *context,
+                               size_t budget) {
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+  size_t executed = 0;
+  while (head != tail && executed < budget) {
+    // The slot is only handed back to the producer once it has run, so the
+    // command executes straight from the ring
+    RingCommand *slot = &ring->slots[head & ring->mask];
+    slot->execute(context, slot->payload);
+    head++;
+    executed++;
+    atomic_store_explicit(&ring->head, head, memory_order_release);
   }
+  return executed;
+}
 
-  Command *cmd = queue->commands[queue->head];
-  CommandStatus status = cmd->execute(cmd->data); // Execute the command
-
-  // Free the command after execution
-  free_command(cmd);
+// Create a multiple producer ring
+MpscCommandRing *create_mpsc_command_ring(size_t capacity) {
+  capacity = command_ring_capacity(capacity);
+  MpscCommandRing *ring = aligned_alloc(
+      COMMAND_CACHE_LINE,
+      (sizeof(MpscCommandRing) + COMMAND_CACHE_LINE - 1) /
+          COMMAND_CACHE_LINE * COMMAND_CACHE_LINE);
+  if (!ring) {
+    return NULL;
+  }
 
-  queue->head = (queue->head + 1) % queue->size;
-  queue->count--;
+  ring->slots = malloc(sizeof(MpscCommandSlot) * capacity);
+  if (!ring->slots) {
+    free(ring);
+    return NULL;
+  }
+  ring->mask = capacity - 1;
+  for (size_t i = 0; i < capacity; i++) {
+    atomic_init(&ring->slots[i].sequence, i);
+  }
+  atomic_init(&ring->enqueue_position, 0);
+  ring->dequeue_position = 0;
+  return ring;
+}
 
-  return status;
+// Free a multiple producer ring
+void free_mpsc_command_ring(MpscCommandRing *ring) {
+  if (ring) {
+    free(ring->slots);
+    free(ring);
+  }
 }
 
-// Process and execute all commands in the queue
-CommandStatus process_all_commands(CommandQueue *queue) {
-  while (queue->count > 0) {
-    CommandStatus status = dequeue_and_execute_command(queue);
-    if (status == COMMAND_FAILURE) {
-      return COMMAND_FAILURE; // Stop processing if a command fails
+// Copy a command into a multiple producer ring
+CommandStatus mpsc_command_ring_push(MpscCommandRing *ring,
+                                     RingCommandFunction execute,
+                                     const void *payload, size_t size) {
+  if (size > COMMAND_PAYLOAD_SIZE) {
+    return COMMAND_FAILURE;
+  }
+
+  // A slot is free for position p when its sequence equals p. Producers race
+  // for the position, the winner fills the slot and publishes it by moving
+  // the sequence to p + 1.
+  size_t position =
+      atomic_load_explicit(&ring->enqueue_position, memory_order_relaxed);
+  MpscCommandSlot *slot;
+  for (;;) {
+    slot = &ring->slots[position & ring->mask];
+    size_t sequence =
+        atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    ptrdiff_t difference = (ptrdiff_t)sequence - (ptrdiff_t)position;
+    if (difference == 0) {
+      if (atomic_compare_exchange_weak_explicit(
+              &ring->enqueue_position, &position, position + 1,
+              memory_order_relaxed, memory_order_relaxed)) {
+        break;
+      }
+    } else if (difference < 0) {
+      return COMMAND_FAILURE; // Ring is full
+    } else {
+      position =
+          atomic_load_explicit(&ring->enqueue_position, memory_order_relaxed);
     }
   }
 
+  slot->command.execute = execute;
+  if (size > 0) {
+    memcpy(slot->command.payload, payload, size);
+  }
+  atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
   return COMMAND_SUCCESS;
 }
 
+// Execute queued commands of a multiple producer ring
+size_t mpsc_command_ring_drain(MpscCommandRing *ring, void *context,
+                               size_t budget) {
+  size_t executed = 0;
+  while (executed < budget) {
+    size_t position = ring->dequeue_position;
+    MpscCommandSlot *slot = &ring->slots[position & ring->mask];
+    size_t sequence =
+        atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    if (sequence != position + 1) {
+      break; // Empty, or the next producer has not finished writing
+    }
+
+    slot->command.execute(context, slot->command.payload);
+    ring->dequeue_position = position + 1;
+    executed++;
+
+    // Hand the slot to the producer that wraps around to it
+    atomic_store_explicit(&slot->sequence, position + ring->mask + 1,
+                          memory_order_release);
+  }
+  return executed;
+}
+
 #endif // COMMAND_IMPLEMENTATION
@@ -0,0 +1,64 @@
+#ifndef BITSET_H
+#define BITSET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BITSET_WORD_BITS 64
+
+// Dense set of indices, one bit per index packed into 64 bit words. Bits past
+// count in the last word are always clear, so whole word operations never
+// see indices that do not exist.
+typedef struct
+{
+    uint64_t *words;
+    uint64_t count;
+    uint64_t word_capacity;
+} Bitset;
+
+// Number of words holding count bits
+static inline uint64_t bitset_word_count(uint64_t count) {
+    return (count + BITSET_WORD_BITS - 1) / BITSET_WORD_BITS;
+}
+
+static inline bool bitset_test(const Bitset *set, uint64_t index) {
+    uint64_t word = set->words[index / BITSET_WORD_BITS];
+    return (word >> (index % BITSET_WORD_BITS)) & 1;
+}
+
+static inline void bitset_set(Bitset *set, uint64_t index) {
+    set->words[index / BITSET_WORD_BITS] |= 1ull << (index % BITSET_WORD_BITS);
+}
+
+static inline void bitset_clear(Bitset *set, uint64_t index) {
+    set->words[index / BITSET_WORD_BITS] &=
+        ~(1ull << (index % BITSET_WORD_BITS));
+}
+
+// Grow or shrink the set to count bits, new bits are clear
+void bitset_resize(Bitset *set, uint64_t count);
+
+// Release the memory of the set
+void bitset_deinit(Bitset *set);
+
+// Clear every bit
+void bitset_clear_all(Bitset *set);
+
+// Set every bit
+void bitset_set_all(Bitset *set);
+
+// Set the bits of the listed indices
+void bitset_set_indices(Bitset *set, const uint64_t *indices, uint64_t count);
+
+// Number of set bits
+uint64_t bitset_popcount(const Bitset *set);
+
+// First set bit at or after index, or the set's count if there is none
+uint64_t bitset_next(const Bitset *set, uint64_t index);
+
+// Combine other into set word by word. Both sets must have the same count.
+void bitset_union(Bitset *set, const Bitset *other);
+void bitset_intersect(Bitset *set, const Bitset *other);
+void bitset_subtract(Bitset *set, const Bitset *other);
+
+#endif // BITSET_H
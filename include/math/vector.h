@@ -1,7 +1,17 @@
 #ifndef VECTOR_H
 #define VECTOR_H
 
+#include <math.h>
+
+// Define VECTOR_USE_FLOAT to store vectors in single precision. Sums over
+// many vectors should use Vec2Acc, which is always double precision.
+#ifdef VECTOR_USE_FLOAT
+#define VECTOR_T float
+#define VECTOR_SQRT sqrtf
+#else
 #define VECTOR_T double
+#define VECTOR_SQRT sqrt
+#endif
 
 typedef struct
 {
@@ -9,20 +19,72 @@ typedef struct
     VECTOR_T y;
 } Vec2;
 
-Vec2 vec2_zero();
-Vec2 vec2_one();
-Vec2 vec2_add(Vec2 a, Vec2 b);
-Vec2 vec2_sub(Vec2 a, Vec2 b);
-Vec2 vec2_mul(Vec2 a, Vec2 b);
-Vec2 vec2_div(Vec2 a, Vec2 b);
-Vec2 vec2_scale(Vec2 a, VECTOR_T s);
-Vec2 vec2_neg(Vec2 a);
-Vec2 vec2_norm(Vec2 a);
-
-VECTOR_T vec2_dot(Vec2 a, Vec2 b);
-VECTOR_T vec2_len(Vec2 a);
-VECTOR_T vec2_dist(Vec2 a, Vec2 b);
-VECTOR_T vec2_dist_squared(Vec2 a, Vec2 b);
-Vec2 vec2_lerp(Vec2 a, Vec2 b, VECTOR_T t);
-
-#endif // VECTOR_H
\ No newline at end of file
+typedef struct
+{
+    double x;
+    double y;
+} Vec2Acc;
+
+// Every function is static inline so that the inner loops of the simulation
+// and renderer compile without calls. See vector_batch.h for array kernels.
+
+static inline Vec2 vec2_zero() {
+    return (Vec2){0, 0};
+}
+static inline Vec2 vec2_one() {
+    return (Vec2){1, 1};
+}
+static inline Vec2 vec2_add(Vec2 a, Vec2 b) {
+    return (Vec2){a.x + b.x, a.y + b.y};
+}
+static inline Vec2 vec2_sub(Vec2 a, Vec2 b) {
+    return (Vec2){a.x - b.x, a.y - b.y};
+}
+static inline Vec2 vec2_mul(Vec2 a, Vec2 b) {
+    return (Vec2){a.x * b.x, a.y * b.y};
+}
+static inline Vec2 vec2_div(Vec2 a, Vec2 b) {
+    return (Vec2){a.x / b.x, a.y / b.y};
+}
+static inline Vec2 vec2_scale(Vec2 a, VECTOR_T s) {
+    return (Vec2){a.x * s, a.y * s};
+}
+static inline Vec2 vec2_neg(Vec2 a) {
+    return (Vec2){-a.x, -a.y};
+}
+
+static inline VECTOR_T vec2_dot(Vec2 a, Vec2 b) {
+    return a.x * b.x + a.y * b.y;
+}
+static inline VECTOR_T vec2_len(Vec2 a) {
+    return VECTOR_SQRT(a.x * a.x + a.y * a.y);
+}
+static inline Vec2 vec2_norm(Vec2 a) {
+    VECTOR_T inverse_len = 1 / vec2_len(a);
+    return (Vec2){a.x * inverse_len, a.y * inverse_len};
+}
+static inline VECTOR_T vec2_dist(Vec2 a, Vec2 b) {
+    return vec2_len(vec2_sub(a, b));
+}
+static inline VECTOR_T vec2_dist_squared(Vec2 a, Vec2 b) {
+    Vec2 d = vec2_sub(a, b);
+    return vec2_dot(d, d);
+}
+static inline Vec2 vec2_lerp(Vec2 a, Vec2 b, VECTOR_T t) {
+    return vec2_add(a, vec2_scale(vec2_sub(b, a), t));
+}
+
+static inline Vec2Acc vec2_acc_zero() {
+    return (Vec2Acc){0, 0};
+}
+static inline Vec2Acc vec2_acc_add(Vec2Acc a, Vec2 b) {
+    return (Vec2Acc){a.x + b.x, a.y + b.y};
+}
+static inline Vec2Acc vec2_acc_sub(Vec2Acc a, Vec2 b) {
+    return (Vec2Acc){a.x - b.x, a.y - b.y};
+}
+static inline Vec2 vec2_from_acc(Vec2Acc a) {
+    return (Vec2){a.x, a.y};
+}
+
+#endif // VECTOR_H
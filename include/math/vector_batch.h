@@ -0,0 +1,91 @@
+#ifndef VECTOR_BATCH_H
+#define VECTOR_BATCH_H
+
+#include "vector.h"
+
+#include <stddef.h>
+
+// Fixed width batches of vectors with the lanes stored per component, so that
+// the per-lane loops below compile to SIMD instructions on any target the
+// compiler can vectorize for (SSE/AVX on x86, NEON on ARM).
+#define DEFINE_VEC2_BATCH(lanes)                                               \
+  typedef struct {                                                             \
+    VECTOR_T x[lanes];                                                         \
+    VECTOR_T y[lanes];                                                         \
+  } Vec2x##lanes;                                                              \
+                                                                               \
+  /* Load consecutive vectors into the lanes */                                \
+  static inline Vec2x##lanes vec2x##lanes##_load(const Vec2 *v) {              \
+    Vec2x##lanes r;                                                            \
+    for (int l = 0; l < lanes; l++) {                                          \
+      r.x[l] = v[l].x;                                                         \
+      r.y[l] = v[l].y;                                                         \
+    }                                                                          \
+    return r;                                                                  \
+  }                                                                            \
+                                                                               \
+  /* Store the lanes as consecutive vectors */                                 \
+  static inline void vec2x##lanes##_store(Vec2 *v, Vec2x##lanes a) {           \
+    for (int l = 0; l < lanes; l++) {                                          \
+      v[l] = (Vec2){a.x[l], a.y[l]};                                           \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  /* Copy one vector into every lane */                                        \
+  static inline Vec2x##lanes vec2x##lanes##_splat(Vec2 v) {                    \
+    Vec2x##lanes r;                                                            \
+    for (int l = 0; l < lanes; l++) {                                          \
+      r.x[l] = v.x;                                                            \
+      r.y[l] = v.y;                                                            \
+    }                                                                          \
+    return r;                                                                  \
+  }                                                                            \
+                                                                               \
+  static inline Vec2x##lanes vec2x##lanes##_add(Vec2x##lanes a,                \
+                                                Vec2x##lanes b) {              \
+    Vec2x##lanes r;                                                            \
+    for (int l = 0; l < lanes; l++) {                                          \
+      r.x[l] = a.x[l] + b.x[l];                                                \
+      r.y[l] = a.y[l] + b.y[l];                                                \
+    }                                                                          \
+    return r;                                                                  \
+  }                                                                            \
+                                                                               \
+  static inline Vec2x##lanes vec2x##lanes##_sub(Vec2x##lanes a,                \
+                                                Vec2x##lanes b) {              \
+    Vec2x##lanes r;                                                            \
+    for (int l = 0; l < lanes; l++) {                                          \
+      r.x[l] = a.x[l] - b.x[l];                                                \
+      r.y[l] = a.y[l] - b.y[l];                                                \
+    }                                                                          \
+    return r;                                                                  \
+  }                                                                            \
+                                                                               \
+  static inline Vec2x##lanes vec2x##lanes##_scale(Vec2x##lanes a,              \
+                                                  VECTOR_T s) {                \
+    Vec2x##lanes r;                                                            \
+    for (int l = 0; l < lanes; l++) {                                          \
+      r.x[l] = a.x[l] * s;                                                     \
+      r.y[l] = a.y[l] * s;                                                     \
+    }                                                                          \
+    return r;                                                                  \
+  }                                                                            \
+                                                                               \
+  /* Squared distance between each pair of lanes */                            \
+  static inline void vec2x##lanes##_dist_squared(                              \
+      VECTOR_T out[lanes], Vec2x##lanes a, Vec2x##lanes b) {                   \
+    for (int l = 0; l < lanes; l++) {                                          \
+      VECTOR_T dx = a.x[l] - b.x[l];                                           \
+      VECTOR_T dy = a.y[l] - b.y[l];                                           \
+      out[l] = dx * dx + dy * dy;                                              \
+    }                                                                          \
+  }
+
+DEFINE_VEC2_BATCH(4)
+
+// out[i] += a[i] * s over count vectors, the position and velocity update of
+// the tracer integrator. The output may alias the input.
+void vec2_array_add_scaled(Vec2 *out, const Vec2 *a, VECTOR_T s,
+                           size_t count);
+
+#endif // VECTOR_BATCH_H
@@ -0,0 +1,17 @@
+#ifndef CCD_H
+#define CCD_H
+
+#include "arena_allocator.h"
+#include "simulation.h"
+
+#include <stdbool.h>
+
+// Move every awake particle along its velocity for one time step. Particles
+// that travel further than ccd_fast_ratio of their radius are swept against
+// the particles within reach in the collision grid, and each time of impact
+// splits the step of the pair involved into sub-steps so that fast particles
+// cannot tunnel.
+void ccd_advance(Simulation *simulation, ArenaAllocator *allocator, bool *woken,
+                 double time_step);
+
+#endif // CCD_H
@@ -0,0 +1,24 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include "simulation.h"
+#include "vector.h"
+
+// Coefficient of restitution for particle collisions
+#define COLLISION_RESTITUTION 1.0
+
+// Inverse mass of a particle, zero for static particles which never move
+double collision_inverse_mass(const Particle *particle);
+
+// Apply the collision impulse between two touching particles. The normal
+// points from p2 towards p1. Returns false if the particles are separating.
+bool collision_apply_impulse(Particle *p1, Particle *p2, double inverse_mass_p1,
+                             double inverse_mass_p2, Vec2 normal);
+
+// Earliest time in [0, max_time] at which two circles moving linearly start
+// touching, or a negative value if they do not. Circles that already overlap
+// are left to the discrete collision pass.
+double collision_time_of_impact(Vec2 relative_position, Vec2 relative_velocity,
+                                double radius_sum, double max_time);
+
+#endif // COLLISION_H
@@ -0,0 +1,105 @@
+#ifndef GRAVITY_H
+#define GRAVITY_H
+
+#include "arena_allocator.h"
+#include "simulation.h"
+#include "vector.h"
+
+#include <math.h>
+
+// Cubic spline kernels reach Newtonian gravity at this multiple of the
+// softening length, matching the Plummer kernel's potential at r = 0
+#define GRAVITY_SPLINE_SUPPORT 2.8
+
+// Per-step constants of the softening kernels
+typedef struct
+{
+    double epsilon_squared;
+    double spline_length;
+    double inverse_spline_length;
+    double inverse_spline_length_cubed;
+} SofteningParameters;
+
+// Define the kernels returning the factor f of the softened acceleration
+// a = G m f d, where d is the separation and r2 its squared length. For
+// unsoftened gravity f = 1 / r^3.
+#define DEFINE_SOFTENING_KERNELS(type, sqrt_function, suffix)                  \
+  static inline type softening_none_##suffix(type r2,                          \
+                                             SofteningParameters params) {     \
+    (void)params;                                                              \
+    return (type)1 / (r2 * sqrt_function(r2));                                 \
+  }                                                                            \
+                                                                               \
+  static inline type softening_plummer_##suffix(type r2,                       \
+                                                SofteningParameters params) {  \
+    type softened = r2 + (type)params.epsilon_squared;                         \
+    return (type)1 / (softened * sqrt_function(softened));                     \
+  }                                                                            \
+                                                                               \
+  /* Gadget-2 cubic spline kernel, u = r / h */                                \
+  static inline type softening_spline_##suffix(type r2,                        \
+                                               SofteningParameters params) {   \
+    type r = sqrt_function(r2);                                                \
+    type h = (type)params.spline_length;                                       \
+    if (r >= h) {                                                              \
+      return (type)1 / (r2 * r);                                               \
+    }                                                                          \
+    type u = r * (type)params.inverse_spline_length;                           \
+    type inverse_h3 = (type)params.inverse_spline_length_cubed;                \
+    if (u < (type)0.5) {                                                       \
+      return inverse_h3 *                                                      \
+             ((type)10.666666666667 + u * u * ((type)32 * u - (type)38.4));    \
+    }                                                                          \
+    return inverse_h3 *                                                        \
+           ((type)21.333333333333 - (type)48 * u + (type)38.4 * u * u -        \
+            (type)10.666666666667 * u * u * u -                                \
+            (type)0.066666666667 / (u * u * u));                               \
+  }
+
+DEFINE_SOFTENING_KERNELS(VECTOR_T, VECTOR_SQRT, v)
+DEFINE_SOFTENING_KERNELS(double, sqrt, f64)
+
+// Kernel constants for the simulation's current softening length
+SofteningParameters gravity_softening_parameters(const Simulation *simulation);
+
+// Collect the indices of the particles that take part in pairwise gravity,
+// which is every particle that is not static. Returns their count.
+uint64_t gravity_dynamic_indices(const Simulation *simulation,
+                                 ArenaAllocator *allocator,
+                                 uint64_t **indices);
+
+// Add the pair accelerations between the particles in indices and those in
+// partners. Passing the same list twice adds every pair within it once.
+void gravity_accumulate_pairs(const Simulation *simulation,
+                              const uint64_t *indices, uint64_t count,
+                              const uint64_t *partners, uint64_t partner_count,
+                              Vec2Acc *accelerations);
+
+// Add the acceleration caused by the static particles to the indexed ones
+void gravity_accumulate_static(const Simulation *simulation,
+                               const uint64_t *indices, uint64_t count,
+                               Vec2Acc *accelerations);
+
+// Accumulate the gravitational acceleration of the indexed particles from
+// each other and from the static field. Pair terms are evaluated in VECTOR_T
+// precision and summed in double precision. Every other particle is zeroed.
+void gravity_accumulate(const Simulation *simulation, const uint64_t *indices,
+                        uint64_t count, Vec2Acc *accelerations);
+
+// Gravitational acceleration of every tracer, caused by the indexed particles
+// and the static field only. Costs O(particles x tracers) and writes each
+// tracer's result exactly once.
+void gravity_accumulate_tracers(const Simulation *simulation,
+                                const uint64_t *indices, uint64_t count,
+                                Vec2 *accelerations);
+
+// Softened acceleration factor in double precision, for reference checks
+double gravity_softened_factor_f64(SofteningKernel kernel, double r2,
+                                   SofteningParameters params);
+
+// Softened potential of a unit mass pair at squared separation r2, without
+// the gravitational constant
+double gravity_softened_potential_f64(SofteningKernel kernel, double r2,
+                                      SofteningParameters params);
+
+#endif // GRAVITY_H
@@ -0,0 +1,46 @@
+#ifndef ISLANDS_H
+#define ISLANDS_H
+
+#include "arena_allocator.h"
+#include "simulation.h"
+#include "vector.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Disjoint-set forest over particle indices, rebuilt every step from the
+// contacts found by the collision pass. Static particles never join an island,
+// instead the islands resting on them are marked as anchored.
+typedef struct
+{
+    uint64_t *parent;
+    uint64_t *size;
+    bool *anchored;
+    uint64_t count;
+} IslandSet;
+
+// Create an island set where every particle is its own island
+IslandSet islands_init(ArenaAllocator *allocator, uint64_t count);
+
+// Find the root particle of the island containing index
+uint64_t islands_find(IslandSet *islands, uint64_t index);
+
+// Merge the islands containing a and b
+void islands_union(IslandSet *islands, uint64_t a, uint64_t b);
+
+// Mark the island containing index as resting on a static particle
+void islands_anchor(IslandSet *islands, uint64_t index);
+
+// Check whether a sleeping particle's acceleration has changed enough since it
+// fell asleep that it has to wake up
+bool islands_force_changed(const Simulation *simulation,
+                           const Particle *particle, Vec2 acceleration,
+                           double time_step);
+
+// Wake every island containing a woken particle, count calm steps for the rest
+// and put islands that have been calm for long enough to sleep
+void islands_update_sleep(Simulation *simulation, IslandSet *islands,
+                          ArenaAllocator *allocator,
+                          const Vec2Acc *accelerations, const bool *woken);
+
+#endif // ISLANDS_H
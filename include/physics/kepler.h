@@ -0,0 +1,15 @@
+#ifndef KEPLER_H
+#define KEPLER_H
+
+#include "vector.h"
+
+// Largest number of root finding iterations for one Kepler drift
+#define KEPLER_MAX_ITERATIONS 50
+
+// Advance a body along its unperturbed two-body orbit around a fixed mass with
+// gravitational parameter mu = G M. Works for elliptic, parabolic and
+// hyperbolic orbits alike. Position and velocity are relative to the mass.
+void kepler_drift(Vec2Acc *position, Vec2Acc *velocity, double mu,
+                  double time);
+
+#endif // KEPLER_H
@@ -0,0 +1,33 @@
+#ifndef PRECISION_H
+#define PRECISION_H
+
+#include "arena_allocator.h"
+#include "simulation.h"
+
+#include <stdint.h>
+
+// Accuracy of the VECTOR_T build compared with a double precision reference
+typedef struct
+{
+    uint32_t steps;
+    // Largest relative error of a particle's acceleration in the first step
+    double max_acceleration_error;
+    // Position errors after the last step, relative to the system's extent
+    double rms_position_error;
+    double max_position_error;
+    // Relative change of the total energy over the run
+    double energy_drift;
+    double reference_energy_drift;
+} PrecisionReport;
+
+// Integrate the gravity of the simulation's particles for the given number of
+// steps with the build's VECTOR_T and with double precision, and compare.
+// Collisions are left out: they are not smooth, so a rounding difference
+// would flip contacts and swamp the error being measured.
+PrecisionReport precision_report(const Simulation *simulation, ArenaAllocator *allocator,
+                                 double time_step, uint32_t steps);
+
+// Print the report to stdout
+void precision_report_print(PrecisionReport report);
+
+#endif // PRECISION_H
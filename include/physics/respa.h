@@ -0,0 +1,33 @@
+#ifndef RESPA_H
+#define RESPA_H
+
+#include "arena_allocator.h"
+#include "simulation.h"
+#include "vector.h"
+
+#include <stdint.h>
+
+// Accumulate the accelerations of the dynamic particles split by time scale.
+// Forces involving a heavy particle and the static field are fast and are
+// evaluated every step. Forces among light particles are slow and are only
+// evaluated every respa_interval steps. Writes the total acceleration into
+// accelerations and the acceleration to kick with this step into kicks,
+// which carries respa_interval steps of slow acceleration on the steps that
+// evaluate it and none on the others.
+void respa_accumulate(Simulation *simulation, ArenaAllocator *allocator,
+                      const uint64_t *dynamic, uint64_t dynamic_count,
+                      Vec2Acc *accelerations, Vec2Acc *kicks);
+
+// Mark the slow accelerations as stale, for example after particles changed.
+// Particles added since the last due step get the slow impulse for the rest
+// of the interval once the accelerations are evaluated again.
+void respa_invalidate(Simulation *simulation);
+
+// Account for removed particles among those already paid the slow impulse of
+// the current interval, so that the particles after them keep their place
+void respa_remove_paid(Simulation *simulation, uint64_t removed);
+
+// Release the memory of the slow accelerations
+void respa_deinit(RespaState *respa);
+
+#endif // RESPA_H
@@ -0,0 +1,62 @@
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include "simulation.h"
+#include "vector.h"
+
+#include <stdint.h>
+
+// Particles more than this many times the mean radius are oversized
+#define SPATIAL_GRID_OVERSIZED_RATIO 4.0
+// Upper bound on the number of cells per particle, the cells grow beyond the
+// largest particle's diameter when the particles are spread thinly
+#define SPATIAL_GRID_CELLS_PER_PARTICLE 2
+
+// Block of cells, inclusive on both ends
+typedef struct
+{
+    uint32_t min_column;
+    uint32_t min_row;
+    uint32_t max_column;
+    uint32_t max_row;
+} SpatialGridRange;
+
+// Sort the particles into the grid, reusing its memory from the last build
+void spatial_grid_build(SpatialGrid *grid, const Particle *particles,
+                        uint64_t count);
+
+// Cells overlapping the box from min to max. Boxes reaching outside the grid
+// are clamped to its border cells, which hold everything beyond the border.
+SpatialGridRange spatial_grid_range(const SpatialGrid *grid, Vec2 min,
+                                    Vec2 max);
+
+// Find the particles whose centre lies inside the box from min to max. Writes
+// up to capacity indices in no particular order and returns how many there
+// are in total.
+uint64_t spatial_grid_query_box(const SpatialGrid *grid,
+                                const Particle *particles, Vec2 min, Vec2 max,
+                                uint64_t *indices, uint64_t capacity);
+
+// Find the particles whose centre lies inside the circle, like
+// spatial_grid_query_box
+uint64_t spatial_grid_query_circle(const SpatialGrid *grid,
+                                   const Particle *particles, Vec2 center,
+                                   double radius, uint64_t *indices,
+                                   uint64_t capacity);
+
+// Particle whose centre is nearest to the point and at most max_distance away,
+// or the grid's particle count if there is none. The search widens one ring
+// of cells at a time and stops once the ring is further than the best match.
+uint64_t spatial_grid_nearest(const SpatialGrid *grid,
+                              const Particle *particles, Vec2 point,
+                              double max_distance);
+
+// Whether a circle overlaps the disk of any particle
+bool spatial_grid_overlaps_circle(const SpatialGrid *grid,
+                                  const Particle *particles, Vec2 center,
+                                  double radius);
+
+// Release the memory of the grid
+void spatial_grid_deinit(SpatialGrid *grid);
+
+#endif // SPATIAL_GRID_H
@@ -0,0 +1,26 @@
+#ifndef STATIC_FIELD_H
+#define STATIC_FIELD_H
+
+#include "simulation.h"
+#include "vector.h"
+
+// Up to this many static particles are summed directly instead of sampled
+#define STATIC_FIELD_DIRECT_LIMIT 16
+// Sources within this many cells of a sample's cell are summed directly
+// instead of interpolated, which keeps the interpolation error near a source
+// from growing with 1/r^2 as the sample approaches it
+#define STATIC_FIELD_NEAR_CELLS 2
+
+// Rebuild the static field if a static particle changed since the last build
+void static_field_update(Simulation *simulation);
+
+// Mark the static field as stale
+void static_field_invalidate(Simulation *simulation);
+
+// Acceleration caused by all static particles at the position
+Vec2Acc static_field_sample(const Simulation *simulation, Vec2 position);
+
+// Release the memory of the static field
+void static_field_deinit(StaticField *field);
+
+#endif // STATIC_FIELD_H
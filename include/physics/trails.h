@@ -0,0 +1,29 @@
+#ifndef TRAILS_H
+#define TRAILS_H
+
+#include "simulation.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Start a trail for the particle, filled with its current position. Returns
+// false if every trail is taken.
+bool trails_add(Simulation *simulation, uint64_t index);
+
+// Drop the particle's trail, the last trail moves into its slot
+void trails_remove(Simulation *simulation, uint64_t index);
+
+// Sample every trail once stride steps have passed since the last sample
+void trails_record(Simulation *simulation);
+
+// Point the trails at the particles that carry them after the particles were
+// compacted, dropping the trails whose particle is gone
+void trails_compact(Simulation *simulation);
+
+// Copy the trails into another set, growing its memory to fit them
+void trails_copy(TrailSet *copy, const TrailSet *trails);
+
+// Release the memory of the trails
+void trails_deinit(TrailSet *trails);
+
+#endif // TRAILS_H
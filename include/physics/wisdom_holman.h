@@ -0,0 +1,39 @@
+#ifndef WISDOM_HOLMAN_H
+#define WISDOM_HOLMAN_H
+
+#include "arena_allocator.h"
+#include "simulation.h"
+#include "vector.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Find the body the awake particles orbit: the most massive awake dynamic
+// particle, provided it outweighs all other awake dynamic particles together
+// by dominant_mass_ratio. Returns false if there is no such body.
+bool wisdom_holman_central(const Simulation *simulation,
+                           const uint64_t *dynamic, uint64_t dynamic_count,
+                           uint64_t *central);
+
+// Advance the awake particles and the tracers by half a step of the Kepler
+// drift around the central body and of the jump caused by its recoil, in
+// democratic heliocentric coordinates. The first half drifts and then jumps,
+// the second half jumps and then drifts, so a step is symmetric around the
+// interaction kick. Particles marked in woken, which may be NULL, are left
+// out until the next step.
+void wisdom_holman_half_drift(Simulation *simulation, ArenaAllocator *allocator,
+                              const uint64_t *dynamic, uint64_t dynamic_count,
+                              uint64_t central, const bool *woken,
+                              double time_step, bool first_half);
+
+// Turn total accelerations into interaction kicks by removing the Newtonian
+// pull of the central body, which the Kepler drift already accounts for, and
+// its reaction on the central body. Particles marked in woken keep their
+// total acceleration. Tracer accelerations may be NULL.
+void wisdom_holman_interaction(const Simulation *simulation,
+                               const uint64_t *dynamic, uint64_t dynamic_count,
+                               uint64_t central, const bool *woken,
+                               Vec2Acc *accelerations,
+                               Vec2 *tracer_accelerations);
+
+#endif // WISDOM_HOLMAN_H
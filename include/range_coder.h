@@ -0,0 +1,144 @@
+#ifndef RANGE_CODER_H
+#define RANGE_CODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Probabilities are fractions of 1 << RANGE_PROBABILITY_BITS that a bit is 0,
+// each moving 1 / (1 << RANGE_MOVE_BITS) of the way towards every bit coded
+// with it
+#define RANGE_PROBABILITY_BITS 11
+#define RANGE_PROBABILITY_ONE (1u << RANGE_PROBABILITY_BITS)
+#define RANGE_MOVE_BITS 5
+// The range is renormalized once it drops below this
+#define RANGE_TOP (1u << 24)
+
+// Bits of the tree that codes the bit length of an integer. Its largest
+// value means the length is at least that and the rest follows in a second
+// tree, so that the short lengths of small integers take few bits.
+#define RANGE_INT_LENGTH_BITS 4
+#define RANGE_INT_LONG_LENGTH ((1u << RANGE_INT_LENGTH_BITS) - 1)
+#define RANGE_INT_LONG_LENGTH_BITS 6
+// Bits below the leading one that are coded with adaptive probabilities, the
+// rest are close to random and are coded directly
+#define RANGE_INT_MODELED_BITS 3
+
+// Adaptive binary range encoder writing into a growing byte buffer, in the
+// manner of the LZMA range coder
+typedef struct
+{
+    uint8_t *bytes;
+    size_t size;
+    size_t capacity;
+    uint64_t low;
+    uint32_t range;
+    uint8_t cache;
+    uint64_t cache_size;
+} RangeEncoder;
+
+// Reads what a RangeEncoder wrote. Reading past the end reads zeros.
+typedef struct
+{
+    const uint8_t *bytes;
+    size_t size;
+    size_t position;
+    uint32_t range;
+    uint32_t code;
+} RangeDecoder;
+
+// Probabilities for coding signed integers that are mostly small. An
+// integer is coded as its bit length, then its highest bits below the
+// leading one with probabilities per length, then the remaining bits as is.
+typedef struct
+{
+    uint16_t length[1 << RANGE_INT_LENGTH_BITS];
+    uint16_t long_length[1 << RANGE_INT_LONG_LENGTH_BITS];
+    uint16_t mantissa[65][1 << RANGE_INT_MODELED_BITS];
+} RangeIntModel;
+
+// Start coding into the encoder's buffer, keeping its memory
+void range_encoder_reset(RangeEncoder *encoder);
+
+// Write out the bytes still held in the encoder. It must be reset before
+// coding again.
+void range_encoder_flush(RangeEncoder *encoder);
+
+// Release the encoder's buffer
+void range_encoder_deinit(RangeEncoder *encoder);
+
+// Move the top byte of low into the buffer, carrying into the bytes held back
+void range_encoder_shift_low(RangeEncoder *encoder);
+
+// Code a bit with an adaptive probability
+static inline void range_encode_bit(RangeEncoder *encoder,
+                                    uint16_t *probability, uint32_t bit) {
+    uint32_t bound =
+        (encoder->range >> RANGE_PROBABILITY_BITS) * *probability;
+    if (bit == 0) {
+        encoder->range = bound;
+        *probability += (RANGE_PROBABILITY_ONE - *probability) >>
+                        RANGE_MOVE_BITS;
+    } else {
+        encoder->low += bound;
+        encoder->range -= bound;
+        *probability -= *probability >> RANGE_MOVE_BITS;
+    }
+    while (encoder->range < RANGE_TOP) {
+        encoder->range <<= 8;
+        range_encoder_shift_low(encoder);
+    }
+}
+
+// Code the count lowest bits of a value with even odds, highest first
+void range_encode_direct(RangeEncoder *encoder, uint64_t value,
+                         uint32_t count);
+
+// Start reading coded bytes
+void range_decoder_init(RangeDecoder *decoder, const uint8_t *bytes,
+                        size_t size);
+
+// Next coded byte, zero past the end
+static inline uint32_t range_decoder_next_byte(RangeDecoder *decoder) {
+    return decoder->position < decoder->size
+               ? decoder->bytes[decoder->position++]
+               : 0;
+}
+
+// Read a bit coded with an adaptive probability
+static inline uint32_t range_decode_bit(RangeDecoder *decoder,
+                                        uint16_t *probability) {
+    uint32_t bound =
+        (decoder->range >> RANGE_PROBABILITY_BITS) * *probability;
+    uint32_t bit;
+    if (decoder->code < bound) {
+        decoder->range = bound;
+        *probability += (RANGE_PROBABILITY_ONE - *probability) >>
+                        RANGE_MOVE_BITS;
+        bit = 0;
+    } else {
+        decoder->code -= bound;
+        decoder->range -= bound;
+        *probability -= *probability >> RANGE_MOVE_BITS;
+        bit = 1;
+    }
+    while (decoder->range < RANGE_TOP) {
+        decoder->range <<= 8;
+        decoder->code = (decoder->code << 8) | range_decoder_next_byte(decoder);
+    }
+    return bit;
+}
+
+// Read count bits coded with even odds
+uint64_t range_decode_direct(RangeDecoder *decoder, uint32_t count);
+
+// Set every probability of the model to even odds
+void range_int_model_init(RangeIntModel *model);
+
+// Code a signed integer
+void range_encode_int(RangeEncoder *encoder, RangeIntModel *model,
+                      int64_t value);
+
+// Read a signed integer
+int64_t range_decode_int(RangeDecoder *decoder, RangeIntModel *model);
+
+#endif // RANGE_CODER_H
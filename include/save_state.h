@@ -0,0 +1,54 @@
+#ifndef SAVE_STATE_H
+#define SAVE_STATE_H
+
+#include "simulation.h"
+
+// Version written into new files. Files of other versions are refused.
+#define SAVE_STATE_VERSION 1
+// Bytes of scratch memory save_state_write_descriptor needs
+#define SAVE_STATE_SCRATCH_SIZE 65536
+
+// Outcome of saving or loading a simulation
+typedef enum {
+    SAVE_STATE_OK,
+    // The file could not be opened, mapped or written
+    SAVE_STATE_IO_ERROR,
+    // Not a save file, one whose header or columns do not fit the file, or
+    // one whose parameters cannot be run
+    SAVE_STATE_BAD_FORMAT,
+    SAVE_STATE_BAD_VERSION,
+    // A checksum does not match
+    SAVE_STATE_CORRUPT,
+    // The format is little-endian and read in place, big-endian hosts cannot
+    // use it
+    SAVE_STATE_UNSUPPORTED_HOST,
+} SaveStateStatus;
+
+// Write the particles, tracers and parameters of the simulation to a file.
+// The file holds a header, the parameters, a directory of columns and then
+// one column per particle or tracer field, each starting on a 64 byte
+// boundary and covered by its own checksum. Vectors are stored in the
+// build's precision. Trails, caches and sleep bookkeeping beyond the sleep
+// state itself are not saved. The file is written next to the path and
+// renamed over it once complete, so the path keeps the previous save if
+// writing fails.
+SaveStateStatus save_state_write(const Simulation *simulation,
+                                 const char *path);
+
+// Write the simulation like save_state_write into a file open for writing,
+// gathering the columns in SAVE_STATE_SCRATCH_SIZE bytes of scratch. Only
+// write and lseek are called, no allocation or stdio, so a child forked from
+// a process with other threads can use it. The descriptor is left open.
+SaveStateStatus save_state_write_descriptor(const Simulation *simulation,
+                                            int descriptor, void *scratch);
+
+// Replace the simulation with the one saved in a file. The file is mapped
+// into memory and its columns are read in place: tracer columns are copied
+// with one memcpy each, particle columns are spread into the particles in
+// one pass each. The simulation is left untouched if loading fails.
+SaveStateStatus save_state_read(Simulation *simulation, const char *path);
+
+// Short description of a status for messages
+const char *save_state_status_name(SaveStateStatus status);
+
+#endif // SAVE_STATE_H
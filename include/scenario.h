@@ -0,0 +1,18 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include "simulation.h"
+
+#include <stdint.h>
+
+// Fill the simulation with a rotating disk of particles of random size around
+// the origin. The same seed always produces the same disk.
+void scenario_random_disk(Simulation *simulation, uint64_t count,
+                          double disk_radius, double density, uint32_t seed);
+
+// Fill a circle uniformly with tracers at rest. The same seed always produces
+// the same tracers.
+void scenario_dust(Simulation *simulation, Vec2 center, double radius,
+                   uint64_t count, uint32_t seed);
+
+#endif // SCENARIO_H
@@ -7,22 +7,240 @@
 #include "vector.h"
 
 #include "arena_allocator.h"
+#include "bitset.h"
 
+#include <stdbool.h>
 #include <stdint.h>
 
+// Default kinetic energy per unit mass below which an island counts as calm
+#define SIMULATION_DEFAULT_SLEEP_ENERGY 1.0
+// Default number of consecutive calm steps before an island goes to sleep
+#define SIMULATION_DEFAULT_SLEEP_STEPS 60
+// Default fraction of its radius a particle must travel in one step before it
+// is swept for continuous collision detection
+#define SIMULATION_DEFAULT_CCD_FAST_RATIO 0.5
+// Default maximum number of impacts resolved by sub-stepping in one step
+#define SIMULATION_DEFAULT_CCD_MAX_EVENTS 256
+
+// Default number of cells along each side of the static field grid
+#define SIMULATION_DEFAULT_STATIC_FIELD_RESOLUTION 128
+
+// Default factor by which the central body must outweigh all other moving
+// particles together for the Wisdom-Holman integrator to be used
+#define SIMULATION_DEFAULT_DOMINANT_MASS_RATIO 10.0
+
+// Default number of steps between evaluations of the forces among light
+// particles, and the fraction of the heaviest particle's mass from which a
+// particle counts as heavy
+#define SIMULATION_DEFAULT_RESPA_INTERVAL 4
+#define SIMULATION_DEFAULT_RESPA_HEAVY_FRACTION 0.1
+
+// Default softening kernel of the gravitational force, plain 1/r^2, and the
+// softening length used once a kernel is chosen
+#define SIMULATION_DEFAULT_SOFTENING_KERNEL SOFTENING_NONE
+#define SIMULATION_DEFAULT_SOFTENING_LENGTH 0.5
+
+// Default number of positions kept in each particle trail, steps between two
+// of them, and most particles that can have a trail at once
+#define SIMULATION_DEFAULT_TRAIL_LENGTH 64
+#define SIMULATION_DEFAULT_TRAIL_STRIDE 4
+#define SIMULATION_DEFAULT_TRAIL_CAPACITY 4096
+
+// How the gravitational force is bounded at small separations
+typedef enum
+{
+    // Plain 1/r^2, diverges for coincident particles
+    SOFTENING_NONE,
+    // 1/(r^2 + eps^2), smooth everywhere
+    SOFTENING_PLUMMER,
+    // Cubic spline density kernel, exactly Newtonian beyond 2.8 eps
+    SOFTENING_SPLINE,
+} SofteningKernel;
+
+// How particles are advanced through a step
+typedef enum
+{
+    // Semi-implicit Euler on the total acceleration
+    INTEGRATOR_EULER,
+    // Mixed-variable symplectic integrator: analytic Kepler drifts around a
+    // dominant mass and kicks from all other interactions. Falls back to
+    // INTEGRATOR_EULER while no particle dominates.
+    INTEGRATOR_WISDOM_HOLMAN,
+    // Semi-implicit Euler with multiple time steps: forces involving heavy
+    // particles every step, forces among light particles as an impulse every
+    // respa_interval steps
+    INTEGRATOR_RESPA,
+} Integrator;
+
 typedef struct
 {
     Vec2 position;
     Vec2 velocity;
-    double mass;
-    double radius;
+    // Stored in the vector precision like the position, sums over particles
+    // are taken in double
+    VECTOR_T mass;
+    VECTOR_T radius;
+    // Sleeping particles skip integration and the collision narrow phase
+    bool is_sleeping;
+    // Consecutive steps the particle's island has been calm
+    uint32_t calm_steps;
+    // Acceleration at the time the particle went to sleep
+    Vec2 sleep_acceleration;
+    // Static particles are pinned in place. Their gravity reaches the other
+    // particles through the cached static field.
+    bool is_static;
+    // Index plus one of the particle's trail in the simulation's TrailSet, 0
+    // if it has none
+    uint32_t trail;
 } Particle;
 
+// Massless particles that follow the gravity of the particles without
+// contributing to it. Stored as columns apart from the particles so that they
+// can be integrated with array kernels.
+typedef struct
+{
+    Vec2 *positions;
+    Vec2 *velocities;
+    uint64_t count;
+    uint64_t capacity;
+    // Scratch for the accelerations of a step, grown to the count when a step
+    // needs more
+    Vec2 *accelerations;
+    uint64_t acceleration_capacity;
+} TracerSet;
+
+// Recent positions of the particles that have a trail. Every trail is
+// sampled on the same steps, so they share one ring position: head is the
+// slot the next sample overwrites, which holds the oldest one. The samples
+// of all trails live in one block allocated for capacity trails when the
+// first trail is added, length and capacity are fixed from then on.
+typedef struct
+{
+    uint32_t length;
+    // Steps between two samples
+    uint32_t stride;
+    uint64_t capacity;
+    uint64_t count;
+    uint32_t head;
+    // Steps left until the next sample
+    uint32_t countdown;
+    // Particle each trail follows
+    uint64_t *particles;
+    // Sample k of trail t is at t * length + k
+    float *x;
+    float *y;
+} TrailSet;
+
+// A static particle as seen by the static field
+typedef struct
+{
+    Vec2 position;
+    double mass;
+} StaticSource;
+
+// Combined gravitational field of the static particles. It is sampled onto a
+// grid around them once and only rebuilt after a static particle is added,
+// removed or moved, so a particle pays one lookup for all of them. The grid
+// holds the field of the sources more than STATIC_FIELD_NEAR_CELLS cells
+// away from each cell, which is smooth at the cell's scale, and the sources
+// closer than that are summed directly.
+typedef struct
+{
+    bool is_valid;
+    // Sources sorted by grid cell, the sources in cell c are cell_start[c]
+    // up to cell_start[c + 1], row by row from origin
+    StaticSource *sources;
+    uint64_t source_count;
+    uint64_t *cell_start;
+    // Far field of every cell at its four corners, at the nodes (column,
+    // row), (column + 1, row), (column, row + 1) and (column + 1, row + 1)
+    Vec2Acc *corners;
+    uint32_t resolution;
+    Vec2 origin;
+    double cell_size;
+    // Mass, centre of mass and quadrupole moment, used outside the grid
+    double mass;
+    Vec2Acc center;
+    double quadrupole_xx;
+    double quadrupole_xy;
+    double quadrupole_yy;
+} StaticField;
+
+// Uniform grid over the particle centres, stored cell by cell: the particles in
+// cell c are cell_particles[cell_start[c]] up to cell_start[c + 1], row by row
+// from origin. Particles with a radius above oversized_radius would make the
+// cells too large for everyone else and are kept in the oversized list.
+typedef struct
+{
+    Vec2 origin;
+    double cell_size;
+    uint32_t columns;
+    uint32_t rows;
+    uint64_t *cell_start;
+    uint64_t cell_capacity;
+    uint64_t *cell_particles;
+    uint64_t *oversized;
+    uint64_t particle_capacity;
+    uint64_t oversized_count;
+    uint64_t particle_count;
+    double oversized_radius;
+    // Largest radius of a particle stored in the cells
+    double max_radius;
+} SpatialGrid;
+
+// Slow accelerations of the multiple time step split, kept between the steps
+// that evaluate them
+typedef struct
+{
+    Vec2Acc *slow_accelerations;
+    // Number of particles they were evaluated for, 0 when stale
+    uint64_t count;
+    uint64_t step;
+    // The first paid_count particles were kicked with the slow impulse that
+    // covers the current interval. Particles added since then are not.
+    uint64_t paid_count;
+} RespaState;
+
 typedef struct
 {
     Particle *particles;
     uint64_t particle_count;
+    uint64_t particle_capacity;
+    TracerSet tracers;
+    TrailSet trails;
+    StaticField static_field;
+    // Broad phase of the collision pass, rebuilt every step
+    SpatialGrid collision_grid;
+    uint32_t static_field_resolution;
     double gravitational_constant;
+    // The Wisdom-Holman integrator needs a particle dominant_mass_ratio times
+    // heavier than all other moving particles together. Orbits around it are
+    // then exact between kicks and stay stable at much larger time steps.
+    Integrator integrator;
+    double dominant_mass_ratio;
+    // The RESPA integrator treats particles of at least respa_heavy_fraction
+    // of the heaviest particle's mass as heavy
+    RespaState respa;
+    uint32_t respa_interval;
+    double respa_heavy_fraction;
+    // Softening of the gravitational force, see SofteningKernel. The kernel is
+    // chosen once per step, each kernel has its own force loop.
+    SofteningKernel softening_kernel;
+    double softening_length;
+    // Islands of touching particles whose kinetic energy per unit mass stays
+    // below sleep_energy_threshold for sleep_step_count steps go to sleep.
+    // A sleep_step_count of 0 disables sleeping.
+    double sleep_energy_threshold;
+    uint32_t sleep_step_count;
+    // Particles travelling further than ccd_fast_ratio of their radius in one
+    // step are swept against the others, resolving at most ccd_max_events
+    // impacts per step. A ccd_max_events of 0 disables sweeping.
+    double ccd_fast_ratio;
+    uint32_t ccd_max_events;
+    // Incremented whenever a particle starts or stops being still, static or
+    // sleeping, and whenever a still particle is added, moved or removed, so
+    // that drawings of the still particles can be kept until it changes
+    uint64_t still_version;
 } Simulation;
 
 // Initialize the simulation struct
@@ -38,6 +256,34 @@ void simulation_update(Simulation *simulation, ArenaAllocator *allocator, double
 Particle *simulation_get_particle(Simulation *simulation, uint64_t index);
 
 // Add a new particle to the simulation
-void simulation_new_particle(Simulation *simulation, ArenaAllocator *allocator, Particle particle);
+void simulation_new_particle(Simulation *simulation, Particle particle);
+
+// Pin a particle in place or release it
+void simulation_set_particle_static(Simulation *simulation, uint64_t index, bool is_static);
+
+// Pin or release every particle in the mask. The masked functions sweep the
+// particles once, skipping 64 unselected particles at a time, and ignore mask
+// bits past the last particle.
+void simulation_set_static_masked(Simulation *simulation, const Bitset *mask, bool is_static);
+
+// Move every particle in the mask by the offset
+void simulation_translate_masked(Simulation *simulation, const Bitset *mask, Vec2 offset);
+
+// Set the velocity of every dynamic particle in the mask
+void simulation_set_velocity_masked(Simulation *simulation, const Bitset *mask, Vec2 velocity);
+
+// Multiply the mass of every particle in the mask, keeping its radius
+void simulation_scale_density_masked(Simulation *simulation, const Bitset *mask, double factor);
+
+// Give every particle in the mask a trail, or take it away. Particles beyond
+// the trail capacity stay without one.
+void simulation_set_trail_masked(Simulation *simulation, const Bitset *mask, bool has_trail);
+
+// Remove every particle in the mask. The remaining particles keep their order
+// but move down to close the gaps, so indices held across this call are stale.
+void simulation_delete_masked(Simulation *simulation, const Bitset *mask);
+
+// Add a new tracer to the simulation
+void simulation_new_tracer(Simulation *simulation, Vec2 position, Vec2 velocity);
 
 #endif // SIMULATION_H
\ No newline at end of file
@@ -0,0 +1,234 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include "range_coder.h"
+#include "simulation.h"
+#include "vector.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Version written into new files
+#define TRAJECTORY_VERSION 1
+// Positions are rounded to multiples of this many units
+#define TRAJECTORY_DEFAULT_CELL_SIZE 0.01
+// Steps between recorded frames
+#define TRAJECTORY_DEFAULT_INTERVAL 10
+// Frames between keyframes, which are decoded without the frames before them
+#define TRAJECTORY_KEYFRAME_INTERVAL 64
+// Frames that can wait for the recording thread. Steps offered while every
+// buffer is waiting are dropped rather than waited for.
+#define TRAJECTORY_FRAME_BUFFERS 4
+
+// Flags of a recorded frame
+#define TRAJECTORY_FRAME_KEY 1u
+// Decoded frames a reader holds: the one asked for last and the ones after
+// it that are decoded ahead
+#define TRAJECTORY_READER_SLOTS 8
+
+// One step copied for the recording thread
+typedef struct
+{
+    uint64_t step;
+    uint64_t particle_count;
+    uint64_t tracer_count;
+    // Particle positions followed by tracer positions
+    Vec2 *positions;
+    uint64_t position_capacity;
+    float *radii;
+    uint64_t radius_capacity;
+} TrajectoryFrame;
+
+// Totals of a recording, see trajectory_recorder_stop
+typedef struct
+{
+    uint64_t frames;
+    uint64_t keyframes;
+    uint64_t dropped;
+    // Bytes the recorded positions take as pairs of doubles, and bytes
+    // written to the file
+    uint64_t raw_bytes;
+    uint64_t written_bytes;
+    double encode_seconds;
+    // Set when the file could not be written, frames after that are lost
+    bool failed;
+} TrajectoryStats;
+
+// State carried from one frame to the next by the encoder and the decoder
+typedef struct
+{
+    double cell_size;
+    uint64_t particle_count;
+    uint64_t tracer_count;
+    uint64_t frames_since_key;
+    // Quantized x and y of every position of the previous frame, and of the
+    // frame being coded
+    int64_t *previous;
+    int64_t *current;
+    float *radii;
+    uint64_t capacity;
+    // Previous positions in Morton order of their cells, with the keys and
+    // scratch space of the sort that finds it
+    uint32_t *order;
+    uint32_t *keys;
+    uint32_t *scratch_order;
+    uint32_t *scratch_keys;
+    RangeEncoder encoder;
+} TrajectoryCodec;
+
+// Where a frame starts in the file
+typedef struct
+{
+    uint64_t offset;
+    uint64_t step;
+    uint32_t flags;
+    uint32_t reserved;
+} TrajectoryIndexEntry;
+
+// Writes every interval-th step of a simulation to a file on its own thread.
+// Each position is rounded to a grid of cell_size units. Keyframes code the
+// rounded positions in particle order as differences to the previous
+// particle. Other frames visit the particles in Morton order of their
+// previous cells, and code how far each moved since the previous frame
+// minus how far its predecessor in that order moved, which nearby particles
+// on similar paths make close to zero. The numbers are coded with an
+// adaptive range coder.
+//
+// Files start with a TrajectoryFileHeader. Each frame is a
+// TrajectoryFrameHeader followed by its coded bytes. Once recording stops,
+// the index of every frame and a TrajectoryFileFooter pointing at it end the
+// file.
+typedef struct
+{
+    FILE *file;
+    uint32_t interval;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t frame_ready;
+    // Signalled each time a frame is coded and its buffer freed
+    pthread_cond_t frame_done;
+    bool stopping;
+
+    // Frames not in use, and frames waiting in offer order in a ring
+    TrajectoryFrame frames[TRAJECTORY_FRAME_BUFFERS];
+    TrajectoryFrame *free_frames[TRAJECTORY_FRAME_BUFFERS];
+    uint32_t free_count;
+    TrajectoryFrame *queue[TRAJECTORY_FRAME_BUFFERS];
+    uint32_t queue_head;
+    uint32_t queue_count;
+
+    // Owned by the recording thread until it stops
+    TrajectoryCodec codec;
+    TrajectoryIndexEntry *index;
+    uint64_t index_count;
+    uint64_t index_capacity;
+    uint64_t offset;
+    TrajectoryStats stats;
+} TrajectoryRecorder;
+
+// A decoded frame held by a reader, number is the frame it holds or
+// UINT64_MAX while it holds none
+typedef struct
+{
+    TrajectoryFrame frame;
+    uint64_t number;
+    bool is_valid;
+} TrajectorySlot;
+
+// Decodes frames of a trajectory file in any order. The file is mapped into
+// memory and its frames are found through the index at its end, or by
+// walking the frame headers if recording stopped before writing it. A frame
+// is decoded from the keyframe before it, so no frame takes more than
+// TRAJECTORY_KEYFRAME_INTERVAL frames to decode, and reading frames in order
+// decodes each once. A worker thread decodes the frames after the one asked
+// for last, so playing forward rarely waits.
+typedef struct
+{
+    const uint8_t *data;
+    size_t size;
+    // Frames lie between the header and here
+    size_t frames_end;
+    double cell_size;
+    TrajectoryIndexEntry *index;
+    uint64_t frame_count;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wanted_changed;
+    pthread_cond_t frame_decoded;
+    bool stopping;
+    uint64_t wanted;
+    TrajectorySlot slots[TRAJECTORY_READER_SLOTS];
+    // Slot handed out by the last trajectory_reader_frame, UINT32_MAX if none
+    uint32_t pinned;
+
+    // Owned by the worker thread, the codec holds the decoded frame
+    // codec_frame or UINT64_MAX
+    TrajectoryCodec codec;
+    uint64_t codec_frame;
+} TrajectoryReader;
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t keyframe_interval;
+    double cell_size;
+    uint64_t reserved;
+} TrajectoryFileHeader;
+
+// End of a finished file
+typedef struct
+{
+    uint64_t index_offset;
+    uint64_t frame_count;
+    char magic[8];
+} TrajectoryFileFooter;
+
+typedef struct
+{
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t step;
+    uint64_t particle_count;
+    uint64_t tracer_count;
+    uint64_t size;
+} TrajectoryFrameHeader;
+
+// Start recording into a new file every interval steps, with positions
+// rounded to cell_size. Returns NULL if the file cannot be created.
+TrajectoryRecorder *trajectory_recorder_start(const char *path,
+                                              uint32_t interval,
+                                              double cell_size);
+
+// Hand the state after a step to the recording thread if the step is due.
+// Copies the positions and radii into a free buffer and never waits, the
+// step is dropped when no buffer is free.
+void trajectory_recorder_offer(TrajectoryRecorder *recorder,
+                               const Simulation *simulation, uint64_t step);
+
+// Wait until every frame offered so far is coded and written, so that the
+// next offer finds a free buffer. Call it from the thread that offers.
+void trajectory_recorder_flush(TrajectoryRecorder *recorder);
+
+// Code every waiting frame, write the index, close the file and release the
+// recorder
+TrajectoryStats trajectory_recorder_stop(TrajectoryRecorder *recorder);
+
+// Open a trajectory file for reading. Returns NULL if it cannot be mapped or
+// holds no frames.
+TrajectoryReader *trajectory_reader_open(const char *path);
+
+// Decoded frame of the given number, waiting for it to be decoded if needed.
+// The frame stays valid until the next call. Returns NULL past the last
+// frame or if the frame is damaged.
+const TrajectoryFrame *trajectory_reader_frame(TrajectoryReader *reader,
+                                               uint64_t number);
+
+// Stop the worker, unmap the file and release the reader
+void trajectory_reader_close(TrajectoryReader *reader);
+
+#endif // TRAJECTORY_H
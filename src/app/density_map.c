@@ -0,0 +1,431 @@
+// sysconf's processor count is hidden by strict C11 on glibc and by a bare
+// _POSIX_C_SOURCE on macOS
+#define _POSIX_C_SOURCE 200809L
+#define _DARWIN_C_SOURCE
+
+#include "density_map.h"
+
+#include "raylib.h"
+#include "simulation.h"
+#include "vector.h"
+
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Colours the ramp passes through, from the faintest density to the densest.
+// Empty pixels stay black.
+static const Color DENSITY_MAP_RAMP_STOPS[] = {
+    {24, 12, 64, 255},  {96, 24, 128, 255},   {200, 56, 80, 255},
+    {248, 144, 40, 255}, {252, 232, 160, 255}, {255, 255, 255, 255},
+};
+#define DENSITY_MAP_RAMP_STOP_COUNT                                            \
+  (sizeof(DENSITY_MAP_RAMP_STOPS) / sizeof(DENSITY_MAP_RAMP_STOPS[0]))
+
+// Marks a particle or tracer off the map
+#define DENSITY_MAP_OFF UINT32_MAX
+
+// One thread's share of a render: a slice of the particles and tracers to
+// sort, and the band of rows it owns
+typedef struct {
+  DensityMap *map;
+  Camera2D camera;
+  const Particle *particles;
+  uint64_t particle_count;
+  const Vec2 *tracers;
+  uint64_t item_count;
+  DensityWeight weight;
+  uint32_t thread;
+  // Splats of the thread's slice in each band, then where the next of them
+  // goes in the sorted splats
+  uint64_t band_splats[DENSITY_MAP_MAX_THREADS];
+  // Sorted splats landing in the thread's band
+  uint64_t first_splat;
+  uint64_t last_splat;
+  // Densest and lightest non empty pixel of the thread's band
+  float max;
+  float min;
+  // Tone curve, the same for every thread
+  float exposure;
+  float scale;
+} DensityJob;
+
+// Threads waiting for passes of a render. The thread rendering runs the
+// first job of a pass and the workers and it share out the rest, so a pool
+// short of workers still runs every job.
+struct DensityPool {
+  pthread_t workers[DENSITY_MAP_MAX_THREADS];
+  uint32_t worker_count;
+  pthread_mutex_t lock;
+  pthread_cond_t pass_ready;
+  pthread_cond_t pass_done;
+  bool stopping;
+  // Pass being run, a new one each time the generation moves on
+  void *(*pass)(void *);
+  DensityJob *jobs;
+  uint64_t generation;
+  uint32_t job_count;
+  uint32_t next_job;
+  uint32_t unfinished;
+};
+
+// Blend two colours, t running from 0 to 1
+static Color density_map_blend(Color a, Color b, float t) {
+  return (Color){(unsigned char)(a.r + (b.r - a.r) * t),
+                 (unsigned char)(a.g + (b.g - a.g) * t),
+                 (unsigned char)(a.b + (b.b - a.b) * t), 255};
+}
+
+// Fill the ramp by blending between the stops
+static void density_map_build_ramp(DensityMap *map) {
+  map->ramp[0] = BLACK;
+  uint32_t segments = DENSITY_MAP_RAMP_STOP_COUNT - 1;
+  for (uint32_t i = 1; i < DENSITY_MAP_RAMP_SIZE; i++) {
+    float t = (float)(i - 1) / (DENSITY_MAP_RAMP_SIZE - 2) * segments;
+    uint32_t stop = (uint32_t)t;
+    if (stop >= segments) {
+      stop = segments - 1;
+    }
+    map->ramp[i] = density_map_blend(DENSITY_MAP_RAMP_STOPS[stop],
+                                     DENSITY_MAP_RAMP_STOPS[stop + 1],
+                                     t - stop);
+  }
+}
+
+// Run the jobs of the current pass not yet taken, with the pool locked
+static void density_map_take_jobs(DensityPool *pool) {
+  while (pool->next_job < pool->job_count) {
+    void *(*pass)(void *) = pool->pass;
+    DensityJob *job = &pool->jobs[pool->next_job++];
+    pthread_mutex_unlock(&pool->lock);
+    pass(job);
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->unfinished == 0) {
+      pthread_cond_signal(&pool->pass_done);
+    }
+  }
+}
+
+// Help with every pass until the pool stops
+static void *density_map_worker(void *argument) {
+  DensityPool *pool = argument;
+  pthread_mutex_lock(&pool->lock);
+  uint64_t seen = pool->generation;
+  for (;;) {
+    while (pool->generation == seen && !pool->stopping) {
+      pthread_cond_wait(&pool->pass_ready, &pool->lock);
+    }
+    if (pool->stopping) {
+      break;
+    }
+    seen = pool->generation;
+    density_map_take_jobs(pool);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+// Start a worker for every thread but the one rendering, as many as can be
+// started
+static DensityPool *density_map_start_pool(uint32_t thread_count) {
+  DensityPool *pool = calloc(1, sizeof(DensityPool));
+  assert(pool);
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->pass_ready, NULL);
+  pthread_cond_init(&pool->pass_done, NULL);
+  for (uint32_t w = 0; w + 1 < thread_count; w++) {
+    if (pthread_create(&pool->workers[pool->worker_count], NULL,
+                       density_map_worker, pool) == 0) {
+      pool->worker_count++;
+    }
+  }
+  return pool;
+}
+
+// Create a map of the given size
+DensityMap density_map_init(int width, int height, uint32_t thread_count) {
+  if (thread_count == 0) {
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    thread_count = processors > 0 ? (uint32_t)processors : 1;
+  }
+  if (thread_count > DENSITY_MAP_MAX_THREADS) {
+    thread_count = DENSITY_MAP_MAX_THREADS;
+  }
+
+  DensityMap map = {.thread_count = thread_count,
+                    .pool = density_map_start_pool(thread_count)};
+  density_map_build_ramp(&map);
+  density_map_resize(&map, width, height);
+  return map;
+}
+
+// Fit the map to a new size
+void density_map_resize(DensityMap *map, int width, int height) {
+  if (width == map->width && height == map->height) {
+    return;
+  }
+  size_t pixel_count = (size_t)width * height;
+  // Pixels are numbered in 32 bits, with the largest marking none
+  assert(pixel_count < DENSITY_MAP_OFF);
+  map->width = width;
+  map->height = height;
+  map->density = realloc(map->density, sizeof(float) * pixel_count);
+  map->pixels = realloc(map->pixels, sizeof(Color) * pixel_count);
+  assert(map->density && map->pixels);
+}
+
+// Stop the map's threads and release its memory
+void density_map_deinit(DensityMap *map) {
+  DensityPool *pool = map->pool;
+  if (pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->pass_ready);
+    pthread_mutex_unlock(&pool->lock);
+    for (uint32_t w = 0; w < pool->worker_count; w++) {
+      pthread_join(pool->workers[w], NULL);
+    }
+    pthread_cond_destroy(&pool->pass_done);
+    pthread_cond_destroy(&pool->pass_ready);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+  }
+  free(map->density);
+  free(map->pixels);
+  free(map->pixel_of);
+  free(map->splats);
+  *map = (DensityMap){0};
+}
+
+// Band of rows of the map a row belongs to. Band b starts at row
+// height * b / thread_count, rounded down.
+static inline uint32_t density_map_band(const DensityMap *map, uint32_t row) {
+  return (uint32_t)((((uint64_t)row + 1) * map->thread_count - 1) /
+                    (uint64_t)map->height);
+}
+
+// First pixel of a band, the end of the map for the band past the last
+static size_t density_map_band_start(const DensityMap *map, uint32_t band) {
+  return (size_t)map->height * band / map->thread_count * map->width;
+}
+
+// Items of the job's slice, particles followed by the tracers
+static void density_map_slice(const DensityJob *job, uint64_t *first,
+                              uint64_t *last) {
+  uint32_t count = job->map->thread_count;
+  *first = job->item_count * job->thread / count;
+  *last = job->item_count * (job->thread + 1) / count;
+}
+
+// Position and weight of a particle, or of a tracer past the particles
+static inline Vec2 density_map_item(const DensityJob *job, uint64_t i,
+                                    float *weight) {
+  if (i >= job->particle_count) {
+    *weight = 1;
+    return job->tracers[i - job->particle_count];
+  }
+  const Particle *p = &job->particles[i];
+  *weight = job->weight == DENSITY_WEIGHT_MASS ? (float)p->mass : 1;
+  return p->position;
+}
+
+// Find the pixel under each item of the thread's slice and count how many
+// land in each band
+static void *density_map_locate_pass(void *argument) {
+  DensityJob *job = argument;
+  DensityMap *map = job->map;
+  Camera2D camera = job->camera;
+  memset(job->band_splats, 0, sizeof(job->band_splats));
+
+  uint64_t first, last;
+  density_map_slice(job, &first, &last);
+  for (uint64_t i = first; i < last; i++) {
+    float weight;
+    Vec2 position = density_map_item(job, i, &weight);
+    // The camera is never rotated
+    float x = (position.x - camera.target.x) * camera.zoom + camera.offset.x;
+    float y = (position.y - camera.target.y) * camera.zoom + camera.offset.y;
+    if (!(x >= 0 && x < map->width && y >= 0 && y < map->height)) {
+      map->pixel_of[i] = DENSITY_MAP_OFF;
+      continue;
+    }
+    uint32_t row = (uint32_t)y;
+    map->pixel_of[i] = row * (uint32_t)map->width + (uint32_t)x;
+    job->band_splats[density_map_band(map, row)]++;
+  }
+  return NULL;
+}
+
+// Write the splats of the thread's slice where their bands sort them
+static void *density_map_sort_pass(void *argument) {
+  DensityJob *job = argument;
+  DensityMap *map = job->map;
+
+  uint64_t first, last;
+  density_map_slice(job, &first, &last);
+  for (uint64_t i = first; i < last; i++) {
+    uint32_t pixel = map->pixel_of[i];
+    if (pixel == DENSITY_MAP_OFF) {
+      continue;
+    }
+    float weight;
+    density_map_item(job, i, &weight);
+    uint32_t band = density_map_band(map, pixel / (uint32_t)map->width);
+    map->splats[job->band_splats[band]++] = (DensitySplat){pixel, weight};
+  }
+  return NULL;
+}
+
+// Add the splats of the thread's band into its rows, noting the densest and
+// lightest pixels
+static void *density_map_splat_pass(void *argument) {
+  DensityJob *job = argument;
+  DensityMap *map = job->map;
+  size_t first = density_map_band_start(map, job->thread);
+  size_t last = density_map_band_start(map, job->thread + 1);
+  memset(map->density + first, 0, sizeof(float) * (last - first));
+
+  for (uint64_t k = job->first_splat; k < job->last_splat; k++) {
+    map->density[map->splats[k].pixel] += map->splats[k].weight;
+  }
+
+  job->max = 0;
+  job->min = INFINITY;
+  for (size_t i = first; i < last; i++) {
+    float density = map->density[i];
+    if (density > 0) {
+      job->max = fmaxf(job->max, density);
+      job->min = fminf(job->min, density);
+    }
+  }
+  return NULL;
+}
+
+// Map the density of the thread's band to colours
+static void *density_map_tone_pass(void *argument) {
+  DensityJob *job = argument;
+  DensityMap *map = job->map;
+  size_t first = density_map_band_start(map, job->thread);
+  size_t last = density_map_band_start(map, job->thread + 1);
+
+  for (size_t i = first; i < last; i++) {
+    float density = map->density[i];
+    if (density <= 0) {
+      map->pixels[i] = map->ramp[0];
+      continue;
+    }
+    float t = log1pf(density * job->exposure) * job->scale;
+    int index = 1 + (int)(t * (DENSITY_MAP_RAMP_SIZE - 2));
+    if (index > DENSITY_MAP_RAMP_SIZE - 1) {
+      index = DENSITY_MAP_RAMP_SIZE - 1;
+    }
+    map->pixels[i] = map->ramp[index];
+  }
+  return NULL;
+}
+
+// Run a pass of every job on the pool and wait for all of them
+static void density_map_run(DensityMap *map, DensityJob *jobs,
+                            void *(*pass)(void *)) {
+  DensityPool *pool = map->pool;
+  pthread_mutex_lock(&pool->lock);
+  pool->pass = pass;
+  pool->jobs = jobs;
+  pool->job_count = map->thread_count;
+  pool->next_job = 1;
+  pool->unfinished = map->thread_count - 1;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->pass_ready);
+  pthread_mutex_unlock(&pool->lock);
+
+  pass(&jobs[0]);
+
+  pthread_mutex_lock(&pool->lock);
+  density_map_take_jobs(pool);
+  while (pool->unfinished > 0) {
+    pthread_cond_wait(&pool->pass_done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+// Grow the scratch of a render to hold count particles and tracers
+static void density_map_reserve(DensityMap *map, uint64_t count) {
+  if (count <= map->item_capacity) {
+    return;
+  }
+  free(map->pixel_of);
+  free(map->splats);
+  map->pixel_of = malloc(sizeof(uint32_t) * count);
+  map->splats = malloc(sizeof(DensitySplat) * count);
+  assert(map->pixel_of && map->splats);
+  map->item_capacity = count;
+}
+
+// Render the particles and tracers seen through the camera into the pixels
+void density_map_render(DensityMap *map, Camera2D camera,
+                        const Particle *particles, uint64_t particle_count,
+                        const Vec2 *tracers, uint64_t tracer_count,
+                        DensityWeight weight) {
+  uint64_t item_count = particle_count;
+  if (weight == DENSITY_WEIGHT_COUNT) {
+    item_count += tracer_count;
+  }
+  density_map_reserve(map, item_count);
+
+  DensityJob jobs[DENSITY_MAP_MAX_THREADS];
+  for (uint32_t t = 0; t < map->thread_count; t++) {
+    jobs[t] = (DensityJob){.map = map,
+                           .camera = camera,
+                           .particles = particles,
+                           .particle_count = particle_count,
+                           .tracers = tracers,
+                           .item_count = item_count,
+                           .weight = weight,
+                           .thread = t};
+  }
+  density_map_run(map, jobs, density_map_locate_pass);
+
+  // The splats of band b come after those of the bands before it, those of
+  // thread t after those other threads before it found in the same band
+  uint64_t next = 0;
+  for (uint32_t band = 0; band < map->thread_count; band++) {
+    jobs[band].first_splat = next;
+    for (uint32_t t = 0; t < map->thread_count; t++) {
+      uint64_t count = jobs[t].band_splats[band];
+      jobs[t].band_splats[band] = next;
+      next += count;
+    }
+    jobs[band].last_splat = next;
+  }
+  density_map_run(map, jobs, density_map_sort_pass);
+  density_map_run(map, jobs, density_map_splat_pass);
+
+  // The lightest pixel lands just above the bottom of the ramp and the
+  // densest at its top
+  float max = 0;
+  float min = INFINITY;
+  for (uint32_t t = 0; t < map->thread_count; t++) {
+    max = fmaxf(max, jobs[t].max);
+    min = fminf(min, jobs[t].min);
+  }
+  float exposure = max > 0 ? 1 / min : 1;
+  float scale = max > 0 ? 1 / log1pf(max * exposure) : 0;
+  for (uint32_t t = 0; t < map->thread_count; t++) {
+    jobs[t].exposure = exposure;
+    jobs[t].scale = scale;
+  }
+  density_map_run(map, jobs, density_map_tone_pass);
+}
+
+// The map's pixels as an image, owned by the map
+Image density_map_image(const DensityMap *map) {
+  return (Image){.data = map->pixels,
+                 .width = map->width,
+                 .height = map->height,
+                 .mipmaps = 1,
+                 .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+}
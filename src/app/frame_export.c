@@ -0,0 +1,259 @@
+// clock_gettime, mkdir and sysconf's processor count are POSIX, hidden by
+// strict C11 on glibc and by a bare _POSIX_C_SOURCE on macOS
+#define _POSIX_C_SOURCE 200809L
+#define _DARWIN_C_SOURCE
+
+#include "frame_export.h"
+
+#include "raylib.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Longest path of a frame file
+#define FRAME_EXPORT_PATH_SIZE 1024
+
+// Seconds on a monotonic clock
+static double frame_export_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Write a frame as a binary portable pixmap
+static bool frame_export_write_ppm(const char *path, const Color *pixels,
+                                   int width, int height) {
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    return false;
+  }
+  unsigned char *row = malloc((size_t)width * 3);
+  bool written = row != NULL && fprintf(file, "P6\n%d %d\n255\n", width,
+                                        height) > 0;
+  for (int y = 0; written && y < height; y++) {
+    const Color *source = &pixels[(size_t)y * width];
+    for (int x = 0; x < width; x++) {
+      row[x * 3] = source[x].r;
+      row[x * 3 + 1] = source[x].g;
+      row[x * 3 + 2] = source[x].b;
+    }
+    written = fwrite(row, 3, width, file) == (size_t)width;
+  }
+  free(row);
+  return fclose(file) == 0 && written;
+}
+
+// Encode one frame into its numbered file
+static bool frame_export_write(const FrameExporter *exporter,
+                               const FrameJob *job) {
+  char path[FRAME_EXPORT_PATH_SIZE];
+  const char *extension =
+      exporter->format == FRAME_FORMAT_PNG ? "png" : "ppm";
+  snprintf(path, sizeof(path), "%s/frame_%06llu.%s", exporter->directory,
+           (unsigned long long)job->frame, extension);
+
+  if (exporter->format == FRAME_FORMAT_PPM) {
+    return frame_export_write_ppm(path, job->pixels, exporter->width,
+                                  exporter->height);
+  }
+  return ExportImage((Image){.data = job->pixels,
+                             .width = exporter->width,
+                             .height = exporter->height,
+                             .mipmaps = 1,
+                             .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8},
+                     path);
+}
+
+// Encode queued frames until the exporter stops and the queue is empty
+static void *frame_export_worker(void *argument) {
+  FrameExporter *exporter = argument;
+
+  pthread_mutex_lock(&exporter->lock);
+  for (;;) {
+    while (exporter->job_count == 0 && !exporter->stopping) {
+      pthread_cond_wait(&exporter->job_ready, &exporter->lock);
+    }
+    if (exporter->job_count == 0) {
+      break;
+    }
+    FrameJob job = exporter->jobs[exporter->job_head];
+    exporter->job_head = (exporter->job_head + 1) % exporter->buffer_count;
+    exporter->job_count--;
+    pthread_mutex_unlock(&exporter->lock);
+
+    double start = frame_export_now();
+    bool written = frame_export_write(exporter, &job);
+    double elapsed = frame_export_now() - start;
+
+    pthread_mutex_lock(&exporter->lock);
+    exporter->stats.frames++;
+    exporter->stats.failed += !written;
+    exporter->stats.encode_seconds += elapsed;
+    exporter->free_buffers[exporter->free_count++] = job.pixels;
+    pthread_cond_signal(&exporter->buffer_free);
+  }
+  pthread_mutex_unlock(&exporter->lock);
+  return NULL;
+}
+
+// Start an exporter writing frames into the directory
+FrameExporter *frame_exporter_start(const char *directory, FrameFormat format,
+                                    int width, int height,
+                                    uint32_t worker_count) {
+  if (mkdir(directory, 0755) != 0 && errno != EEXIST) {
+    return NULL;
+  }
+  if (worker_count == 0) {
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    worker_count = processors > 0 ? (uint32_t)processors : 1;
+  }
+  if (worker_count > FRAME_EXPORT_MAX_WORKERS) {
+    worker_count = FRAME_EXPORT_MAX_WORKERS;
+  }
+
+  FrameExporter *exporter = malloc(sizeof(FrameExporter));
+  assert(exporter);
+  *exporter = (FrameExporter){
+      .directory = directory,
+      .format = format,
+      .width = width,
+      .height = height,
+      .buffer_count = worker_count + FRAME_EXPORT_SPARE_BUFFERS,
+      .start_time = frame_export_now(),
+  };
+  pthread_mutex_init(&exporter->lock, NULL);
+  pthread_cond_init(&exporter->job_ready, NULL);
+  pthread_cond_init(&exporter->buffer_free, NULL);
+
+  exporter->buffers = malloc(sizeof(Color *) * exporter->buffer_count);
+  exporter->free_buffers = malloc(sizeof(Color *) * exporter->buffer_count);
+  exporter->jobs = malloc(sizeof(FrameJob) * exporter->buffer_count);
+  assert(exporter->buffers && exporter->free_buffers && exporter->jobs);
+  for (uint32_t b = 0; b < exporter->buffer_count; b++) {
+    exporter->buffers[b] = malloc(sizeof(Color) * (size_t)width * height);
+    assert(exporter->buffers[b]);
+    exporter->free_buffers[b] = exporter->buffers[b];
+  }
+  exporter->free_count = exporter->buffer_count;
+
+  for (uint32_t w = 0; w < worker_count; w++) {
+    if (pthread_create(&exporter->workers[exporter->worker_count], NULL,
+                       frame_export_worker, exporter) == 0) {
+      exporter->worker_count++;
+    }
+  }
+  // Without a single worker the frames would never be written
+  if (exporter->worker_count == 0) {
+    frame_exporter_stop(exporter);
+    return NULL;
+  }
+  return exporter;
+}
+
+// Take a free frame buffer
+Color *frame_exporter_acquire(FrameExporter *exporter) {
+  pthread_mutex_lock(&exporter->lock);
+  while (exporter->free_count == 0) {
+    pthread_cond_wait(&exporter->buffer_free, &exporter->lock);
+  }
+  Color *pixels = exporter->free_buffers[--exporter->free_count];
+  pthread_mutex_unlock(&exporter->lock);
+  return pixels;
+}
+
+// Queue a buffer to be written as the numbered frame
+void frame_exporter_submit(FrameExporter *exporter, Color *pixels,
+                           uint64_t frame) {
+  pthread_mutex_lock(&exporter->lock);
+  assert(exporter->job_count < exporter->buffer_count);
+  uint32_t slot =
+      (exporter->job_head + exporter->job_count) % exporter->buffer_count;
+  exporter->jobs[slot] = (FrameJob){.pixels = pixels, .frame = frame};
+  exporter->job_count++;
+  pthread_cond_signal(&exporter->job_ready);
+  pthread_mutex_unlock(&exporter->lock);
+}
+
+// Write every queued frame, stop the workers and release the exporter
+FrameExportStats frame_exporter_stop(FrameExporter *exporter) {
+  pthread_mutex_lock(&exporter->lock);
+  exporter->stopping = true;
+  pthread_cond_broadcast(&exporter->job_ready);
+  pthread_mutex_unlock(&exporter->lock);
+  for (uint32_t w = 0; w < exporter->worker_count; w++) {
+    pthread_join(exporter->workers[w], NULL);
+  }
+
+  FrameExportStats stats = exporter->stats;
+  stats.seconds = frame_export_now() - exporter->start_time;
+
+  for (uint32_t b = 0; b < exporter->buffer_count; b++) {
+    free(exporter->buffers[b]);
+  }
+  free(exporter->buffers);
+  free(exporter->free_buffers);
+  free(exporter->jobs);
+  pthread_cond_destroy(&exporter->buffer_free);
+  pthread_cond_destroy(&exporter->job_ready);
+  pthread_mutex_destroy(&exporter->lock);
+  free(exporter);
+  return stats;
+}
+
+// Fill a frame with one colour
+void frame_clear(Color *pixels, int width, int height, Color color) {
+  size_t count = (size_t)width * height;
+  for (size_t i = 0; i < count; i++) {
+    pixels[i] = color;
+  }
+}
+
+// Blend a colour over a pixel with the given opacity
+static inline void frame_blend(Color *pixel, Color color, float opacity) {
+  float alpha = color.a / 255.0f * opacity;
+  pixel->r = (unsigned char)(pixel->r + (color.r - pixel->r) * alpha);
+  pixel->g = (unsigned char)(pixel->g + (color.g - pixel->g) * alpha);
+  pixel->b = (unsigned char)(pixel->b + (color.b - pixel->b) * alpha);
+  pixel->a = 255;
+}
+
+// Blend a disc in screen space into a frame
+void frame_fill_circle(Color *pixels, int width, int height, float x, float y,
+                       float radius, Color color) {
+  if (radius < 0.5f) {
+    if (x >= 0 && x < width && y >= 0 && y < height) {
+      frame_blend(&pixels[(size_t)y * width + (size_t)x], color,
+                  PI * radius * radius);
+    }
+    return;
+  }
+
+  if (!(x + radius >= 0 && x - radius <= width && y + radius >= 0 &&
+        y - radius <= height)) {
+    return;
+  }
+
+  // Pixels whose centre lies inside the disc, clipped to the frame
+  int min_x = (int)fmaxf(ceilf(x - radius - 0.5f), 0);
+  int max_x = (int)fminf(floorf(x + radius - 0.5f), width - 1);
+  int min_y = (int)fmaxf(ceilf(y - radius - 0.5f), 0);
+  int max_y = (int)fminf(floorf(y + radius - 0.5f), height - 1);
+  float radius_squared = radius * radius;
+  for (int row = min_y; row <= max_y; row++) {
+    float dy = row + 0.5f - y;
+    Color *line = &pixels[(size_t)row * width];
+    for (int column = min_x; column <= max_x; column++) {
+      float dx = column + 0.5f - x;
+      if (dx * dx + dy * dy <= radius_squared) {
+        frame_blend(&line[column], color, 1);
+      }
+    }
+  }
+}
@@ -0,0 +1,234 @@
+#include "particle_renderer.h"
+
+#include "raylib.h"
+#include "raymath.h"
+#include "rlgl.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Two triangles covering the unit square around a circle's centre
+static const float PARTICLE_RENDERER_QUAD[] = {
+    -1, -1, 1, -1, 1, 1, -1, -1, 1, 1, -1, 1,
+};
+#define PARTICLE_RENDERER_QUAD_VERTICES 6
+
+// The corner runs from -1 to 1 across the quad. Fragments further than 1
+// from the centre are cut, the last pixel of the edge fades out so the disc
+// is smooth at any zoom.
+static const char *PARTICLE_RENDERER_VERTEX_SHADER =
+    "in vec2 vertexCorner;\n"
+    "in vec3 instanceCircle;\n"
+    "in vec4 instanceColor;\n"
+    "uniform mat4 mvp;\n"
+    "out vec2 corner;\n"
+    "out vec4 color;\n"
+    "void main() {\n"
+    "  corner = vertexCorner;\n"
+    "  color = instanceColor;\n"
+    "  vec2 position = instanceCircle.xy + vertexCorner * instanceCircle.z;\n"
+    "  gl_Position = mvp * vec4(position, 0.0, 1.0);\n"
+    "}\n";
+
+static const char *PARTICLE_RENDERER_FRAGMENT_SHADER =
+    "in vec2 corner;\n"
+    "in vec4 color;\n"
+    "out vec4 finalColor;\n"
+    "void main() {\n"
+    "  float distance = length(corner);\n"
+    "  float edge = fwidth(distance);\n"
+    "  float alpha = 1.0 - smoothstep(1.0 - edge, 1.0, distance);\n"
+    "  if (alpha <= 0.0) discard;\n"
+    "  finalColor = vec4(color.rgb, color.a * alpha);\n"
+    "}\n";
+
+// Version line the shaders are compiled with, or NULL if the context cannot
+// draw instanced
+static const char *particle_renderer_glsl_header(void) {
+  switch (rlGetVersion()) {
+  case RL_OPENGL_33:
+  case RL_OPENGL_43:
+    return "#version 330\n";
+  case RL_OPENGL_ES_30:
+    return "#version 300 es\nprecision mediump float;\n";
+  default:
+    return NULL;
+  }
+}
+
+// (Re)create the instance buffer with room for capacity circles and point
+// the vertex array's instanced attributes at it
+static void particle_renderer_load_instance_buffer(ParticleRenderer *renderer,
+                                                   uint64_t capacity) {
+  if (renderer->instance_buffer != 0) {
+    rlUnloadVertexBuffer(renderer->instance_buffer);
+  }
+
+  rlEnableVertexArray(renderer->vao);
+  renderer->instance_buffer = rlLoadVertexBuffer(
+      NULL, (int)(sizeof(ParticleInstance) * capacity), true);
+  renderer->instance_buffer_capacity = capacity;
+
+  int circle = rlGetLocationAttrib(renderer->shader, "instanceCircle");
+  int color = rlGetLocationAttrib(renderer->shader, "instanceColor");
+  rlSetVertexAttribute(circle, 3, RL_FLOAT, false, sizeof(ParticleInstance),
+                       (const void *)offsetof(ParticleInstance, x));
+  rlSetVertexAttributeDivisor(circle, 1);
+  rlEnableVertexAttribute(circle);
+  rlSetVertexAttribute(color, 4, RL_UNSIGNED_BYTE, true,
+                       sizeof(ParticleInstance),
+                       (const void *)offsetof(ParticleInstance, color));
+  rlSetVertexAttributeDivisor(color, 1);
+  rlEnableVertexAttribute(color);
+  rlDisableVertexArray();
+}
+
+// Set up the instanced path, returns false if the context cannot run it
+static bool particle_renderer_load_instanced(ParticleRenderer *renderer) {
+  const char *header = particle_renderer_glsl_header();
+  if (header == NULL) {
+    return false;
+  }
+
+  char vertex[1024];
+  char fragment[1024];
+  snprintf(vertex, sizeof(vertex), "%s%s", header,
+           PARTICLE_RENDERER_VERTEX_SHADER);
+  snprintf(fragment, sizeof(fragment), "%s%s", header,
+           PARTICLE_RENDERER_FRAGMENT_SHADER);
+  renderer->shader = rlLoadShaderCode(vertex, fragment);
+  if (renderer->shader == 0 || renderer->shader == rlGetShaderIdDefault()) {
+    renderer->shader = 0;
+    return false;
+  }
+  renderer->mvp_location = rlGetLocationUniform(renderer->shader, "mvp");
+
+  renderer->vao = rlLoadVertexArray();
+  if (renderer->vao == 0) {
+    rlUnloadShaderProgram(renderer->shader);
+    renderer->shader = 0;
+    return false;
+  }
+  rlEnableVertexArray(renderer->vao);
+  renderer->quad_buffer = rlLoadVertexBuffer(
+      PARTICLE_RENDERER_QUAD, sizeof(PARTICLE_RENDERER_QUAD), false);
+  int corner = rlGetLocationAttrib(renderer->shader, "vertexCorner");
+  rlSetVertexAttribute(corner, 2, RL_FLOAT, false, 0, 0);
+  rlEnableVertexAttribute(corner);
+  rlDisableVertexArray();
+
+  particle_renderer_load_instance_buffer(renderer,
+                                         PARTICLE_RENDERER_INITIAL_CAPACITY);
+  return true;
+}
+
+// Create the renderer, after the window has been opened
+ParticleRenderer particle_renderer_init(void) {
+  ParticleRenderer renderer = {0};
+  renderer.instanced = particle_renderer_load_instanced(&renderer);
+
+  if (!renderer.instanced) {
+    Image disc = GenImageColor(PARTICLE_RENDERER_DISC_SIZE,
+                               PARTICLE_RENDERER_DISC_SIZE, BLANK);
+    ImageDrawCircle(&disc, PARTICLE_RENDERER_DISC_SIZE / 2,
+                    PARTICLE_RENDERER_DISC_SIZE / 2,
+                    PARTICLE_RENDERER_DISC_SIZE / 2 - 1, WHITE);
+    renderer.disc = LoadTextureFromImage(disc);
+    SetTextureFilter(renderer.disc, TEXTURE_FILTER_BILINEAR);
+    UnloadImage(disc);
+  }
+
+  particle_renderer_reserve(&renderer, PARTICLE_RENDERER_INITIAL_CAPACITY);
+  return renderer;
+}
+
+// Release the renderer's GPU and CPU memory
+void particle_renderer_deinit(ParticleRenderer *renderer) {
+  if (renderer->instanced) {
+    rlUnloadVertexBuffer(renderer->instance_buffer);
+    rlUnloadVertexBuffer(renderer->quad_buffer);
+    rlUnloadVertexArray(renderer->vao);
+    rlUnloadShaderProgram(renderer->shader);
+  } else {
+    UnloadTexture(renderer->disc);
+  }
+  free(renderer->instances);
+  *renderer = (ParticleRenderer){0};
+}
+
+// Make room for count more circles
+void particle_renderer_reserve(ParticleRenderer *renderer, uint64_t count) {
+  uint64_t needed = renderer->count + count;
+  if (needed <= renderer->capacity) {
+    return;
+  }
+  uint64_t capacity = renderer->capacity ? renderer->capacity : 256;
+  while (capacity < needed) {
+    capacity *= 2;
+  }
+  renderer->instances =
+      realloc(renderer->instances, sizeof(ParticleInstance) * capacity);
+  assert(renderer->instances);
+  renderer->capacity = capacity;
+}
+
+// Draw the queued circles as textured quads through the rlgl batch, which
+// starts a new draw call whenever its vertex buffer fills up
+static void particle_renderer_flush_batched(ParticleRenderer *renderer) {
+  rlSetTexture(renderer->disc.id);
+  rlBegin(RL_QUADS);
+  for (uint64_t i = 0; i < renderer->count; i++) {
+    const ParticleInstance *p = &renderer->instances[i];
+    rlColor4ub(p->color.r, p->color.g, p->color.b, p->color.a);
+    rlTexCoord2f(0, 0);
+    rlVertex2f(p->x - p->radius, p->y - p->radius);
+    rlTexCoord2f(0, 1);
+    rlVertex2f(p->x - p->radius, p->y + p->radius);
+    rlTexCoord2f(1, 1);
+    rlVertex2f(p->x + p->radius, p->y + p->radius);
+    rlTexCoord2f(1, 0);
+    rlVertex2f(p->x + p->radius, p->y - p->radius);
+  }
+  rlEnd();
+  rlSetTexture(0);
+}
+
+// Draw every queued circle and empty the queue
+void particle_renderer_flush(ParticleRenderer *renderer) {
+  if (renderer->count == 0) {
+    return;
+  }
+  if (!renderer->instanced) {
+    particle_renderer_flush_batched(renderer);
+    renderer->count = 0;
+    return;
+  }
+
+  if (renderer->count > renderer->instance_buffer_capacity) {
+    uint64_t capacity = renderer->instance_buffer_capacity;
+    while (capacity < renderer->count) {
+      capacity *= 2;
+    }
+    particle_renderer_load_instance_buffer(renderer, capacity);
+  }
+
+  // Everything drawn so far goes first, then the camera transform the rlgl
+  // batch would have used is handed to the shader
+  rlDrawRenderBatchActive();
+  Matrix mvp =
+      MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection());
+
+  rlEnableShader(renderer->shader);
+  rlSetUniformMatrix(renderer->mvp_location, mvp);
+  rlEnableVertexArray(renderer->vao);
+  rlUpdateVertexBuffer(renderer->instance_buffer, renderer->instances,
+                       (int)(sizeof(ParticleInstance) * renderer->count), 0);
+  rlDrawVertexArrayInstanced(0, PARTICLE_RENDERER_QUAD_VERTICES,
+                             (int)renderer->count);
+  rlDisableVertexArray();
+  rlDisableShader();
+
+  renderer->count = 0;
+}
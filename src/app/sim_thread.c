@@ -0,0 +1,584 @@
+// clock_gettime and nanosleep are POSIX, hidden by strict C11 on glibc and by
+// a bare _POSIX_C_SOURCE on macOS
+#define _POSIX_C_SOURCE 200809L
+#define _DARWIN_C_SOURCE
+
+#include "sim_thread.h"
+
+#define COMMAND_IMPLEMENTATION
+#include "command.h"
+
+#include "arena_allocator.h"
+#include "checkpoint.h"
+#include "save_state.h"
+#include "scenario.h"
+#include "simulation.h"
+#include "spatial_grid.h"
+#include "trails.h"
+#include "trajectory.h"
+#include "vector.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Payloads of the built in commands, each fits in a ring command
+typedef struct {
+  Particle particle;
+} SpawnParticleCommand;
+
+typedef struct {
+  Vec2 center;
+  double radius;
+  uint32_t count;
+  uint32_t seed;
+} SpawnDustCommand;
+
+typedef struct {
+  Integrator integrator;
+} SetIntegratorCommand;
+
+// The path must outlive the command
+typedef struct {
+  const char *path;
+  bool is_load;
+} SaveStateCommand;
+
+// The path must outlive the command
+typedef struct {
+  const char *path;
+} RecordCommand;
+
+// The path must outlive the command
+typedef struct {
+  const char *path;
+  uint64_t interval;
+  CheckpointMode mode;
+} CheckpointCommand;
+
+typedef enum {
+  SELECTION_ACTION_PIN,
+  SELECTION_ACTION_RELEASE,
+  SELECTION_ACTION_TRANSLATE,
+  SELECTION_ACTION_SET_VELOCITY,
+  SELECTION_ACTION_SCALE_DENSITY,
+  SELECTION_ACTION_DELETE,
+  SELECTION_ACTION_ADD_TRAIL,
+  SELECTION_ACTION_REMOVE_TRAIL,
+} SelectionAction;
+
+// The mask owns a copy of the selection's words, freed once applied
+typedef struct {
+  SelectionAction action;
+  Bitset mask;
+  Vec2 vector;
+  double factor;
+} SelectionCommand;
+
+_Static_assert(sizeof(SpawnParticleCommand) <= COMMAND_PAYLOAD_SIZE,
+               "particle does not fit in a ring command");
+
+// Seconds on a monotonic clock
+static double sim_thread_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Sleep for the given number of seconds
+static void sim_thread_sleep(double seconds) {
+  if (seconds <= 0) {
+    return;
+  }
+  struct timespec duration = {
+      .tv_sec = (time_t)seconds,
+      .tv_nsec = (long)((seconds - (time_t)seconds) * 1e9),
+  };
+  nanosleep(&duration, NULL);
+}
+
+// Grow a snapshot array to hold at least count elements
+static void *sim_thread_reserve(void *items, uint64_t *capacity,
+                                uint64_t count, size_t size) {
+  if (count <= *capacity) {
+    return items;
+  }
+  uint64_t new_capacity = *capacity ? *capacity : 256;
+  while (new_capacity < count) {
+    new_capacity *= 2;
+  }
+  items = realloc(items, size * new_capacity);
+  assert(items);
+  *capacity = new_capacity;
+  return items;
+}
+
+// Copy the simulation into the back snapshot and publish it
+static void sim_thread_publish(SimThread *sim_thread) {
+  const Simulation *simulation = &sim_thread->simulation;
+  SimulationSnapshot *snapshot = &sim_thread->snapshots[sim_thread->back];
+
+  snapshot->particles =
+      sim_thread_reserve(snapshot->particles, &snapshot->particle_capacity,
+                         simulation->particle_count, sizeof(Particle));
+  if (simulation->particle_count > 0) {
+    memcpy(snapshot->particles, simulation->particles,
+           sizeof(Particle) * simulation->particle_count);
+  }
+  snapshot->particle_count = simulation->particle_count;
+  spatial_grid_build(&snapshot->grid, snapshot->particles,
+                     snapshot->particle_count);
+
+  snapshot->tracers =
+      sim_thread_reserve(snapshot->tracers, &snapshot->tracer_capacity,
+                         simulation->tracers.count, sizeof(Vec2));
+  if (simulation->tracers.count > 0) {
+    memcpy(snapshot->tracers, simulation->tracers.positions,
+           sizeof(Vec2) * simulation->tracers.count);
+  }
+  snapshot->tracer_count = simulation->tracers.count;
+  trails_copy(&snapshot->trails, &simulation->trails);
+
+  snapshot->integrator = simulation->integrator;
+  snapshot->step = sim_thread->step;
+  snapshot->still_version = simulation->still_version;
+
+  // Release makes the copy visible before the index that points at it
+  sim_thread->back =
+      atomic_exchange_explicit(&sim_thread->latest,
+                               sim_thread->back | SIM_THREAD_SNAPSHOT_FRESH,
+                               memory_order_acq_rel) &
+      ~SIM_THREAD_SNAPSHOT_FRESH;
+}
+
+// Execute queued commands up to the budget, UI commands first
+static void sim_thread_drain_commands(SimThread *sim_thread) {
+  size_t budget = atomic_load_explicit(&sim_thread->command_budget,
+                                       memory_order_relaxed);
+  budget -= spsc_command_ring_drain(sim_thread->commands, sim_thread, budget);
+  mpsc_command_ring_drain(sim_thread->shared_commands, sim_thread, budget);
+}
+
+// Report the totals of a finished recording
+static void sim_thread_print_recording(TrajectoryStats stats) {
+  printf("recorded %llu frames (%llu keyframes, %llu dropped), %.1f MB "
+         "instead of %.1f MB, %.2f s spent coding\n",
+         (unsigned long long)stats.frames, (unsigned long long)stats.keyframes,
+         (unsigned long long)stats.dropped, stats.written_bytes / 1e6,
+         stats.raw_bytes / 1e6, stats.encode_seconds);
+  if (stats.failed) {
+    fprintf(stderr, "recording: the file could not be written\n");
+  }
+}
+
+// Report the totals of the checkpoints taken since they were started
+static void sim_thread_print_checkpoints(CheckpointStats stats) {
+  printf("checkpoints: %llu written, %llu failed, %llu skipped while "
+         "writing, %llu fell back to a thread, paused %.2f ms at most and "
+         "%.2f ms in total\n",
+         (unsigned long long)stats.written, (unsigned long long)stats.failed,
+         (unsigned long long)stats.skipped,
+         (unsigned long long)stats.fallbacks,
+         stats.max_pause_seconds * 1e3, stats.total_pause_seconds * 1e3);
+}
+
+// Step the simulation at a fixed rate until stopped
+static void *sim_thread_run(void *argument) {
+  SimThread *sim_thread = argument;
+  double next_step = sim_thread_now();
+
+  while (atomic_load(&sim_thread->running)) {
+    sim_thread_drain_commands(sim_thread);
+
+    reset_arena(sim_thread->frame_arena);
+    simulation_update(&sim_thread->simulation, sim_thread->frame_arena,
+                      sim_thread->time_step);
+    sim_thread->step++;
+    sim_thread_publish(sim_thread);
+    if (sim_thread->recorder != NULL) {
+      trajectory_recorder_offer(sim_thread->recorder, &sim_thread->simulation,
+                                sim_thread->step);
+    }
+    if (sim_thread->checkpointer.interval != 0 &&
+        checkpointer_step(&sim_thread->checkpointer, &sim_thread->simulation,
+                          sim_thread->step)) {
+      printf("checkpoint at step %llu, the simulation paused %.2f ms\n",
+             (unsigned long long)sim_thread->step,
+             sim_thread->checkpointer.stats.last_pause_seconds * 1e3);
+    }
+
+    // Keep pace with real time, but never try to catch up on steps that a
+    // slow step made late, that would only make the next ones later still
+    next_step += sim_thread->time_step;
+    double now = sim_thread_now();
+    if (next_step < now) {
+      next_step = now;
+    }
+    sim_thread_sleep(next_step - now);
+  }
+  return NULL;
+}
+
+// Start stepping the simulation on a new thread
+SimThread *sim_thread_start(Simulation simulation, ArenaAllocator *frame_arena,
+                            double time_step) {
+  SimThread *sim_thread = calloc(1, sizeof(SimThread));
+  assert(sim_thread);
+
+  sim_thread->simulation = simulation;
+  sim_thread->frame_arena = frame_arena;
+  sim_thread->time_step = time_step;
+  sim_thread->commands = create_spsc_command_ring(SIM_THREAD_COMMAND_CAPACITY);
+  sim_thread->shared_commands =
+      create_mpsc_command_ring(SIM_THREAD_COMMAND_CAPACITY);
+  assert(sim_thread->commands && sim_thread->shared_commands);
+  atomic_init(&sim_thread->command_budget, SIM_THREAD_DEFAULT_COMMAND_BUDGET);
+
+  // Publish the initial state so readers always have a snapshot
+  sim_thread->back = 0;
+  sim_thread->front = 1;
+  atomic_init(&sim_thread->latest, 2);
+  sim_thread_publish(sim_thread);
+
+  atomic_init(&sim_thread->running, true);
+  int result =
+      pthread_create(&sim_thread->thread, NULL, sim_thread_run, sim_thread);
+  assert(result == 0);
+  (void)result;
+  return sim_thread;
+}
+
+// Stop the thread and release everything it owns
+void sim_thread_stop(SimThread *sim_thread) {
+  atomic_store(&sim_thread->running, false);
+  pthread_join(sim_thread->thread, NULL);
+
+  // Commands still queued are run, some own memory they release when done
+  spsc_command_ring_drain(sim_thread->commands, sim_thread, SIZE_MAX);
+  mpsc_command_ring_drain(sim_thread->shared_commands, sim_thread, SIZE_MAX);
+  if (sim_thread->recorder != NULL) {
+    sim_thread_print_recording(trajectory_recorder_stop(sim_thread->recorder));
+  }
+  if (sim_thread->checkpointer.interval != 0) {
+    checkpointer_deinit(&sim_thread->checkpointer);
+    sim_thread_print_checkpoints(sim_thread->checkpointer.stats);
+  }
+  free_spsc_command_ring(sim_thread->commands);
+  free_mpsc_command_ring(sim_thread->shared_commands);
+
+  for (int i = 0; i < SIM_THREAD_SNAPSHOT_COUNT; i++) {
+    free(sim_thread->snapshots[i].particles);
+    free(sim_thread->snapshots[i].tracers);
+    spatial_grid_deinit(&sim_thread->snapshots[i].grid);
+    trails_deinit(&sim_thread->snapshots[i].trails);
+  }
+  simulation_deinit(&sim_thread->simulation);
+  deinit_arena(sim_thread->frame_arena);
+  free(sim_thread);
+}
+
+// Queue a command for the simulation thread
+CommandStatus sim_thread_submit(SimThread *sim_thread,
+                                RingCommandFunction execute,
+                                const void *payload, size_t size) {
+  return spsc_command_ring_push(sim_thread->commands, execute, payload, size);
+}
+
+// Queue a command for the simulation thread from any thread
+CommandStatus sim_thread_submit_shared(SimThread *sim_thread,
+                                       RingCommandFunction execute,
+                                       const void *payload, size_t size) {
+  return mpsc_command_ring_push(sim_thread->shared_commands, execute, payload,
+                                size);
+}
+
+// Set how many commands run before each step
+void sim_thread_set_command_budget(SimThread *sim_thread, uint32_t budget) {
+  atomic_store_explicit(&sim_thread->command_budget, budget,
+                        memory_order_relaxed);
+}
+
+// Latest complete snapshot
+const SimulationSnapshot *sim_thread_snapshot(SimThread *sim_thread) {
+  // Only swap when the writer published since the last read, otherwise the
+  // reader would hand back a snapshot it has already shown
+  if (atomic_load_explicit(&sim_thread->latest, memory_order_relaxed) &
+      SIM_THREAD_SNAPSHOT_FRESH) {
+    sim_thread->front = atomic_exchange_explicit(&sim_thread->latest,
+                                                 sim_thread->front,
+                                                 memory_order_acq_rel) &
+                        ~SIM_THREAD_SNAPSHOT_FRESH;
+  }
+  return &sim_thread->snapshots[sim_thread->front];
+}
+
+// Add a particle on the simulation thread
+static CommandStatus sim_thread_spawn_particle_execute(void *context,
+                                                       const void *payload) {
+  SimThread *sim_thread = context;
+  const SpawnParticleCommand *command = payload;
+  simulation_new_particle(&sim_thread->simulation, command->particle);
+  return COMMAND_SUCCESS;
+}
+
+// Fill a circle with tracers on the simulation thread
+static CommandStatus sim_thread_spawn_dust_execute(void *context,
+                                                   const void *payload) {
+  SimThread *sim_thread = context;
+  const SpawnDustCommand *command = payload;
+  scenario_dust(&sim_thread->simulation, command->center, command->radius,
+                command->count, command->seed);
+  return COMMAND_SUCCESS;
+}
+
+// Switch the integrator on the simulation thread
+static CommandStatus sim_thread_set_integrator_execute(void *context,
+                                                       const void *payload) {
+  SimThread *sim_thread = context;
+  const SetIntegratorCommand *command = payload;
+  sim_thread->simulation.integrator = command->integrator;
+  return COMMAND_SUCCESS;
+}
+
+// Save or load the simulation on the simulation thread
+static CommandStatus sim_thread_save_state_execute(void *context,
+                                                   const void *payload) {
+  SimThread *sim_thread = context;
+  const SaveStateCommand *command = payload;
+  SaveStateStatus status =
+      command->is_load
+          ? save_state_read(&sim_thread->simulation, command->path)
+          : save_state_write(&sim_thread->simulation, command->path);
+  printf("%s %s: %s\n", command->is_load ? "load" : "save", command->path,
+         save_state_status_name(status));
+  return status == SAVE_STATE_OK ? COMMAND_SUCCESS : COMMAND_FAILURE;
+}
+
+// Start or stop recording on the simulation thread
+static CommandStatus sim_thread_toggle_recording_execute(void *context,
+                                                         const void *payload) {
+  SimThread *sim_thread = context;
+  const RecordCommand *command = payload;
+  if (sim_thread->recorder != NULL) {
+    sim_thread_print_recording(trajectory_recorder_stop(sim_thread->recorder));
+    sim_thread->recorder = NULL;
+    return COMMAND_SUCCESS;
+  }
+
+  sim_thread->recorder = trajectory_recorder_start(
+      command->path, TRAJECTORY_DEFAULT_INTERVAL, TRAJECTORY_DEFAULT_CELL_SIZE);
+  if (sim_thread->recorder == NULL) {
+    fprintf(stderr, "recording: cannot create %s\n", command->path);
+    return COMMAND_FAILURE;
+  }
+  printf("recording into %s\n", command->path);
+  return COMMAND_SUCCESS;
+}
+
+// Start or stop periodic checkpoints on the simulation thread
+static CommandStatus
+sim_thread_toggle_checkpoints_execute(void *context, const void *payload) {
+  SimThread *sim_thread = context;
+  const CheckpointCommand *command = payload;
+  Checkpointer *checkpointer = &sim_thread->checkpointer;
+  if (checkpointer->interval != 0) {
+    checkpointer_deinit(checkpointer);
+    sim_thread_print_checkpoints(checkpointer->stats);
+    checkpointer->interval = 0;
+    return COMMAND_SUCCESS;
+  }
+
+  if (command->interval == 0 ||
+      !checkpointer_init(checkpointer, command->path, command->interval,
+                         command->mode)) {
+    checkpointer->interval = 0;
+    fprintf(stderr, "checkpoints: cannot write to %s\n", command->path);
+    return COMMAND_FAILURE;
+  }
+  printf("checkpointing into %s every %llu steps\n", command->path,
+         (unsigned long long)command->interval);
+  return COMMAND_SUCCESS;
+}
+
+// Queue adding a particle
+CommandStatus sim_thread_spawn_particle(SimThread *sim_thread,
+                                        Particle particle) {
+  SpawnParticleCommand command = {particle};
+  return sim_thread_submit(sim_thread, sim_thread_spawn_particle_execute,
+                           &command, sizeof(command));
+}
+
+// Queue filling a circle with tracers at rest
+CommandStatus sim_thread_spawn_dust(SimThread *sim_thread, Vec2 center,
+                                    double radius, uint32_t count,
+                                    uint32_t seed) {
+  SpawnDustCommand command = {center, radius, count, seed};
+  return sim_thread_submit(sim_thread, sim_thread_spawn_dust_execute, &command,
+                           sizeof(command));
+}
+
+// Queue switching the integrator
+CommandStatus sim_thread_set_integrator(SimThread *sim_thread,
+                                        Integrator integrator) {
+  SetIntegratorCommand command = {integrator};
+  return sim_thread_submit(sim_thread, sim_thread_set_integrator_execute,
+                           &command, sizeof(command));
+}
+
+// Queue saving the simulation to a file
+CommandStatus sim_thread_save(SimThread *sim_thread, const char *path) {
+  SaveStateCommand command = {path, false};
+  return sim_thread_submit(sim_thread, sim_thread_save_state_execute,
+                           &command, sizeof(command));
+}
+
+// Queue replacing the simulation with one saved in a file
+CommandStatus sim_thread_load(SimThread *sim_thread, const char *path) {
+  SaveStateCommand command = {path, true};
+  return sim_thread_submit(sim_thread, sim_thread_save_state_execute,
+                           &command, sizeof(command));
+}
+
+// Queue starting or stopping a recording
+CommandStatus sim_thread_toggle_recording(SimThread *sim_thread,
+                                          const char *path) {
+  RecordCommand command = {path};
+  return sim_thread_submit(sim_thread, sim_thread_toggle_recording_execute,
+                           &command, sizeof(command));
+}
+
+// Queue starting or stopping periodic checkpoints
+CommandStatus sim_thread_toggle_checkpoints(SimThread *sim_thread,
+                                            const char *path,
+                                            uint64_t interval,
+                                            CheckpointMode mode) {
+  CheckpointCommand command = {path, interval, mode};
+  return sim_thread_submit(sim_thread, sim_thread_toggle_checkpoints_execute,
+                           &command, sizeof(command));
+}
+
+// Apply a selection action on the simulation thread
+static CommandStatus sim_thread_selection_execute(void *context,
+                                                  const void *payload) {
+  SimThread *sim_thread = context;
+  const SelectionCommand *command = payload;
+  Simulation *simulation = &sim_thread->simulation;
+
+  switch (command->action) {
+  case SELECTION_ACTION_PIN:
+  case SELECTION_ACTION_RELEASE:
+    simulation_set_static_masked(simulation, &command->mask,
+                                 command->action == SELECTION_ACTION_PIN);
+    break;
+  case SELECTION_ACTION_TRANSLATE:
+    simulation_translate_masked(simulation, &command->mask, command->vector);
+    break;
+  case SELECTION_ACTION_SET_VELOCITY:
+    simulation_set_velocity_masked(simulation, &command->mask,
+                                   command->vector);
+    break;
+  case SELECTION_ACTION_SCALE_DENSITY:
+    simulation_scale_density_masked(simulation, &command->mask,
+                                    command->factor);
+    break;
+  case SELECTION_ACTION_DELETE:
+    simulation_delete_masked(simulation, &command->mask);
+    break;
+  case SELECTION_ACTION_ADD_TRAIL:
+  case SELECTION_ACTION_REMOVE_TRAIL:
+    simulation_set_trail_masked(simulation, &command->mask,
+                                command->action == SELECTION_ACTION_ADD_TRAIL);
+    break;
+  }
+  free(command->mask.words);
+  return COMMAND_SUCCESS;
+}
+
+// Queue a selection action with a copy of the selection
+static CommandStatus sim_thread_submit_selection(SimThread *sim_thread,
+                                                 const Bitset *selection,
+                                                 SelectionCommand command) {
+  if (bitset_next(selection, 0) == selection->count) {
+    return COMMAND_SUCCESS;
+  }
+
+  uint64_t words = bitset_word_count(selection->count);
+  command.mask = (Bitset){
+      .words = malloc(sizeof(uint64_t) * words),
+      .count = selection->count,
+      .word_capacity = words,
+  };
+  if (command.mask.words == NULL) {
+    return COMMAND_FAILURE;
+  }
+  memcpy(command.mask.words, selection->words, sizeof(uint64_t) * words);
+
+  CommandStatus status = sim_thread_submit(
+      sim_thread, sim_thread_selection_execute, &command, sizeof(command));
+  if (status != COMMAND_SUCCESS) {
+    free(command.mask.words);
+  }
+  return status;
+}
+
+// Queue pinning or releasing the selected particles
+CommandStatus sim_thread_pin_selection(SimThread *sim_thread,
+                                       const Bitset *selection,
+                                       bool is_static) {
+  return sim_thread_submit_selection(
+      sim_thread, selection,
+      (SelectionCommand){.action = is_static ? SELECTION_ACTION_PIN
+                                             : SELECTION_ACTION_RELEASE});
+}
+
+// Queue moving the selected particles by the offset
+CommandStatus sim_thread_translate_selection(SimThread *sim_thread,
+                                             const Bitset *selection,
+                                             Vec2 offset) {
+  return sim_thread_submit_selection(
+      sim_thread, selection,
+      (SelectionCommand){.action = SELECTION_ACTION_TRANSLATE,
+                         .vector = offset});
+}
+
+// Queue setting the velocity of the selected particles
+CommandStatus sim_thread_set_selection_velocity(SimThread *sim_thread,
+                                                const Bitset *selection,
+                                                Vec2 velocity) {
+  return sim_thread_submit_selection(
+      sim_thread, selection,
+      (SelectionCommand){.action = SELECTION_ACTION_SET_VELOCITY,
+                         .vector = velocity});
+}
+
+// Queue multiplying the density of the selected particles
+CommandStatus sim_thread_scale_selection_density(SimThread *sim_thread,
+                                                 const Bitset *selection,
+                                                 double factor) {
+  return sim_thread_submit_selection(
+      sim_thread, selection,
+      (SelectionCommand){.action = SELECTION_ACTION_SCALE_DENSITY,
+                         .factor = factor});
+}
+
+// Queue removing the selected particles
+CommandStatus sim_thread_delete_selection(SimThread *sim_thread,
+                                          const Bitset *selection) {
+  return sim_thread_submit_selection(
+      sim_thread, selection,
+      (SelectionCommand){.action = SELECTION_ACTION_DELETE});
+}
+
+// Queue starting or dropping trails for the selected particles
+CommandStatus sim_thread_trail_selection(SimThread *sim_thread,
+                                         const Bitset *selection,
+                                         bool has_trail) {
+  return sim_thread_submit_selection(
+      sim_thread, selection,
+      (SelectionCommand){.action = has_trail ? SELECTION_ACTION_ADD_TRAIL
+                                             : SELECTION_ACTION_REMOVE_TRAIL});
+}
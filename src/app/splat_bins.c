@@ -0,0 +1,90 @@
+#include "splat_bins.h"
+
+#include "particle_renderer.h"
+#include "raylib.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+// Empty a bin
+static void splat_bins_clear(SplatBins *bins, uint32_t bin) {
+  bins->weight[bin] = 0;
+  bins->x[bin] = 0;
+  bins->y[bin] = 0;
+  bins->area[bin] = 0;
+  bins->max_weight[bin] = -1;
+}
+
+// Fit the bins to the screen, dropping anything not yet flushed
+void splat_bins_resize(SplatBins *bins, int screen_width, int screen_height) {
+  int columns = screen_width / SPLAT_BIN_PIXELS + 1;
+  int rows = screen_height / SPLAT_BIN_PIXELS + 1;
+  if (columns == bins->columns && rows == bins->rows) {
+    return;
+  }
+
+  splat_bins_deinit(bins);
+  size_t count = (size_t)columns * rows;
+  bins->columns = columns;
+  bins->rows = rows;
+  bins->weight = malloc(sizeof(float) * count);
+  bins->x = malloc(sizeof(float) * count);
+  bins->y = malloc(sizeof(float) * count);
+  bins->area = malloc(sizeof(float) * count);
+  bins->max_weight = malloc(sizeof(float) * count);
+  bins->color = malloc(sizeof(Color) * count);
+  bins->touched = malloc(sizeof(uint32_t) * count);
+  assert(bins->weight && bins->x && bins->y && bins->area &&
+         bins->max_weight && bins->color && bins->touched);
+  for (uint32_t bin = 0; bin < count; bin++) {
+    splat_bins_clear(bins, bin);
+  }
+}
+
+// Release the memory of the bins
+void splat_bins_deinit(SplatBins *bins) {
+  free(bins->weight);
+  free(bins->x);
+  free(bins->y);
+  free(bins->area);
+  free(bins->max_weight);
+  free(bins->color);
+  free(bins->touched);
+  *bins = (SplatBins){0};
+}
+
+// Queue one splat per touched bin on the renderer and empty the bins
+void splat_bins_flush(SplatBins *bins, ParticleRenderer *renderer,
+                      Camera2D camera) {
+  // A splat is a disc filling its bin, faded by how much of the bin the
+  // circles in it would cover
+  float radius = 0.5f * SPLAT_BIN_PIXELS / camera.zoom;
+  float disc_area = PI * 0.25f * SPLAT_BIN_PIXELS * SPLAT_BIN_PIXELS;
+
+  particle_renderer_reserve(renderer, bins->touched_count);
+  for (uint32_t t = 0; t < bins->touched_count; t++) {
+    uint32_t bin = bins->touched[t];
+    Color color = bins->color[bin];
+    float coverage = fminf(bins->area[bin] / disc_area, 1.0f);
+    color.a = (unsigned char)(color.a * fmaxf(coverage, SPLAT_MIN_ALPHA));
+    // Circles without weight have no centre to average, their splat sits
+    // in the middle of the bin
+    float x, y;
+    if (bins->weight[bin] > 0) {
+      x = bins->x[bin] / bins->weight[bin];
+      y = bins->y[bin] / bins->weight[bin];
+    } else {
+      int column = bin % bins->columns;
+      int row = bin / bins->columns;
+      x = ((column + 0.5f) * SPLAT_BIN_PIXELS - camera.offset.x) /
+              camera.zoom +
+          camera.target.x;
+      y = ((row + 0.5f) * SPLAT_BIN_PIXELS - camera.offset.y) / camera.zoom +
+          camera.target.y;
+    }
+    particle_renderer_push(renderer, x, y, radius, color);
+    splat_bins_clear(bins, bin);
+  }
+  bins->touched_count = 0;
+}
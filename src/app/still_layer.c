@@ -0,0 +1,63 @@
+#include "still_layer.h"
+
+#include "raylib.h"
+
+// Whether two cameras show the same view
+static bool still_layer_same_camera(Camera2D a, Camera2D b) {
+  return a.target.x == b.target.x && a.target.y == b.target.y &&
+         a.offset.x == b.offset.x && a.offset.y == b.offset.y &&
+         a.zoom == b.zoom && a.rotation == b.rotation;
+}
+
+// Whether the layer has to be redrawn for this version, camera and screen
+bool still_layer_is_stale(const StillLayer *layer, uint64_t version,
+                          Camera2D camera) {
+  return !layer->is_valid || layer->version != version ||
+         !still_layer_same_camera(layer->camera, camera) ||
+         layer->target.texture.width != GetScreenWidth() ||
+         layer->target.texture.height != GetScreenHeight();
+}
+
+// Start redrawing the layer, sizing it to the screen
+void still_layer_begin(StillLayer *layer, Camera2D camera) {
+  int width = GetScreenWidth();
+  int height = GetScreenHeight();
+  if (layer->target.texture.width != width ||
+      layer->target.texture.height != height) {
+    still_layer_deinit(layer);
+    layer->target = LoadRenderTexture(width, height);
+  }
+
+  // The layer is opaque and stands in for clearing the screen, so nothing
+  // drawn into it is blended with a transparent background
+  BeginTextureMode(layer->target);
+  ClearBackground(BLACK);
+  BeginMode2D(camera);
+}
+
+// Finish redrawing the layer
+void still_layer_end(StillLayer *layer, uint64_t version, Camera2D camera) {
+  EndMode2D();
+  EndTextureMode();
+  layer->is_valid = true;
+  layer->version = version;
+  layer->camera = camera;
+}
+
+// Draw the layer over the whole screen
+void still_layer_draw(const StillLayer *layer) {
+  // Render textures are stored upside down
+  Texture2D texture = layer->target.texture;
+  DrawTextureRec(texture,
+                 (Rectangle){0, 0, (float)texture.width,
+                             -(float)texture.height},
+                 (Vector2){0, 0}, WHITE);
+}
+
+// Release the layer's texture
+void still_layer_deinit(StillLayer *layer) {
+  if (layer->target.id != 0) {
+    UnloadRenderTexture(layer->target);
+  }
+  *layer = (StillLayer){0};
+}
@@ -3,8 +3,17 @@
 #include "raylib.h"
 
 void collect_input(UserInput *input) {
+  // A double click lasts until the frame after its release
+  if (input->mouse_left_released) {
+    input->mouse_double_clicked = false;
+  }
   input->mouse_left_released = false;
+  input->mouse_previous = input->mouse_current;
   if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
+    double now = GetTime();
+    input->mouse_double_clicked =
+        now - input->last_press_time < USER_INPUT_DOUBLE_CLICK_TIME;
+    input->last_press_time = now;
     input->mouse_left_pressed = true;
     input->mouse_start = GetMousePosition();
   } else if (IsMouseButtonReleased(MOUSE_LEFT_BUTTON)) {
@@ -12,4 +21,7 @@ void collect_input(UserInput *input) {
     input->mouse_left_released = true;
   }
   input->mouse_current = GetMousePosition();
+  input->shift_down = IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT);
+  input->ctrl_down =
+      IsKeyDown(KEY_LEFT_CONTROL) || IsKeyDown(KEY_RIGHT_CONTROL);
 }
\ No newline at end of file
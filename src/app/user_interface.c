@@ -7,6 +7,10 @@
 
 #define SELECT_BOX_COLOR                                                       \
   (Color) { 255, 0, 0, 255 }
+#define SPAWN_OVERLAP_COLOR                                                    \
+  (Color) { 255, 60, 60, 255 }
+#define SPAWN_FREE_COLOR                                                       \
+  (Color) { 60, 255, 60, 255 }
 
 // Forward declarations
 Rectangle sort_rect(Vector2 p1, Vector2 p2);
@@ -58,6 +62,14 @@ bool draw_ui(UIState *state) {
       state->select_mode = SELECT_MODE_BOX;
       button_pressed = true;
     }
+    Rectangle circle_mode_rect = {
+        select_mode_rect.x,
+        select_mode_rect.y + tool_option_button_size + tool_spacing,
+        tool_option_button_size, tool_option_button_size};
+    if (GuiButton(circle_mode_rect, "Circ")) {
+      state->select_mode = SELECT_MODE_CIRCLE;
+      button_pressed = true;
+    }
   } else if (state->current_tool == UI_TOOL_MOVE) {
     // Draw the move tool options
     Rectangle move_mode_rect = {
@@ -67,6 +79,39 @@ bool draw_ui(UIState *state) {
       state->move_mode = MOVE_MODE_POSITION;
       button_pressed = true;
     }
+    Rectangle velocity_mode_rect = {
+        move_mode_rect.x,
+        move_mode_rect.y + tool_option_button_size + tool_spacing,
+        tool_option_button_size, tool_option_button_size};
+    if (GuiButton(velocity_mode_rect, "Vel")) {
+      state->move_mode = MOVE_MODE_VELOCITY;
+      button_pressed = true;
+    }
+  } else if (state->current_tool == UI_TOOL_SPAWN) {
+    // Draw the spawn mode options
+    Rectangle single_mode_rect = {
+        spawn_tool_rect.x, spawn_tool_rect.y + tool_button_size + tool_spacing,
+        tool_option_button_size, tool_option_button_size};
+    if (GuiButton(single_mode_rect, "One")) {
+      state->spawn_mode = SPAWN_MODE_SINGLE;
+      button_pressed = true;
+    }
+    Rectangle dust_mode_rect = {
+        single_mode_rect.x,
+        single_mode_rect.y + tool_option_button_size + tool_spacing,
+        tool_option_button_size, tool_option_button_size};
+    if (GuiButton(dust_mode_rect, "Dust")) {
+      state->spawn_mode = SPAWN_MODE_DUST;
+      button_pressed = true;
+    }
+    Rectangle static_mode_rect = {
+        dust_mode_rect.x,
+        dust_mode_rect.y + tool_option_button_size + tool_spacing,
+        tool_option_button_size, tool_option_button_size};
+    if (GuiButton(static_mode_rect, "Pin")) {
+      state->spawn_mode = SPAWN_MODE_STATIC;
+      button_pressed = true;
+    }
   }
 
   return button_pressed;
@@ -80,12 +125,28 @@ void draw_tool(UIState *state, UserInput *input) {
             sort_rect(input->mouse_start, input->mouse_current);
         DrawRectangleLinesEx(select_box_rect, 1, SELECT_BOX_COLOR);
       }
+    } else if (state->select_mode == SELECT_MODE_CIRCLE) {
+      if (input->mouse_left_pressed) {
+        float radius =
+            Vector2Distance(input->mouse_start, input->mouse_current);
+        DrawCircleLinesV(input->mouse_start, radius, SELECT_BOX_COLOR);
+      }
     }
   } else if (state->current_tool == UI_TOOL_MOVE) {
+    // The velocity given to the selection
+    if (state->move_mode == MOVE_MODE_VELOCITY && input->mouse_left_pressed) {
+      DrawLineV(input->mouse_start, input->mouse_current, SELECT_BOX_COLOR);
+    }
   } else if (state->current_tool == UI_TOOL_SPAWN) {
     if (input->mouse_left_pressed) {
+      // Tint particles red where they would land on another one, dust only
+      // holds tracers and never collides
+      Color color = WHITE;
+      if (state->spawn_mode != SPAWN_MODE_DUST) {
+        color = state->spawn_overlaps ? SPAWN_OVERLAP_COLOR : SPAWN_FREE_COLOR;
+      }
       float radius = Vector2Distance(input->mouse_start, input->mouse_current);
-      DrawCircleLinesV(input->mouse_start, radius, WHITE);
+      DrawCircleLinesV(input->mouse_start, radius, color);
     }
   }
 }
@@ -1,10 +1,23 @@
 #include "arena_allocator.h"
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 
+// Memory taken once the buffer is full, kept until the next reset
+typedef struct ArenaBlock {
+  struct ArenaBlock *next;
+  max_align_t data[];
+} ArenaBlock;
+
 struct ArenaAllocator {
   char *buffer;
   size_t size;
   size_t used;
+  // Blocks allocated past the buffer since the last reset, and the bytes
+  // all allocations since then needed
+  ArenaBlock *blocks;
+  size_t needed;
 };
 
 ArenaAllocator *init_arena(size_t size) {
@@ -20,22 +33,74 @@ ArenaAllocator *init_arena(size_t size) {
 
   arena->size = size;
   arena->used = 0;
+  arena->blocks = NULL;
+  arena->needed = 0;
   return arena;
 }
 
+// Release the blocks allocated past the buffer
+static void arena_free_blocks(ArenaAllocator *arena) {
+  while (arena->blocks) {
+    ArenaBlock *next = arena->blocks->next;
+    free(arena->blocks);
+    arena->blocks = next;
+  }
+}
+
 void deinit_arena(ArenaAllocator *arena) {
+  arena_free_blocks(arena);
   free(arena->buffer);
   free(arena);
 }
 
 void *arena_alloc(ArenaAllocator *arena, size_t size) {
-  if (arena->used + size > arena->size) {
+  // Every allocation is aligned for any type, so a bool array can be followed
+  // by a double array
+  size_t alignment = alignof(max_align_t);
+  size_t rounded = (size + alignment - 1) & ~(alignment - 1);
+  if (rounded < size || arena->needed + rounded < arena->needed) {
     return NULL; // Out of memory
   }
+  arena->needed += rounded;
 
-  void *ptr = arena->buffer + arena->used;
-  arena->used += size;
-  return ptr;
+  size_t start = (arena->used + alignment - 1) & ~(alignment - 1);
+  if (start <= arena->size && size <= arena->size - start) {
+    void *ptr = arena->buffer + start;
+    arena->used = start + size;
+    return ptr;
+  }
+
+  // The buffer is full. The allocation gets a block of its own, and the next
+  // reset grows the buffer so the same allocations fit in it.
+  if (size > SIZE_MAX - sizeof(ArenaBlock)) {
+    return NULL; // Out of memory
+  }
+  ArenaBlock *block = malloc(sizeof(ArenaBlock) + size);
+  if (!block) {
+    return NULL; // Out of memory
+  }
+  block->next = arena->blocks;
+  arena->blocks = block;
+  return block->data;
 }
 
-void reset_arena(ArenaAllocator *arena) { arena->used = 0; }
+void reset_arena(ArenaAllocator *arena) {
+  if (arena->blocks) {
+    arena_free_blocks(arena);
+    // Grow past what was needed so a slowly growing simulation does not
+    // reallocate every step. A failed allocation keeps the old buffer and
+    // the next step takes blocks again.
+    size_t size = arena->needed + arena->needed / 2;
+    if (size < arena->needed) {
+      size = arena->needed;
+    }
+    char *buffer = malloc(size);
+    if (buffer) {
+      free(arena->buffer);
+      arena->buffer = buffer;
+      arena->size = size;
+    }
+  }
+  arena->used = 0;
+  arena->needed = 0;
+}
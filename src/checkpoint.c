@@ -0,0 +1,251 @@
+// fork, waitpid, open and clock_gettime are POSIX, hidden by strict C11 on
+// glibc and by a bare _POSIX_C_SOURCE on macOS
+#define _POSIX_C_SOURCE 200809L
+#define _DARWIN_C_SOURCE
+
+#include "checkpoint.h"
+
+#include "save_state.h"
+#include "simulation.h"
+#include "vector.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Seconds on a monotonic clock
+static double checkpoint_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Write the simulation over the path, save_state_write writes it next to
+// the path first
+static bool checkpoint_write(const Checkpointer *checkpointer,
+                             const Simulation *simulation) {
+  return save_state_write(simulation, checkpointer->path) == SAVE_STATE_OK;
+}
+
+// Write the copy on the checkpoint thread
+static void *checkpoint_thread_run(void *argument) {
+  Checkpointer *checkpointer = argument;
+  checkpointer->thread_written =
+      checkpoint_write(checkpointer, &checkpointer->copy);
+  // Release makes the result visible before the flag that announces it
+  atomic_store_explicit(&checkpointer->thread_done, true,
+                        memory_order_release);
+  return NULL;
+}
+
+// Grow a copy array to hold at least count elements, false if out of memory
+static bool checkpoint_reserve(void **items, uint64_t *capacity,
+                               uint64_t count, size_t size) {
+  if (count <= *capacity) {
+    return true;
+  }
+  void *grown = realloc(*items, size * count);
+  if (grown == NULL) {
+    return false;
+  }
+  *items = grown;
+  *capacity = count;
+  return true;
+}
+
+// Copy the particles and tracers and start a thread writing the copy
+static bool checkpoint_start_thread(Checkpointer *checkpointer,
+                                    const Simulation *simulation) {
+  uint64_t tracer_count = simulation->tracers.count;
+  if (!checkpoint_reserve((void **)&checkpointer->particles,
+                          &checkpointer->particle_capacity,
+                          simulation->particle_count, sizeof(Particle)) ||
+      !checkpoint_reserve((void **)&checkpointer->tracers,
+                          &checkpointer->tracer_capacity, tracer_count,
+                          2 * sizeof(Vec2))) {
+    return false;
+  }
+
+  // Only the parameters, particles and tracers of the copy are its own, the
+  // rest still points into the simulation and is never read by the writer
+  Simulation *copy = &checkpointer->copy;
+  *copy = *simulation;
+  copy->particles = checkpointer->particles;
+  copy->tracers.positions = checkpointer->tracers;
+  copy->tracers.velocities = checkpointer->tracers + tracer_count;
+  copy->tracers.capacity = tracer_count;
+  if (simulation->particle_count > 0) {
+    memcpy(copy->particles, simulation->particles,
+           sizeof(Particle) * simulation->particle_count);
+  }
+  if (tracer_count > 0) {
+    memcpy(copy->tracers.positions, simulation->tracers.positions,
+           sizeof(Vec2) * tracer_count);
+    memcpy(copy->tracers.velocities, simulation->tracers.velocities,
+           sizeof(Vec2) * tracer_count);
+  }
+
+  atomic_store_explicit(&checkpointer->thread_done, false,
+                        memory_order_relaxed);
+  return pthread_create(&checkpointer->thread, NULL, checkpoint_thread_run,
+                        checkpointer) == 0;
+}
+
+// Write the simulation to the temporary file and rename it over the path
+// from a forked child. The child of a process with other threads may find
+// their locks held forever, malloc's and stdio's included, so it only makes
+// system calls and writes through the scratch taken before the fork.
+static bool checkpoint_write_forked(const Checkpointer *checkpointer,
+                                    const Simulation *simulation) {
+  int descriptor =
+      open(checkpointer->temporary_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (descriptor < 0) {
+    return false;
+  }
+  bool written = save_state_write_descriptor(simulation, descriptor,
+                                             checkpointer->scratch) ==
+                 SAVE_STATE_OK;
+  written = close(descriptor) == 0 && written;
+  if (!written) {
+    unlink(checkpointer->temporary_path);
+    return false;
+  }
+  return rename(checkpointer->temporary_path, checkpointer->path) == 0;
+}
+
+// Fork a child that writes the simulation as it is at the fork
+static bool checkpoint_start_fork(Checkpointer *checkpointer,
+                                  const Simulation *simulation) {
+  if (checkpointer->scratch == NULL) {
+    checkpointer->scratch = malloc(SAVE_STATE_SCRATCH_SIZE);
+    if (checkpointer->scratch == NULL) {
+      return false;
+    }
+  }
+  pid_t child = fork();
+  if (child < 0) {
+    return false;
+  }
+  if (child == 0) {
+    // _exit skips the parent's exit handlers and stdio buffers
+    _exit(checkpoint_write_forked(checkpointer, simulation) ? 0 : 1);
+  }
+  checkpointer->child = child;
+  return true;
+}
+
+// Count a checkpoint that finished writing
+static void checkpoint_finished(Checkpointer *checkpointer, bool written) {
+  checkpointer->is_writing = false;
+  if (written) {
+    checkpointer->stats.written++;
+  } else {
+    checkpointer->stats.failed++;
+  }
+}
+
+// Collect the checkpoint being written, waiting for it if asked to
+static void checkpoint_collect(Checkpointer *checkpointer, bool wait) {
+  if (!checkpointer->is_writing) {
+    return;
+  }
+  if (checkpointer->child > 0) {
+    int status;
+    pid_t result;
+    do {
+      result = waitpid(checkpointer->child, &status, wait ? 0 : WNOHANG);
+    } while (result < 0 && errno == EINTR);
+    if (result == 0) {
+      return;
+    }
+    checkpointer->child = 0;
+    checkpoint_finished(checkpointer, result > 0 && WIFEXITED(status) &&
+                                          WEXITSTATUS(status) == 0);
+    return;
+  }
+  if (!wait && !atomic_load_explicit(&checkpointer->thread_done,
+                                     memory_order_acquire)) {
+    return;
+  }
+  pthread_join(checkpointer->thread, NULL);
+  checkpoint_finished(checkpointer, checkpointer->thread_written);
+}
+
+// Set up checkpoints of the given mode into path every interval steps
+bool checkpointer_init(Checkpointer *checkpointer, const char *path,
+                       uint64_t interval, CheckpointMode mode) {
+  *checkpointer = (Checkpointer){
+      .interval = interval,
+      .mode = mode,
+  };
+  atomic_init(&checkpointer->thread_done, false);
+  int length = snprintf(checkpointer->temporary_path,
+                        sizeof(checkpointer->temporary_path), "%s.tmp", path);
+  if (length < 0 || (size_t)length >= sizeof(checkpointer->temporary_path)) {
+    return false;
+  }
+  strcpy(checkpointer->path, path);
+  return true;
+}
+
+// Collect a finished checkpoint and start the next one if due
+bool checkpointer_step(Checkpointer *checkpointer,
+                       const Simulation *simulation, uint64_t step) {
+  checkpoint_collect(checkpointer, false);
+  if (checkpointer->interval == 0 || step % checkpointer->interval != 0) {
+    return false;
+  }
+  if (checkpointer->is_writing) {
+    checkpointer->stats.skipped++;
+    return false;
+  }
+
+  double start = checkpoint_now();
+  bool started = false;
+  if (checkpointer->mode == CHECKPOINT_MODE_FORK) {
+    started = checkpoint_start_fork(checkpointer, simulation);
+    if (!started) {
+      checkpointer->stats.fallbacks++;
+    }
+  }
+  if (!started) {
+    started = checkpoint_start_thread(checkpointer, simulation);
+  }
+  double pause = checkpoint_now() - start;
+
+  if (!started) {
+    checkpointer->stats.failed++;
+    return false;
+  }
+  checkpointer->is_writing = true;
+  checkpointer->stats.started++;
+  checkpointer->stats.last_pause_seconds = pause;
+  checkpointer->stats.total_pause_seconds += pause;
+  if (pause > checkpointer->stats.max_pause_seconds) {
+    checkpointer->stats.max_pause_seconds = pause;
+  }
+  return true;
+}
+
+// Wait for the checkpoint being written and release the copy's memory
+void checkpointer_deinit(Checkpointer *checkpointer) {
+  checkpoint_collect(checkpointer, true);
+  free(checkpointer->particles);
+  free(checkpointer->tracers);
+  free(checkpointer->scratch);
+  checkpointer->particles = NULL;
+  checkpointer->tracers = NULL;
+  checkpointer->scratch = NULL;
+  checkpointer->particle_capacity = 0;
+  checkpointer->tracer_capacity = 0;
+}
@@ -1,35 +1,175 @@
 #include "arena_allocator.h"
+#include "bitset.h"
+#include "checkpoint.h"
+#include "density_map.h"
+#include "frame_export.h"
+#include "particle_renderer.h"
+#include "precision.h"
 #include "raylib.h"
 #include "raymath.h"
+#include "rlgl.h"
+#include "scenario.h"
+#include "sim_thread.h"
 #include "simulation.h"
+#include "spatial_grid.h"
+#include "splat_bins.h"
+#include "still_layer.h"
+#include "trajectory.h"
 #include "user_input.h"
 #include "user_interface.h"
 #include "vector.h"
 
+#include <assert.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
-#define APP_ARENA_SIZE (1024 * 1024)   // 1 MB
 #define FRAME_ARENA_SIZE (1024 * 1024) // 1 MB
 
 #define SCREEN_WIDTH 800
 #define SCREEN_HEIGHT 600
 
 #define G 100
+// Softening of the app's simulations, so that close encounters in dense
+// disks stay bounded
+#define SOFTENING_KERNEL SOFTENING_PLUMMER
+#define SIMULATION_TIME_STEP (1.0 / 60.0)
 #define PARTICLE_DENSITY 1
 #define PARTICLE_MIN_RADIUS 0.1
 
+// Tracers spawned per unit of area by the dust spawn mode
+#define TRACER_SPAWN_DENSITY 0.05
+#define TRACER_SPAWN_MAX 20000
+#define TRACER_DRAW_RADIUS 0.5f
+#define TRACER_COLOR                                                           \
+  (Color) { 120, 140, 255, 255 }
+#define STATIC_PARTICLE_COLOR                                                  \
+  (Color) { 255, 170, 60, 255 }
+#define SELECTED_PARTICLE_COLOR                                                \
+  (Color) { 255, 80, 80, 255 }
+// Colour of the newest end of a trail, it fades out towards the oldest
+#define TRAIL_COLOR                                                            \
+  (Color) { 90, 200, 255, 200 }
+
+// Distance in pixels within which the cursor picks the nearest particle, and
+// the most the mouse may move for a press to count as a click
+#define PICK_RADIUS_PIXELS 6.0
+#define CLICK_MAX_DRAG_PIXELS 3.0
+#define TOOLTIP_FONT_SIZE 10
+#define TOOLTIP_OFFSET 12
+
+// Velocity given to the selection per unit of the dragged arrow's length
+#define MOVE_VELOCITY_SCALE 1.0
+// Factor the [ and ] keys divide and multiply the selection's density by
+#define DENSITY_SCALE_STEP 2.0
+
+#define DENSITY_PNG_PARTICLES 1000000
+#define DENSITY_PNG_DISK_RADIUS 20000
+#define DENSITY_PNG_SEED 1
+
+#define EXPORT_PARTICLES 2000
+#define EXPORT_DISK_RADIUS 400
+#define EXPORT_SEED 1
+#define EXPORT_DEFAULT_FRAMES 600
+#define EXPORT_STEPS_PER_FRAME 1
+
+// File the save and load keys use
+#define SAVE_STATE_PATH "simulation.save"
+// Steps between the checkpoints the checkpoint key starts, written to the
+// file the load key reads
+#define CHECKPOINT_INTERVAL 600
+// File the record key writes
+#define TRAJECTORY_PATH "simulation.traj"
+
+#define RECORD_PARTICLES 2000
+#define RECORD_TRACERS 100000
+#define RECORD_DISK_RADIUS 400
+#define RECORD_SEED 1
+#define RECORD_DEFAULT_STEPS 3000
+
+#define CHECKPOINT_PARTICLES 16
+#define CHECKPOINT_TRACERS 2000000
+#define CHECKPOINT_DISK_RADIUS 400
+#define CHECKPOINT_SEED 1
+#define CHECKPOINT_DEFAULT_STEPS 200
+#define CHECKPOINT_BENCHMARK_INTERVAL 20
+
+#define PRECISION_REPORT_PARTICLES 256
+#define PRECISION_REPORT_DISK_RADIUS 2000
+#define PRECISION_REPORT_STEPS 300
+#define PRECISION_REPORT_SEED 1
+
 #define CAMERA_MOVE_SPEED 200.0f
 #define CAMERA_ZOOM_SPEED 0.1f
 #define CAMERA_MIN_ZOOM 0.01f
 #define CAMERA_MAX_ZOOM 10.0f
 
+// Particle drawn on top among those found under a point so far
+typedef struct {
+  uint64_t index;
+  int layer;
+  uint64_t order;
+} SimulationPick;
+
 // Forward declarations
+Simulation simulation_setup();
 Camera2D camera_setup();
 void camera_update(Camera2D *camera, float delta_time);
-void simulation_apply_input(Simulation *simulation, ArenaAllocator *sim_arena,
-                            UserInput input, UIState state, Camera2D camera);
-void simulation_draw(Simulation *simulation);
+int particle_draw_layer(const Particle *particle, bool selected, float zoom);
+void simulation_pick_consider(const SimulationSnapshot *snapshot,
+                              const Bitset *selection, float zoom, Vec2 point,
+                              uint64_t index, uint64_t order,
+                              SimulationPick *pick);
+uint64_t simulation_pick(const SimulationSnapshot *snapshot,
+                         const Bitset *selection, Camera2D camera,
+                         Vector2 screen_position);
+void simulation_select(UIState *state, const SimulationSnapshot *snapshot,
+                       UserInput input, Camera2D camera);
+void simulation_apply_selection(SimThread *sim_thread,
+                                const SimulationSnapshot *snapshot,
+                                UIState *state, UserInput input,
+                                Camera2D camera);
+void simulation_apply_input(SimThread *sim_thread,
+                            const SimulationSnapshot *snapshot,
+                            UserInput input, UIState *state, Camera2D camera);
+void simulation_draw_particle(ParticleRenderer *renderer, SplatBins *bins,
+                              Camera2D camera, const Particle *particle,
+                              Color color);
+bool particle_is_still(const Particle *particle);
+bool particle_in_view(const Particle *particle, Vector2 min, Vector2 max);
+void simulation_draw_visible(ParticleRenderer *renderer, SplatBins *bins,
+                             const SimulationSnapshot *snapshot,
+                             const Bitset *selection, Camera2D camera,
+                             bool still, uint64_t index, Vector2 min,
+                             Vector2 max);
+void simulation_draw_tracers(ParticleRenderer *renderer, SplatBins *bins,
+                             const SimulationSnapshot *snapshot,
+                             Camera2D camera, Vector2 top_left,
+                             Vector2 bottom_right);
+void simulation_draw(ParticleRenderer *renderer, SplatBins *bins,
+                     const SimulationSnapshot *snapshot,
+                     const Bitset *selection, Camera2D camera, bool still);
+void simulation_draw_density(DensityMap *map, Texture2D *texture,
+                             const SimulationSnapshot *snapshot,
+                             Camera2D camera, RenderMode mode);
+void simulation_draw_trails(const TrailSet *trails);
+void simulation_draw_tooltip(const Particle *particle,
+                             Vector2 screen_position);
+int run_precision_report(ArenaAllocator *frame_arena);
+int run_density_png(const char *path);
+void export_draw_particles(Color *pixels, const Simulation *simulation,
+                           Camera2D camera);
+int run_export(const char *directory, int argc, char **argv,
+               ArenaAllocator *frame_arena);
+int run_record(const char *path, int argc, char **argv,
+               ArenaAllocator *frame_arena);
+int run_checkpoint(const char *path, int argc, char **argv,
+                   ArenaAllocator *frame_arena);
+void playback_snapshot(SimulationSnapshot *snapshot,
+                       const TrajectoryFrame *frame);
+int run_playback(const char *path);
 
 // Calculate the radius of a particle based on its mass
 float calculate_particle_radius(double mass) {
@@ -52,56 +192,528 @@ Vector2 simulation_to_screen_space(Camera2D camera, Vec2 position) {
   return GetWorldToScreen2D((Vector2){position.x, position.y}, camera);
 }
 
-int main(void) {
-  ArenaAllocator *sim_arena = init_arena(APP_ARENA_SIZE);
+int main(int argc, char **argv) {
   ArenaAllocator *frame_arena = init_arena(FRAME_ARENA_SIZE);
 
+  if (argc > 1 && strcmp(argv[1], "--precision-report") == 0) {
+    return run_precision_report(frame_arena);
+  }
+  if (argc > 2 && strcmp(argv[1], "--density-png") == 0) {
+    deinit_arena(frame_arena);
+    return run_density_png(argv[2]);
+  }
+  if (argc > 2 && strcmp(argv[1], "--export") == 0) {
+    return run_export(argv[2], argc - 3, argv + 3, frame_arena);
+  }
+  if (argc > 2 && strcmp(argv[1], "--record") == 0) {
+    return run_record(argv[2], argc - 3, argv + 3, frame_arena);
+  }
+  if (argc > 2 && strcmp(argv[1], "--checkpoint") == 0) {
+    return run_checkpoint(argv[2], argc - 3, argv + 3, frame_arena);
+  }
+  if (argc > 2 && strcmp(argv[1], "--play") == 0) {
+    deinit_arena(frame_arena);
+    return run_playback(argv[2]);
+  }
+
   InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Gravity Simulation");
 
-  Simulation simulation = simulation_init(G);
+  // The simulation steps on its own thread, the loop below only sends it
+  // commands and draws its latest snapshot
+  SimThread *sim_thread =
+      sim_thread_start(simulation_setup(), frame_arena, SIMULATION_TIME_STEP);
   Camera2D camera = camera_setup();
+  ParticleRenderer renderer = particle_renderer_init();
+  SplatBins splat_bins = {0};
+  DensityMap density_map = density_map_init(SCREEN_WIDTH, SCREEN_HEIGHT, 0);
+  Texture2D density_texture = {0};
+  StillLayer still_layer = {0};
 
   UIState ui_state = (UIState){.current_tool = UI_TOOL_SELECT,
                                .select_mode = SELECT_MODE_BOX,
                                .move_mode = MOVE_MODE_POSITION,
-                               .spawn_mode = SPAWN_MODE_SINGLE};
+                               .spawn_mode = SPAWN_MODE_SINGLE,
+                               .selection = {0}};
   UserInput user_input = (UserInput){.mouse_left_pressed = false,
                                      .mouse_start = (Vector2){0, 0},
                                      .mouse_current = (Vector2){0, 0}};
 
   while (!WindowShouldClose()) {
-    reset_arena(frame_arena);
+    const SimulationSnapshot *snapshot = sim_thread_snapshot(sim_thread);
 
     double time_step = GetFrameTime();
     collect_input(&user_input);
 
     camera_update(&camera, time_step);
 
-    simulation_apply_input(&simulation, sim_arena, user_input, ui_state,
+    // Cycle through the integrators
+    if (IsKeyPressed(KEY_I)) {
+      static const char *integrator_names[] = {"euler", "wisdom-holman",
+                                               "respa"};
+      Integrator integrator = (snapshot->integrator + 1) % 3;
+      sim_thread_set_integrator(sim_thread, integrator);
+      printf("integrator: %s\n", integrator_names[integrator]);
+    }
+
+    // Save the simulation, or replace it with the saved one
+    if (IsKeyPressed(KEY_F5)) {
+      sim_thread_save(sim_thread, SAVE_STATE_PATH);
+    }
+    if (IsKeyPressed(KEY_F9)) {
+      sim_thread_load(sim_thread, SAVE_STATE_PATH);
+      bitset_clear_all(&ui_state.selection);
+    }
+    // Start or stop writing checkpoints the load key restores
+    if (IsKeyPressed(KEY_F6)) {
+      sim_thread_toggle_checkpoints(sim_thread, SAVE_STATE_PATH,
+                                    CHECKPOINT_INTERVAL, CHECKPOINT_MODE_FORK);
+    }
+    // Start or stop recording the steps into a trajectory file
+    if (IsKeyPressed(KEY_F7)) {
+      sim_thread_toggle_recording(sim_thread, TRAJECTORY_PATH);
+    }
+
+    // Cycle between drawing the particles and the density heat maps
+    if (IsKeyPressed(KEY_H)) {
+      ui_state.render_mode = (ui_state.render_mode + 1) % 3;
+    }
+
+    simulation_apply_input(sim_thread, snapshot, user_input, &ui_state,
                            camera);
-    simulation_update(&simulation, frame_arena, time_step);
 
     BeginDrawing();
-    ClearBackground(BLACK);
 
-    BeginMode2D(camera);
-    simulation_draw(&simulation);
-    EndMode2D();
+    if (ui_state.render_mode == RENDER_MODE_PARTICLES) {
+      // Particles that do not move are only redrawn when they or the camera
+      // change, the layer holding them also clears the screen
+      splat_bins_resize(&splat_bins, GetScreenWidth(), GetScreenHeight());
+      if (still_layer_is_stale(&still_layer, snapshot->still_version,
+                               camera)) {
+        still_layer_begin(&still_layer, camera);
+        simulation_draw(&renderer, &splat_bins, snapshot, &ui_state.selection,
+                        camera, true);
+        still_layer_end(&still_layer, snapshot->still_version, camera);
+      }
+      still_layer_draw(&still_layer);
+
+      BeginMode2D(camera);
+      simulation_draw_trails(&snapshot->trails);
+      simulation_draw(&renderer, &splat_bins, snapshot, &ui_state.selection,
+                      camera, false);
+      EndMode2D();
+    } else {
+      ClearBackground(BLACK);
+      simulation_draw_density(&density_map, &density_texture, snapshot,
+                              camera, ui_state.render_mode);
+    }
+
+    // Describe the particle under the cursor
+    Vector2 mouse = GetMousePosition();
+    uint64_t hovered =
+        simulation_pick(snapshot, &ui_state.selection, camera, mouse);
+    if (hovered < snapshot->particle_count) {
+      simulation_draw_tooltip(&snapshot->particles[hovered], mouse);
+    }
 
     bool button_pressed = draw_ui(&ui_state);
     if (!button_pressed) {
       draw_tool(&ui_state, &user_input);
     }
 
+    uint64_t selected = bitset_popcount(&ui_state.selection);
+    if (selected > 0) {
+      DrawText(TextFormat("%llu selected", (unsigned long long)selected), 10,
+               GetScreenHeight() - 30, TOOLTIP_FONT_SIZE * 2, WHITE);
+    }
     DrawFPS(10, 10);
     EndDrawing();
   }
 
+  sim_thread_stop(sim_thread);
+  bitset_deinit(&ui_state.selection);
+  splat_bins_deinit(&splat_bins);
+  density_map_deinit(&density_map);
+  still_layer_deinit(&still_layer);
+  if (density_texture.id != 0) {
+    UnloadTexture(density_texture);
+  }
+  particle_renderer_deinit(&renderer);
   CloseWindow();
 
   return 0;
 }
 
+// Compare the accuracy of the build's vector precision against a double
+// precision reference on a random disk
+int run_precision_report(ArenaAllocator *frame_arena) {
+  Simulation simulation = simulation_setup();
+  scenario_random_disk(&simulation, PRECISION_REPORT_PARTICLES,
+                       PRECISION_REPORT_DISK_RADIUS, PARTICLE_DENSITY,
+                       PRECISION_REPORT_SEED);
+
+  PrecisionReport report = precision_report(
+      &simulation, frame_arena, 1.0 / 60.0, PRECISION_REPORT_STEPS);
+  precision_report_print(report);
+  simulation_deinit(&simulation);
+  deinit_arena(frame_arena);
+  return 0;
+}
+
+// Render a random disk of particles as a mass density map into a PNG file,
+// without opening a window
+int run_density_png(const char *path) {
+  Simulation simulation = simulation_setup();
+  scenario_random_disk(&simulation, DENSITY_PNG_PARTICLES,
+                       DENSITY_PNG_DISK_RADIUS, PARTICLE_DENSITY,
+                       DENSITY_PNG_SEED);
+
+  // Fit the disk to the image with a small margin
+  Camera2D camera = camera_setup();
+  camera.zoom = 0.45f * fminf(SCREEN_WIDTH, SCREEN_HEIGHT) /
+                DENSITY_PNG_DISK_RADIUS;
+  DensityMap map = density_map_init(SCREEN_WIDTH, SCREEN_HEIGHT, 0);
+  density_map_render(&map, camera, simulation.particles,
+                     simulation.particle_count, NULL, 0, DENSITY_WEIGHT_MASS);
+  bool saved = ExportImage(density_map_image(&map), path);
+
+  density_map_deinit(&map);
+  simulation_deinit(&simulation);
+  return saved ? 0 : 1;
+}
+
+// Draw the particles and tracers into an exported frame on the CPU
+void export_draw_particles(Color *pixels, const Simulation *simulation,
+                           Camera2D camera) {
+  frame_clear(pixels, SCREEN_WIDTH, SCREEN_HEIGHT, BLACK);
+  for (uint64_t i = 0; i < simulation->particle_count; i++) {
+    const Particle *p = &simulation->particles[i];
+    Vector2 screen = simulation_to_screen_space(camera, p->position);
+    frame_fill_circle(pixels, SCREEN_WIDTH, SCREEN_HEIGHT, screen.x, screen.y,
+                      p->radius * camera.zoom,
+                      p->is_static ? STATIC_PARTICLE_COLOR : WHITE);
+  }
+  for (uint64_t i = 0; i < simulation->tracers.count; i++) {
+    Vector2 screen =
+        simulation_to_screen_space(camera, simulation->tracers.positions[i]);
+    frame_fill_circle(pixels, SCREEN_WIDTH, SCREEN_HEIGHT, screen.x, screen.y,
+                      TRACER_DRAW_RADIUS * camera.zoom, TRACER_COLOR);
+  }
+}
+
+// Step a random disk at a fixed time step without opening a window and write
+// every frame into the directory. The options after the directory are the
+// number of frames, png or ppm, and density to draw the mass density map
+// instead of the particles. Frames are encoded on worker threads while the
+// following frames are stepped and drawn.
+int run_export(const char *directory, int argc, char **argv,
+               ArenaAllocator *frame_arena) {
+  uint64_t frames = EXPORT_DEFAULT_FRAMES;
+  FrameFormat format = FRAME_FORMAT_PNG;
+  bool density = false;
+  for (int a = 0; a < argc; a++) {
+    if (strcmp(argv[a], "png") == 0) {
+      format = FRAME_FORMAT_PNG;
+    } else if (strcmp(argv[a], "ppm") == 0) {
+      format = FRAME_FORMAT_PPM;
+    } else if (strcmp(argv[a], "density") == 0) {
+      density = true;
+    } else {
+      frames = strtoull(argv[a], NULL, 10);
+    }
+  }
+
+  // Every written frame would be logged otherwise
+  SetTraceLogLevel(LOG_WARNING);
+  FrameExporter *exporter = frame_exporter_start(
+      directory, format, SCREEN_WIDTH, SCREEN_HEIGHT, 0);
+  if (exporter == NULL) {
+    fprintf(stderr, "export: cannot write frames into %s\n", directory);
+    deinit_arena(frame_arena);
+    return 1;
+  }
+
+  Simulation simulation = simulation_setup();
+  scenario_random_disk(&simulation, EXPORT_PARTICLES, EXPORT_DISK_RADIUS,
+                       PARTICLE_DENSITY, EXPORT_SEED);
+  Camera2D camera = camera_setup();
+  camera.zoom = 0.45f * fminf(SCREEN_WIDTH, SCREEN_HEIGHT) / EXPORT_DISK_RADIUS;
+  DensityMap map = {0};
+  if (density) {
+    map = density_map_init(SCREEN_WIDTH, SCREEN_HEIGHT, 0);
+  }
+
+  for (uint64_t frame = 0; frame < frames; frame++) {
+    Color *pixels = frame_exporter_acquire(exporter);
+    if (density) {
+      density_map_render(&map, camera, simulation.particles,
+                         simulation.particle_count,
+                         simulation.tracers.positions, simulation.tracers.count,
+                         DENSITY_WEIGHT_MASS);
+      memcpy(pixels, map.pixels,
+             sizeof(Color) * SCREEN_WIDTH * SCREEN_HEIGHT);
+    } else {
+      export_draw_particles(pixels, &simulation, camera);
+    }
+    frame_exporter_submit(exporter, pixels, frame);
+
+    for (uint32_t step = 0; step < EXPORT_STEPS_PER_FRAME; step++) {
+      reset_arena(frame_arena);
+      simulation_update(&simulation, frame_arena, SIMULATION_TIME_STEP);
+    }
+  }
+
+  FrameExportStats stats = frame_exporter_stop(exporter);
+  printf("export: %llu frames in %.2f s, %.1f simulated frames per wall "
+         "second, %.2f s spent encoding\n",
+         (unsigned long long)stats.frames, stats.seconds,
+         stats.frames / stats.seconds, stats.encode_seconds);
+  if (stats.failed > 0) {
+    fprintf(stderr, "export: %llu frames could not be written\n",
+            (unsigned long long)stats.failed);
+  }
+
+  density_map_deinit(&map);
+  simulation_deinit(&simulation);
+  deinit_arena(frame_arena);
+  return stats.failed > 0 ? 1 : 0;
+}
+
+// Step a disk of particles in dust without a window, recording every
+// TRAJECTORY_DEFAULT_INTERVAL-th step into a trajectory file. The option
+// after the path is the number of steps. Frames are coded on the recording
+// thread while the following steps run.
+int run_record(const char *path, int argc, char **argv,
+               ArenaAllocator *frame_arena) {
+  uint64_t steps =
+      argc > 0 ? strtoull(argv[0], NULL, 10) : RECORD_DEFAULT_STEPS;
+  TrajectoryRecorder *recorder = trajectory_recorder_start(
+      path, TRAJECTORY_DEFAULT_INTERVAL, TRAJECTORY_DEFAULT_CELL_SIZE);
+  if (recorder == NULL) {
+    fprintf(stderr, "record: cannot create %s\n", path);
+    deinit_arena(frame_arena);
+    return 1;
+  }
+
+  Simulation simulation = simulation_setup();
+  scenario_random_disk(&simulation, RECORD_PARTICLES, RECORD_DISK_RADIUS,
+                       PARTICLE_DENSITY, RECORD_SEED);
+  scenario_dust(&simulation, (Vec2){0, 0}, RECORD_DISK_RADIUS, RECORD_TRACERS,
+                RECORD_SEED);
+
+  for (uint64_t step = 0; step < steps; step++) {
+    trajectory_recorder_offer(recorder, &simulation, step);
+    reset_arena(frame_arena);
+    simulation_update(&simulation, frame_arena, SIMULATION_TIME_STEP);
+  }
+  TrajectoryStats stats = trajectory_recorder_stop(recorder);
+  printf("record: %llu steps, %llu frames (%llu keyframes, %llu dropped), "
+         "%.2f MB instead of %.2f MB, %.2f s spent coding\n",
+         (unsigned long long)steps,
+         (unsigned long long)stats.frames, (unsigned long long)stats.keyframes,
+         (unsigned long long)stats.dropped, stats.written_bytes / 1e6,
+         stats.raw_bytes / 1e6, stats.encode_seconds);
+  if (stats.failed) {
+    fprintf(stderr, "record: %s could not be written\n", path);
+  }
+
+  simulation_deinit(&simulation);
+  deinit_arena(frame_arena);
+  return stats.failed ? 1 : 0;
+}
+
+// Step a disk of particles in a large cloud of dust without a window,
+// writing a checkpoint every interval steps. The options after the path are
+// the number of steps, the interval, and "thread" to copy the simulation for
+// a writing thread instead of forking a writing process. Prints how long
+// each checkpoint held up the steps.
+int run_checkpoint(const char *path, int argc, char **argv,
+                   ArenaAllocator *frame_arena) {
+  uint64_t steps =
+      argc > 0 ? strtoull(argv[0], NULL, 10) : CHECKPOINT_DEFAULT_STEPS;
+  uint64_t interval =
+      argc > 1 ? strtoull(argv[1], NULL, 10) : CHECKPOINT_BENCHMARK_INTERVAL;
+  CheckpointMode mode = argc > 2 && strcmp(argv[2], "thread") == 0
+                            ? CHECKPOINT_MODE_THREAD
+                            : CHECKPOINT_MODE_FORK;
+  Checkpointer checkpointer;
+  if (interval == 0 ||
+      !checkpointer_init(&checkpointer, path, interval, mode)) {
+    fprintf(stderr, "checkpoint: cannot write to %s every %llu steps\n", path,
+            (unsigned long long)interval);
+    deinit_arena(frame_arena);
+    return 1;
+  }
+
+  Simulation simulation = simulation_setup();
+  scenario_random_disk(&simulation, CHECKPOINT_PARTICLES,
+                       CHECKPOINT_DISK_RADIUS, PARTICLE_DENSITY,
+                       CHECKPOINT_SEED);
+  scenario_dust(&simulation, (Vec2){0, 0}, CHECKPOINT_DISK_RADIUS,
+                CHECKPOINT_TRACERS, CHECKPOINT_SEED);
+
+  for (uint64_t step = 1; step <= steps; step++) {
+    reset_arena(frame_arena);
+    simulation_update(&simulation, frame_arena, SIMULATION_TIME_STEP);
+    if (checkpointer_step(&checkpointer, &simulation, step)) {
+      printf("checkpoint: step %llu paused %.2f ms\n",
+             (unsigned long long)step,
+             checkpointer.stats.last_pause_seconds * 1e3);
+    }
+  }
+  checkpointer_deinit(&checkpointer);
+  CheckpointStats stats = checkpointer.stats;
+  printf("checkpoint: %llu written, %llu failed, %llu skipped while writing, "
+         "%llu fell back to a thread, paused %.2f ms at most and %.2f ms on "
+         "average\n",
+         (unsigned long long)stats.written, (unsigned long long)stats.failed,
+         (unsigned long long)stats.skipped,
+         (unsigned long long)stats.fallbacks, stats.max_pause_seconds * 1e3,
+         stats.started ? stats.total_pause_seconds * 1e3 / stats.started : 0);
+
+  simulation_deinit(&simulation);
+  deinit_arena(frame_arena);
+  return stats.failed > 0 ? 1 : 0;
+}
+
+// Fill a snapshot with a recorded frame so it can be drawn like a live one.
+// Masses are derived from the radii, velocities are not recorded.
+void playback_snapshot(SimulationSnapshot *snapshot,
+                       const TrajectoryFrame *frame) {
+  if (frame->particle_count > snapshot->particle_capacity) {
+    snapshot->particles = realloc(snapshot->particles,
+                                  sizeof(Particle) * frame->particle_count);
+    assert(snapshot->particles);
+    snapshot->particle_capacity = frame->particle_count;
+  }
+  for (uint64_t i = 0; i < frame->particle_count; i++) {
+    snapshot->particles[i] = (Particle){
+        .position = frame->positions[i],
+        .mass = calculate_particle_mass(frame->radii[i]),
+        .radius = frame->radii[i],
+    };
+  }
+  snapshot->particle_count = frame->particle_count;
+  spatial_grid_build(&snapshot->grid, snapshot->particles,
+                     snapshot->particle_count);
+
+  if (frame->tracer_count > snapshot->tracer_capacity) {
+    snapshot->tracers =
+        realloc(snapshot->tracers, sizeof(Vec2) * frame->tracer_count);
+    assert(snapshot->tracers);
+    snapshot->tracer_capacity = frame->tracer_count;
+  }
+  if (frame->tracer_count > 0) {
+    memcpy(snapshot->tracers, &frame->positions[frame->particle_count],
+           sizeof(Vec2) * frame->tracer_count);
+  }
+  snapshot->tracer_count = frame->tracer_count;
+  snapshot->step = frame->step;
+}
+
+// Play back a trajectory file in a window instead of simulating. Space
+// pauses, the arrow keys step one frame, page up and page down jump by a
+// keyframe interval and home returns to the start. Frames are decoded ahead
+// on the reader's thread.
+int run_playback(const char *path) {
+  TrajectoryReader *reader = trajectory_reader_open(path);
+  if (reader == NULL) {
+    fprintf(stderr, "play: cannot read %s\n", path);
+    return 1;
+  }
+
+  InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Gravity Simulation");
+  Camera2D camera = camera_setup();
+  ParticleRenderer renderer = particle_renderer_init();
+  SplatBins splat_bins = {0};
+  DensityMap density_map = density_map_init(SCREEN_WIDTH, SCREEN_HEIGHT, 0);
+  Texture2D density_texture = {0};
+  RenderMode render_mode = RENDER_MODE_PARTICLES;
+  Bitset no_selection = {0};
+  SimulationSnapshot snapshot = {0};
+  uint64_t last = reader->frame_count - 1;
+  uint64_t frame = 0;
+  bool is_paused = false;
+
+  while (!WindowShouldClose()) {
+    camera_update(&camera, GetFrameTime());
+    if (IsKeyPressed(KEY_SPACE)) {
+      is_paused = !is_paused;
+    }
+    if (IsKeyPressed(KEY_RIGHT) && frame < last) {
+      frame++;
+    }
+    if (IsKeyPressed(KEY_LEFT) && frame > 0) {
+      frame--;
+    }
+    if (IsKeyPressed(KEY_PAGE_DOWN)) {
+      frame = last - frame > TRAJECTORY_KEYFRAME_INTERVAL
+                  ? frame + TRAJECTORY_KEYFRAME_INTERVAL
+                  : last;
+    }
+    if (IsKeyPressed(KEY_PAGE_UP)) {
+      frame = frame > TRAJECTORY_KEYFRAME_INTERVAL
+                  ? frame - TRAJECTORY_KEYFRAME_INTERVAL
+                  : 0;
+    }
+    if (IsKeyPressed(KEY_HOME)) {
+      frame = 0;
+    }
+    if (IsKeyPressed(KEY_H)) {
+      render_mode = (render_mode + 1) % 3;
+    }
+
+    const TrajectoryFrame *decoded = trajectory_reader_frame(reader, frame);
+    if (decoded != NULL) {
+      playback_snapshot(&snapshot, decoded);
+    }
+
+    BeginDrawing();
+    ClearBackground(BLACK);
+    if (render_mode == RENDER_MODE_PARTICLES) {
+      splat_bins_resize(&splat_bins, GetScreenWidth(), GetScreenHeight());
+      BeginMode2D(camera);
+      simulation_draw(&renderer, &splat_bins, &snapshot, &no_selection,
+                      camera, false);
+      EndMode2D();
+    } else {
+      simulation_draw_density(&density_map, &density_texture, &snapshot,
+                              camera, render_mode);
+    }
+    DrawText(TextFormat("frame %llu / %llu, step %llu%s",
+                        (unsigned long long)frame + 1,
+                        (unsigned long long)last + 1,
+                        (unsigned long long)snapshot.step,
+                        decoded == NULL ? ", damaged" : ""),
+             10, 30, TOOLTIP_FONT_SIZE * 2, WHITE);
+    DrawFPS(10, 10);
+    EndDrawing();
+
+    if (!is_paused && frame < last) {
+      frame++;
+    }
+  }
+
+  free(snapshot.particles);
+  free(snapshot.tracers);
+  spatial_grid_deinit(&snapshot.grid);
+  splat_bins_deinit(&splat_bins);
+  density_map_deinit(&density_map);
+  if (density_texture.id != 0) {
+    UnloadTexture(density_texture);
+  }
+  particle_renderer_deinit(&renderer);
+  CloseWindow();
+  trajectory_reader_close(reader);
+  return 0;
+}
+
+// Create an empty simulation with the app's gravity and softening
+Simulation simulation_setup() {
+  Simulation simulation = simulation_init(G);
+  simulation.softening_kernel = SOFTENING_KERNEL;
+  return simulation;
+}
+
 // Setup the camera
 // Set origin to the center of the screen
 Camera2D camera_setup() {
@@ -141,34 +753,457 @@ void camera_update(Camera2D *camera, float delta_time) {
   }
 }
 
+// Layer a particle is drawn in, higher layers on top. The still layer is
+// drawn first, then the moving particles and the selected still particles
+// drawn again over them. Each pass queues its circles before the splats of
+// everything smaller than a pixel.
+int particle_draw_layer(const Particle *particle, bool selected, float zoom) {
+  bool splat = particle->radius * zoom < 0.5f;
+  if (!particle_is_still(particle)) {
+    return splat ? 4 : 2;
+  }
+  if (selected) {
+    return splat ? 4 : 3;
+  }
+  return splat ? 1 : 0;
+}
+
+// Keep a particle whose disk holds the point if it is drawn over the best so
+// far. Order is where the draw queues it within its layer.
+void simulation_pick_consider(const SimulationSnapshot *snapshot,
+                              const Bitset *selection, float zoom, Vec2 point,
+                              uint64_t index, uint64_t order,
+                              SimulationPick *pick) {
+  const Particle *p = &snapshot->particles[index];
+  double dx = p->position.x - point.x;
+  double dy = p->position.y - point.y;
+  if (dx * dx + dy * dy > p->radius * p->radius) {
+    return;
+  }
+  bool selected = index < selection->count && bitset_test(selection, index);
+  int layer = particle_draw_layer(p, selected, zoom);
+  // Selected still particles are drawn again after the grid, by index
+  if (selected && particle_is_still(p)) {
+    order = snapshot->particle_count + index;
+  }
+  if (layer > pick->layer || (layer == pick->layer && order >= pick->order)) {
+    *pick = (SimulationPick){index, layer, order};
+  }
+}
+
+// Find the particle drawn on top under a screen position, or the nearest one
+// within a few pixels. The grid is walked in the order simulation_draw
+// queues it, so the pick is the particle the user sees. Returns the
+// snapshot's particle count if there is none.
+uint64_t simulation_pick(const SimulationSnapshot *snapshot,
+                         const Bitset *selection, Camera2D camera,
+                         Vector2 screen_position) {
+  Vec2 point = screen_to_simulation_space(camera, screen_position);
+  const SpatialGrid *grid = &snapshot->grid;
+  SimulationPick pick = {snapshot->particle_count, -1, 0};
+
+  for (uint64_t o = 0; o < grid->oversized_count; o++) {
+    simulation_pick_consider(snapshot, selection, camera.zoom, point,
+                             grid->oversized[o], o, &pick);
+  }
+  if (grid->particle_count > grid->oversized_count) {
+    double reach = grid->max_radius;
+    SpatialGridRange range =
+        spatial_grid_range(grid, (Vec2){point.x - reach, point.y - reach},
+                           (Vec2){point.x + reach, point.y + reach});
+    for (uint32_t row = range.min_row; row <= range.max_row; row++) {
+      uint64_t first = (uint64_t)row * grid->columns + range.min_column;
+      uint64_t last = (uint64_t)row * grid->columns + range.max_column;
+      for (uint64_t c = grid->cell_start[first]; c < grid->cell_start[last + 1];
+           c++) {
+        simulation_pick_consider(snapshot, selection, camera.zoom, point,
+                                 grid->cell_particles[c],
+                                 grid->oversized_count + c, &pick);
+      }
+    }
+  }
+
+  if (pick.index == snapshot->particle_count) {
+    return spatial_grid_nearest(grid, snapshot->particles, point,
+                                PICK_RADIUS_PIXELS / camera.zoom);
+  }
+  return pick.index;
+}
+
+// Update the selection from the select tool, querying the snapshot's grid
+void simulation_select(UIState *state, const SimulationSnapshot *snapshot,
+                       UserInput input, Camera2D camera) {
+  Bitset *selection = &state->selection;
+  if (selection->count != snapshot->particle_count) {
+    bitset_resize(selection, snapshot->particle_count);
+  }
+  if (state->current_tool != UI_TOOL_SELECT || !input.mouse_left_released) {
+    return;
+  }
+
+  if (input.mouse_double_clicked) {
+    bitset_set_all(selection);
+    return;
+  }
+
+  // A click picks the particle under the cursor. A drag counts the hits in
+  // the dragged shape first, then fetches them.
+  Vec2 start = screen_to_simulation_space(camera, input.mouse_start);
+  Vec2 end = screen_to_simulation_space(camera, input.mouse_current);
+  Vec2 min = {fmin(start.x, end.x), fmin(start.y, end.y)};
+  Vec2 max = {fmax(start.x, end.x), fmax(start.y, end.y)};
+  double radius = vec2_dist(start, end);
+  uint64_t picked = snapshot->particle_count;
+  uint64_t *indices = NULL;
+  uint64_t found = 0;
+  bool is_click = Vector2Distance(input.mouse_start, input.mouse_current) <
+                  CLICK_MAX_DRAG_PIXELS;
+  if (is_click) {
+    picked = simulation_pick(snapshot, selection, camera,
+                             input.mouse_current);
+    indices = &picked;
+    found = picked < snapshot->particle_count;
+  }
+  for (uint64_t capacity = 0; !is_click; capacity = found) {
+    found = state->select_mode == SELECT_MODE_CIRCLE
+                ? spatial_grid_query_circle(&snapshot->grid,
+                                            snapshot->particles, start,
+                                            radius, indices, capacity)
+                : spatial_grid_query_box(&snapshot->grid, snapshot->particles,
+                                         min, max, indices, capacity);
+    if (found <= capacity) {
+      break;
+    }
+    indices = realloc(indices, sizeof(uint64_t) * found);
+    assert(indices);
+  }
+
+  // Shift adds to the selection, ctrl removes from it and both together
+  // keep only what is in both
+  Bitset hits = {0};
+  bitset_resize(&hits, selection->count);
+  bitset_set_indices(&hits, indices, found);
+  if (input.shift_down && input.ctrl_down) {
+    bitset_intersect(selection, &hits);
+  } else if (input.shift_down) {
+    bitset_union(selection, &hits);
+  } else if (input.ctrl_down) {
+    bitset_subtract(selection, &hits);
+  } else {
+    bitset_clear_all(selection);
+    bitset_union(selection, &hits);
+  }
+  bitset_deinit(&hits);
+  if (!is_click) {
+    free(indices);
+  }
+}
+
+// Send the move tool and the selection keys to the simulation
+void simulation_apply_selection(SimThread *sim_thread,
+                                const SimulationSnapshot *snapshot,
+                                UIState *state, UserInput input,
+                                Camera2D camera) {
+  Bitset *selection = &state->selection;
+
+  if (state->current_tool == UI_TOOL_MOVE &&
+      state->move_mode == MOVE_MODE_POSITION && input.mouse_left_pressed) {
+    Vec2 previous = screen_to_simulation_space(camera, input.mouse_previous);
+    Vec2 current = screen_to_simulation_space(camera, input.mouse_current);
+    Vec2 offset = vec2_sub(current, previous);
+    if (offset.x != 0 || offset.y != 0) {
+      sim_thread_translate_selection(sim_thread, selection, offset);
+    }
+  } else if (state->current_tool == UI_TOOL_MOVE &&
+             state->move_mode == MOVE_MODE_VELOCITY &&
+             input.mouse_left_released) {
+    Vec2 start = screen_to_simulation_space(camera, input.mouse_start);
+    Vec2 end = screen_to_simulation_space(camera, input.mouse_current);
+    sim_thread_set_selection_velocity(
+        sim_thread, selection,
+        vec2_scale(vec2_sub(end, start), MOVE_VELOCITY_SCALE));
+  }
+
+  if (IsKeyPressed(KEY_P)) {
+    sim_thread_pin_selection(sim_thread, selection, true);
+  }
+  if (IsKeyPressed(KEY_U)) {
+    sim_thread_pin_selection(sim_thread, selection, false);
+  }
+  if (IsKeyPressed(KEY_RIGHT_BRACKET)) {
+    sim_thread_scale_selection_density(sim_thread, selection,
+                                       DENSITY_SCALE_STEP);
+  }
+  if (IsKeyPressed(KEY_LEFT_BRACKET)) {
+    sim_thread_scale_selection_density(sim_thread, selection,
+                                       1 / DENSITY_SCALE_STEP);
+  }
+  // Trails are added if any selected particle lacks one, otherwise removed
+  if (IsKeyPressed(KEY_T)) {
+    bool has_trail = true;
+    uint64_t limit = selection->count < snapshot->particle_count
+                         ? selection->count
+                         : snapshot->particle_count;
+    for (uint64_t i = bitset_next(selection, 0); i < limit && has_trail;
+         i = bitset_next(selection, i + 1)) {
+      has_trail = snapshot->particles[i].trail != 0;
+    }
+    sim_thread_trail_selection(sim_thread, selection, !has_trail);
+  }
+  if (IsKeyPressed(KEY_DELETE) || IsKeyPressed(KEY_BACKSPACE)) {
+    sim_thread_delete_selection(sim_thread, selection);
+    bitset_clear_all(selection);
+  }
+}
+
 // Apply commands to the simulation
 // Construct commands from UI state and user input
-void simulation_apply_input(Simulation *simulation, ArenaAllocator *arena,
-                            UserInput input, UIState state, Camera2D camera) {
-  if (state.current_tool == UI_TOOL_SPAWN) {
+void simulation_apply_input(SimThread *sim_thread,
+                            const SimulationSnapshot *snapshot,
+                            UserInput input, UIState *state, Camera2D camera) {
+  simulation_select(state, snapshot, input, camera);
+  simulation_apply_selection(sim_thread, snapshot, state, input, camera);
+
+  // Check the particle being spawned against the others for the tool's tint
+  state->spawn_overlaps = false;
+  if (state->current_tool == UI_TOOL_SPAWN && input.mouse_left_pressed) {
+    Vec2 start = screen_to_simulation_space(camera, input.mouse_start);
+    Vec2 end = screen_to_simulation_space(camera, input.mouse_current);
+    state->spawn_overlaps = spatial_grid_overlaps_circle(
+        &snapshot->grid, snapshot->particles, start, vec2_dist(start, end));
+  }
+
+  if (state->current_tool == UI_TOOL_SPAWN &&
+      state->spawn_mode == SPAWN_MODE_DUST) {
+    if (input.mouse_left_released) {
+      Vec2 start = screen_to_simulation_space(camera, input.mouse_start);
+      Vec2 end = screen_to_simulation_space(camera, input.mouse_current);
+      double radius = vec2_dist(start, end);
+      double area = M_PI * radius * radius;
+      int count = fmin(area * TRACER_SPAWN_DENSITY, TRACER_SPAWN_MAX);
+      if (count > 0) {
+        sim_thread_spawn_dust(sim_thread, start, radius, count,
+                              GetRandomValue(1, INT32_MAX));
+      }
+    }
+  } else if (state->current_tool == UI_TOOL_SPAWN) {
     if (input.mouse_left_released) {
       Vec2 start = screen_to_simulation_space(camera, input.mouse_start);
       Vec2 end = screen_to_simulation_space(camera, input.mouse_current);
       double radius = vec2_dist(start, end);
       if (radius >= PARTICLE_MIN_RADIUS) {
-        simulation_new_particle(
-            simulation, arena,
+        sim_thread_spawn_particle(
+            sim_thread,
             (Particle){.position = (Vec2){start.x, start.y},
                        .velocity = (Vec2){0, 0},
                        .mass = calculate_particle_mass(radius),
-                       .radius = radius});
-        printf("spawned particle with mass %f\n",
-               simulation->particles[simulation->particle_count - 1].mass);
+                       .radius = radius,
+                       .is_static = state->spawn_mode == SPAWN_MODE_STATIC});
       }
     }
   }
 }
 
-// Draw the simulation
-void simulation_draw(Simulation *simulation) {
-  for (uint64_t i = 0; i < simulation->particle_count; i++) {
-    Particle *p = &simulation->particles[i];
-    Vector2 position = {p->position.x, p->position.y};
-    DrawCircleV(position, calculate_particle_radius(p->mass), WHITE);
+// Queue a particle on the renderer, or on the splat bins if it would be
+// smaller than a pixel on screen. The camera is never rotated, so the screen
+// position is a scale and a shift of the world position.
+void simulation_draw_particle(ParticleRenderer *renderer, SplatBins *bins,
+                              Camera2D camera, const Particle *particle,
+                              Color color) {
+  float x = particle->position.x;
+  float y = particle->position.y;
+  // Density changes keep the radius, so it is drawn rather than derived from
+  // the mass
+  float radius = particle->radius * camera.zoom;
+  if (radius >= 0.5f) {
+    particle_renderer_push(renderer, x, y, particle->radius, color);
+    return;
   }
+  splat_bins_add(bins, (x - camera.target.x) * camera.zoom + camera.offset.x,
+                 (y - camera.target.y) * camera.zoom + camera.offset.y, x, y,
+                 particle->mass, PI * radius * radius, color);
+}
+
+// Queue the tracers seen through the camera
+void simulation_draw_tracers(ParticleRenderer *renderer, SplatBins *bins,
+                             const SimulationSnapshot *snapshot,
+                             Camera2D camera, Vector2 top_left,
+                             Vector2 bottom_right) {
+  // Tracers have no mass, each one counts the same
+  float tracer_radius = TRACER_DRAW_RADIUS * camera.zoom;
+  float tracer_area = PI * tracer_radius * tracer_radius;
+  for (uint64_t i = 0; i < snapshot->tracer_count; i++) {
+    Vec2 t = snapshot->tracers[i];
+    if (t.x < top_left.x || t.x > bottom_right.x || t.y < top_left.y ||
+        t.y > bottom_right.y) {
+      continue;
+    }
+    if (tracer_radius >= 0.5f) {
+      particle_renderer_push(renderer, t.x, t.y, TRACER_DRAW_RADIUS,
+                             TRACER_COLOR);
+      continue;
+    }
+    float screen_x = (t.x - camera.target.x) * camera.zoom + camera.offset.x;
+    float screen_y = (t.y - camera.target.y) * camera.zoom + camera.offset.y;
+    splat_bins_add(bins, screen_x, screen_y, t.x, t.y, 1, tracer_area,
+                   TRACER_COLOR);
+  }
+}
+
+// Whether a particle does not move and is drawn into the still layer
+bool particle_is_still(const Particle *particle) {
+  return particle->is_static || particle->is_sleeping;
+}
+
+// Whether any of a particle's disk lies inside the view from min to max
+bool particle_in_view(const Particle *particle, Vector2 min, Vector2 max) {
+  return particle->position.x + particle->radius >= min.x &&
+         particle->position.x - particle->radius <= max.x &&
+         particle->position.y + particle->radius >= min.y &&
+         particle->position.y - particle->radius <= max.y;
+}
+
+// Queue a particle seen through the camera in its colour, unless it is off
+// screen or belongs to the other layer
+void simulation_draw_visible(ParticleRenderer *renderer, SplatBins *bins,
+                             const SimulationSnapshot *snapshot,
+                             const Bitset *selection, Camera2D camera,
+                             bool still, uint64_t index, Vector2 min,
+                             Vector2 max) {
+  const Particle *p = &snapshot->particles[index];
+  if (particle_is_still(p) != still || !particle_in_view(p, min, max)) {
+    return;
+  }
+  Color color = p->is_static ? STATIC_PARTICLE_COLOR : WHITE;
+  // Selected still particles are drawn again on top of the still layer, so
+  // the layer does not depend on the selection
+  if (!still && index < selection->count && bitset_test(selection, index)) {
+    color = SELECTED_PARTICLE_COLOR;
+  }
+  simulation_draw_particle(renderer, bins, camera, p, color);
+}
+
+// Draw either the still particles or the moving particles and tracers on
+// screen. Only the grid cells overlapping the view are visited, so the cost
+// follows what is visible rather than the particle count, and everything
+// smaller than a pixel is merged into at most one splat per bin.
+void simulation_draw(ParticleRenderer *renderer, SplatBins *bins,
+                     const SimulationSnapshot *snapshot,
+                     const Bitset *selection, Camera2D camera, bool still) {
+  Vector2 top_left = GetScreenToWorld2D((Vector2){0, 0}, camera);
+  Vector2 bottom_right = GetScreenToWorld2D(
+      (Vector2){GetScreenWidth(), GetScreenHeight()}, camera);
+  const SpatialGrid *grid = &snapshot->grid;
+
+  for (uint64_t o = 0; o < grid->oversized_count; o++) {
+    simulation_draw_visible(renderer, bins, snapshot, selection, camera, still,
+                            grid->oversized[o], top_left, bottom_right);
+  }
+
+  // Particles in the cells reach at most max_radius past their centre, so
+  // only the cells that close to the view are visited
+  if (grid->particle_count > grid->oversized_count) {
+    Vec2 min = {top_left.x - grid->max_radius, top_left.y - grid->max_radius};
+    Vec2 max = {bottom_right.x + grid->max_radius,
+                bottom_right.y + grid->max_radius};
+    SpatialGridRange range = spatial_grid_range(grid, min, max);
+    for (uint32_t row = range.min_row; row <= range.max_row; row++) {
+      uint64_t first = (uint64_t)row * grid->columns + range.min_column;
+      uint64_t last = (uint64_t)row * grid->columns + range.max_column;
+      for (uint64_t c = grid->cell_start[first]; c < grid->cell_start[last + 1];
+           c++) {
+        simulation_draw_visible(renderer, bins, snapshot, selection, camera,
+                                still, grid->cell_particles[c], top_left,
+                                bottom_right);
+      }
+    }
+  }
+
+  if (!still) {
+    uint64_t limit = selection->count < snapshot->particle_count
+                         ? selection->count
+                         : snapshot->particle_count;
+    for (uint64_t i = bitset_next(selection, 0); i < limit;
+         i = bitset_next(selection, i + 1)) {
+      const Particle *p = &snapshot->particles[i];
+      if (particle_is_still(p) && particle_in_view(p, top_left, bottom_right)) {
+        simulation_draw_particle(renderer, bins, camera, p,
+                                 SELECTED_PARTICLE_COLOR);
+      }
+    }
+  }
+  splat_bins_flush(bins, renderer, camera);
+
+  // Tracers never stop moving
+  if (!still) {
+    simulation_draw_tracers(renderer, bins, snapshot, camera, top_left,
+                            bottom_right);
+    splat_bins_flush(bins, renderer, camera);
+  }
+
+  particle_renderer_flush(renderer);
+}
+
+// Draw every trail as a line strip fading towards its oldest sample, all in
+// one batch of lines
+void simulation_draw_trails(const TrailSet *trails) {
+  if (trails->count == 0 || trails->length < 2) {
+    return;
+  }
+
+  Color color = TRAIL_COLOR;
+  rlBegin(RL_LINES);
+  for (uint64_t t = 0; t < trails->count; t++) {
+    const float *x = &trails->x[t * trails->length];
+    const float *y = &trails->y[t * trails->length];
+    // The head slot holds the oldest sample
+    uint32_t from = trails->head;
+    for (uint32_t k = 1; k < trails->length; k++) {
+      uint32_t to = (trails->head + k) % trails->length;
+      rlColor4ub(color.r, color.g, color.b,
+                 (unsigned char)(color.a * (k - 1) / (trails->length - 1)));
+      rlVertex2f(x[from], y[from]);
+      rlColor4ub(color.r, color.g, color.b,
+                 (unsigned char)(color.a * k / (trails->length - 1)));
+      rlVertex2f(x[to], y[to]);
+      from = to;
+    }
+  }
+  rlEnd();
+}
+
+// Draw the snapshot as a density heat map covering the screen, rendered on
+// the CPU and uploaded as one texture
+void simulation_draw_density(DensityMap *map, Texture2D *texture,
+                             const SimulationSnapshot *snapshot,
+                             Camera2D camera, RenderMode mode) {
+  int width = GetScreenWidth();
+  int height = GetScreenHeight();
+  density_map_resize(map, width, height);
+  DensityWeight weight = mode == RENDER_MODE_DENSITY_MASS
+                             ? DENSITY_WEIGHT_MASS
+                             : DENSITY_WEIGHT_COUNT;
+  density_map_render(map, camera, snapshot->particles,
+                     snapshot->particle_count, snapshot->tracers,
+                     snapshot->tracer_count, weight);
+
+  if (texture->width != width || texture->height != height) {
+    if (texture->id != 0) {
+      UnloadTexture(*texture);
+    }
+    *texture = LoadTextureFromImage(density_map_image(map));
+  } else {
+    UpdateTexture(*texture, map->pixels);
+  }
+  DrawTexture(*texture, 0, 0, WHITE);
+}
+
+// Draw the mass, radius and speed of a particle next to the cursor
+void simulation_draw_tooltip(const Particle *particle,
+                             Vector2 screen_position) {
+  const char *text = TextFormat(
+      "mass %.2f\nradius %.2f\nspeed %.2f%s", particle->mass, particle->radius,
+      vec2_len(particle->velocity), particle->is_static ? "\npinned" : "");
+  DrawText(text, screen_position.x + TOOLTIP_OFFSET,
+           screen_position.y + TOOLTIP_OFFSET, TOOLTIP_FONT_SIZE, WHITE);
 }
@@ -0,0 +1,116 @@
+#include "bitset.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The word loops below have no dependencies between iterations, so the
+// compiler vectorizes them and turns the popcount into vector popcount or
+// the pshufb nibble lookup where the target has them.
+
+// Clear the bits past count in the last word
+static void bitset_trim(Bitset *set) {
+    uint64_t tail = set->count % BITSET_WORD_BITS;
+    if (tail != 0) {
+        set->words[set->count / BITSET_WORD_BITS] &= (1ull << tail) - 1;
+    }
+}
+
+void bitset_resize(Bitset *set, uint64_t count) {
+    uint64_t old_words = bitset_word_count(set->count);
+    uint64_t new_words = bitset_word_count(count);
+
+    if (new_words > set->word_capacity) {
+        uint64_t capacity = set->word_capacity ? set->word_capacity : 16;
+        while (capacity < new_words) {
+            capacity *= 2;
+        }
+        set->words = realloc(set->words, sizeof(uint64_t) * capacity);
+        assert(set->words);
+        set->word_capacity = capacity;
+    }
+    if (new_words > old_words) {
+        memset(set->words + old_words, 0,
+               sizeof(uint64_t) * (new_words - old_words));
+    }
+
+    set->count = count;
+    bitset_trim(set);
+}
+
+void bitset_deinit(Bitset *set) {
+    free(set->words);
+    *set = (Bitset){0};
+}
+
+void bitset_clear_all(Bitset *set) {
+    if (set->count > 0) {
+        memset(set->words, 0, sizeof(uint64_t) * bitset_word_count(set->count));
+    }
+}
+
+void bitset_set_all(Bitset *set) {
+    if (set->count > 0) {
+        memset(set->words, 0xff,
+               sizeof(uint64_t) * bitset_word_count(set->count));
+        bitset_trim(set);
+    }
+}
+
+void bitset_set_indices(Bitset *set, const uint64_t *indices, uint64_t count) {
+    for (uint64_t i = 0; i < count; i++) {
+        assert(indices[i] < set->count);
+        bitset_set(set, indices[i]);
+    }
+}
+
+uint64_t bitset_popcount(const Bitset *set) {
+    uint64_t words = bitset_word_count(set->count);
+    uint64_t total = 0;
+    for (uint64_t w = 0; w < words; w++) {
+        total += (uint64_t)__builtin_popcountll(set->words[w]);
+    }
+    return total;
+}
+
+uint64_t bitset_next(const Bitset *set, uint64_t index) {
+    if (index >= set->count) {
+        return set->count;
+    }
+
+    // Skip whole words of clear bits
+    uint64_t w = index / BITSET_WORD_BITS;
+    uint64_t word = set->words[w] & (~0ull << (index % BITSET_WORD_BITS));
+    uint64_t words = bitset_word_count(set->count);
+    while (word == 0) {
+        if (++w == words) {
+            return set->count;
+        }
+        word = set->words[w];
+    }
+    return w * BITSET_WORD_BITS + (uint64_t)__builtin_ctzll(word);
+}
+
+void bitset_union(Bitset *set, const Bitset *other) {
+    assert(set->count == other->count);
+    uint64_t words = bitset_word_count(set->count);
+    for (uint64_t w = 0; w < words; w++) {
+        set->words[w] |= other->words[w];
+    }
+}
+
+void bitset_intersect(Bitset *set, const Bitset *other) {
+    assert(set->count == other->count);
+    uint64_t words = bitset_word_count(set->count);
+    for (uint64_t w = 0; w < words; w++) {
+        set->words[w] &= other->words[w];
+    }
+}
+
+void bitset_subtract(Bitset *set, const Bitset *other) {
+    assert(set->count == other->count);
+    uint64_t words = bitset_word_count(set->count);
+    for (uint64_t w = 0; w < words; w++) {
+        set->words[w] &= ~other->words[w];
+    }
+}
@@ -0,0 +1,16 @@
+#include "vector_batch.h"
+
+#include "vector.h"
+
+#include <stddef.h>
+
+// Treats the interleaved components as one flat array, which vectorizes
+// without any shuffling
+void vec2_array_add_scaled(Vec2 *out, const Vec2 *a, VECTOR_T s,
+                           size_t count) {
+    VECTOR_T *o = (VECTOR_T *)out;
+    const VECTOR_T *fa = (const VECTOR_T *)a;
+    for (size_t i = 0; i < 2 * count; i++) {
+        o[i] += fa[i] * s;
+    }
+}
@@ -0,0 +1,197 @@
+#include "ccd.h"
+
+#include "arena_allocator.h"
+#include "collision.h"
+#include "simulation.h"
+#include "spatial_grid.h"
+#include "vector.h"
+
+#include <assert.h>
+#include <math.h>
+
+// Earliest predicted impact of a swept particle
+typedef struct {
+  double time;
+  uint64_t partner;
+} CCDEvent;
+
+// Where every particle has got to within the step. No particle moves further
+// than max_speed times the time step from its start, the collision grid is
+// sorted by the starts.
+typedef struct {
+  double *times;
+  Vec2 *starts;
+  double max_speed;
+} CCDState;
+
+// Position of a particle at the given time within the step
+static Vec2 ccd_position_at(const Particle *p, double particle_time,
+                            double time) {
+  return vec2_add(p->position, vec2_scale(p->velocity, time - particle_time));
+}
+
+// Keep the impact of particle i with particle j if it is the earliest so far
+static void ccd_predict_pair(const Simulation *simulation,
+                             const CCDState *state, uint64_t i, uint64_t j,
+                             double time_step, CCDEvent *event) {
+  if (j == i) {
+    return;
+  }
+  const Particle *p1 = &simulation->particles[i];
+  const Particle *p2 = &simulation->particles[j];
+  const double *times = state->times;
+
+  // Both trajectories are only known from the later of the two times on
+  double start = fmax(times[i], times[j]);
+  Vec2 relative_position = vec2_sub(ccd_position_at(p1, times[i], start),
+                                    ccd_position_at(p2, times[j], start));
+  Vec2 relative_velocity = vec2_sub(p1->velocity, p2->velocity);
+
+  double time =
+      collision_time_of_impact(relative_position, relative_velocity,
+                               p1->radius + p2->radius, time_step - start);
+  if (time >= 0 && start + time < event->time) {
+    event->time = start + time;
+    event->partner = j;
+  }
+}
+
+// Find the earliest impact of particle i against every particle it can reach
+// within the step
+static CCDEvent ccd_predict(const Simulation *simulation,
+                            const CCDState *state, uint64_t i,
+                            double time_step) {
+  const Particle *p = &simulation->particles[i];
+  const SpatialGrid *grid = &simulation->collision_grid;
+  CCDEvent event = {.time = INFINITY, .partner = i};
+
+  // Both particles of a pair travel at most max_speed from their starts
+  double reach =
+      p->radius + grid->max_radius + 2 * state->max_speed * time_step;
+  Vec2 start = state->starts[i];
+  SpatialGridRange range =
+      spatial_grid_range(grid, (Vec2){start.x - reach, start.y - reach},
+                         (Vec2){start.x + reach, start.y + reach});
+  for (uint32_t row = range.min_row; row <= range.max_row; row++) {
+    for (uint32_t column = range.min_column; column <= range.max_column;
+         column++) {
+      uint64_t cell = (uint64_t)row * grid->columns + column;
+      for (uint64_t k = grid->cell_start[cell]; k < grid->cell_start[cell + 1];
+           k++) {
+        ccd_predict_pair(simulation, state, i, grid->cell_particles[k],
+                         time_step, &event);
+      }
+    }
+  }
+  for (uint64_t k = 0; k < grid->oversized_count; k++) {
+    ccd_predict_pair(simulation, state, i, grid->oversized[k], time_step,
+                     &event);
+  }
+  return event;
+}
+
+// Move every awake particle for one time step, sub-stepping fast pairs at
+// their times of impact
+void ccd_advance(Simulation *simulation, ArenaAllocator *allocator, bool *woken,
+                 double time_step) {
+  uint64_t count = simulation->particle_count;
+
+  // Time within the step each particle's position has been advanced to
+  CCDState state = {
+      .times = arena_alloc(allocator, sizeof(double) * count),
+      .starts = arena_alloc(allocator, sizeof(Vec2) * count),
+  };
+  double *times = state.times;
+  bool *swept = arena_alloc(allocator, sizeof(bool) * count);
+  CCDEvent *events = arena_alloc(allocator, sizeof(CCDEvent) * count);
+  assert(count == 0 || (times && state.starts && swept && events));
+
+  // Only particles that move far relative to their size are swept
+  uint64_t swept_count = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    Particle *p = &simulation->particles[i];
+    double speed = vec2_len(p->velocity);
+    double travel = speed * time_step;
+    times[i] = 0;
+    state.starts[i] = p->position;
+    if (!p->is_sleeping && !p->is_static && speed > state.max_speed) {
+      state.max_speed = speed;
+    }
+    swept[i] = simulation->ccd_max_events > 0 && !p->is_sleeping &&
+               !p->is_static &&
+               travel > simulation->ccd_fast_ratio * p->radius;
+    swept_count += swept[i];
+  }
+
+  if (swept_count > 0) {
+    spatial_grid_build(&simulation->collision_grid, simulation->particles,
+                       count);
+    for (uint64_t i = 0; i < count; i++) {
+      if (swept[i]) {
+        events[i] = ccd_predict(simulation, &state, i, time_step);
+      }
+    }
+  }
+
+  // Process impacts in time order until none remain in this step
+  for (uint32_t processed = 0;
+       swept_count > 0 && processed < simulation->ccd_max_events;
+       processed++) {
+    uint64_t first = count;
+    for (uint64_t i = 0; i < count; i++) {
+      if (swept[i] && events[i].time < INFINITY &&
+          (first == count || events[i].time < events[first].time)) {
+        first = i;
+      }
+    }
+    if (first == count) {
+      break;
+    }
+
+    uint64_t partner = events[first].partner;
+    double time = events[first].time;
+    Particle *p1 = &simulation->particles[first];
+    Particle *p2 = &simulation->particles[partner];
+
+    // Advance both particles to the moment they touch
+    p1->position = ccd_position_at(p1, times[first], time);
+    p2->position = ccd_position_at(p2, times[partner], time);
+    times[first] = time;
+    times[partner] = time;
+
+    if (p2->is_sleeping && !p2->is_static) {
+      p2->is_sleeping = false;
+      woken[partner] = true;
+      simulation->still_version++;
+    }
+
+    Vec2 normal = vec2_norm(vec2_sub(p1->position, p2->position));
+    collision_apply_impulse(p1, p2, collision_inverse_mass(p1),
+                            collision_inverse_mass(p2), normal);
+    state.max_speed = fmax(state.max_speed, vec2_len(p1->velocity));
+    state.max_speed = fmax(state.max_speed, vec2_len(p2->velocity));
+
+    // The pair now moves on new trajectories, so both are swept from here and
+    // every prediction involving either of them is stale. A static partner
+    // does not move and needs no prediction of its own.
+    if (!p2->is_static) {
+      swept_count += !swept[partner];
+      swept[partner] = true;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+      if (swept[i] && (i == first || i == partner ||
+                       events[i].partner == first ||
+                       events[i].partner == partner)) {
+        events[i] = ccd_predict(simulation, &state, i, time_step);
+      }
+    }
+  }
+
+  // Move every awake particle through the rest of the step
+  for (uint64_t i = 0; i < count; i++) {
+    Particle *p = &simulation->particles[i];
+    if (!p->is_sleeping && !p->is_static) {
+      p->position = ccd_position_at(p, times[i], time_step);
+    }
+  }
+}
@@ -0,0 +1,54 @@
+#include "collision.h"
+
+#include "simulation.h"
+#include "vector.h"
+
+#include <math.h>
+
+// Inverse mass of a particle, zero for static particles which never move
+double collision_inverse_mass(const Particle *particle) {
+  return particle->is_static ? 0 : 1.0 / particle->mass;
+}
+
+// Apply the collision impulse between two touching particles
+bool collision_apply_impulse(Particle *p1, Particle *p2, double inverse_mass_p1,
+                             double inverse_mass_p2, Vec2 normal) {
+  Vec2 relative_velocity = vec2_sub(p1->velocity, p2->velocity);
+  double normal_velocity = vec2_dot(relative_velocity, normal);
+  if (normal_velocity > 0) {
+    return false;
+  }
+
+  double total_inverse_mass = inverse_mass_p1 + inverse_mass_p2;
+  double impulse_scalar =
+      -(1 + COLLISION_RESTITUTION) * normal_velocity / total_inverse_mass;
+  Vec2 impulse = vec2_scale(normal, impulse_scalar);
+
+  p1->velocity = vec2_add(p1->velocity, vec2_scale(impulse, inverse_mass_p1));
+  p2->velocity = vec2_sub(p2->velocity, vec2_scale(impulse, inverse_mass_p2));
+  return true;
+}
+
+// Earliest time at which two linearly moving circles start touching
+double collision_time_of_impact(Vec2 relative_position, Vec2 relative_velocity,
+                                double radius_sum, double max_time) {
+  // Solve |d + w t| = r for the smaller root of a t^2 + 2 b t + c = 0
+  double a = vec2_dot(relative_velocity, relative_velocity);
+  double b = vec2_dot(relative_position, relative_velocity);
+  double c = vec2_dot(relative_position, relative_position) -
+             radius_sum * radius_sum;
+
+  // Already overlapping, or not approaching each other
+  if (c <= 0 || b >= 0) {
+    return -1;
+  }
+
+  double discriminant = b * b - a * c;
+  if (discriminant < 0) {
+    return -1;
+  }
+
+  // Equivalent to (-b - sqrt(disc)) / a without the cancellation
+  double time = c / (-b + sqrt(discriminant));
+  return time <= max_time ? time : -1;
+}
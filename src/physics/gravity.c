@@ -0,0 +1,296 @@
+#include "gravity.h"
+
+#include "arena_allocator.h"
+#include "simulation.h"
+#include "static_field.h"
+#include "vector.h"
+#include "vector_batch.h"
+
+#include <assert.h>
+#include <math.h>
+
+// Define the force loop for one softening kernel between the particles of
+// two index lists, or among the particles of one list when both are the same.
+// Every kernel gets its own copy of the loop so that the kernel is inlined
+// and no pair pays for choosing it.
+#define DEFINE_GRAVITY_ACCUMULATE(name, kernel)                                \
+  static void gravity_accumulate_##name(                                       \
+      const Simulation *simulation, const uint64_t *indices, uint64_t count,   \
+      const uint64_t *partners, uint64_t partner_count,                        \
+      Vec2Acc *accelerations, SofteningParameters params) {                    \
+    const Particle *particles = simulation->particles;                         \
+    VECTOR_T g = (VECTOR_T)simulation->gravitational_constant;                 \
+                                                                               \
+    for (uint64_t a = 0; a < count; a++) {                                     \
+      uint64_t i = indices[a];                                                 \
+      const Particle *p1 = &particles[i];                                      \
+      VECTOR_T mass_p1 = (VECTOR_T)p1->mass;                                   \
+      Vec2x4 origin = vec2x4_splat(p1->position);                              \
+      Vec2Acc acceleration_p1 = accelerations[i];                              \
+                                                                               \
+      /* Partners are processed four at a time in SIMD lanes */                \
+      uint64_t b = partners == indices ? a + 1 : 0;                            \
+      for (; b + 4 <= partner_count; b += 4) {                                 \
+        Vec2x4 positions;                                                      \
+        VECTOR_T masses[4];                                                    \
+        for (int l = 0; l < 4; l++) {                                          \
+          const Particle *p2 = &particles[partners[b + l]];                    \
+          positions.x[l] = p2->position.x;                                     \
+          positions.y[l] = p2->position.y;                                     \
+          masses[l] = (VECTOR_T)p2->mass;                                      \
+        }                                                                      \
+                                                                               \
+        /* Direction from p1 to each partner, scaled by G f */                 \
+        Vec2x4 direction = vec2x4_sub(positions, origin);                      \
+        VECTOR_T scale[4];                                                     \
+        vec2x4_dist_squared(scale, positions, origin);                         \
+        for (int l = 0; l < 4; l++) {                                          \
+          scale[l] = g * kernel(scale[l], params);                             \
+        }                                                                      \
+                                                                               \
+        for (int l = 0; l < 4; l++) {                                          \
+          Vec2Acc *acceleration_p2 = &accelerations[partners[b + l]];          \
+          Vec2 pull = {direction.x[l] * scale[l], direction.y[l] * scale[l]};  \
+          acceleration_p1 =                                                    \
+              vec2_acc_add(acceleration_p1, vec2_scale(pull, masses[l]));      \
+          *acceleration_p2 =                                                   \
+              vec2_acc_sub(*acceleration_p2, vec2_scale(pull, mass_p1));       \
+        }                                                                      \
+      }                                                                        \
+                                                                               \
+      for (; b < partner_count; b++) {                                         \
+        uint64_t j = partners[b];                                              \
+        const Particle *p2 = &particles[j];                                    \
+        Vec2 direction = vec2_sub(p2->position, p1->position);                 \
+        Vec2 pull = vec2_scale(                                                \
+            direction, g * kernel(vec2_dot(direction, direction), params));    \
+        acceleration_p1 = vec2_acc_add(acceleration_p1,                        \
+                                       vec2_scale(pull, (VECTOR_T)p2->mass));  \
+        accelerations[j] =                                                     \
+            vec2_acc_sub(accelerations[j], vec2_scale(pull, mass_p1));         \
+      }                                                                        \
+                                                                               \
+      accelerations[i] = acceleration_p1;                                      \
+    }                                                                          \
+  }
+
+DEFINE_GRAVITY_ACCUMULATE(none, softening_none_v)
+DEFINE_GRAVITY_ACCUMULATE(plummer, softening_plummer_v)
+DEFINE_GRAVITY_ACCUMULATE(spline, softening_spline_v)
+
+// Define the tracer force loop for one softening kernel. Tracers fill the SIMD
+// lanes and each particle is broadcast across them, so every lane does the
+// same work and no lane writes to another's result.
+#define DEFINE_TRACER_ACCUMULATE(name, kernel)                                 \
+  static void gravity_accumulate_tracers_##name(                               \
+      const Simulation *simulation, const uint64_t *indices,                   \
+      uint64_t source_count, Vec2 *accelerations,                              \
+      SofteningParameters params) {                                            \
+    uint64_t count = simulation->tracers.count;                                \
+    const Vec2 *tracers = simulation->tracers.positions;                       \
+    const Particle *particles = simulation->particles;                         \
+    VECTOR_T g = (VECTOR_T)simulation->gravitational_constant;                 \
+                                                                               \
+    uint64_t t = 0;                                                            \
+    for (; t + 4 <= count; t += 4) {                                           \
+      Vec2x4 positions = vec2x4_load(&tracers[t]);                             \
+      double sum_x[4] = {0}, sum_y[4] = {0};                                   \
+      for (uint64_t b = 0; b < source_count; b++) {                            \
+        const Particle *p = &particles[indices[b]];                            \
+        Vec2x4 source = vec2x4_splat(p->position);                             \
+        Vec2x4 direction = vec2x4_sub(source, positions);                      \
+        VECTOR_T scale[4];                                                     \
+        vec2x4_dist_squared(scale, source, positions);                         \
+        VECTOR_T pull = g * (VECTOR_T)p->mass;                                 \
+        for (int l = 0; l < 4; l++) {                                          \
+          scale[l] = pull * kernel(scale[l], params);                          \
+          sum_x[l] += direction.x[l] * scale[l];                               \
+          sum_y[l] += direction.y[l] * scale[l];                               \
+        }                                                                      \
+      }                                                                        \
+      for (int l = 0; l < 4; l++) {                                            \
+        accelerations[t + l] = (Vec2){sum_x[l], sum_y[l]};                     \
+      }                                                                        \
+    }                                                                          \
+                                                                               \
+    for (; t < count; t++) {                                                   \
+      Vec2Acc sum = vec2_acc_zero();                                           \
+      for (uint64_t b = 0; b < source_count; b++) {                            \
+        const Particle *p = &particles[indices[b]];                            \
+        Vec2 direction = vec2_sub(p->position, tracers[t]);                    \
+        VECTOR_T scale = g * (VECTOR_T)p->mass *                               \
+                         kernel(vec2_dot(direction, direction), params);       \
+        sum = vec2_acc_add(sum, vec2_scale(direction, scale));                 \
+      }                                                                        \
+      accelerations[t] = vec2_from_acc(sum);                                   \
+    }                                                                          \
+  }
+
+DEFINE_TRACER_ACCUMULATE(none, softening_none_v)
+DEFINE_TRACER_ACCUMULATE(plummer, softening_plummer_v)
+DEFINE_TRACER_ACCUMULATE(spline, softening_spline_v)
+
+// Softening kernel in effect for the simulation
+static SofteningKernel gravity_kernel(const Simulation *simulation) {
+  if (simulation->softening_length <= 0) {
+    return SOFTENING_NONE;
+  }
+  return simulation->softening_kernel;
+}
+
+// Kernel constants for the simulation's current softening length
+SofteningParameters gravity_softening_parameters(const Simulation *simulation) {
+  double epsilon = simulation->softening_length;
+  double h = GRAVITY_SPLINE_SUPPORT * epsilon;
+  return (SofteningParameters){
+      .epsilon_squared = epsilon * epsilon,
+      .spline_length = h,
+      .inverse_spline_length = h > 0 ? 1 / h : 0,
+      .inverse_spline_length_cubed = h > 0 ? 1 / (h * h * h) : 0,
+  };
+}
+
+// Indices of the particles taking part in pairwise gravity
+uint64_t gravity_dynamic_indices(const Simulation *simulation,
+                                 ArenaAllocator *allocator,
+                                 uint64_t **indices) {
+  *indices =
+      arena_alloc(allocator, sizeof(uint64_t) * simulation->particle_count);
+  assert(simulation->particle_count == 0 || *indices);
+
+  uint64_t count = 0;
+  for (uint64_t i = 0; i < simulation->particle_count; i++) {
+    if (!simulation->particles[i].is_static) {
+      (*indices)[count++] = i;
+    }
+  }
+  return count;
+}
+
+// Accumulate the pair accelerations between two sets of particles
+void gravity_accumulate_pairs(const Simulation *simulation,
+                              const uint64_t *indices, uint64_t count,
+                              const uint64_t *partners, uint64_t partner_count,
+                              Vec2Acc *accelerations) {
+  SofteningParameters params = gravity_softening_parameters(simulation);
+  switch (gravity_kernel(simulation)) {
+  case SOFTENING_NONE:
+    gravity_accumulate_none(simulation, indices, count, partners,
+                            partner_count, accelerations, params);
+    break;
+  case SOFTENING_PLUMMER:
+    gravity_accumulate_plummer(simulation, indices, count, partners,
+                               partner_count, accelerations, params);
+    break;
+  case SOFTENING_SPLINE:
+    gravity_accumulate_spline(simulation, indices, count, partners,
+                              partner_count, accelerations, params);
+    break;
+  }
+}
+
+// Accumulate the acceleration caused by the static particles
+void gravity_accumulate_static(const Simulation *simulation,
+                               const uint64_t *indices, uint64_t count,
+                               Vec2Acc *accelerations) {
+  // A single lookup stands in for every static particle
+  if (simulation->static_field.source_count == 0) {
+    return;
+  }
+  for (uint64_t a = 0; a < count; a++) {
+    uint64_t i = indices[a];
+    Vec2Acc field =
+        static_field_sample(simulation, simulation->particles[i].position);
+    accelerations[i].x += field.x;
+    accelerations[i].y += field.y;
+  }
+}
+
+// Accumulate the gravitational acceleration of the indexed particles
+void gravity_accumulate(const Simulation *simulation, const uint64_t *indices,
+                        uint64_t count, Vec2Acc *accelerations) {
+  // Initialize accelerations to zero
+  for (uint64_t i = 0; i < simulation->particle_count; i++) {
+    accelerations[i] = vec2_acc_zero();
+  }
+
+  gravity_accumulate_pairs(simulation, indices, count, indices, count,
+                           accelerations);
+  gravity_accumulate_static(simulation, indices, count, accelerations);
+}
+
+// Gravitational acceleration of every tracer, caused by the particles only
+void gravity_accumulate_tracers(const Simulation *simulation,
+                                const uint64_t *indices, uint64_t count,
+                                Vec2 *accelerations) {
+  SofteningParameters params = gravity_softening_parameters(simulation);
+  switch (gravity_kernel(simulation)) {
+  case SOFTENING_NONE:
+    gravity_accumulate_tracers_none(simulation, indices, count, accelerations,
+                                    params);
+    break;
+  case SOFTENING_PLUMMER:
+    gravity_accumulate_tracers_plummer(simulation, indices, count,
+                                       accelerations, params);
+    break;
+  case SOFTENING_SPLINE:
+    gravity_accumulate_tracers_spline(simulation, indices, count,
+                                      accelerations, params);
+    break;
+  }
+
+  if (simulation->static_field.source_count > 0) {
+    const TracerSet *tracers = &simulation->tracers;
+    for (uint64_t t = 0; t < tracers->count; t++) {
+      Vec2Acc field = static_field_sample(simulation, tracers->positions[t]);
+      accelerations[t] = vec2_add(accelerations[t], vec2_from_acc(field));
+    }
+  }
+}
+
+// Softened acceleration factor in double precision
+double gravity_softened_factor_f64(SofteningKernel kernel, double r2,
+                                   SofteningParameters params) {
+  if (params.spline_length <= 0) {
+    kernel = SOFTENING_NONE;
+  }
+  switch (kernel) {
+  case SOFTENING_PLUMMER:
+    return softening_plummer_f64(r2, params);
+  case SOFTENING_SPLINE:
+    return softening_spline_f64(r2, params);
+  default:
+    return softening_none_f64(r2, params);
+  }
+}
+
+// Softened potential of a unit mass pair at squared separation r2
+double gravity_softened_potential_f64(SofteningKernel kernel, double r2,
+                                      SofteningParameters params) {
+  double r = sqrt(r2);
+  if (params.spline_length <= 0) {
+    kernel = SOFTENING_NONE;
+  }
+
+  switch (kernel) {
+  case SOFTENING_PLUMMER:
+    return -1 / sqrt(r2 + params.epsilon_squared);
+  case SOFTENING_SPLINE: {
+    if (r >= params.spline_length) {
+      return -1 / r;
+    }
+    double u = r * params.inverse_spline_length;
+    double w;
+    if (u < 0.5) {
+      w = -2.8 + u * u * (5.333333333333 + u * u * (6.4 * u - 9.6));
+    } else {
+      w = -3.2 + 0.066666666667 / u +
+          u * u *
+              (10.666666666667 + u * (-16.0 + u * (9.6 - 2.133333333333 * u)));
+    }
+    return w * params.inverse_spline_length;
+  }
+  default:
+    return -1 / r;
+  }
+}
@@ -0,0 +1,158 @@
+#include "islands.h"
+
+#include "arena_allocator.h"
+#include "simulation.h"
+#include "vector.h"
+
+#include <assert.h>
+
+// Create an island set where every particle is its own island
+IslandSet islands_init(ArenaAllocator *allocator, uint64_t count) {
+  IslandSet islands = {
+      .parent = arena_alloc(allocator, sizeof(uint64_t) * count),
+      .size = arena_alloc(allocator, sizeof(uint64_t) * count),
+      .anchored = arena_alloc(allocator, sizeof(bool) * count),
+      .count = count,
+  };
+  assert(count == 0 || (islands.parent && islands.size && islands.anchored));
+
+  for (uint64_t i = 0; i < count; i++) {
+    islands.parent[i] = i;
+    islands.size[i] = 1;
+    islands.anchored[i] = false;
+  }
+  return islands;
+}
+
+// Find the root particle of the island containing index
+uint64_t islands_find(IslandSet *islands, uint64_t index) {
+  while (islands->parent[index] != index) {
+    // Path halving keeps the trees flat without recursion
+    islands->parent[index] = islands->parent[islands->parent[index]];
+    index = islands->parent[index];
+  }
+  return index;
+}
+
+// Merge the islands containing a and b
+void islands_union(IslandSet *islands, uint64_t a, uint64_t b) {
+  uint64_t root_a = islands_find(islands, a);
+  uint64_t root_b = islands_find(islands, b);
+  if (root_a == root_b) {
+    return;
+  }
+
+  // Attach the smaller tree below the larger one
+  if (islands->size[root_a] < islands->size[root_b]) {
+    uint64_t swap = root_a;
+    root_a = root_b;
+    root_b = swap;
+  }
+  islands->parent[root_b] = root_a;
+  islands->size[root_a] += islands->size[root_b];
+  islands->anchored[root_a] = islands->anchored[root_a] ||
+                              islands->anchored[root_b];
+}
+
+// Mark the island containing index as resting on a static particle
+void islands_anchor(IslandSet *islands, uint64_t index) {
+  islands->anchored[islands_find(islands, index)] = true;
+}
+
+// Check whether a sleeping particle's acceleration has changed enough since it
+// fell asleep that it has to wake up
+bool islands_force_changed(const Simulation *simulation,
+                           const Particle *particle, Vec2 acceleration,
+                           double time_step) {
+  // The change is significant once the velocity it adds in a single step
+  // carries more energy than a calm island may have
+  Vec2 delta = vec2_sub(acceleration, particle->sleep_acceleration);
+  double delta_velocity_squared =
+      vec2_dot(delta, delta) * time_step * time_step;
+  return 0.5 * delta_velocity_squared > simulation->sleep_energy_threshold;
+}
+
+// Wake every island containing a woken particle, count calm steps for the rest
+// and put islands that have been calm for long enough to sleep
+void islands_update_sleep(Simulation *simulation, IslandSet *islands,
+                          ArenaAllocator *allocator,
+                          const Vec2Acc *accelerations, const bool *woken) {
+  uint64_t count = simulation->particle_count;
+  if (count == 0 || simulation->sleep_step_count == 0) {
+    return;
+  }
+
+  uint64_t *roots = arena_alloc(allocator, sizeof(uint64_t) * count);
+  double *energy = arena_alloc(allocator, sizeof(double) * count);
+  double *mass = arena_alloc(allocator, sizeof(double) * count);
+  bool *disturbed = arena_alloc(allocator, sizeof(bool) * count);
+  uint32_t *min_calm_steps = arena_alloc(allocator, sizeof(uint32_t) * count);
+  assert(roots && energy && mass && disturbed && min_calm_steps);
+
+  for (uint64_t i = 0; i < count; i++) {
+    roots[i] = islands_find(islands, i);
+    energy[i] = 0;
+    mass[i] = 0;
+    disturbed[i] = false;
+    min_calm_steps[i] = UINT32_MAX;
+  }
+
+  // Accumulate the kinetic energy and mass of every island
+  for (uint64_t i = 0; i < count; i++) {
+    Particle *p = &simulation->particles[i];
+    uint64_t root = roots[i];
+    if (p->is_static) {
+      continue;
+    }
+    energy[root] += 0.5 * p->mass * vec2_dot(p->velocity, p->velocity);
+    mass[root] += p->mass;
+    disturbed[root] = disturbed[root] || woken[i];
+  }
+
+  // Count calm steps. Only islands held together by contacts or resting on a
+  // static particle may sleep, a lone particle at rest is simply at the
+  // turning point of its trajectory.
+  for (uint64_t i = 0; i < count; i++) {
+    Particle *p = &simulation->particles[i];
+    uint64_t root = roots[i];
+    if (p->is_static) {
+      continue;
+    }
+
+    if (disturbed[root]) {
+      if (p->is_sleeping) {
+        p->is_sleeping = false;
+        simulation->still_version++;
+      }
+      p->calm_steps = 0;
+      continue;
+    }
+
+    bool calm = (islands->size[root] > 1 || islands->anchored[root]) &&
+                energy[root] < simulation->sleep_energy_threshold * mass[root];
+    if (!calm) {
+      p->calm_steps = 0;
+    } else if (p->calm_steps < UINT32_MAX) {
+      p->calm_steps++;
+    }
+
+    if (p->calm_steps < min_calm_steps[root]) {
+      min_calm_steps[root] = p->calm_steps;
+    }
+  }
+
+  // Put islands whose every member has been calm for long enough to sleep
+  for (uint64_t i = 0; i < count; i++) {
+    Particle *p = &simulation->particles[i];
+    uint64_t root = roots[i];
+    if (disturbed[root] || p->is_sleeping || p->is_static ||
+        min_calm_steps[root] < simulation->sleep_step_count) {
+      continue;
+    }
+
+    p->is_sleeping = true;
+    p->velocity = vec2_zero();
+    simulation->still_version++;
+    p->sleep_acceleration = vec2_from_acc(accelerations[i]);
+  }
+}
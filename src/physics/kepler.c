@@ -0,0 +1,114 @@
+#include "kepler.h"
+
+#include "vector.h"
+
+#include <math.h>
+
+// Below this |z| the Stumpff functions are summed as series
+#define KEPLER_SERIES_LIMIT 1.0
+#define KEPLER_SERIES_TERMS 12
+#define KEPLER_TWO_PI 6.28318530717958647692
+
+// Stumpff functions c0 to c3 of z
+static void kepler_stumpff(double z, double c[4]) {
+  if (z > KEPLER_SERIES_LIMIT) {
+    double root = sqrt(z);
+    c[0] = cos(root);
+    c[1] = sin(root) / root;
+  } else if (z < -KEPLER_SERIES_LIMIT) {
+    double root = sqrt(-z);
+    c[0] = cosh(root);
+    c[1] = sinh(root) / root;
+  } else {
+    // c2 and c3 lose all precision to cancellation near zero, so all four
+    // come from their series there
+    double term2 = 0.5;
+    double term3 = 1.0 / 6.0;
+    c[2] = 0;
+    c[3] = 0;
+    for (int k = 0; k < KEPLER_SERIES_TERMS; k++) {
+      c[2] += term2;
+      c[3] += term3;
+      term2 *= -z / ((2 * k + 3) * (2 * k + 4));
+      term3 *= -z / ((2 * k + 4) * (2 * k + 5));
+    }
+    c[1] = 1 - z * c[3];
+    c[0] = 1 - z * c[2];
+    return;
+  }
+  c[2] = (1 - c[0]) / z;
+  c[3] = (1 - c[1]) / z;
+}
+
+// Advance a body along its unperturbed two-body orbit around a fixed mass
+void kepler_drift(Vec2Acc *position, Vec2Acc *velocity, double mu,
+                  double time) {
+  double r0 = sqrt(position->x * position->x + position->y * position->y);
+  if (r0 == 0 || time == 0) {
+    return;
+  }
+  double v2 = velocity->x * velocity->x + velocity->y * velocity->y;
+  double eta = position->x * velocity->x + position->y * velocity->y;
+  double beta = 2 * mu / r0 - v2;
+  if (beta > 0) {
+    // Whole periods of an ellipse bring the body back where it started
+    double period = KEPLER_TWO_PI * mu / (beta * sqrt(beta));
+    time = fmod(time, period);
+  }
+
+  // Solve the universal Kepler equation
+  //   r0 G1(s) + eta G2(s) + mu G3(s) = time
+  // for the universal anomaly s, where Gk(s) = s^k ck(beta s^2). Laguerre's
+  // method converges from the small step guess for every kind of orbit.
+  double s = time / r0;
+  if (beta < 0) {
+    // On a hyperbola s only grows with the log of the time, and the small
+    // step guess for a long drift would overflow cosh
+    double k = sqrt(-beta);
+    double limit = log(1 + 2 * k * k * k * fabs(time) / mu) / k;
+    s = copysign(fmin(fabs(s), limit), time);
+  }
+  double g[4];
+  double r = r0;
+  for (int iteration = 0; iteration < KEPLER_MAX_ITERATIONS; iteration++) {
+    double c[4];
+    kepler_stumpff(beta * s * s, c);
+    g[0] = c[0];
+    g[1] = s * c[1];
+    g[2] = s * s * c[2];
+    g[3] = s * s * s * c[3];
+
+    double f = r0 * g[1] + eta * g[2] + mu * g[3] - time;
+    r = r0 * g[0] + eta * g[1] + mu * g[2];
+    double f2 = eta * g[0] + (mu - beta * r0) * g[1];
+
+    const double n = 5;
+    double root = sqrt(fabs((n - 1) * (n - 1) * r * r - n * (n - 1) * f * f2));
+    double step = n * f / (r + copysign(root, r));
+    s -= step;
+    if (fabs(step) <= 1e-15 * fabs(s)) {
+      break;
+    }
+  }
+
+  // Lagrange f and g functions at the solved anomaly
+  double c[4];
+  kepler_stumpff(beta * s * s, c);
+  g[0] = c[0];
+  g[1] = s * c[1];
+  g[2] = s * s * c[2];
+  g[3] = s * s * s * c[3];
+  r = r0 * g[0] + eta * g[1] + mu * g[2];
+
+  double f = 1 - mu * g[2] / r0;
+  double gt = time - mu * g[3];
+  double f_dot = -mu * g[1] / (r * r0);
+  double g_dot = 1 - mu * g[2] / r;
+
+  Vec2Acc x = *position;
+  Vec2Acc v = *velocity;
+  position->x = f * x.x + gt * v.x;
+  position->y = f * x.y + gt * v.y;
+  velocity->x = f_dot * x.x + g_dot * v.x;
+  velocity->y = f_dot * x.y + g_dot * v.y;
+}
@@ -0,0 +1,207 @@
+#include "precision.h"
+
+#include "arena_allocator.h"
+#include "gravity.h"
+#include "simulation.h"
+#include "vector.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// Double precision copy of the particle state
+typedef struct {
+  SofteningKernel kernel;
+  SofteningParameters softening;
+  double *x, *y;
+  double *vx, *vy;
+  double *mass;
+  double *ax, *ay;
+} PrecisionReference;
+
+// Gravitational acceleration of every particle, entirely in double precision
+static void precision_reference_gravity(PrecisionReference *reference,
+                                        uint64_t count,
+                                        double gravitational_constant) {
+  for (uint64_t i = 0; i < count; i++) {
+    reference->ax[i] = 0;
+    reference->ay[i] = 0;
+  }
+  for (uint64_t i = 0; i < count; i++) {
+    for (uint64_t j = i + 1; j < count; j++) {
+      double dx = reference->x[j] - reference->x[i];
+      double dy = reference->y[j] - reference->y[i];
+      double scale = gravitational_constant *
+                     gravity_softened_factor_f64(reference->kernel,
+                                                 dx * dx + dy * dy,
+                                                 reference->softening);
+      reference->ax[i] += dx * scale * reference->mass[j];
+      reference->ay[i] += dy * scale * reference->mass[j];
+      reference->ax[j] -= dx * scale * reference->mass[i];
+      reference->ay[j] -= dy * scale * reference->mass[i];
+    }
+  }
+}
+
+// Total kinetic and potential energy of the particles
+static double precision_energy(const Simulation *simulation, const double *x,
+                               const double *y, const double *vx,
+                               const double *vy, const double *mass,
+                               uint64_t count) {
+  SofteningParameters softening = gravity_softening_parameters(simulation);
+  double energy = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    energy += 0.5 * mass[i] * (vx[i] * vx[i] + vy[i] * vy[i]);
+    for (uint64_t j = i + 1; j < count; j++) {
+      double dx = x[j] - x[i];
+      double dy = y[j] - y[i];
+      energy += simulation->gravitational_constant * mass[i] * mass[j] *
+                gravity_softened_potential_f64(simulation->softening_kernel,
+                                               dx * dx + dy * dy, softening);
+    }
+  }
+  return energy;
+}
+
+// Energy of the VECTOR_T particles, evaluated in double precision
+static double precision_particle_energy(const Simulation *simulation,
+                                        ArenaAllocator *allocator) {
+  uint64_t count = simulation->particle_count;
+  double *columns = arena_alloc(allocator, sizeof(double) * count * 5);
+  assert(columns);
+  for (uint64_t i = 0; i < count; i++) {
+    const Particle *p = &simulation->particles[i];
+    columns[i] = p->position.x;
+    columns[count + i] = p->position.y;
+    columns[2 * count + i] = p->velocity.x;
+    columns[3 * count + i] = p->velocity.y;
+    columns[4 * count + i] = p->mass;
+  }
+  return precision_energy(simulation, columns, columns + count,
+                          columns + 2 * count, columns + 3 * count,
+                          columns + 4 * count, count);
+}
+
+// Compare the VECTOR_T build with a double precision reference
+PrecisionReport precision_report(const Simulation *simulation,
+                                 ArenaAllocator *allocator, double time_step,
+                                 uint32_t steps) {
+  uint64_t count = simulation->particle_count;
+  PrecisionReport report = {.steps = steps};
+  if (count < 2) {
+    return report;
+  }
+
+  // Working copy of the particles in the build's precision
+  Simulation working = *simulation;
+  working.particles = arena_alloc(allocator, sizeof(Particle) * count);
+  Vec2Acc *accelerations = arena_alloc(allocator, sizeof(Vec2Acc) * count);
+
+  PrecisionReference reference = {
+      .kernel = simulation->softening_kernel,
+      .softening = gravity_softening_parameters(simulation),
+  };
+  double *columns = arena_alloc(allocator, sizeof(double) * count * 7);
+  assert(working.particles && accelerations && columns);
+  memcpy(working.particles, simulation->particles, sizeof(Particle) * count);
+  reference.x = columns;
+  reference.y = columns + count;
+  reference.vx = columns + 2 * count;
+  reference.vy = columns + 3 * count;
+  reference.mass = columns + 4 * count;
+  reference.ax = columns + 5 * count;
+  reference.ay = columns + 6 * count;
+  for (uint64_t i = 0; i < count; i++) {
+    const Particle *p = &simulation->particles[i];
+    reference.x[i] = p->position.x;
+    reference.y[i] = p->position.y;
+    reference.vx[i] = p->velocity.x;
+    reference.vy[i] = p->velocity.y;
+    reference.mass[i] = p->mass;
+  }
+
+  uint64_t *indices;
+  uint64_t dynamic_count =
+      gravity_dynamic_indices(&working, allocator, &indices);
+
+  double reference_start_energy =
+      precision_energy(simulation, reference.x, reference.y, reference.vx,
+                       reference.vy, reference.mass, count);
+  double start_energy = precision_particle_energy(&working, allocator);
+
+  for (uint32_t step = 0; step < steps; step++) {
+    gravity_accumulate(&working, indices, dynamic_count, accelerations);
+    precision_reference_gravity(&reference, count,
+                                simulation->gravitational_constant);
+
+    for (uint64_t i = 0; i < count; i++) {
+      if (step == 0) {
+        double error_x = accelerations[i].x - reference.ax[i];
+        double error_y = accelerations[i].y - reference.ay[i];
+        double magnitude = sqrt(reference.ax[i] * reference.ax[i] +
+                                reference.ay[i] * reference.ay[i]);
+        double error = sqrt(error_x * error_x + error_y * error_y);
+        if (magnitude > 0 &&
+            error / magnitude > report.max_acceleration_error) {
+          report.max_acceleration_error = error / magnitude;
+        }
+      }
+
+      // Same semi-implicit Euler step as simulation_update
+      Particle *p = &working.particles[i];
+      Vec2 acceleration = vec2_from_acc(accelerations[i]);
+      p->velocity = vec2_add(p->velocity, vec2_scale(acceleration, time_step));
+      p->position = vec2_add(p->position, vec2_scale(p->velocity, time_step));
+
+      reference.vx[i] += reference.ax[i] * time_step;
+      reference.vy[i] += reference.ay[i] * time_step;
+      reference.x[i] += reference.vx[i] * time_step;
+      reference.y[i] += reference.vy[i] * time_step;
+    }
+  }
+
+  // Position errors relative to the extent of the reference system
+  double extent = 0;
+  double squared_error_sum = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    const Particle *p = &working.particles[i];
+    double error_x = p->position.x - reference.x[i];
+    double error_y = p->position.y - reference.y[i];
+    double error = sqrt(error_x * error_x + error_y * error_y);
+    squared_error_sum += error * error;
+    if (error > report.max_position_error) {
+      report.max_position_error = error;
+    }
+    extent = fmax(extent, fmax(fabs(reference.x[i]), fabs(reference.y[i])));
+  }
+  if (extent > 0) {
+    report.rms_position_error = sqrt(squared_error_sum / count) / extent;
+    report.max_position_error /= extent;
+  }
+
+  double end_energy = precision_particle_energy(&working, allocator);
+  double reference_end_energy =
+      precision_energy(simulation, reference.x, reference.y, reference.vx,
+                       reference.vy, reference.mass, count);
+  report.energy_drift = fabs((end_energy - start_energy) / start_energy);
+  report.reference_energy_drift =
+      fabs((reference_end_energy - reference_start_energy) /
+           reference_start_energy);
+
+  return report;
+}
+
+// Print the report to stdout
+void precision_report_print(PrecisionReport report) {
+  printf("precision report (%s storage, %u steps)\n",
+         sizeof(VECTOR_T) == sizeof(float) ? "float" : "double", report.steps);
+  printf("  max acceleration error: %.3e (relative)\n",
+         report.max_acceleration_error);
+  printf("  rms position error:     %.3e (relative to extent)\n",
+         report.rms_position_error);
+  printf("  max position error:     %.3e (relative to extent)\n",
+         report.max_position_error);
+  printf("  energy drift:           %.3e (reference %.3e)\n",
+         report.energy_drift, report.reference_energy_drift);
+}
@@ -0,0 +1,104 @@
+#include "respa.h"
+
+#include "arena_allocator.h"
+#include "gravity.h"
+#include "simulation.h"
+#include "vector.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+// Accumulate the accelerations of the dynamic particles split by time scale
+void respa_accumulate(Simulation *simulation, ArenaAllocator *allocator,
+                      const uint64_t *dynamic, uint64_t dynamic_count,
+                      Vec2Acc *accelerations, Vec2Acc *kicks) {
+  RespaState *respa = &simulation->respa;
+  uint64_t count = simulation->particle_count;
+  uint32_t interval =
+      simulation->respa_interval > 0 ? simulation->respa_interval : 1;
+
+  // Particles within respa_heavy_fraction of the heaviest one are heavy
+  double heaviest = 0;
+  for (uint64_t a = 0; a < dynamic_count; a++) {
+    double mass = simulation->particles[dynamic[a]].mass;
+    heaviest = mass > heaviest ? mass : heaviest;
+  }
+  double threshold = simulation->respa_heavy_fraction * heaviest;
+
+  uint64_t *heavy = arena_alloc(allocator, sizeof(uint64_t) * dynamic_count);
+  uint64_t *light = arena_alloc(allocator, sizeof(uint64_t) * dynamic_count);
+  assert(dynamic_count == 0 || (heavy && light));
+  uint64_t heavy_count = 0;
+  uint64_t light_count = 0;
+  for (uint64_t a = 0; a < dynamic_count; a++) {
+    if (simulation->particles[dynamic[a]].mass >= threshold) {
+      heavy[heavy_count++] = dynamic[a];
+    } else {
+      light[light_count++] = dynamic[a];
+    }
+  }
+
+  // Fast accelerations every step
+  for (uint64_t i = 0; i < count; i++) {
+    accelerations[i] = vec2_acc_zero();
+  }
+  gravity_accumulate_pairs(simulation, heavy, heavy_count, heavy, heavy_count,
+                           accelerations);
+  gravity_accumulate_pairs(simulation, heavy, heavy_count, light, light_count,
+                           accelerations);
+  gravity_accumulate_static(simulation, dynamic, dynamic_count, accelerations);
+
+  // Slow accelerations when their impulse is due, or when the particles
+  // changed since they were last evaluated
+  bool due = respa->step % interval == 0;
+  if (due || respa->count != count) {
+    if (respa->count != count) {
+      Vec2Acc *slow =
+          realloc(respa->slow_accelerations, sizeof(Vec2Acc) * count);
+      assert(count == 0 || slow);
+      respa->slow_accelerations = slow;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+      respa->slow_accelerations[i] = vec2_acc_zero();
+    }
+    gravity_accumulate_pairs(simulation, light, light_count, light,
+                             light_count, respa->slow_accelerations);
+    respa->count = count;
+  }
+
+  // The impulse of a due step pays for the whole interval ahead. Particles
+  // added during the interval are paid for the steps left of it when the
+  // slow accelerations are evaluated again for them.
+  uint32_t remaining = interval - respa->step % interval;
+  uint64_t paid_count = due ? 0 : respa->paid_count;
+  for (uint64_t i = 0; i < count; i++) {
+    Vec2Acc slow = respa->slow_accelerations[i];
+    kicks[i] = accelerations[i];
+    if (i >= paid_count) {
+      kicks[i].x += remaining * slow.x;
+      kicks[i].y += remaining * slow.y;
+    }
+    accelerations[i].x += slow.x;
+    accelerations[i].y += slow.y;
+  }
+  respa->paid_count = count;
+  respa->step++;
+}
+
+// Mark the slow accelerations as stale
+void respa_invalidate(Simulation *simulation) {
+  simulation->respa.count = 0;
+}
+
+// Forget the slow impulse of removed particles that had been paid for
+void respa_remove_paid(Simulation *simulation, uint64_t removed) {
+  RespaState *respa = &simulation->respa;
+  respa->paid_count =
+      removed < respa->paid_count ? respa->paid_count - removed : 0;
+}
+
+// Release the memory of the slow accelerations
+void respa_deinit(RespaState *respa) {
+  free(respa->slow_accelerations);
+  *respa = (RespaState){0};
+}
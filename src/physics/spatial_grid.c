@@ -0,0 +1,411 @@
+#include "spatial_grid.h"
+
+#include "simulation.h"
+#include "vector.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Cell coordinate of a position along one axis, clamped to the grid. Values
+// that are not finite land in the first cell.
+static uint32_t spatial_grid_coordinate(double value, double origin,
+                                        double cell_size, uint32_t cells) {
+  double coordinate = (value - origin) / cell_size;
+  if (!(coordinate >= 0)) {
+    return 0;
+  }
+  if (coordinate >= cells) {
+    return cells - 1;
+  }
+  return (uint32_t)coordinate;
+}
+
+// Index of the cell containing a position
+static uint64_t spatial_grid_cell(const SpatialGrid *grid, Vec2 position) {
+  uint32_t column = spatial_grid_coordinate(position.x, grid->origin.x,
+                                            grid->cell_size, grid->columns);
+  uint32_t row = spatial_grid_coordinate(position.y, grid->origin.y,
+                                         grid->cell_size, grid->rows);
+  return (uint64_t)row * grid->columns + column;
+}
+
+// Grow the grid's arrays to hold count particles and cell_count cells
+static void spatial_grid_reserve(SpatialGrid *grid, uint64_t count,
+                                 uint64_t cell_count) {
+  if (count > grid->particle_capacity) {
+    free(grid->cell_particles);
+    free(grid->oversized);
+    grid->cell_particles = malloc(sizeof(uint64_t) * count);
+    grid->oversized = malloc(sizeof(uint64_t) * count);
+    assert(grid->cell_particles && grid->oversized);
+    grid->particle_capacity = count;
+  }
+  if (cell_count + 1 > grid->cell_capacity) {
+    free(grid->cell_start);
+    grid->cell_start = malloc(sizeof(uint64_t) * (cell_count + 1));
+    assert(grid->cell_start);
+    grid->cell_capacity = cell_count + 1;
+  }
+}
+
+// Sort the particles into the grid, reusing its memory from the last build
+void spatial_grid_build(SpatialGrid *grid, const Particle *particles,
+                        uint64_t count) {
+  assert(grid);
+  assert(count == 0 || particles);
+
+  // Particles much larger than the average get their own list, so that a
+  // single planet does not put every grain of dust into one cell
+  double mean_radius = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    mean_radius += particles[i].radius;
+  }
+  mean_radius = count ? mean_radius / count : 0;
+  grid->oversized_radius = SPATIAL_GRID_OVERSIZED_RATIO * mean_radius;
+
+  double min_x = INFINITY, min_y = INFINITY;
+  double max_x = -INFINITY, max_y = -INFINITY;
+  uint64_t stored = 0;
+  grid->max_radius = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    const Particle *p = &particles[i];
+    if (p->radius > grid->oversized_radius) {
+      continue;
+    }
+    stored++;
+    if (p->radius > grid->max_radius) {
+      grid->max_radius = p->radius;
+    }
+    if (isfinite(p->position.x) && isfinite(p->position.y)) {
+      min_x = fmin(min_x, p->position.x);
+      min_y = fmin(min_y, p->position.y);
+      max_x = fmax(max_x, p->position.x);
+      max_y = fmax(max_y, p->position.y);
+    }
+  }
+  if (min_x > max_x) {
+    min_x = min_y = max_x = max_y = 0;
+  }
+
+  // Cells as wide as the largest stored particle, so touching particles are
+  // in neighbouring cells, but never many more cells than particles
+  double width = max_x - min_x;
+  double height = max_y - min_y;
+  double cell_size = 2 * grid->max_radius;
+  if (!(cell_size > 0)) {
+    cell_size = fmax(fmax(width, height), 1.0);
+  }
+  double cell_limit = (double)SPATIAL_GRID_CELLS_PER_PARTICLE * stored + 1;
+  while ((floor(width / cell_size) + 1) * (floor(height / cell_size) + 1) >
+         cell_limit) {
+    cell_size *= 2;
+  }
+  grid->origin = (Vec2){min_x, min_y};
+  grid->cell_size = cell_size;
+  grid->columns = (uint32_t)(width / cell_size) + 1;
+  grid->rows = (uint32_t)(height / cell_size) + 1;
+  grid->particle_count = count;
+
+  uint64_t cell_count = (uint64_t)grid->columns * grid->rows;
+  spatial_grid_reserve(grid, count, cell_count);
+
+  // Counting sort by cell. After the prefix sum cell_start[c] is the end of
+  // cell c, filling the cells backwards leaves it at the start and keeps the
+  // particles of a cell in index order.
+  uint64_t *cell_start = grid->cell_start;
+  memset(cell_start, 0, sizeof(uint64_t) * (cell_count + 1));
+  grid->oversized_count = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    if (particles[i].radius > grid->oversized_radius) {
+      grid->oversized[grid->oversized_count++] = i;
+      continue;
+    }
+    cell_start[spatial_grid_cell(grid, particles[i].position)]++;
+  }
+  for (uint64_t c = 1; c <= cell_count; c++) {
+    cell_start[c] += cell_start[c - 1];
+  }
+  for (uint64_t i = count; i-- > 0;) {
+    if (particles[i].radius > grid->oversized_radius) {
+      continue;
+    }
+    uint64_t cell = spatial_grid_cell(grid, particles[i].position);
+    grid->cell_particles[--cell_start[cell]] = i;
+  }
+}
+
+// Cells overlapping the box from min to max
+SpatialGridRange spatial_grid_range(const SpatialGrid *grid, Vec2 min,
+                                    Vec2 max) {
+  return (SpatialGridRange){
+      .min_column = spatial_grid_coordinate(min.x, grid->origin.x,
+                                            grid->cell_size, grid->columns),
+      .min_row = spatial_grid_coordinate(min.y, grid->origin.y,
+                                         grid->cell_size, grid->rows),
+      .max_column = spatial_grid_coordinate(max.x, grid->origin.x,
+                                            grid->cell_size, grid->columns),
+      .max_row = spatial_grid_coordinate(max.y, grid->origin.y,
+                                         grid->cell_size, grid->rows),
+  };
+}
+
+// Record a found particle if there is room for it
+static void spatial_grid_emit(uint64_t index, uint64_t *indices,
+                              uint64_t capacity, uint64_t *found) {
+  if (*found < capacity) {
+    indices[*found] = index;
+  }
+  (*found)++;
+}
+
+// Record every particle of a cell at once
+static void spatial_grid_emit_cell(const SpatialGrid *grid, uint64_t cell,
+                                   uint64_t *indices, uint64_t capacity,
+                                   uint64_t *found) {
+  uint64_t start = grid->cell_start[cell];
+  uint64_t end = grid->cell_start[cell + 1];
+  if (*found < capacity) {
+    uint64_t room = capacity - *found;
+    uint64_t copied = end - start < room ? end - start : room;
+    memcpy(indices + *found, grid->cell_particles + start,
+           sizeof(uint64_t) * copied);
+  }
+  *found += end - start;
+}
+
+// Whether a cell lies inside the grid's border, so it holds nothing beyond
+// the grid's edge
+static bool spatial_grid_is_interior(const SpatialGrid *grid, uint32_t column,
+                                     uint32_t row) {
+  return column > 0 && row > 0 && column + 1 < grid->columns &&
+         row + 1 < grid->rows;
+}
+
+// Find the particles whose centre lies inside the box from min to max
+uint64_t spatial_grid_query_box(const SpatialGrid *grid,
+                                const Particle *particles, Vec2 min, Vec2 max,
+                                uint64_t *indices, uint64_t capacity) {
+  assert(grid);
+  assert(capacity == 0 || indices);
+
+  uint64_t found = 0;
+  if (grid->particle_count == 0 || min.x > max.x || min.y > max.y) {
+    return 0;
+  }
+
+  // Cells entirely inside the box are taken whole, only the cells on its
+  // edge test their particles
+  SpatialGridRange range = spatial_grid_range(grid, min, max);
+  double size = grid->cell_size;
+  for (uint32_t row = range.min_row; row <= range.max_row; row++) {
+    double cell_min_y = grid->origin.y + row * size;
+    for (uint32_t column = range.min_column; column <= range.max_column;
+         column++) {
+      double cell_min_x = grid->origin.x + column * size;
+      uint64_t cell = (uint64_t)row * grid->columns + column;
+      if (spatial_grid_is_interior(grid, column, row) && cell_min_x >= min.x &&
+          cell_min_y >= min.y && cell_min_x + size <= max.x &&
+          cell_min_y + size <= max.y) {
+        spatial_grid_emit_cell(grid, cell, indices, capacity, &found);
+        continue;
+      }
+
+      for (uint64_t k = grid->cell_start[cell]; k < grid->cell_start[cell + 1];
+           k++) {
+        uint64_t i = grid->cell_particles[k];
+        Vec2 position = particles[i].position;
+        if (position.x >= min.x && position.x <= max.x &&
+            position.y >= min.y && position.y <= max.y) {
+          spatial_grid_emit(i, indices, capacity, &found);
+        }
+      }
+    }
+  }
+
+  for (uint64_t k = 0; k < grid->oversized_count; k++) {
+    uint64_t i = grid->oversized[k];
+    Vec2 position = particles[i].position;
+    if (position.x >= min.x && position.x <= max.x && position.y >= min.y &&
+        position.y <= max.y) {
+      spatial_grid_emit(i, indices, capacity, &found);
+    }
+  }
+  return found;
+}
+
+// Find the particles whose centre lies inside the circle
+uint64_t spatial_grid_query_circle(const SpatialGrid *grid,
+                                   const Particle *particles, Vec2 center,
+                                   double radius, uint64_t *indices,
+                                   uint64_t capacity) {
+  assert(grid);
+  assert(capacity == 0 || indices);
+
+  uint64_t found = 0;
+  if (grid->particle_count == 0 || !(radius >= 0)) {
+    return 0;
+  }
+
+  // Cells whose farthest corner is inside the circle are taken whole
+  double radius_squared = radius * radius;
+  SpatialGridRange range = spatial_grid_range(
+      grid, (Vec2){center.x - radius, center.y - radius},
+      (Vec2){center.x + radius, center.y + radius});
+  double size = grid->cell_size;
+  for (uint32_t row = range.min_row; row <= range.max_row; row++) {
+    double cell_min_y = grid->origin.y + row * size;
+    double far_y = fmax(fabs(cell_min_y - center.y),
+                        fabs(cell_min_y + size - center.y));
+    for (uint32_t column = range.min_column; column <= range.max_column;
+         column++) {
+      double cell_min_x = grid->origin.x + column * size;
+      double far_x = fmax(fabs(cell_min_x - center.x),
+                          fabs(cell_min_x + size - center.x));
+      uint64_t cell = (uint64_t)row * grid->columns + column;
+      if (spatial_grid_is_interior(grid, column, row) &&
+          far_x * far_x + far_y * far_y <= radius_squared) {
+        spatial_grid_emit_cell(grid, cell, indices, capacity, &found);
+        continue;
+      }
+
+      for (uint64_t k = grid->cell_start[cell]; k < grid->cell_start[cell + 1];
+           k++) {
+        uint64_t i = grid->cell_particles[k];
+        double dx = particles[i].position.x - center.x;
+        double dy = particles[i].position.y - center.y;
+        if (dx * dx + dy * dy <= radius_squared) {
+          spatial_grid_emit(i, indices, capacity, &found);
+        }
+      }
+    }
+  }
+
+  for (uint64_t k = 0; k < grid->oversized_count; k++) {
+    uint64_t i = grid->oversized[k];
+    double dx = particles[i].position.x - center.x;
+    double dy = particles[i].position.y - center.y;
+    if (dx * dx + dy * dy <= radius_squared) {
+      spatial_grid_emit(i, indices, capacity, &found);
+    }
+  }
+  return found;
+}
+
+// Keep particle i if its centre is nearer to the point than the best so far
+static void spatial_grid_nearer(const Particle *particles, uint64_t i,
+                                Vec2 point, uint64_t *best,
+                                double *best_distance_squared) {
+  double dx = particles[i].position.x - point.x;
+  double dy = particles[i].position.y - point.y;
+  double distance_squared = dx * dx + dy * dy;
+  if (distance_squared <= *best_distance_squared) {
+    *best = i;
+    *best_distance_squared = distance_squared;
+  }
+}
+
+// Particle whose centre is nearest to the point
+uint64_t spatial_grid_nearest(const SpatialGrid *grid,
+                              const Particle *particles, Vec2 point,
+                              double max_distance) {
+  assert(grid);
+
+  uint64_t best = grid->particle_count;
+  double best_distance_squared = max_distance * max_distance;
+  if (grid->particle_count == 0 || !(max_distance >= 0)) {
+    return best;
+  }
+
+  for (uint64_t k = 0; k < grid->oversized_count; k++) {
+    spatial_grid_nearer(particles, grid->oversized[k], point, &best,
+                        &best_distance_squared);
+  }
+
+  // Every cell in ring r around the point's cell is at least r - 1 cells away
+  // from the point, also when the point lies outside the grid
+  int64_t center_column = spatial_grid_coordinate(
+      point.x, grid->origin.x, grid->cell_size, grid->columns);
+  int64_t center_row = spatial_grid_coordinate(point.y, grid->origin.y,
+                                               grid->cell_size, grid->rows);
+  int64_t rings = grid->columns > grid->rows ? grid->columns : grid->rows;
+  for (int64_t r = 0; r < rings; r++) {
+    double gap = (r - 1) * grid->cell_size;
+    if (r > 0 && gap * gap > best_distance_squared) {
+      break;
+    }
+
+    for (int64_t row = center_row - r; row <= center_row + r; row++) {
+      if (row < 0 || row >= grid->rows) {
+        continue;
+      }
+      // Inner rows of the ring only have its left and right cells
+      bool edge_row = row == center_row - r || row == center_row + r;
+      int64_t step = edge_row || r == 0 ? 1 : 2 * r;
+      for (int64_t column = center_column - r; column <= center_column + r;
+           column += step) {
+        if (column < 0 || column >= grid->columns) {
+          continue;
+        }
+        uint64_t cell = (uint64_t)row * grid->columns + (uint64_t)column;
+        for (uint64_t k = grid->cell_start[cell];
+             k < grid->cell_start[cell + 1]; k++) {
+          spatial_grid_nearer(particles, grid->cell_particles[k], point, &best,
+                              &best_distance_squared);
+        }
+      }
+    }
+  }
+  return best;
+}
+
+// Whether a circle overlaps the disk of any particle
+bool spatial_grid_overlaps_circle(const SpatialGrid *grid,
+                                  const Particle *particles, Vec2 center,
+                                  double radius) {
+  assert(grid);
+  if (grid->particle_count == 0) {
+    return false;
+  }
+
+  for (uint64_t k = 0; k < grid->oversized_count; k++) {
+    uint64_t i = grid->oversized[k];
+    double dx = particles[i].position.x - center.x;
+    double dy = particles[i].position.y - center.y;
+    double radius_sum = radius + particles[i].radius;
+    if (dx * dx + dy * dy < radius_sum * radius_sum) {
+      return true;
+    }
+  }
+
+  double reach = radius + grid->max_radius;
+  SpatialGridRange range =
+      spatial_grid_range(grid, (Vec2){center.x - reach, center.y - reach},
+                         (Vec2){center.x + reach, center.y + reach});
+  for (uint32_t row = range.min_row; row <= range.max_row; row++) {
+    for (uint32_t column = range.min_column; column <= range.max_column;
+         column++) {
+      uint64_t cell = (uint64_t)row * grid->columns + column;
+      for (uint64_t k = grid->cell_start[cell]; k < grid->cell_start[cell + 1];
+           k++) {
+        uint64_t i = grid->cell_particles[k];
+        double dx = particles[i].position.x - center.x;
+        double dy = particles[i].position.y - center.y;
+        double radius_sum = radius + particles[i].radius;
+        if (dx * dx + dy * dy < radius_sum * radius_sum) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+// Release the memory of the grid
+void spatial_grid_deinit(SpatialGrid *grid) {
+  free(grid->cell_start);
+  free(grid->cell_particles);
+  free(grid->oversized);
+  *grid = (SpatialGrid){0};
+}
@@ -0,0 +1,351 @@
+#include "static_field.h"
+
+#include "gravity.h"
+#include "simulation.h"
+#include "vector.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+// Margin around the static particles covered by the grid, as a fraction of
+// their extent and as a multiple of their largest radius
+#define STATIC_FIELD_MARGIN_FRACTION 0.5
+#define STATIC_FIELD_MARGIN_RADII 8.0
+
+// Sum the acceleration of the sources first up to end at the position
+static Vec2Acc static_field_direct(const Simulation *simulation,
+                                   const StaticField *field, uint64_t first,
+                                   uint64_t end, double x, double y) {
+  SofteningParameters softening = gravity_softening_parameters(simulation);
+  Vec2Acc acceleration = vec2_acc_zero();
+  for (uint64_t s = first; s < end; s++) {
+    const StaticSource *source = &field->sources[s];
+    double dx = source->position.x - x;
+    double dy = source->position.y - y;
+    double scale = simulation->gravitational_constant * source->mass *
+                   gravity_softened_factor_f64(simulation->softening_kernel,
+                                               dx * dx + dy * dy, softening);
+    acceleration.x += dx * scale;
+    acceleration.y += dy * scale;
+  }
+  return acceleration;
+}
+
+// Add the acceleration of the sources in a block of cells, clamped to the
+// grid, to the acceleration at the position
+static void static_field_add_block(const Simulation *simulation,
+                                   const StaticField *field, int64_t column0,
+                                   int64_t row0, int64_t column1,
+                                   int64_t row1, double x, double y,
+                                   Vec2Acc *acceleration) {
+  int64_t last = (int64_t)field->resolution - 1;
+  column0 = column0 < 0 ? 0 : column0;
+  row0 = row0 < 0 ? 0 : row0;
+  column1 = column1 > last ? last : column1;
+  row1 = row1 > last ? last : row1;
+  // The cells of a row are consecutive, so are their sources
+  for (int64_t row = row0; row <= row1 && column0 <= column1; row++) {
+    uint64_t cell = (uint64_t)row * field->resolution;
+    Vec2Acc part = static_field_direct(
+        simulation, field, field->cell_start[cell + column0],
+        field->cell_start[cell + column1 + 1], x, y);
+    acceleration->x += part.x;
+    acceleration->y += part.y;
+  }
+}
+
+// Add the acceleration of the sources outside a block of cells to the
+// acceleration at the position
+static void static_field_add_outside(const Simulation *simulation,
+                                     const StaticField *field,
+                                     int64_t column0, int64_t row0,
+                                     int64_t column1, int64_t row1, double x,
+                                     double y, Vec2Acc *acceleration) {
+  int64_t last = (int64_t)field->resolution - 1;
+  for (int64_t row = 0; row <= last; row++) {
+    if (row < row0 || row > row1) {
+      static_field_add_block(simulation, field, 0, row, last, row, x, y,
+                             acceleration);
+      continue;
+    }
+    static_field_add_block(simulation, field, 0, row, column0 - 1, row, x, y,
+                           acceleration);
+    static_field_add_block(simulation, field, column1 + 1, row, last, row, x,
+                           y, acceleration);
+  }
+}
+
+// Cell of the grid holding a position, clamped to the grid
+static uint32_t static_field_cell_index(const StaticField *field,
+                                        double coordinate, double origin) {
+  double u = (coordinate - origin) / field->cell_size;
+  if (!(u >= 0)) {
+    return 0;
+  }
+  return u >= field->resolution ? field->resolution - 1 : (uint32_t)u;
+}
+
+// Sort the sources by the cell that holds them
+static void static_field_sort_sources(StaticField *field) {
+  uint64_t cell_count = (uint64_t)field->resolution * field->resolution;
+  uint64_t *start = calloc(cell_count + 1, sizeof(uint64_t));
+  uint64_t *cells = malloc(sizeof(uint64_t) * field->source_count);
+  StaticSource *sorted = malloc(sizeof(StaticSource) * field->source_count);
+  assert(start && cells && sorted);
+
+  for (uint64_t s = 0; s < field->source_count; s++) {
+    const StaticSource *source = &field->sources[s];
+    uint32_t column = static_field_cell_index(field, source->position.x,
+                                              field->origin.x);
+    uint32_t row = static_field_cell_index(field, source->position.y,
+                                           field->origin.y);
+    cells[s] = (uint64_t)row * field->resolution + column;
+    start[cells[s] + 1]++;
+  }
+  for (uint64_t c = 0; c < cell_count; c++) {
+    start[c + 1] += start[c];
+  }
+  // Place each source at the next free slot of its cell, then shift the
+  // starts back into place
+  for (uint64_t s = 0; s < field->source_count; s++) {
+    sorted[start[cells[s]]++] = field->sources[s];
+  }
+  for (uint64_t c = cell_count; c > 0; c--) {
+    start[c] = start[c - 1];
+  }
+  start[0] = 0;
+
+  free(field->sources);
+  free(cells);
+  field->sources = sorted;
+  free(field->cell_start);
+  field->cell_start = start;
+}
+
+// Sample the far field of every cell at its corners. Each node first sums the
+// sources outside the near blocks of all four cells around it, then each of
+// those cells adds the sources in that union that are not near to it. A
+// source is never closer than STATIC_FIELD_NEAR_CELLS cells to a node whose
+// cell counts it as far.
+static void static_field_sample_corners(const Simulation *simulation,
+                                        StaticField *field) {
+  int64_t near = STATIC_FIELD_NEAR_CELLS;
+  uint32_t resolution = field->resolution;
+  uint64_t stride = resolution + 1;
+  Vec2Acc *nodes = malloc(sizeof(Vec2Acc) * stride * stride);
+  assert(nodes);
+
+  for (uint32_t row = 0; row <= resolution; row++) {
+    for (uint32_t column = 0; column <= resolution; column++) {
+      double x = field->origin.x + column * field->cell_size;
+      double y = field->origin.y + row * field->cell_size;
+      // The cells around the node are column - 1 and column along x, their
+      // near blocks together span column - 1 - near up to column + near
+      int64_t column0 = (int64_t)column - 1 - near;
+      int64_t column1 = (int64_t)column + near;
+      int64_t row0 = (int64_t)row - 1 - near;
+      int64_t row1 = (int64_t)row + near;
+      Vec2Acc far = vec2_acc_zero();
+      static_field_add_outside(simulation, field, column0, row0, column1,
+                               row1, x, y, &far);
+      nodes[row * stride + column] = far;
+    }
+  }
+
+  uint64_t cell_count = (uint64_t)resolution * resolution;
+  free(field->corners);
+  field->corners = malloc(sizeof(Vec2Acc) * 4 * cell_count);
+  assert(field->corners);
+  for (uint32_t row = 0; row < resolution; row++) {
+    for (uint32_t column = 0; column < resolution; column++) {
+      Vec2Acc *corners =
+          &field->corners[4 * ((uint64_t)row * resolution + column)];
+      for (uint32_t corner = 0; corner < 4; corner++) {
+        uint32_t node_column = column + (corner & 1);
+        uint32_t node_row = row + (corner >> 1);
+        double x = field->origin.x + node_column * field->cell_size;
+        double y = field->origin.y + node_row * field->cell_size;
+        Vec2Acc value = nodes[node_row * stride + node_column];
+
+        // Add the rows and columns of the node's union block that lie
+        // outside this cell's near block: one column and one row strip
+        int64_t column0 = (int64_t)node_column - 1 - near;
+        int64_t column1 = (int64_t)node_column + near;
+        int64_t row0 = (int64_t)node_row - 1 - near;
+        int64_t row1 = (int64_t)node_row + near;
+        int64_t near_column0 = (int64_t)column - near;
+        int64_t near_column1 = (int64_t)column + near;
+        int64_t near_row0 = (int64_t)row - near;
+        int64_t strip_column = column0 < near_column0 ? column0 : column1;
+        int64_t strip_row = row0 < near_row0 ? row0 : row1;
+        static_field_add_block(simulation, field, strip_column, row0,
+                               strip_column, row1, x, y, &value);
+        static_field_add_block(simulation, field, near_column0, strip_row,
+                               near_column1, strip_row, x, y, &value);
+        corners[corner] = value;
+      }
+    }
+  }
+  free(nodes);
+}
+
+// Monopole and quadrupole approximation of the field far from the sources
+static Vec2Acc static_field_multipole(const Simulation *simulation,
+                                      const StaticField *field, double x,
+                                      double y) {
+  double g = simulation->gravitational_constant;
+  double dx = x - field->center.x;
+  double dy = y - field->center.y;
+  double r2 = dx * dx + dy * dy;
+  double r = sqrt(r2);
+  double inverse_r3 = 1 / (r2 * r);
+  double inverse_r5 = inverse_r3 / r2;
+
+  // a = -G M x / r^3 + G (Q x / r^5 - 5/2 (x.Q.x) x / r^7)
+  double qx = field->quadrupole_xx * dx + field->quadrupole_xy * dy;
+  double qy = field->quadrupole_xy * dx + field->quadrupole_yy * dy;
+  double xqx = dx * qx + dy * qy;
+  return (Vec2Acc){
+      -g * field->mass * dx * inverse_r3 +
+          g * (qx * inverse_r5 - 2.5 * xqx * dx * inverse_r5 / r2),
+      -g * field->mass * dy * inverse_r3 +
+          g * (qy * inverse_r5 - 2.5 * xqx * dy * inverse_r5 / r2),
+  };
+}
+
+// Rebuild the static field if a static particle changed since the last build
+void static_field_update(Simulation *simulation) {
+  StaticField *field = &simulation->static_field;
+  if (field->is_valid) {
+    return;
+  }
+
+  // Gather the static particles
+  uint64_t count = 0;
+  for (uint64_t i = 0; i < simulation->particle_count; i++) {
+    count += simulation->particles[i].is_static;
+  }
+  free(field->sources);
+  field->sources = count ? malloc(sizeof(StaticSource) * count) : NULL;
+  assert(count == 0 || field->sources);
+  field->source_count = 0;
+
+  double min_x = INFINITY, min_y = INFINITY;
+  double max_x = -INFINITY, max_y = -INFINITY;
+  double max_radius = 0;
+  field->mass = 0;
+  field->center = vec2_acc_zero();
+  for (uint64_t i = 0; i < simulation->particle_count; i++) {
+    const Particle *p = &simulation->particles[i];
+    if (!p->is_static) {
+      continue;
+    }
+    field->sources[field->source_count++] =
+        (StaticSource){.position = p->position, .mass = p->mass};
+    min_x = fmin(min_x, p->position.x);
+    min_y = fmin(min_y, p->position.y);
+    max_x = fmax(max_x, p->position.x);
+    max_y = fmax(max_y, p->position.y);
+    max_radius = fmax(max_radius, p->radius);
+    field->mass += p->mass;
+    field->center.x += p->mass * p->position.x;
+    field->center.y += p->mass * p->position.y;
+  }
+  field->is_valid = true;
+  if (field->source_count <= STATIC_FIELD_DIRECT_LIMIT) {
+    free(field->corners);
+    free(field->cell_start);
+    field->corners = NULL;
+    field->cell_start = NULL;
+    return;
+  }
+  field->center.x /= field->mass;
+  field->center.y /= field->mass;
+
+  // Quadrupole moment about the centre of mass
+  field->quadrupole_xx = 0;
+  field->quadrupole_xy = 0;
+  field->quadrupole_yy = 0;
+  for (uint64_t s = 0; s < field->source_count; s++) {
+    const StaticSource *source = &field->sources[s];
+    double dx = source->position.x - field->center.x;
+    double dy = source->position.y - field->center.y;
+    double d2 = dx * dx + dy * dy;
+    field->quadrupole_xx += source->mass * (3 * dx * dx - d2);
+    field->quadrupole_xy += source->mass * 3 * dx * dy;
+    field->quadrupole_yy += source->mass * (3 * dy * dy - d2);
+  }
+
+  // Square grid over the sources plus a margin
+  double extent = fmax(max_x - min_x, max_y - min_y);
+  double margin = fmax(STATIC_FIELD_MARGIN_FRACTION * extent,
+                       STATIC_FIELD_MARGIN_RADII * max_radius);
+  double size = extent + 2 * margin;
+  uint32_t resolution = simulation->static_field_resolution;
+  assert(resolution > 0);
+  field->resolution = resolution;
+  field->cell_size = size / resolution;
+  field->origin =
+      (Vec2){(min_x + max_x - size) / 2, (min_y + max_y - size) / 2};
+
+  static_field_sort_sources(field);
+  static_field_sample_corners(simulation, field);
+}
+
+// Mark the static field as stale
+void static_field_invalidate(Simulation *simulation) {
+  simulation->static_field.is_valid = false;
+}
+
+// Acceleration caused by all static particles at the position
+Vec2Acc static_field_sample(const Simulation *simulation, Vec2 position) {
+  const StaticField *field = &simulation->static_field;
+  assert(field->is_valid);
+  if (field->source_count == 0) {
+    return vec2_acc_zero();
+  }
+  if (field->corners == NULL) {
+    return static_field_direct(simulation, field, 0, field->source_count,
+                               position.x, position.y);
+  }
+
+  double u = (position.x - field->origin.x) / field->cell_size;
+  double v = (position.y - field->origin.y) / field->cell_size;
+  if (!(u >= 0 && v >= 0 && u < field->resolution && v < field->resolution)) {
+    return static_field_multipole(simulation, field, position.x, position.y);
+  }
+
+  // Bilinear interpolation of the far field between the cell's corners, plus
+  // the near sources summed directly
+  uint32_t column = (uint32_t)u;
+  uint32_t row = (uint32_t)v;
+  double fx = u - column;
+  double fy = v - row;
+  const Vec2Acc *corners =
+      &field->corners[4 * ((uint64_t)row * field->resolution + column)];
+  double w00 = (1 - fx) * (1 - fy);
+  double w01 = fx * (1 - fy);
+  double w10 = (1 - fx) * fy;
+  double w11 = fx * fy;
+  Vec2Acc acceleration = {
+      w00 * corners[0].x + w01 * corners[1].x + w10 * corners[2].x +
+          w11 * corners[3].x,
+      w00 * corners[0].y + w01 * corners[1].y + w10 * corners[2].y +
+          w11 * corners[3].y,
+  };
+  int64_t near = STATIC_FIELD_NEAR_CELLS;
+  static_field_add_block(simulation, field, (int64_t)column - near,
+                         (int64_t)row - near, (int64_t)column + near,
+                         (int64_t)row + near, position.x, position.y,
+                         &acceleration);
+  return acceleration;
+}
+
+// Release the memory of the static field
+void static_field_deinit(StaticField *field) {
+  free(field->sources);
+  free(field->cell_start);
+  free(field->corners);
+  *field = (StaticField){0};
+}
@@ -0,0 +1,156 @@
+#include "trails.h"
+
+#include "simulation.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Copy the samples of one trail slot over another
+static void trails_move(TrailSet *trails, uint64_t from, uint64_t to) {
+  memcpy(&trails->x[to * trails->length], &trails->x[from * trails->length],
+         sizeof(float) * trails->length);
+  memcpy(&trails->y[to * trails->length], &trails->y[from * trails->length],
+         sizeof(float) * trails->length);
+  trails->particles[to] = trails->particles[from];
+}
+
+// Start a trail for the particle, filled with its current position
+bool trails_add(Simulation *simulation, uint64_t index) {
+  TrailSet *trails = &simulation->trails;
+  Particle *p = &simulation->particles[index];
+  if (p->trail != 0) {
+    return true;
+  }
+  if (trails->count == trails->capacity || trails->length == 0) {
+    return false;
+  }
+
+  // The whole block is taken at once so its size never changes
+  if (trails->particles == NULL) {
+    size_t samples = trails->capacity * trails->length;
+    trails->particles = malloc(sizeof(uint64_t) * trails->capacity);
+    trails->x = malloc(sizeof(float) * samples);
+    trails->y = malloc(sizeof(float) * samples);
+    assert(trails->particles && trails->x && trails->y);
+  }
+
+  uint64_t slot = trails->count++;
+  trails->particles[slot] = index;
+  for (uint32_t k = 0; k < trails->length; k++) {
+    trails->x[slot * trails->length + k] = p->position.x;
+    trails->y[slot * trails->length + k] = p->position.y;
+  }
+  p->trail = (uint32_t)(slot + 1);
+  return true;
+}
+
+// Drop the particle's trail
+void trails_remove(Simulation *simulation, uint64_t index) {
+  TrailSet *trails = &simulation->trails;
+  Particle *p = &simulation->particles[index];
+  if (p->trail == 0) {
+    return;
+  }
+
+  uint64_t slot = p->trail - 1;
+  uint64_t last = --trails->count;
+  if (slot != last) {
+    trails_move(trails, last, slot);
+    simulation->particles[trails->particles[slot]].trail =
+        (uint32_t)(slot + 1);
+  }
+  p->trail = 0;
+}
+
+// Sample every trail once stride steps have passed
+void trails_record(Simulation *simulation) {
+  TrailSet *trails = &simulation->trails;
+  if (trails->count == 0) {
+    return;
+  }
+  if (trails->countdown > 0) {
+    trails->countdown--;
+    return;
+  }
+  trails->countdown = trails->stride > 0 ? trails->stride - 1 : 0;
+
+  for (uint64_t t = 0; t < trails->count; t++) {
+    const Particle *p = &simulation->particles[trails->particles[t]];
+    trails->x[t * trails->length + trails->head] = p->position.x;
+    trails->y[t * trails->length + trails->head] = p->position.y;
+  }
+  trails->head = (trails->head + 1) % trails->length;
+}
+
+// Point the trails at the particles that carry them after compaction
+void trails_compact(Simulation *simulation) {
+  TrailSet *trails = &simulation->trails;
+  if (trails->count == 0) {
+    return;
+  }
+
+  // Slots nobody claims belong to removed particles
+  for (uint64_t t = 0; t < trails->count; t++) {
+    trails->particles[t] = UINT64_MAX;
+  }
+  for (uint64_t i = 0; i < simulation->particle_count; i++) {
+    const Particle *p = &simulation->particles[i];
+    if (p->trail != 0) {
+      trails->particles[p->trail - 1] = i;
+    }
+  }
+
+  uint64_t kept = 0;
+  for (uint64_t t = 0; t < trails->count; t++) {
+    uint64_t index = trails->particles[t];
+    if (index == UINT64_MAX) {
+      continue;
+    }
+    if (t != kept) {
+      trails_move(trails, t, kept);
+      simulation->particles[index].trail = (uint32_t)(kept + 1);
+    }
+    kept++;
+  }
+  trails->count = kept;
+}
+
+// Copy the trails into another set, growing its memory to fit them
+void trails_copy(TrailSet *copy, const TrailSet *trails) {
+  if (trails->count > 0 &&
+      (copy->particles == NULL || trails->count > copy->capacity ||
+       trails->length != copy->length)) {
+    size_t samples = trails->count * trails->length;
+    copy->particles =
+        realloc(copy->particles, sizeof(uint64_t) * trails->count);
+    copy->x = realloc(copy->x, sizeof(float) * samples);
+    copy->y = realloc(copy->y, sizeof(float) * samples);
+    assert(copy->particles && copy->x && copy->y);
+    copy->capacity = trails->count;
+  }
+
+  copy->length = trails->length;
+  copy->stride = trails->stride;
+  copy->count = trails->count;
+  copy->head = trails->head;
+  copy->countdown = trails->countdown;
+  if (trails->count > 0) {
+    size_t samples = trails->count * trails->length;
+    memcpy(copy->particles, trails->particles,
+           sizeof(uint64_t) * trails->count);
+    memcpy(copy->x, trails->x, sizeof(float) * samples);
+    memcpy(copy->y, trails->y, sizeof(float) * samples);
+  }
+}
+
+// Release the memory of the trails
+void trails_deinit(TrailSet *trails) {
+  free(trails->particles);
+  free(trails->x);
+  free(trails->y);
+  trails->particles = NULL;
+  trails->x = NULL;
+  trails->y = NULL;
+  trails->count = 0;
+}
@@ -0,0 +1,218 @@
+#include "wisdom_holman.h"
+
+#include "arena_allocator.h"
+#include "kepler.h"
+#include "simulation.h"
+#include "vector.h"
+
+#include <assert.h>
+#include <math.h>
+
+// Whether a particle is advanced by the mixed-variable integrator. Particles
+// woken during the step join it from the next step on.
+static bool wisdom_holman_moves(const Simulation *simulation,
+                                const bool *woken, uint64_t index) {
+  const Particle *p = &simulation->particles[index];
+  return !p->is_static && !p->is_sleeping && !(woken && woken[index]);
+}
+
+// Whether a particle orbits the central body
+static bool wisdom_holman_orbits(const Simulation *simulation,
+                                 const bool *woken, uint64_t index,
+                                 uint64_t central) {
+  return index != central && wisdom_holman_moves(simulation, woken, index);
+}
+
+// Newtonian pull of the central body on a body at the position
+static Vec2Acc wisdom_holman_central_pull(const Simulation *simulation,
+                                          const Particle *central,
+                                          Vec2 position) {
+  double dx = central->position.x - position.x;
+  double dy = central->position.y - position.y;
+  double r2 = dx * dx + dy * dy;
+  if (r2 == 0) {
+    return vec2_acc_zero();
+  }
+  double scale =
+      simulation->gravitational_constant * central->mass / (r2 * sqrt(r2));
+  return (Vec2Acc){dx * scale, dy * scale};
+}
+
+// Find the body the awake particles orbit
+bool wisdom_holman_central(const Simulation *simulation,
+                           const uint64_t *dynamic, uint64_t dynamic_count,
+                           uint64_t *central) {
+  double total_mass = 0;
+  uint64_t heaviest = simulation->particle_count;
+  for (uint64_t a = 0; a < dynamic_count; a++) {
+    const Particle *p = &simulation->particles[dynamic[a]];
+    if (!wisdom_holman_moves(simulation, NULL, dynamic[a])) {
+      continue;
+    }
+    total_mass += p->mass;
+    if (heaviest == simulation->particle_count ||
+        p->mass > simulation->particles[heaviest].mass) {
+      heaviest = dynamic[a];
+    }
+  }
+  if (heaviest == simulation->particle_count) {
+    return false;
+  }
+
+  double central_mass = simulation->particles[heaviest].mass;
+  *central = heaviest;
+  return central_mass >=
+         simulation->dominant_mass_ratio * (total_mass - central_mass);
+}
+
+// Advance the awake particles and the tracers by half a step of the Kepler
+// drift and the jump
+void wisdom_holman_half_drift(Simulation *simulation, ArenaAllocator *allocator,
+                              const uint64_t *dynamic, uint64_t dynamic_count,
+                              uint64_t central, const bool *woken,
+                              double time_step, bool first_half) {
+  Particle *sun = &simulation->particles[central];
+  TracerSet *tracers = &simulation->tracers;
+  double h = 0.5 * time_step;
+  double mu = simulation->gravitational_constant * sun->mass;
+
+  // Barycentre of the moving bodies
+  double total_mass = 0;
+  Vec2Acc center = vec2_acc_zero();
+  Vec2Acc center_velocity = vec2_acc_zero();
+  for (uint64_t a = 0; a < dynamic_count; a++) {
+    const Particle *p = &simulation->particles[dynamic[a]];
+    if (!wisdom_holman_moves(simulation, woken, dynamic[a])) {
+      continue;
+    }
+    total_mass += p->mass;
+    center.x += p->mass * p->position.x;
+    center.y += p->mass * p->position.y;
+    center_velocity.x += p->mass * p->velocity.x;
+    center_velocity.y += p->mass * p->velocity.y;
+  }
+  center.x /= total_mass;
+  center.y /= total_mass;
+  center_velocity.x /= total_mass;
+  center_velocity.y /= total_mass;
+
+  // Heliocentric positions and barycentric velocities, bodies first and
+  // tracers after them
+  uint64_t count = dynamic_count + tracers->count;
+  Vec2Acc *positions = arena_alloc(allocator, sizeof(Vec2Acc) * count);
+  Vec2Acc *velocities = arena_alloc(allocator, sizeof(Vec2Acc) * count);
+  assert(positions && velocities);
+  Vec2Acc *tracer_positions = positions + dynamic_count;
+  Vec2Acc *tracer_velocities = velocities + dynamic_count;
+
+  Vec2Acc momentum = vec2_acc_zero();
+  for (uint64_t a = 0; a < dynamic_count; a++) {
+    const Particle *p = &simulation->particles[dynamic[a]];
+    if (!wisdom_holman_orbits(simulation, woken, dynamic[a], central)) {
+      continue;
+    }
+    positions[a] = (Vec2Acc){p->position.x - sun->position.x,
+                             p->position.y - sun->position.y};
+    velocities[a] = (Vec2Acc){p->velocity.x - center_velocity.x,
+                              p->velocity.y - center_velocity.y};
+    momentum.x += p->mass * velocities[a].x;
+    momentum.y += p->mass * velocities[a].y;
+  }
+  for (uint64_t t = 0; t < tracers->count; t++) {
+    tracer_positions[t] =
+        (Vec2Acc){tracers->positions[t].x - sun->position.x,
+                  tracers->positions[t].y - sun->position.y};
+    tracer_velocities[t] =
+        (Vec2Acc){tracers->velocities[t].x - center_velocity.x,
+                  tracers->velocities[t].y - center_velocity.y};
+  }
+
+  // The jump moves every body by the recoil of the central body, which only
+  // depends on the total barycentric momentum and so is the same for all
+  Vec2Acc jump = {h * momentum.x / sun->mass, h * momentum.y / sun->mass};
+  for (uint64_t a = 0; a < count; a++) {
+    if (a < dynamic_count &&
+        !wisdom_holman_orbits(simulation, woken, dynamic[a], central)) {
+      continue;
+    }
+    if (first_half) {
+      kepler_drift(&positions[a], &velocities[a], mu, h);
+    }
+    positions[a].x += jump.x;
+    positions[a].y += jump.y;
+    if (!first_half) {
+      kepler_drift(&positions[a], &velocities[a], mu, h);
+    }
+  }
+
+  // The barycentre moves freely, place the central body so that it stays put
+  center.x += h * center_velocity.x;
+  center.y += h * center_velocity.y;
+  Vec2Acc offset = vec2_acc_zero();
+  momentum = vec2_acc_zero();
+  for (uint64_t a = 0; a < dynamic_count; a++) {
+    const Particle *p = &simulation->particles[dynamic[a]];
+    if (!wisdom_holman_orbits(simulation, woken, dynamic[a], central)) {
+      continue;
+    }
+    offset.x += p->mass * positions[a].x;
+    offset.y += p->mass * positions[a].y;
+    momentum.x += p->mass * velocities[a].x;
+    momentum.y += p->mass * velocities[a].y;
+  }
+  Vec2Acc sun_position = {center.x - offset.x / total_mass,
+                          center.y - offset.y / total_mass};
+
+  for (uint64_t a = 0; a < dynamic_count; a++) {
+    Particle *p = &simulation->particles[dynamic[a]];
+    if (!wisdom_holman_orbits(simulation, woken, dynamic[a], central)) {
+      continue;
+    }
+    p->position = (Vec2){sun_position.x + positions[a].x,
+                         sun_position.y + positions[a].y};
+    p->velocity = (Vec2){center_velocity.x + velocities[a].x,
+                         center_velocity.y + velocities[a].y};
+  }
+  for (uint64_t t = 0; t < tracers->count; t++) {
+    tracers->positions[t] = (Vec2){sun_position.x + tracer_positions[t].x,
+                                   sun_position.y + tracer_positions[t].y};
+    tracers->velocities[t] =
+        (Vec2){center_velocity.x + tracer_velocities[t].x,
+               center_velocity.y + tracer_velocities[t].y};
+  }
+  sun->position = (Vec2){sun_position.x, sun_position.y};
+  sun->velocity = (Vec2){center_velocity.x - momentum.x / sun->mass,
+                         center_velocity.y - momentum.y / sun->mass};
+}
+
+// Turn total accelerations into interaction kicks
+void wisdom_holman_interaction(const Simulation *simulation,
+                               const uint64_t *dynamic, uint64_t dynamic_count,
+                               uint64_t central, const bool *woken,
+                               Vec2Acc *accelerations,
+                               Vec2 *tracer_accelerations) {
+  const Particle *sun = &simulation->particles[central];
+  for (uint64_t a = 0; a < dynamic_count; a++) {
+    uint64_t i = dynamic[a];
+    const Particle *p = &simulation->particles[i];
+    if (!wisdom_holman_orbits(simulation, woken, i, central)) {
+      continue;
+    }
+
+    // The pull on the body and its reaction on the central body
+    Vec2Acc pull = wisdom_holman_central_pull(simulation, sun, p->position);
+    double ratio = p->mass / sun->mass;
+    accelerations[i].x -= pull.x;
+    accelerations[i].y -= pull.y;
+    accelerations[central].x += ratio * pull.x;
+    accelerations[central].y += ratio * pull.y;
+  }
+
+  for (uint64_t t = 0; tracer_accelerations && t < simulation->tracers.count;
+       t++) {
+    Vec2Acc pull = wisdom_holman_central_pull(simulation, sun,
+                                              simulation->tracers.positions[t]);
+    tracer_accelerations[t].x -= pull.x;
+    tracer_accelerations[t].y -= pull.y;
+  }
+}
@@ -0,0 +1,188 @@
+#include "range_coder.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+// Append a byte to the encoder's buffer
+static void range_encoder_put(RangeEncoder *encoder, uint8_t byte) {
+  if (encoder->size == encoder->capacity) {
+    encoder->capacity = encoder->capacity ? encoder->capacity * 2 : 4096;
+    encoder->bytes = realloc(encoder->bytes, encoder->capacity);
+    assert(encoder->bytes);
+  }
+  encoder->bytes[encoder->size++] = byte;
+}
+
+// Start coding into the encoder's buffer, keeping its memory
+void range_encoder_reset(RangeEncoder *encoder) {
+  encoder->size = 0;
+  encoder->low = 0;
+  encoder->range = UINT32_MAX;
+  encoder->cache = 0;
+  encoder->cache_size = 1;
+}
+
+// Move the top byte of low into the buffer. A byte of 0xFF may still change
+// when a later addition carries into it, so those are held back and counted
+// until the carry is known.
+void range_encoder_shift_low(RangeEncoder *encoder) {
+  if ((uint32_t)encoder->low < 0xFF000000u || (encoder->low >> 32) != 0) {
+    uint8_t carry = (uint8_t)(encoder->low >> 32);
+    uint8_t byte = encoder->cache;
+    do {
+      range_encoder_put(encoder, (uint8_t)(byte + carry));
+      byte = 0xFF;
+    } while (--encoder->cache_size != 0);
+    encoder->cache = (uint8_t)(encoder->low >> 24);
+  }
+  encoder->cache_size++;
+  encoder->low = (encoder->low & 0x00FFFFFFu) << 8;
+}
+
+// Write out the bytes still held in the encoder
+void range_encoder_flush(RangeEncoder *encoder) {
+  for (int i = 0; i < 5; i++) {
+    range_encoder_shift_low(encoder);
+  }
+}
+
+// Release the encoder's buffer
+void range_encoder_deinit(RangeEncoder *encoder) {
+  free(encoder->bytes);
+  *encoder = (RangeEncoder){0};
+}
+
+// Code the count lowest bits of a value with even odds
+void range_encode_direct(RangeEncoder *encoder, uint64_t value,
+                         uint32_t count) {
+  while (count-- > 0) {
+    encoder->range >>= 1;
+    if ((value >> count) & 1) {
+      encoder->low += encoder->range;
+    }
+    while (encoder->range < RANGE_TOP) {
+      encoder->range <<= 8;
+      range_encoder_shift_low(encoder);
+    }
+  }
+}
+
+// Start reading coded bytes. The encoder's first byte is always zero and
+// the next four fill the code.
+void range_decoder_init(RangeDecoder *decoder, const uint8_t *bytes,
+                        size_t size) {
+  *decoder = (RangeDecoder){.bytes = bytes, .size = size, .range = UINT32_MAX};
+  for (int i = 0; i < 5; i++) {
+    decoder->code = (decoder->code << 8) | range_decoder_next_byte(decoder);
+  }
+}
+
+// Read count bits coded with even odds
+uint64_t range_decode_direct(RangeDecoder *decoder, uint32_t count) {
+  uint64_t value = 0;
+  while (count-- > 0) {
+    decoder->range >>= 1;
+    uint32_t bit = decoder->code >= decoder->range;
+    if (bit) {
+      decoder->code -= decoder->range;
+    }
+    value = (value << 1) | bit;
+    while (decoder->range < RANGE_TOP) {
+      decoder->range <<= 8;
+      decoder->code = (decoder->code << 8) | range_decoder_next_byte(decoder);
+    }
+  }
+  return value;
+}
+
+// Set every probability of the model to even odds
+void range_int_model_init(RangeIntModel *model) {
+  for (size_t i = 0; i < (1u << RANGE_INT_LENGTH_BITS); i++) {
+    model->length[i] = RANGE_PROBABILITY_ONE / 2;
+  }
+  for (size_t i = 0; i < (1u << RANGE_INT_LONG_LENGTH_BITS); i++) {
+    model->long_length[i] = RANGE_PROBABILITY_ONE / 2;
+  }
+  for (size_t n = 0; n < 65; n++) {
+    for (size_t i = 0; i < (1u << RANGE_INT_MODELED_BITS); i++) {
+      model->mantissa[n][i] = RANGE_PROBABILITY_ONE / 2;
+    }
+  }
+}
+
+// Code the count lowest bits of a value with a tree of probabilities, where
+// each bit's probability depends on the bits above it
+static void range_encode_tree(RangeEncoder *encoder, uint16_t *tree,
+                              uint32_t value, uint32_t count) {
+  uint32_t node = 1;
+  while (count-- > 0) {
+    uint32_t bit = (value >> count) & 1;
+    range_encode_bit(encoder, &tree[node], bit);
+    node = (node << 1) | bit;
+  }
+}
+
+// Read count bits coded with a tree of probabilities
+static uint32_t range_decode_tree(RangeDecoder *decoder, uint16_t *tree,
+                                  uint32_t count) {
+  uint32_t node = 1;
+  for (uint32_t i = 0; i < count; i++) {
+    node = (node << 1) | range_decode_bit(decoder, &tree[node]);
+  }
+  return node - (1u << count);
+}
+
+// Code a signed integer. Signs are folded into the lowest bit so that small
+// magnitudes of either sign have short lengths.
+void range_encode_int(RangeEncoder *encoder, RangeIntModel *model,
+                      int64_t value) {
+  uint64_t folded = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+  uint32_t length = folded ? 64 - (uint32_t)__builtin_clzll(folded) : 0;
+  if (length < RANGE_INT_LONG_LENGTH) {
+    range_encode_tree(encoder, model->length, length, RANGE_INT_LENGTH_BITS);
+  } else {
+    range_encode_tree(encoder, model->length, RANGE_INT_LONG_LENGTH,
+                      RANGE_INT_LENGTH_BITS);
+    range_encode_tree(encoder, model->long_length,
+                      length - RANGE_INT_LONG_LENGTH,
+                      RANGE_INT_LONG_LENGTH_BITS);
+  }
+  if (length <= 1) {
+    return;
+  }
+
+  uint32_t rest = length - 1;
+  uint32_t modeled =
+      rest < RANGE_INT_MODELED_BITS ? rest : RANGE_INT_MODELED_BITS;
+  uint32_t direct = rest - modeled;
+  range_encode_tree(encoder, model->mantissa[length],
+                    (uint32_t)(folded >> direct) & ((1u << modeled) - 1),
+                    modeled);
+  range_encode_direct(encoder, folded, direct);
+}
+
+// Read a signed integer
+int64_t range_decode_int(RangeDecoder *decoder, RangeIntModel *model) {
+  uint32_t length =
+      range_decode_tree(decoder, model->length, RANGE_INT_LENGTH_BITS);
+  if (length == RANGE_INT_LONG_LENGTH) {
+    length += range_decode_tree(decoder, model->long_length,
+                                RANGE_INT_LONG_LENGTH_BITS);
+  }
+  uint64_t folded = length;
+  if (length > 64) {
+    // Only a damaged stream holds such a length
+    return 0;
+  }
+  if (length > 1) {
+    uint32_t rest = length - 1;
+    uint32_t modeled =
+        rest < RANGE_INT_MODELED_BITS ? rest : RANGE_INT_MODELED_BITS;
+    uint32_t direct = rest - modeled;
+    uint64_t high =
+        (1u << modeled) |
+        range_decode_tree(decoder, model->mantissa[length], modeled);
+    folded = (high << direct) | range_decode_direct(decoder, direct);
+  }
+  return (int64_t)(folded >> 1) ^ -(int64_t)(folded & 1);
+}
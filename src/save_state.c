@@ -0,0 +1,724 @@
+// mmap, open and fstat are POSIX, hidden by strict C11 on glibc and by a bare
+// _POSIX_C_SOURCE on macOS
+#define _POSIX_C_SOURCE 200809L
+#define _DARWIN_C_SOURCE
+
+#include "save_state.h"
+
+#include "simulation.h"
+#include "vector.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SAVE_STATE_MAGIC "GRAVSAVE"
+// Every column starts on a multiple of this many bytes from the file start
+#define SAVE_STATE_ALIGNMENT 64
+// Elements gathered into one write, as many of the largest type as fit the
+// scratch
+#define SAVE_STATE_CHUNK (SAVE_STATE_SCRATCH_SIZE / 16)
+// Most columns a directory may list, newer files may add columns this
+// version skips
+#define SAVE_STATE_MAX_COLUMNS 256
+#define SAVE_STATE_CHECKSUM_PRIME 0x9E3779B97F4A7C15ull
+// Largest static field grid and trail sample block a file may ask for,
+// far above the defaults but small enough to allocate
+#define SAVE_STATE_MAX_FIELD_RESOLUTION 1024
+#define SAVE_STATE_MAX_TRAIL_SAMPLES (UINT64_C(1) << 26)
+// Appended to the path to name the file written before the rename, the X
+// are replaced by mkstemp
+#define SAVE_STATE_TEMPORARY_SUFFIX ".XXXXXX"
+
+// Fields stored as columns, in the order they are written
+typedef enum {
+    SAVE_COLUMN_PARTICLE_POSITION,
+    SAVE_COLUMN_PARTICLE_VELOCITY,
+    SAVE_COLUMN_PARTICLE_MASS,
+    SAVE_COLUMN_PARTICLE_RADIUS,
+    // Bit 0 static, bit 1 sleeping
+    SAVE_COLUMN_PARTICLE_FLAGS,
+    SAVE_COLUMN_PARTICLE_CALM_STEPS,
+    SAVE_COLUMN_PARTICLE_SLEEP_ACCELERATION,
+    SAVE_COLUMN_TRACER_POSITION,
+    SAVE_COLUMN_TRACER_VELOCITY,
+    SAVE_COLUMN_COUNT,
+} SaveColumnId;
+
+// Element types of the columns
+typedef enum {
+    SAVE_TYPE_U8 = 1,
+    SAVE_TYPE_U32,
+    SAVE_TYPE_F64,
+    SAVE_TYPE_F32X2,
+    SAVE_TYPE_F64X2,
+} SaveColumnType;
+
+// Type vectors are written with, the build's precision
+#define SAVE_TYPE_VEC2                                                         \
+  (sizeof(VECTOR_T) == sizeof(float) ? SAVE_TYPE_F32X2 : SAVE_TYPE_F64X2)
+
+#define SAVE_FLAG_STATIC 1u
+#define SAVE_FLAG_SLEEPING 2u
+
+// Start of the file. Counts are those of the particle and tracer columns,
+// the checksum covers the parameters and the column directory.
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t column_count;
+  uint64_t particle_count;
+  uint64_t tracer_count;
+  uint64_t checksum;
+  uint64_t reserved;
+} SaveStateHeader;
+
+// Simulation parameters, directly after the header
+typedef struct {
+  double gravitational_constant;
+  double dominant_mass_ratio;
+  double respa_heavy_fraction;
+  double softening_length;
+  double sleep_energy_threshold;
+  double ccd_fast_ratio;
+  uint32_t integrator;
+  uint32_t respa_interval;
+  uint32_t softening_kernel;
+  uint32_t sleep_step_count;
+  uint32_t ccd_max_events;
+  uint32_t static_field_resolution;
+  uint32_t trail_length;
+  uint32_t trail_stride;
+  uint64_t trail_capacity;
+} SaveStateParameters;
+
+// Entry of the column directory, which follows the parameters
+typedef struct {
+  uint32_t id;
+  uint32_t type;
+  uint64_t offset;
+  uint64_t count;
+  uint64_t checksum;
+} SaveStateColumn;
+
+_Static_assert(sizeof(SaveStateHeader) == 48, "header layout changed");
+_Static_assert(sizeof(SaveStateParameters) == 88, "parameter layout changed");
+_Static_assert(sizeof(SaveStateColumn) == 32, "column layout changed");
+
+// Gathers count elements of a column starting at first into out
+typedef void (*SaveColumnFill)(const Simulation *simulation, uint64_t first,
+                               uint64_t count, void *out);
+
+// Checksum over 32 byte blocks in four independent lanes, so that it runs
+// close to memory speed
+typedef struct {
+  uint64_t lanes[4];
+  uint64_t length;
+} SaveChecksum;
+
+// Whether the host stores integers least significant byte first
+static bool save_state_little_endian(void) {
+  uint16_t one = 1;
+  unsigned char first;
+  memcpy(&first, &one, 1);
+  return first == 1;
+}
+
+static SaveChecksum save_checksum_init(void) {
+  return (SaveChecksum){.lanes = {1, 2, 3, 4}};
+}
+
+// Mix one 32 byte block into the lanes
+static inline void save_checksum_block(SaveChecksum *checksum,
+                                       const unsigned char *block) {
+  for (int lane = 0; lane < 4; lane++) {
+    uint64_t word;
+    memcpy(&word, block + lane * 8, 8);
+    uint64_t mixed =
+        (checksum->lanes[lane] ^ word) * SAVE_STATE_CHECKSUM_PRIME;
+    checksum->lanes[lane] = mixed ^ (mixed >> 32);
+  }
+}
+
+// Add bytes to the checksum. Only the last update may have a size that is not
+// a multiple of 32 bytes.
+static void save_checksum_update(SaveChecksum *checksum, const void *data,
+                                 size_t size) {
+  const unsigned char *bytes = data;
+  size_t full = size / 32 * 32;
+  for (size_t offset = 0; offset < full; offset += 32) {
+    save_checksum_block(checksum, bytes + offset);
+  }
+  if (size > full) {
+    unsigned char tail[32] = {0};
+    memcpy(tail, bytes + full, size - full);
+    save_checksum_block(checksum, tail);
+  }
+  checksum->length += size;
+}
+
+// Combine the lanes and the length into the final checksum
+static uint64_t save_checksum_finish(const SaveChecksum *checksum) {
+  uint64_t hash = checksum->length * SAVE_STATE_CHECKSUM_PRIME;
+  for (int lane = 0; lane < 4; lane++) {
+    hash = (hash ^ checksum->lanes[lane]) * SAVE_STATE_CHECKSUM_PRIME;
+    hash ^= hash >> 29;
+  }
+  return hash;
+}
+
+// Checksum of a block of memory
+static uint64_t save_checksum(const void *data, size_t size) {
+  SaveChecksum checksum = save_checksum_init();
+  save_checksum_update(&checksum, data, size);
+  return save_checksum_finish(&checksum);
+}
+
+// Size in bytes of one element of a column type, 0 for unknown types
+static size_t save_state_type_size(uint32_t type) {
+  switch (type) {
+  case SAVE_TYPE_U8:
+    return 1;
+  case SAVE_TYPE_U32:
+    return 4;
+  case SAVE_TYPE_F64:
+  case SAVE_TYPE_F32X2:
+    return 8;
+  case SAVE_TYPE_F64X2:
+    return 16;
+  default:
+    return 0;
+  }
+}
+
+// Round an offset up to the column alignment
+static uint64_t save_state_align(uint64_t offset) {
+  return (offset + SAVE_STATE_ALIGNMENT - 1) / SAVE_STATE_ALIGNMENT *
+         SAVE_STATE_ALIGNMENT;
+}
+
+static void save_fill_position(const Simulation *simulation, uint64_t first,
+                               uint64_t count, void *out) {
+  Vec2 *vectors = out;
+  for (uint64_t i = 0; i < count; i++) {
+    vectors[i] = simulation->particles[first + i].position;
+  }
+}
+
+static void save_fill_velocity(const Simulation *simulation, uint64_t first,
+                               uint64_t count, void *out) {
+  Vec2 *vectors = out;
+  for (uint64_t i = 0; i < count; i++) {
+    vectors[i] = simulation->particles[first + i].velocity;
+  }
+}
+
+static void save_fill_mass(const Simulation *simulation, uint64_t first,
+                           uint64_t count, void *out) {
+  double *values = out;
+  for (uint64_t i = 0; i < count; i++) {
+    values[i] = simulation->particles[first + i].mass;
+  }
+}
+
+static void save_fill_radius(const Simulation *simulation, uint64_t first,
+                             uint64_t count, void *out) {
+  double *values = out;
+  for (uint64_t i = 0; i < count; i++) {
+    values[i] = simulation->particles[first + i].radius;
+  }
+}
+
+static void save_fill_flags(const Simulation *simulation, uint64_t first,
+                            uint64_t count, void *out) {
+  uint8_t *flags = out;
+  for (uint64_t i = 0; i < count; i++) {
+    const Particle *p = &simulation->particles[first + i];
+    flags[i] = (p->is_static ? SAVE_FLAG_STATIC : 0) |
+               (p->is_sleeping ? SAVE_FLAG_SLEEPING : 0);
+  }
+}
+
+static void save_fill_calm_steps(const Simulation *simulation, uint64_t first,
+                                 uint64_t count, void *out) {
+  uint32_t *values = out;
+  for (uint64_t i = 0; i < count; i++) {
+    values[i] = simulation->particles[first + i].calm_steps;
+  }
+}
+
+static void save_fill_sleep_acceleration(const Simulation *simulation,
+                                         uint64_t first, uint64_t count,
+                                         void *out) {
+  Vec2 *vectors = out;
+  for (uint64_t i = 0; i < count; i++) {
+    vectors[i] = simulation->particles[first + i].sleep_acceleration;
+  }
+}
+
+static void save_fill_tracer_position(const Simulation *simulation,
+                                      uint64_t first, uint64_t count,
+                                      void *out) {
+  memcpy(out, &simulation->tracers.positions[first], sizeof(Vec2) * count);
+}
+
+static void save_fill_tracer_velocity(const Simulation *simulation,
+                                      uint64_t first, uint64_t count,
+                                      void *out) {
+  memcpy(out, &simulation->tracers.velocities[first], sizeof(Vec2) * count);
+}
+
+// How each column is written, indexed by SaveColumnId
+static const struct {
+  uint32_t type;
+  bool is_tracer;
+  SaveColumnFill fill;
+} SAVE_COLUMN_WRITERS[SAVE_COLUMN_COUNT] = {
+    [SAVE_COLUMN_PARTICLE_POSITION] = {SAVE_TYPE_VEC2, false,
+                                       save_fill_position},
+    [SAVE_COLUMN_PARTICLE_VELOCITY] = {SAVE_TYPE_VEC2, false,
+                                       save_fill_velocity},
+    [SAVE_COLUMN_PARTICLE_MASS] = {SAVE_TYPE_F64, false, save_fill_mass},
+    [SAVE_COLUMN_PARTICLE_RADIUS] = {SAVE_TYPE_F64, false, save_fill_radius},
+    [SAVE_COLUMN_PARTICLE_FLAGS] = {SAVE_TYPE_U8, false, save_fill_flags},
+    [SAVE_COLUMN_PARTICLE_CALM_STEPS] = {SAVE_TYPE_U32, false,
+                                         save_fill_calm_steps},
+    [SAVE_COLUMN_PARTICLE_SLEEP_ACCELERATION] = {SAVE_TYPE_VEC2, false,
+                                                 save_fill_sleep_acceleration},
+    [SAVE_COLUMN_TRACER_POSITION] = {SAVE_TYPE_VEC2, true,
+                                     save_fill_tracer_position},
+    [SAVE_COLUMN_TRACER_VELOCITY] = {SAVE_TYPE_VEC2, true,
+                                     save_fill_tracer_velocity},
+};
+
+// Write all of a block at the descriptor's position, retrying short writes
+static bool save_state_write_all(int descriptor, const void *data,
+                                 size_t size) {
+  const unsigned char *bytes = data;
+  while (size > 0) {
+    ssize_t written = write(descriptor, bytes, size);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    bytes += written;
+    size -= (size_t)written;
+  }
+  return true;
+}
+
+// Write one column at the descriptor's position, returning false on failure
+static bool save_state_write_column(int descriptor,
+                                    const Simulation *simulation,
+                                    SaveColumnId id, unsigned char *chunk,
+                                    SaveStateColumn *column) {
+  size_t size = save_state_type_size(SAVE_COLUMN_WRITERS[id].type);
+  SaveChecksum checksum = save_checksum_init();
+  for (uint64_t first = 0; first < column->count; first += SAVE_STATE_CHUNK) {
+    uint64_t count = column->count - first;
+    if (count > SAVE_STATE_CHUNK) {
+      count = SAVE_STATE_CHUNK;
+    }
+    SAVE_COLUMN_WRITERS[id].fill(simulation, first, count, chunk);
+    save_checksum_update(&checksum, chunk, size * count);
+    if (!save_state_write_all(descriptor, chunk, size * count)) {
+      return false;
+    }
+  }
+  column->checksum = save_checksum_finish(&checksum);
+  return true;
+}
+
+// Write the simulation to an open file with write and lseek only
+SaveStateStatus save_state_write_descriptor(const Simulation *simulation,
+                                            int descriptor, void *scratch) {
+  if (!save_state_little_endian()) {
+    return SAVE_STATE_UNSUPPORTED_HOST;
+  }
+
+  SaveStateHeader header = {
+      .version = SAVE_STATE_VERSION,
+      .column_count = SAVE_COLUMN_COUNT,
+      .particle_count = simulation->particle_count,
+      .tracer_count = simulation->tracers.count,
+  };
+  memcpy(header.magic, SAVE_STATE_MAGIC, sizeof(header.magic));
+
+  // The parameters are directly followed by the column directory, so the
+  // header checksum covers one contiguous block
+  struct {
+    SaveStateParameters parameters;
+    SaveStateColumn columns[SAVE_COLUMN_COUNT];
+  } described = {
+      .parameters =
+          {
+              .gravitational_constant = simulation->gravitational_constant,
+              .dominant_mass_ratio = simulation->dominant_mass_ratio,
+              .respa_heavy_fraction = simulation->respa_heavy_fraction,
+              .softening_length = simulation->softening_length,
+              .sleep_energy_threshold = simulation->sleep_energy_threshold,
+              .ccd_fast_ratio = simulation->ccd_fast_ratio,
+              .integrator = simulation->integrator,
+              .respa_interval = simulation->respa_interval,
+              .softening_kernel = simulation->softening_kernel,
+              .sleep_step_count = simulation->sleep_step_count,
+              .ccd_max_events = simulation->ccd_max_events,
+              .static_field_resolution = simulation->static_field_resolution,
+              .trail_length = simulation->trails.length,
+              .trail_stride = simulation->trails.stride,
+              .trail_capacity = simulation->trails.capacity,
+          },
+  };
+  _Static_assert(sizeof(described) == sizeof(SaveStateParameters) +
+                                          sizeof(SaveStateColumn) *
+                                              SAVE_COLUMN_COUNT,
+                 "padding between the parameters and the directory");
+
+  // Columns are written first, the header and directory that describe them
+  // once their checksums are known
+  static const unsigned char zeros[SAVE_STATE_ALIGNMENT] = {0};
+  uint64_t offset = save_state_align(sizeof(header) + sizeof(described));
+  bool written = lseek(descriptor, (off_t)offset, SEEK_SET) >= 0;
+  for (uint32_t id = 0; written && id < SAVE_COLUMN_COUNT; id++) {
+    SaveStateColumn *column = &described.columns[id];
+    *column = (SaveStateColumn){
+        .id = id,
+        .type = SAVE_COLUMN_WRITERS[id].type,
+        .offset = offset,
+        .count = SAVE_COLUMN_WRITERS[id].is_tracer
+                     ? simulation->tracers.count
+                     : simulation->particle_count,
+    };
+    written =
+        save_state_write_column(descriptor, simulation, id, scratch, column);
+
+    // Zeros up to the start of the next column, which also keeps the file
+    // long enough for columns that are empty
+    uint64_t end = offset + column->count * save_state_type_size(column->type);
+    offset = save_state_align(end);
+    written = written && save_state_write_all(descriptor, zeros, offset - end);
+  }
+
+  header.checksum = save_checksum(&described, sizeof(described));
+  written = written && lseek(descriptor, 0, SEEK_SET) == 0 &&
+            save_state_write_all(descriptor, &header, sizeof(header)) &&
+            save_state_write_all(descriptor, &described, sizeof(described));
+  return written ? SAVE_STATE_OK : SAVE_STATE_IO_ERROR;
+}
+
+// Write the simulation to a file
+SaveStateStatus save_state_write(const Simulation *simulation,
+                                 const char *path) {
+  if (!save_state_little_endian()) {
+    return SAVE_STATE_UNSUPPORTED_HOST;
+  }
+  // The file is written under a unique name next to the path and renamed
+  // over it once complete, so a failed save leaves the previous one intact
+  // and two saves into the same path at once cannot mix
+  size_t length = strlen(path);
+  char *temporary_path = malloc(length + sizeof(SAVE_STATE_TEMPORARY_SUFFIX));
+  void *scratch = malloc(SAVE_STATE_SCRATCH_SIZE);
+  if (temporary_path == NULL || scratch == NULL) {
+    free(temporary_path);
+    free(scratch);
+    return SAVE_STATE_IO_ERROR;
+  }
+  memcpy(temporary_path, path, length);
+  memcpy(temporary_path + length, SAVE_STATE_TEMPORARY_SUFFIX,
+         sizeof(SAVE_STATE_TEMPORARY_SUFFIX));
+  int descriptor = mkstemp(temporary_path);
+  if (descriptor < 0) {
+    free(temporary_path);
+    free(scratch);
+    return SAVE_STATE_IO_ERROR;
+  }
+
+  // mkstemp creates the file readable by its owner only
+  SaveStateStatus status =
+      fchmod(descriptor, 0644) == 0
+          ? save_state_write_descriptor(simulation, descriptor, scratch)
+          : SAVE_STATE_IO_ERROR;
+  if (close(descriptor) != 0 && status == SAVE_STATE_OK) {
+    status = SAVE_STATE_IO_ERROR;
+  }
+  if (status == SAVE_STATE_OK && rename(temporary_path, path) != 0) {
+    status = SAVE_STATE_IO_ERROR;
+  }
+  if (status != SAVE_STATE_OK) {
+    unlink(temporary_path);
+  }
+  free(temporary_path);
+  free(scratch);
+  return status;
+}
+
+// Read a vector column into vectors spaced stride bytes apart
+static void save_state_load_vectors(const void *column, uint32_t type,
+                                    uint64_t count, void *out, size_t stride) {
+  unsigned char *destination = out;
+  if (type == SAVE_TYPE_VEC2) {
+    const Vec2 *vectors = column;
+    if (stride == sizeof(Vec2)) {
+      memcpy(out, vectors, sizeof(Vec2) * count);
+      return;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+      memcpy(destination + i * stride, &vectors[i], sizeof(Vec2));
+    }
+    return;
+  }
+
+  // Saved in the other precision
+  for (uint64_t i = 0; i < count; i++) {
+    Vec2 vector;
+    if (type == SAVE_TYPE_F64X2) {
+      const double *xy = (const double *)column + 2 * i;
+      vector = (Vec2){xy[0], xy[1]};
+    } else {
+      const float *xy = (const float *)column + 2 * i;
+      vector = (Vec2){xy[0], xy[1]};
+    }
+    memcpy(destination + i * stride, &vector, sizeof(Vec2));
+  }
+}
+
+// Whether a column of the given id may have the given type
+static bool save_state_type_matches(uint32_t id, uint32_t type) {
+  uint32_t expected = SAVE_COLUMN_WRITERS[id].type;
+  if (expected == SAVE_TYPE_VEC2) {
+    return type == SAVE_TYPE_F32X2 || type == SAVE_TYPE_F64X2;
+  }
+  return type == expected;
+}
+
+// Whether the parameters read from a file describe a simulation that can
+// run: finite numbers, known enums and sizes that can be allocated
+static bool save_state_parameters_valid(const SaveStateParameters *p) {
+  double numbers[] = {p->gravitational_constant, p->dominant_mass_ratio,
+                      p->respa_heavy_fraction,   p->softening_length,
+                      p->sleep_energy_threshold, p->ccd_fast_ratio};
+  for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+    if (!isfinite(numbers[i])) {
+      return false;
+    }
+  }
+  if (p->integrator > INTEGRATOR_RESPA ||
+      p->softening_kernel > SOFTENING_SPLINE) {
+    return false;
+  }
+  if (p->static_field_resolution == 0 ||
+      p->static_field_resolution > SAVE_STATE_MAX_FIELD_RESOLUTION) {
+    return false;
+  }
+  // The trail block holds capacity * length samples, written so the
+  // product cannot overflow
+  return p->trail_capacity <= SAVE_STATE_MAX_TRAIL_SAMPLES &&
+         (p->trail_length == 0 ||
+          p->trail_capacity <=
+              SAVE_STATE_MAX_TRAIL_SAMPLES / p->trail_length);
+}
+
+// Build a simulation from a mapped file
+static SaveStateStatus save_state_load(Simulation *simulation,
+                                       const unsigned char *data,
+                                       size_t size) {
+  SaveStateHeader header;
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, SAVE_STATE_MAGIC, sizeof(header.magic)) != 0) {
+    return SAVE_STATE_BAD_FORMAT;
+  }
+  if (header.version != SAVE_STATE_VERSION) {
+    return SAVE_STATE_BAD_VERSION;
+  }
+  if (header.column_count > SAVE_STATE_MAX_COLUMNS) {
+    return SAVE_STATE_BAD_FORMAT;
+  }
+  size_t described_size = sizeof(SaveStateParameters) +
+                          sizeof(SaveStateColumn) * header.column_count;
+  if (sizeof(header) + described_size > size) {
+    return SAVE_STATE_BAD_FORMAT;
+  }
+  if (save_checksum(data + sizeof(header), described_size) !=
+      header.checksum) {
+    return SAVE_STATE_CORRUPT;
+  }
+
+  SaveStateParameters parameters;
+  memcpy(&parameters, data + sizeof(header), sizeof(parameters));
+  if (!save_state_parameters_valid(&parameters)) {
+    return SAVE_STATE_BAD_FORMAT;
+  }
+  const SaveStateColumn *directory =
+      (const SaveStateColumn *)(data + sizeof(header) + sizeof(parameters));
+
+  // Find and check every known column, skipping unknown ones
+  const void *columns[SAVE_COLUMN_COUNT] = {0};
+  uint32_t types[SAVE_COLUMN_COUNT] = {0};
+  for (uint32_t c = 0; c < header.column_count; c++) {
+    const SaveStateColumn *column = &directory[c];
+    if (column->id >= SAVE_COLUMN_COUNT) {
+      continue;
+    }
+    size_t element_size = save_state_type_size(column->type);
+    uint64_t expected_count = SAVE_COLUMN_WRITERS[column->id].is_tracer
+                                  ? header.tracer_count
+                                  : header.particle_count;
+    if (!save_state_type_matches(column->id, column->type) ||
+        column->count != expected_count ||
+        column->offset % SAVE_STATE_ALIGNMENT != 0 || column->offset > size ||
+        column->count > (size - column->offset) / element_size) {
+      return SAVE_STATE_BAD_FORMAT;
+    }
+    const unsigned char *bytes = data + column->offset;
+    if (save_checksum(bytes, column->count * element_size) !=
+        column->checksum) {
+      return SAVE_STATE_CORRUPT;
+    }
+    columns[column->id] = bytes;
+    types[column->id] = column->type;
+  }
+  for (uint32_t id = 0; id < SAVE_COLUMN_COUNT; id++) {
+    if (columns[id] == NULL) {
+      return SAVE_STATE_BAD_FORMAT;
+    }
+  }
+
+  Simulation loaded = simulation_init(parameters.gravitational_constant);
+  loaded.dominant_mass_ratio = parameters.dominant_mass_ratio;
+  loaded.respa_heavy_fraction = parameters.respa_heavy_fraction;
+  loaded.softening_length = parameters.softening_length;
+  loaded.sleep_energy_threshold = parameters.sleep_energy_threshold;
+  loaded.ccd_fast_ratio = parameters.ccd_fast_ratio;
+  loaded.integrator = parameters.integrator;
+  loaded.respa_interval = parameters.respa_interval;
+  loaded.softening_kernel = parameters.softening_kernel;
+  loaded.sleep_step_count = parameters.sleep_step_count;
+  loaded.ccd_max_events = parameters.ccd_max_events;
+  loaded.static_field_resolution = parameters.static_field_resolution;
+  loaded.trails.length = parameters.trail_length;
+  loaded.trails.stride = parameters.trail_stride;
+  loaded.trails.capacity = parameters.trail_capacity;
+  // Drawings of the old simulation's still particles are out of date
+  loaded.still_version = simulation->still_version + 1;
+
+  uint64_t count = header.particle_count;
+  if (count > 0) {
+    loaded.particles = calloc(count, sizeof(Particle));
+    if (loaded.particles == NULL) {
+      return SAVE_STATE_IO_ERROR;
+    }
+    loaded.particle_count = count;
+    loaded.particle_capacity = count;
+  }
+  Particle *particles = loaded.particles;
+  save_state_load_vectors(columns[SAVE_COLUMN_PARTICLE_POSITION],
+                          types[SAVE_COLUMN_PARTICLE_POSITION], count,
+                          &particles[0].position, sizeof(Particle));
+  save_state_load_vectors(columns[SAVE_COLUMN_PARTICLE_VELOCITY],
+                          types[SAVE_COLUMN_PARTICLE_VELOCITY], count,
+                          &particles[0].velocity, sizeof(Particle));
+  save_state_load_vectors(columns[SAVE_COLUMN_PARTICLE_SLEEP_ACCELERATION],
+                          types[SAVE_COLUMN_PARTICLE_SLEEP_ACCELERATION],
+                          count, &particles[0].sleep_acceleration,
+                          sizeof(Particle));
+  const double *masses = columns[SAVE_COLUMN_PARTICLE_MASS];
+  for (uint64_t i = 0; i < count; i++) {
+    particles[i].mass = masses[i];
+  }
+  const double *radii = columns[SAVE_COLUMN_PARTICLE_RADIUS];
+  for (uint64_t i = 0; i < count; i++) {
+    particles[i].radius = radii[i];
+  }
+  const uint8_t *flags = columns[SAVE_COLUMN_PARTICLE_FLAGS];
+  for (uint64_t i = 0; i < count; i++) {
+    particles[i].is_static = flags[i] & SAVE_FLAG_STATIC;
+    particles[i].is_sleeping = flags[i] & SAVE_FLAG_SLEEPING;
+  }
+  const uint32_t *calm_steps = columns[SAVE_COLUMN_PARTICLE_CALM_STEPS];
+  for (uint64_t i = 0; i < count; i++) {
+    particles[i].calm_steps = calm_steps[i];
+  }
+
+  uint64_t tracer_count = header.tracer_count;
+  if (tracer_count > 0) {
+    TracerSet *tracers = &loaded.tracers;
+    tracers->positions = malloc(sizeof(Vec2) * tracer_count);
+    tracers->velocities = malloc(sizeof(Vec2) * tracer_count);
+    tracers->count = tracer_count;
+    tracers->capacity = tracer_count;
+    if (tracers->positions == NULL || tracers->velocities == NULL) {
+      simulation_deinit(&loaded);
+      return SAVE_STATE_IO_ERROR;
+    }
+    save_state_load_vectors(columns[SAVE_COLUMN_TRACER_POSITION],
+                            types[SAVE_COLUMN_TRACER_POSITION], tracer_count,
+                            tracers->positions, sizeof(Vec2));
+    save_state_load_vectors(columns[SAVE_COLUMN_TRACER_VELOCITY],
+                            types[SAVE_COLUMN_TRACER_VELOCITY], tracer_count,
+                            tracers->velocities, sizeof(Vec2));
+  }
+
+  simulation_deinit(simulation);
+  *simulation = loaded;
+  return SAVE_STATE_OK;
+}
+
+// Replace the simulation with the one saved in a file
+SaveStateStatus save_state_read(Simulation *simulation, const char *path) {
+  if (!save_state_little_endian()) {
+    return SAVE_STATE_UNSUPPORTED_HOST;
+  }
+  int descriptor = open(path, O_RDONLY);
+  if (descriptor < 0) {
+    return SAVE_STATE_IO_ERROR;
+  }
+  struct stat status;
+  if (fstat(descriptor, &status) != 0) {
+    close(descriptor);
+    return SAVE_STATE_IO_ERROR;
+  }
+  size_t size = (size_t)status.st_size;
+  if (size < sizeof(SaveStateHeader)) {
+    close(descriptor);
+    return SAVE_STATE_BAD_FORMAT;
+  }
+
+  // The mapping stays valid after the descriptor is closed
+  void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+  close(descriptor);
+  if (data == MAP_FAILED) {
+    return SAVE_STATE_IO_ERROR;
+  }
+  SaveStateStatus result = save_state_load(simulation, data, size);
+  munmap(data, size);
+  return result;
+}
+
+// Short description of a status for messages
+const char *save_state_status_name(SaveStateStatus status) {
+  switch (status) {
+  case SAVE_STATE_OK:
+    return "ok";
+  case SAVE_STATE_IO_ERROR:
+    return "cannot read or write the file";
+  case SAVE_STATE_BAD_FORMAT:
+    return "not a valid save file";
+  case SAVE_STATE_BAD_VERSION:
+    return "unsupported save file version";
+  case SAVE_STATE_CORRUPT:
+    return "checksum mismatch";
+  case SAVE_STATE_UNSUPPORTED_HOST:
+    return "big-endian hosts are not supported";
+  }
+  return "unknown";
+}
@@ -0,0 +1,79 @@
+#include "scenario.h"
+
+#include "simulation.h"
+#include "vector.h"
+
+#include <math.h>
+#include <stdint.h>
+
+#define SCENARIO_MIN_PARTICLE_RADIUS 0.5
+#define SCENARIO_MAX_PARTICLE_RADIUS 2.0
+
+// Advance the xorshift state and return a number in [0, 1)
+static double scenario_random(uint32_t *state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return (x >> 8) * (1.0 / 16777216.0);
+}
+
+// Fill the simulation with a rotating disk of particles of random size
+void scenario_random_disk(Simulation *simulation, uint64_t count,
+                          double disk_radius, double density, uint32_t seed) {
+  uint32_t state = seed ? seed : 1;
+  double pi = acos(-1.0);
+
+  // Total mass of the disk, used for the orbital velocity of each particle
+  double total_mass = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    Particle particle = {0};
+    particle.radius = SCENARIO_MIN_PARTICLE_RADIUS +
+                      scenario_random(&state) * (SCENARIO_MAX_PARTICLE_RADIUS -
+                                                 SCENARIO_MIN_PARTICLE_RADIUS);
+    particle.mass = pi * particle.radius * particle.radius * density;
+
+    // Uniform over the disk area
+    double distance = disk_radius * sqrt(scenario_random(&state));
+    double angle = 2 * pi * scenario_random(&state);
+    particle.position = (Vec2){distance * cos(angle), distance * sin(angle)};
+
+    simulation_new_particle(simulation, particle);
+    total_mass += particle.mass;
+  }
+
+  // Give every particle the circular speed of the mass enclosed by its orbit,
+  // assuming the mass is spread evenly over the disk
+  Particle *particles =
+      &simulation->particles[simulation->particle_count - count];
+  for (uint64_t i = 0; i < count; i++) {
+    Particle *p = &particles[i];
+    double distance = vec2_len(p->position);
+    if (distance == 0) {
+      continue;
+    }
+    double enclosed = total_mass * (distance * distance) /
+                      (disk_radius * disk_radius);
+    double speed =
+        sqrt(simulation->gravitational_constant * enclosed / distance);
+    p->velocity = (Vec2){-p->position.y / distance * speed,
+                         p->position.x / distance * speed};
+  }
+}
+
+// Fill a circle uniformly with tracers at rest
+void scenario_dust(Simulation *simulation, Vec2 center, double radius,
+                   uint64_t count, uint32_t seed) {
+  uint32_t state = seed ? seed : 1;
+  double pi = acos(-1.0);
+
+  for (uint64_t i = 0; i < count; i++) {
+    // Uniform over the circle
+    double distance = radius * sqrt(scenario_random(&state));
+    double angle = scenario_random(&state) * 2 * pi;
+    Vec2 position = {center.x + distance * cos(angle),
+                     center.y + distance * sin(angle)};
+    simulation_new_tracer(simulation, position, vec2_zero());
+  }
+}
@@ -1,19 +1,45 @@
 #include "simulation.h"
 
 #include "arena_allocator.h"
+#include "ccd.h"
+#include "collision.h"
+#include "gravity.h"
+#include "islands.h"
+#include "respa.h"
+#include "spatial_grid.h"
+#include "static_field.h"
+#include "trails.h"
+#include "wisdom_holman.h"
 #include "vector.h"
+#include "vector_batch.h"
 
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-// Forward declarations
-double calculate_force_gravity(Particle p1, Particle p2,
-                               double gravitational_constant);
+// Fraction of the radius sum within which two particles count as touching
+#define SIMULATION_CONTACT_SLOP 0.01
 
 // Initialize the simulation struct
 Simulation simulation_init(double gravitational_constant) {
-  return (Simulation){.gravitational_constant = gravitational_constant};
+  return (Simulation){
+      .gravitational_constant = gravitational_constant,
+      .integrator = INTEGRATOR_EULER,
+      .dominant_mass_ratio = SIMULATION_DEFAULT_DOMINANT_MASS_RATIO,
+      .respa_interval = SIMULATION_DEFAULT_RESPA_INTERVAL,
+      .respa_heavy_fraction = SIMULATION_DEFAULT_RESPA_HEAVY_FRACTION,
+      .softening_kernel = SIMULATION_DEFAULT_SOFTENING_KERNEL,
+      .softening_length = SIMULATION_DEFAULT_SOFTENING_LENGTH,
+      .sleep_energy_threshold = SIMULATION_DEFAULT_SLEEP_ENERGY,
+      .sleep_step_count = SIMULATION_DEFAULT_SLEEP_STEPS,
+      .ccd_fast_ratio = SIMULATION_DEFAULT_CCD_FAST_RATIO,
+      .ccd_max_events = SIMULATION_DEFAULT_CCD_MAX_EVENTS,
+      .static_field_resolution = SIMULATION_DEFAULT_STATIC_FIELD_RESOLUTION,
+      .trails = {.length = SIMULATION_DEFAULT_TRAIL_LENGTH,
+                 .stride = SIMULATION_DEFAULT_TRAIL_STRIDE,
+                 .capacity = SIMULATION_DEFAULT_TRAIL_CAPACITY},
+  };
 }
 
 // Deinitialize the simulation struct
@@ -21,96 +47,271 @@ void simulation_deinit(Simulation *simulation) {
   free(simulation->particles);
   simulation->particles = NULL;
   simulation->particle_count = 0;
+  simulation->particle_capacity = 0;
+
+  free(simulation->tracers.positions);
+  free(simulation->tracers.velocities);
+  free(simulation->tracers.accelerations);
+  simulation->tracers = (TracerSet){0};
+  trails_deinit(&simulation->trails);
+
+  static_field_deinit(&simulation->static_field);
+  respa_deinit(&simulation->respa);
+  spatial_grid_deinit(&simulation->collision_grid);
 }
 
-// Update the simulation
-void simulation_update(Simulation *simulation, ArenaAllocator *allocator,
-                       double time_step) {
-  Vec2 *accelerations =
-      arena_alloc(allocator, sizeof(Vec2) * simulation->particle_count);
+// Resolve the collision between two particles, recording them as touching in
+// the contact graph for island detection
+static void simulation_collide_pair(Simulation *simulation,
+                                    IslandSet *islands, bool *woken, uint64_t i,
+                                    uint64_t j) {
+  Particle *p1 = &simulation->particles[i];
+  Particle *p2 = &simulation->particles[j];
 
-  // Initialize accelerations to zero
-  for (uint64_t i = 0; i < simulation->particle_count; i++) {
-    accelerations[i] = vec2_zero();
+  Vec2 diff = vec2_sub(p1->position, p2->position);
+  double distance = vec2_len(diff);
+  double radius_sum = p1->radius + p2->radius;
+
+  // Contacts with a static particle anchor the island instead of joining
+  // every particle resting on the same static into one island
+  if (distance < radius_sum * (1.0 + SIMULATION_CONTACT_SLOP)) {
+    if (p1->is_static && !p2->is_static) {
+      islands_anchor(islands, j);
+    } else if (p2->is_static && !p1->is_static) {
+      islands_anchor(islands, i);
+    } else if (!p1->is_static) {
+      islands_union(islands, i, j);
+    }
   }
 
-  // Calculate the acceleration for each particle
-  for (uint64_t i = 0; i < simulation->particle_count; i++) {
-    Particle *p1 = &simulation->particles[i];
+  // Pairs that cannot move skip the narrow phase
+  bool p1_resting = p1->is_sleeping || p1->is_static;
+  bool p2_resting = p2->is_sleeping || p2->is_static;
+  if (p1_resting && p2_resting) {
+    return;
+  }
 
-    for (uint64_t j = i + 1; j < simulation->particle_count; j++) {
-      Particle *p2 = &simulation->particles[j];
+  if (distance < radius_sum) {
+    Vec2 collision_normal = vec2_norm(diff);
+    double overlap = radius_sum - distance;
 
-      // Calculate the gravitational force magnitude
-      double force =
-          calculate_force_gravity(*p1, *p2, simulation->gravitational_constant);
+    // A sleeping particle is woken by an energetic contact, a calm one
+    // rests against it as if it were immovable
+    double inverse_mass_p1 = collision_inverse_mass(p1);
+    double inverse_mass_p2 = collision_inverse_mass(p2);
+    if (p1->is_sleeping || p2->is_sleeping) {
+      Particle *sleeper = p1->is_sleeping ? p1 : p2;
+      Particle *other = p1->is_sleeping ? p2 : p1;
+      double other_energy =
+          0.5 * vec2_dot(other->velocity, other->velocity);
+      if (other_energy > simulation->sleep_energy_threshold) {
+        sleeper->is_sleeping = false;
+        woken[sleeper == p1 ? i : j] = true;
+        simulation->still_version++;
+      } else if (sleeper == p1) {
+        inverse_mass_p1 = 0;
+      } else {
+        inverse_mass_p2 = 0;
+      }
+    }
+    double total_inverse_mass = inverse_mass_p1 + inverse_mass_p2;
 
-      // Calculate the normalized direction vector from p1 to p2
-      Vec2 direction = vec2_norm(vec2_sub(p2->position, p1->position));
+    // Corrected separation calculation
+    Vec2 separation =
+        vec2_scale(collision_normal, overlap / total_inverse_mass);
 
-      // Calculate accelerations
-      Vec2 acceleration_p1 = vec2_scale(direction, force / p1->mass);
-      Vec2 acceleration_p2 = vec2_scale(direction, -force / p2->mass);
+    // Corrected position adjustments
+    p1->position =
+        vec2_add(p1->position, vec2_scale(separation, inverse_mass_p1));
+    p2->position =
+        vec2_sub(p2->position, vec2_scale(separation, inverse_mass_p2));
+
+    collision_apply_impulse(p1, p2, inverse_mass_p1, inverse_mass_p2,
+                            collision_normal);
+  }
+}
 
-      // Update accelerations
-      accelerations[i] = vec2_add(accelerations[i], acceleration_p1);
-      accelerations[j] = vec2_add(accelerations[j], acceleration_p2);
+// Update the simulation
+void simulation_update(Simulation *simulation, ArenaAllocator *allocator,
+                       double time_step) {
+  Vec2Acc *accelerations =
+      arena_alloc(allocator, sizeof(Vec2Acc) * simulation->particle_count);
+
+  // Static particles act through a cached field and feel no forces themselves
+  static_field_update(simulation);
+  uint64_t *dynamic;
+  uint64_t dynamic_count =
+      gravity_dynamic_indices(simulation, allocator, &dynamic);
+
+  // The mixed-variable integrator drifts around a dominant mass on either
+  // side of the kick, every other case uses the Euler step
+  uint64_t central;
+  bool mixed = simulation->integrator == INTEGRATOR_WISDOM_HOLMAN &&
+               wisdom_holman_central(simulation, dynamic, dynamic_count,
+                                     &central);
+  if (mixed) {
+    wisdom_holman_half_drift(simulation, allocator, dynamic, dynamic_count,
+                             central, NULL, time_step, true);
+  }
+
+  // Calculate the acceleration for each particle, and with multiple time
+  // steps the part of it to kick with in this step
+  Vec2Acc *kicks = accelerations;
+  if (simulation->integrator == INTEGRATOR_RESPA) {
+    kicks =
+        arena_alloc(allocator, sizeof(Vec2Acc) * simulation->particle_count);
+    assert(simulation->particle_count == 0 || kicks);
+    respa_accumulate(simulation, allocator, dynamic, dynamic_count,
+                     accelerations, kicks);
+  } else {
+    gravity_accumulate(simulation, dynamic, dynamic_count, accelerations);
+  }
+
+  // Tracers feel the particles but not each other
+  TracerSet *tracers = &simulation->tracers;
+  Vec2 *tracer_accelerations = NULL;
+  if (tracers->count > 0) {
+    if (tracers->count > tracers->acceleration_capacity) {
+      Vec2 *grown = realloc(tracers->accelerations,
+                            sizeof(Vec2) * tracers->count);
+      assert(grown);
+      tracers->accelerations = grown;
+      tracers->acceleration_capacity = tracers->count;
     }
+    tracer_accelerations = tracers->accelerations;
+    gravity_accumulate_tracers(simulation, dynamic, dynamic_count,
+                               tracer_accelerations);
   }
 
-  // Update the velocity and position of each particle
+  // Wake sleeping particles whose acceleration has changed
+  bool *woken =
+      arena_alloc(allocator, sizeof(bool) * simulation->particle_count);
   for (uint64_t i = 0; i < simulation->particle_count; i++) {
     Particle *p = &simulation->particles[i];
-    p->velocity =
-        vec2_add(p->velocity, vec2_scale(accelerations[i], time_step));
-    p->position = vec2_add(p->position, vec2_scale(p->velocity, time_step));
+    woken[i] = p->is_sleeping &&
+               islands_force_changed(simulation, p,
+                                     vec2_from_acc(accelerations[i]),
+                                     time_step);
+    if (woken[i]) {
+      p->is_sleeping = false;
+      simulation->still_version++;
+    }
   }
 
-  // Resolve collisions for each particle
+  // The pull of the central body is part of the drift, so only the rest of
+  // the acceleration is kicked
+  if (mixed) {
+    kicks =
+        arena_alloc(allocator, sizeof(Vec2Acc) * simulation->particle_count);
+    assert(simulation->particle_count == 0 || kicks);
+    memcpy(kicks, accelerations,
+           sizeof(Vec2Acc) * simulation->particle_count);
+    wisdom_holman_interaction(simulation, dynamic, dynamic_count, central,
+                              woken, kicks, tracer_accelerations);
+  }
+
+  // Update the velocity of each awake particle
+  for (uint64_t a = 0; a < dynamic_count; a++) {
+    uint64_t i = dynamic[a];
+    Particle *p = &simulation->particles[i];
+    if (p->is_sleeping) {
+      continue;
+    }
+    Vec2 acceleration = vec2_from_acc(kicks[i]);
+    p->velocity = vec2_add(p->velocity, vec2_scale(acceleration, time_step));
+  }
+  if (tracers->count > 0) {
+    vec2_array_add_scaled(tracers->velocities, tracer_accelerations, time_step,
+                          tracers->count);
+  }
+
+  if (mixed) {
+    // Curved drifts are not swept, the collision pass below still separates
+    // any overlap they leave behind
+    wisdom_holman_half_drift(simulation, allocator, dynamic, dynamic_count,
+                             central, woken, time_step, false);
+    // Particles woken by the kick were at rest through the first half drift
+    // and are left out of the second, so they take a semi-implicit Euler
+    // step with their total acceleration instead of lagging behind
+    for (uint64_t a = 0; a < dynamic_count; a++) {
+      Particle *p = &simulation->particles[dynamic[a]];
+      if (woken[dynamic[a]] && !p->is_sleeping) {
+        p->position = vec2_add(p->position, vec2_scale(p->velocity, time_step));
+      }
+    }
+  } else {
+    // Update the position of each awake particle, sweeping fast particles
+    // against the rest so that they cannot tunnel through them
+    ccd_advance(simulation, allocator, woken, time_step);
+    if (tracers->count > 0) {
+      vec2_array_add_scaled(tracers->positions, tracers->velocities,
+                            time_step, tracers->count);
+    }
+  }
+
+  // Resolve collisions between every pair of particles close enough to touch,
+  // found through the collision grid. Particles pushed apart during the pass
+  // stay in the cells they were sorted into, the pairs they reach by that
+  // push are resolved in the next step.
+  IslandSet islands = islands_init(allocator, simulation->particle_count);
+  SpatialGrid *grid = &simulation->collision_grid;
+  spatial_grid_build(grid, simulation->particles, simulation->particle_count);
+  double reach_scale = 1.0 + SIMULATION_CONTACT_SLOP;
   for (uint64_t i = 0; i < simulation->particle_count; i++) {
-    Particle *p1 = &simulation->particles[i];
-    for (uint64_t j = i + 1; j < simulation->particle_count; j++) {
-      Particle *p2 = &simulation->particles[j];
-
-      Vec2 diff = vec2_sub(p1->position, p2->position);
-      double distance = vec2_len(diff);
-      double radius_sum = p1->radius + p2->radius;
-
-      if (distance < radius_sum) {
-        Vec2 collision_normal = vec2_norm(diff);
-        double overlap = radius_sum - distance;
-        double total_inverse_mass = (1.0 / p1->mass) + (1.0 / p2->mass);
-
-        // Corrected separation calculation
-        Vec2 separation =
-            vec2_scale(collision_normal, overlap / total_inverse_mass);
-
-        // Corrected position adjustments
-        p1->position =
-            vec2_add(p1->position, vec2_scale(separation, 1.0 / p1->mass));
-        p2->position =
-            vec2_sub(p2->position, vec2_scale(separation, 1.0 / p2->mass));
-
-        Vec2 relative_velocity = vec2_sub(p1->velocity, p2->velocity);
-        double normal_velocity = vec2_dot(relative_velocity, collision_normal);
-
-        if (normal_velocity > 0) {
-          continue;
+    const Particle *p = &simulation->particles[i];
+    if (p->radius > grid->oversized_radius) {
+      continue;
+    }
+    double reach = (p->radius + grid->max_radius) * reach_scale;
+    SpatialGridRange range = spatial_grid_range(
+        grid, (Vec2){p->position.x - reach, p->position.y - reach},
+        (Vec2){p->position.x + reach, p->position.y + reach});
+    for (uint32_t row = range.min_row; row <= range.max_row; row++) {
+      for (uint32_t column = range.min_column; column <= range.max_column;
+           column++) {
+        uint64_t cell = (uint64_t)row * grid->columns + column;
+        for (uint64_t k = grid->cell_start[cell];
+             k < grid->cell_start[cell + 1]; k++) {
+          uint64_t j = grid->cell_particles[k];
+          if (j > i) {
+            simulation_collide_pair(simulation, &islands, woken, i, j);
+          }
         }
+      }
+    }
+  }
 
-        double restitution = 1.0;
-        double impulse_scalar =
-            -(1 + restitution) * normal_velocity / total_inverse_mass;
-        Vec2 impulse = vec2_scale(collision_normal, impulse_scalar);
-
-        // Corrected velocity adjustments
-        p1->velocity =
-            vec2_add(p1->velocity, vec2_scale(impulse, 1.0 / p1->mass));
-        p2->velocity =
-            vec2_sub(p2->velocity, vec2_scale(impulse, 1.0 / p2->mass));
+  // Oversized particles meet the particles in the cells they overlap and
+  // each other
+  for (uint64_t a = 0; a < grid->oversized_count; a++) {
+    uint64_t i = grid->oversized[a];
+    const Particle *p = &simulation->particles[i];
+    double reach = (p->radius + grid->max_radius) * reach_scale;
+    SpatialGridRange range = spatial_grid_range(
+        grid, (Vec2){p->position.x - reach, p->position.y - reach},
+        (Vec2){p->position.x + reach, p->position.y + reach});
+    for (uint32_t row = range.min_row; row <= range.max_row; row++) {
+      for (uint32_t column = range.min_column; column <= range.max_column;
+           column++) {
+        uint64_t cell = (uint64_t)row * grid->columns + column;
+        for (uint64_t k = grid->cell_start[cell];
+             k < grid->cell_start[cell + 1]; k++) {
+          uint64_t j = grid->cell_particles[k];
+          simulation_collide_pair(simulation, &islands, woken, i < j ? i : j,
+                                  i < j ? j : i);
+        }
       }
     }
+    for (uint64_t b = a + 1; b < grid->oversized_count; b++) {
+      simulation_collide_pair(simulation, &islands, woken, i,
+                              grid->oversized[b]);
+    }
   }
+
+  // Put calm islands to sleep and wake the disturbed ones
+  islands_update_sleep(simulation, &islands, allocator, accelerations, woken);
+
+  trails_record(simulation);
 }
 
 // Get the particle at the index
@@ -119,25 +320,233 @@ Particle *simulation_get_particle(Simulation *simulation, uint64_t index) {
 }
 
 // Add a new particle to the simulation
-void simulation_new_particle(Simulation *simulation, ArenaAllocator *allocator,
-                             Particle particle) {
+void simulation_new_particle(Simulation *simulation, Particle particle) {
+  assert(simulation);
+
+  if (simulation->particle_count == simulation->particle_capacity) {
+    uint64_t capacity =
+        simulation->particle_capacity ? simulation->particle_capacity * 2 : 256;
+    Particle *particles =
+        realloc(simulation->particles, sizeof(Particle) * capacity);
+    assert(particles);
+    simulation->particles = particles;
+    simulation->particle_capacity = capacity;
+  }
+  // Trails are only started through simulation_set_trail_masked
+  particle.trail = 0;
+  simulation->particles[simulation->particle_count++] = particle;
+
+  if (particle.is_static) {
+    static_field_invalidate(simulation);
+    simulation->still_version++;
+  }
+  respa_invalidate(simulation);
+}
+
+// Pin a particle in place or release it
+void simulation_set_particle_static(Simulation *simulation, uint64_t index,
+                                    bool is_static) {
+  assert(simulation);
+  assert(index < simulation->particle_count);
+
+  Particle *p = &simulation->particles[index];
+  if (p->is_static == is_static) {
+    return;
+  }
+  p->is_static = is_static;
+  p->velocity = vec2_zero();
+  p->is_sleeping = false;
+  p->calm_steps = 0;
+  static_field_invalidate(simulation);
+  respa_invalidate(simulation);
+  simulation->still_version++;
+}
+
+// Wake a particle so that the island it belongs to is checked again
+static void simulation_wake(Simulation *simulation, Particle *p) {
+  if (p->is_sleeping) {
+    simulation->still_version++;
+  }
+  p->is_sleeping = false;
+  p->calm_steps = 0;
+}
+
+// Number of particles covered by the mask
+static uint64_t simulation_mask_limit(const Simulation *simulation,
+                                      const Bitset *mask) {
+  return mask->count < simulation->particle_count ? mask->count
+                                                  : simulation->particle_count;
+}
+
+// Pin or release every particle in the mask
+void simulation_set_static_masked(Simulation *simulation, const Bitset *mask,
+                                  bool is_static) {
   assert(simulation);
-  assert(allocator);
+  assert(mask);
 
-  Particle *new_particle = arena_alloc(allocator, sizeof(Particle));
-  *new_particle = particle;
-  simulation->particle_count++;
+  bool changed = false;
+  uint64_t limit = simulation_mask_limit(simulation, mask);
+  for (uint64_t i = bitset_next(mask, 0); i < limit;
+       i = bitset_next(mask, i + 1)) {
+    Particle *p = &simulation->particles[i];
+    if (p->is_static != is_static) {
+      p->is_static = is_static;
+      p->velocity = vec2_zero();
+      simulation_wake(simulation, p);
+      changed = true;
+    }
+  }
 
-  if (simulation->particles == NULL) {
-    simulation->particles = new_particle;
+  if (changed) {
+    static_field_invalidate(simulation);
+    respa_invalidate(simulation);
+    simulation->still_version++;
   }
 }
 
-// Calculate the force between two particles
-double calculate_force_gravity(Particle p1, Particle p2,
-                               double gravitational_constant) {
-  double distance_squared = vec2_dist_squared(p1.position, p2.position);
-  double force =
-      (gravitational_constant * p1.mass * p2.mass) / distance_squared;
-  return force;
-}
\ No newline at end of file
+// Move every particle in the mask by the offset
+void simulation_translate_masked(Simulation *simulation, const Bitset *mask,
+                                 Vec2 offset) {
+  assert(simulation);
+  assert(mask);
+
+  bool moved_static = false;
+  uint64_t limit = simulation_mask_limit(simulation, mask);
+  for (uint64_t i = bitset_next(mask, 0); i < limit;
+       i = bitset_next(mask, i + 1)) {
+    Particle *p = &simulation->particles[i];
+    p->position = vec2_add(p->position, offset);
+    if (p->is_static) {
+      moved_static = true;
+    } else {
+      simulation_wake(simulation, p);
+    }
+  }
+
+  if (moved_static) {
+    static_field_invalidate(simulation);
+    simulation->still_version++;
+  }
+}
+
+// Set the velocity of every dynamic particle in the mask
+void simulation_set_velocity_masked(Simulation *simulation, const Bitset *mask,
+                                    Vec2 velocity) {
+  assert(simulation);
+  assert(mask);
+
+  uint64_t limit = simulation_mask_limit(simulation, mask);
+  for (uint64_t i = bitset_next(mask, 0); i < limit;
+       i = bitset_next(mask, i + 1)) {
+    Particle *p = &simulation->particles[i];
+    if (!p->is_static) {
+      p->velocity = velocity;
+      simulation_wake(simulation, p);
+    }
+  }
+}
+
+// Multiply the mass of every particle in the mask, keeping its radius
+void simulation_scale_density_masked(Simulation *simulation,
+                                     const Bitset *mask, double factor) {
+  assert(simulation);
+  assert(mask);
+  assert(factor > 0);
+
+  bool scaled = false;
+  bool scaled_static = false;
+  uint64_t limit = simulation_mask_limit(simulation, mask);
+  for (uint64_t i = bitset_next(mask, 0); i < limit;
+       i = bitset_next(mask, i + 1)) {
+    Particle *p = &simulation->particles[i];
+    p->mass *= factor;
+    simulation_wake(simulation, p);
+    scaled = true;
+    scaled_static = scaled_static || p->is_static;
+  }
+
+  if (scaled_static) {
+    static_field_invalidate(simulation);
+  }
+  if (scaled) {
+    respa_invalidate(simulation);
+  }
+}
+
+// Give every particle in the mask a trail, or take it away
+void simulation_set_trail_masked(Simulation *simulation, const Bitset *mask,
+                                 bool has_trail) {
+  assert(simulation);
+  assert(mask);
+
+  uint64_t limit = simulation_mask_limit(simulation, mask);
+  for (uint64_t i = bitset_next(mask, 0); i < limit;
+       i = bitset_next(mask, i + 1)) {
+    if (!has_trail) {
+      trails_remove(simulation, i);
+    } else if (!trails_add(simulation, i)) {
+      break;
+    }
+  }
+}
+
+// Remove every particle in the mask
+void simulation_delete_masked(Simulation *simulation, const Bitset *mask) {
+  assert(simulation);
+  assert(mask);
+
+  uint64_t limit = simulation_mask_limit(simulation, mask);
+  uint64_t first = bitset_next(mask, 0);
+  if (first >= limit) {
+    return;
+  }
+
+  // Compact the survivors in place. Particles may have rested on the removed
+  // ones, so every survivor is woken to find its footing again.
+  bool deleted_static = false;
+  uint64_t deleted_paid = 0;
+  uint64_t kept = first;
+  for (uint64_t i = first; i < simulation->particle_count; i++) {
+    Particle *p = &simulation->particles[i];
+    if (i < limit && bitset_test(mask, i)) {
+      deleted_static = deleted_static || p->is_static;
+      deleted_paid += i < simulation->respa.paid_count;
+      continue;
+    }
+    simulation->particles[kept++] = *p;
+  }
+  simulation->particle_count = kept;
+  for (uint64_t i = 0; i < kept; i++) {
+    simulation_wake(simulation, &simulation->particles[i]);
+  }
+
+  if (deleted_static) {
+    static_field_invalidate(simulation);
+  }
+  respa_invalidate(simulation);
+  respa_remove_paid(simulation, deleted_paid);
+  trails_compact(simulation);
+  simulation->still_version++;
+}
+
+// Add a new tracer to the simulation
+void simulation_new_tracer(Simulation *simulation, Vec2 position,
+                           Vec2 velocity) {
+  assert(simulation);
+
+  TracerSet *tracers = &simulation->tracers;
+  if (tracers->count == tracers->capacity) {
+    uint64_t capacity = tracers->capacity ? tracers->capacity * 2 : 1024;
+    Vec2 *positions = realloc(tracers->positions, sizeof(Vec2) * capacity);
+    assert(positions);
+    tracers->positions = positions;
+    Vec2 *velocities = realloc(tracers->velocities, sizeof(Vec2) * capacity);
+    assert(velocities);
+    tracers->velocities = velocities;
+    tracers->capacity = capacity;
+  }
+
+  tracers->positions[tracers->count] = position;
+  tracers->velocities[tracers->count] = velocity;
+  tracers->count++;
+}
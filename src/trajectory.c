@@ -0,0 +1,880 @@
+// clock_gettime, mmap and open are POSIX, hidden by strict C11 on glibc and
+// by a bare _POSIX_C_SOURCE on macOS
+#define _POSIX_C_SOURCE 200809L
+#define _DARWIN_C_SOURCE
+
+#include "trajectory.h"
+
+#include "range_coder.h"
+#include "simulation.h"
+#include "vector.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRAJECTORY_MAGIC "GRAVTRAJ"
+#define TRAJECTORY_INDEX_MAGIC "TRAJINDX"
+// Rounded positions are clamped to this magnitude so differences between
+// them never overflow
+#define TRAJECTORY_MAX_COORDINATE ((int64_t)1 << 60)
+// Most bits per axis of the cells that give the Morton order
+#define TRAJECTORY_MORTON_BITS 16
+// Positions ahead of the one being coded that are fetched into the cache
+#define TRAJECTORY_PREFETCH_DISTANCE 16
+
+// Seconds on a monotonic clock
+static double trajectory_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Round a coordinate to a whole number of cells
+static inline int64_t trajectory_quantize(double value, double cell_size) {
+  double cells = round(value / cell_size);
+  if (!(cells > -TRAJECTORY_MAX_COORDINATE)) {
+    // Also catches NaN
+    return cells > 0 ? TRAJECTORY_MAX_COORDINATE : -TRAJECTORY_MAX_COORDINATE;
+  }
+  if (cells > TRAJECTORY_MAX_COORDINATE) {
+    return TRAJECTORY_MAX_COORDINATE;
+  }
+  return (int64_t)cells;
+}
+
+// Spread the low 16 bits of a value to the even bits
+static inline uint32_t trajectory_spread_bits(uint32_t value) {
+  value &= 0xFFFF;
+  value = (value | (value << 8)) & 0x00FF00FF;
+  value = (value | (value << 4)) & 0x0F0F0F0F;
+  value = (value | (value << 2)) & 0x33333333;
+  value = (value | (value << 1)) & 0x55555555;
+  return value;
+}
+
+// Grow the codec's arrays to hold count positions
+static void trajectory_codec_reserve(TrajectoryCodec *codec, uint64_t count) {
+  if (count <= codec->capacity) {
+    return;
+  }
+  uint64_t capacity = codec->capacity ? codec->capacity : 1024;
+  while (capacity < count) {
+    capacity *= 2;
+  }
+  codec->previous = realloc(codec->previous, sizeof(int64_t) * 2 * capacity);
+  codec->current = realloc(codec->current, sizeof(int64_t) * 2 * capacity);
+  codec->radii = realloc(codec->radii, sizeof(float) * capacity);
+  codec->order = realloc(codec->order, sizeof(uint32_t) * capacity);
+  codec->keys = realloc(codec->keys, sizeof(uint32_t) * capacity);
+  codec->scratch_order =
+      realloc(codec->scratch_order, sizeof(uint32_t) * capacity);
+  codec->scratch_keys =
+      realloc(codec->scratch_keys, sizeof(uint32_t) * capacity);
+  assert(codec->previous && codec->current && codec->radii && codec->order &&
+         codec->keys && codec->scratch_order && codec->scratch_keys);
+  codec->capacity = capacity;
+}
+
+// Release the codec's memory
+static void trajectory_codec_deinit(TrajectoryCodec *codec) {
+  free(codec->previous);
+  free(codec->current);
+  free(codec->radii);
+  free(codec->order);
+  free(codec->keys);
+  free(codec->scratch_order);
+  free(codec->scratch_keys);
+  range_encoder_deinit(&codec->encoder);
+}
+
+// Sort the previous positions into Morton order of their cells, on a grid
+// over their bounds with about one cell per position. Both sides compute the
+// order from the previous frame, so it is never stored.
+static void trajectory_morton_order(TrajectoryCodec *codec, uint64_t count) {
+  const int64_t *points = codec->previous;
+  if (count == 0) {
+    return;
+  }
+
+  int64_t min_x = points[0], max_x = points[0];
+  int64_t min_y = points[1], max_y = points[1];
+  for (uint64_t i = 1; i < count; i++) {
+    int64_t x = points[2 * i], y = points[2 * i + 1];
+    min_x = x < min_x ? x : min_x;
+    max_x = x > max_x ? x : max_x;
+    min_y = y < min_y ? y : min_y;
+    max_y = y > max_y ? y : max_y;
+  }
+  uint64_t span = (uint64_t)(max_x - min_x);
+  if ((uint64_t)(max_y - min_y) > span) {
+    span = (uint64_t)(max_y - min_y);
+  }
+
+  uint32_t bits = 1;
+  while (bits < TRAJECTORY_MORTON_BITS && (1ull << (2 * bits)) < count) {
+    bits++;
+  }
+  uint32_t span_bits = span ? 64 - (uint32_t)__builtin_clzll(span) : 0;
+  uint32_t shift = span_bits > bits ? span_bits - bits : 0;
+  for (uint64_t i = 0; i < count; i++) {
+    uint32_t x = (uint32_t)((uint64_t)(points[2 * i] - min_x) >> shift);
+    uint32_t y = (uint32_t)((uint64_t)(points[2 * i + 1] - min_y) >> shift);
+    codec->keys[i] = trajectory_spread_bits(x) | trajectory_spread_bits(y) << 1;
+    codec->order[i] = (uint32_t)i;
+  }
+
+  // Least significant digit first radix sort, stable so equal cells keep
+  // their particle order
+  for (uint32_t digit = 0; digit < 2 * bits; digit += 8) {
+    uint64_t offsets[256] = {0};
+    for (uint64_t i = 0; i < count; i++) {
+      offsets[(codec->keys[i] >> digit) & 0xFF]++;
+    }
+    uint64_t total = 0;
+    for (int b = 0; b < 256; b++) {
+      uint64_t bucket = offsets[b];
+      offsets[b] = total;
+      total += bucket;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+      uint64_t slot = offsets[(codec->keys[i] >> digit) & 0xFF]++;
+      codec->scratch_keys[slot] = codec->keys[i];
+      codec->scratch_order[slot] = codec->order[i];
+    }
+    uint32_t *keys = codec->keys;
+    codec->keys = codec->scratch_keys;
+    codec->scratch_keys = keys;
+    uint32_t *order = codec->order;
+    codec->order = codec->scratch_order;
+    codec->scratch_order = order;
+  }
+}
+
+// Code the current positions in particle order as differences to the
+// previous position, and the radii as differences of their bits
+static void trajectory_encode_key(TrajectoryCodec *codec,
+                                  const TrajectoryFrame *frame) {
+  RangeIntModel models[3];
+  for (int m = 0; m < 3; m++) {
+    range_int_model_init(&models[m]);
+  }
+  RangeEncoder *encoder = &codec->encoder;
+  const int64_t *points = codec->current;
+  uint64_t count = frame->particle_count + frame->tracer_count;
+
+  int64_t last_x = 0, last_y = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    range_encode_int(encoder, &models[0], points[2 * i] - last_x);
+    range_encode_int(encoder, &models[1], points[2 * i + 1] - last_y);
+    last_x = points[2 * i];
+    last_y = points[2 * i + 1];
+  }
+
+  int32_t last_bits = 0;
+  for (uint64_t i = 0; i < frame->particle_count; i++) {
+    int32_t bits;
+    memcpy(&bits, &frame->radii[i], sizeof(bits));
+    range_encode_int(encoder, &models[2], (int64_t)bits - last_bits);
+    last_bits = bits;
+  }
+}
+
+// Code how far each position moved since the previous frame, visiting them
+// in Morton order and subtracting how far the one before moved
+static void trajectory_encode_delta(TrajectoryCodec *codec, uint64_t count) {
+  RangeIntModel models[2];
+  range_int_model_init(&models[0]);
+  range_int_model_init(&models[1]);
+  RangeEncoder *encoder = &codec->encoder;
+  trajectory_morton_order(codec, count);
+
+  int64_t last_x = 0, last_y = 0;
+  for (uint64_t j = 0; j < count; j++) {
+    // The order jumps around the arrays, fetch ahead of it
+    if (j + TRAJECTORY_PREFETCH_DISTANCE < count) {
+      uint64_t ahead = codec->order[j + TRAJECTORY_PREFETCH_DISTANCE];
+      __builtin_prefetch(&codec->current[2 * ahead]);
+      __builtin_prefetch(&codec->previous[2 * ahead]);
+    }
+    uint64_t i = codec->order[j];
+    int64_t x = codec->current[2 * i] - codec->previous[2 * i];
+    int64_t y = codec->current[2 * i + 1] - codec->previous[2 * i + 1];
+    range_encode_int(encoder, &models[0], x - last_x);
+    range_encode_int(encoder, &models[1], y - last_y);
+    last_x = x;
+    last_y = y;
+  }
+}
+
+// Code a frame into the codec's encoder, returning its flags
+static uint32_t trajectory_encode(TrajectoryCodec *codec,
+                                  const TrajectoryFrame *frame) {
+  uint64_t count = frame->particle_count + frame->tracer_count;
+  trajectory_codec_reserve(codec, count);
+  for (uint64_t i = 0; i < count; i++) {
+    codec->current[2 * i] =
+        trajectory_quantize(frame->positions[i].x, codec->cell_size);
+    codec->current[2 * i + 1] =
+        trajectory_quantize(frame->positions[i].y, codec->cell_size);
+  }
+
+  // Deltas need the same particles with the same sizes as the frame before
+  bool is_key = codec->frames_since_key >= TRAJECTORY_KEYFRAME_INTERVAL ||
+                frame->particle_count != codec->particle_count ||
+                frame->tracer_count != codec->tracer_count ||
+                (frame->particle_count > 0 &&
+                 memcmp(frame->radii, codec->radii,
+                        sizeof(float) * frame->particle_count) != 0);
+
+  range_encoder_reset(&codec->encoder);
+  if (is_key) {
+    trajectory_encode_key(codec, frame);
+  } else {
+    trajectory_encode_delta(codec, count);
+  }
+  range_encoder_flush(&codec->encoder);
+
+  if (frame->particle_count > 0) {
+    memcpy(codec->radii, frame->radii, sizeof(float) * frame->particle_count);
+  }
+  codec->particle_count = frame->particle_count;
+  codec->tracer_count = frame->tracer_count;
+  codec->frames_since_key = is_key ? 1 : codec->frames_since_key + 1;
+  int64_t *previous = codec->previous;
+  codec->previous = codec->current;
+  codec->current = previous;
+  return is_key ? TRAJECTORY_FRAME_KEY : 0;
+}
+
+// Read the positions and radii of a keyframe, see trajectory_encode_key
+static void trajectory_decode_key(TrajectoryCodec *codec,
+                                  RangeDecoder *decoder,
+                                  const TrajectoryFrameHeader *header) {
+  RangeIntModel models[3];
+  for (int m = 0; m < 3; m++) {
+    range_int_model_init(&models[m]);
+  }
+  int64_t *points = codec->current;
+  uint64_t count = header->particle_count + header->tracer_count;
+
+  int64_t last_x = 0, last_y = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    last_x += range_decode_int(decoder, &models[0]);
+    last_y += range_decode_int(decoder, &models[1]);
+    points[2 * i] = last_x;
+    points[2 * i + 1] = last_y;
+  }
+
+  int32_t last_bits = 0;
+  for (uint64_t i = 0; i < header->particle_count; i++) {
+    last_bits += (int32_t)range_decode_int(decoder, &models[2]);
+    memcpy(&codec->radii[i], &last_bits, sizeof(last_bits));
+  }
+}
+
+// Read the movements of a frame, see trajectory_encode_delta
+static void trajectory_decode_delta(TrajectoryCodec *codec,
+                                    RangeDecoder *decoder, uint64_t count) {
+  RangeIntModel models[2];
+  range_int_model_init(&models[0]);
+  range_int_model_init(&models[1]);
+  trajectory_morton_order(codec, count);
+
+  int64_t last_x = 0, last_y = 0;
+  for (uint64_t j = 0; j < count; j++) {
+    if (j + TRAJECTORY_PREFETCH_DISTANCE < count) {
+      uint64_t ahead = codec->order[j + TRAJECTORY_PREFETCH_DISTANCE];
+      __builtin_prefetch(&codec->current[2 * ahead], 1);
+      __builtin_prefetch(&codec->previous[2 * ahead]);
+    }
+    uint64_t i = codec->order[j];
+    last_x += range_decode_int(decoder, &models[0]);
+    last_y += range_decode_int(decoder, &models[1]);
+    codec->current[2 * i] = codec->previous[2 * i] + last_x;
+    codec->current[2 * i + 1] = codec->previous[2 * i + 1] + last_y;
+  }
+}
+
+// Decode a frame's bytes into the codec. Other than keyframes, the frame
+// must follow the one the codec holds.
+static void trajectory_decode(TrajectoryCodec *codec,
+                              const TrajectoryFrameHeader *header,
+                              const uint8_t *bytes) {
+  uint64_t count = header->particle_count + header->tracer_count;
+  trajectory_codec_reserve(codec, count);
+  RangeDecoder decoder;
+  range_decoder_init(&decoder, bytes, header->size);
+  if (header->flags & TRAJECTORY_FRAME_KEY) {
+    trajectory_decode_key(codec, &decoder, header);
+  } else {
+    trajectory_decode_delta(codec, &decoder, count);
+  }
+
+  codec->particle_count = header->particle_count;
+  codec->tracer_count = header->tracer_count;
+  int64_t *previous = codec->previous;
+  codec->previous = codec->current;
+  codec->current = previous;
+}
+
+// Code a frame, append it to the file and add it to the index
+static bool trajectory_write_frame(TrajectoryRecorder *recorder,
+                                   const TrajectoryFrame *frame,
+                                   uint32_t *flags) {
+  TrajectoryCodec *codec = &recorder->codec;
+  *flags = trajectory_encode(codec, frame);
+  TrajectoryFrameHeader header = {
+      .flags = *flags,
+      .step = frame->step,
+      .particle_count = frame->particle_count,
+      .tracer_count = frame->tracer_count,
+      .size = codec->encoder.size,
+  };
+  if (fwrite(&header, sizeof(header), 1, recorder->file) != 1 ||
+      fwrite(codec->encoder.bytes, 1, codec->encoder.size, recorder->file) !=
+          codec->encoder.size) {
+    return false;
+  }
+
+  if (recorder->index_count == recorder->index_capacity) {
+    recorder->index_capacity =
+        recorder->index_capacity ? recorder->index_capacity * 2 : 256;
+    recorder->index =
+        realloc(recorder->index,
+                sizeof(TrajectoryIndexEntry) * recorder->index_capacity);
+    assert(recorder->index);
+  }
+  recorder->index[recorder->index_count++] = (TrajectoryIndexEntry){
+      .offset = recorder->offset,
+      .step = frame->step,
+      .flags = *flags,
+  };
+  recorder->offset += sizeof(header) + codec->encoder.size;
+  return true;
+}
+
+// Append the index of the frames and the footer pointing at it
+static bool trajectory_write_index(TrajectoryRecorder *recorder) {
+  TrajectoryFileFooter footer = {
+      .index_offset = recorder->offset,
+      .frame_count = recorder->index_count,
+  };
+  memcpy(footer.magic, TRAJECTORY_INDEX_MAGIC, sizeof(footer.magic));
+  return fwrite(recorder->index, sizeof(TrajectoryIndexEntry),
+                recorder->index_count,
+                recorder->file) == recorder->index_count &&
+         fwrite(&footer, sizeof(footer), 1, recorder->file) == 1;
+}
+
+// Code waiting frames until the recorder stops and the queue is empty
+static void *trajectory_recorder_run(void *argument) {
+  TrajectoryRecorder *recorder = argument;
+
+  pthread_mutex_lock(&recorder->lock);
+  for (;;) {
+    while (recorder->queue_count == 0 && !recorder->stopping) {
+      pthread_cond_wait(&recorder->frame_ready, &recorder->lock);
+    }
+    if (recorder->queue_count == 0) {
+      break;
+    }
+    TrajectoryFrame *frame = recorder->queue[recorder->queue_head];
+    recorder->queue_head =
+        (recorder->queue_head + 1) % TRAJECTORY_FRAME_BUFFERS;
+    recorder->queue_count--;
+    bool failed = recorder->stats.failed;
+    pthread_mutex_unlock(&recorder->lock);
+
+    // After a failed write the file is incomplete, later frames are skipped
+    double start = trajectory_now();
+    uint32_t flags = 0;
+    bool written = !failed && trajectory_write_frame(recorder, frame, &flags);
+    double elapsed = trajectory_now() - start;
+    uint64_t points = frame->particle_count + frame->tracer_count;
+
+    pthread_mutex_lock(&recorder->lock);
+    if (written) {
+      recorder->stats.frames++;
+      recorder->stats.keyframes += (flags & TRAJECTORY_FRAME_KEY) != 0;
+      recorder->stats.raw_bytes += points * 2 * sizeof(double);
+      recorder->stats.written_bytes +=
+          sizeof(TrajectoryFrameHeader) + recorder->codec.encoder.size;
+    } else {
+      recorder->stats.failed = true;
+    }
+    recorder->stats.encode_seconds += elapsed;
+    recorder->free_frames[recorder->free_count++] = frame;
+    pthread_cond_broadcast(&recorder->frame_done);
+  }
+  pthread_mutex_unlock(&recorder->lock);
+  return NULL;
+}
+
+// Start recording into a new file
+TrajectoryRecorder *trajectory_recorder_start(const char *path,
+                                              uint32_t interval,
+                                              double cell_size) {
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    return NULL;
+  }
+  TrajectoryFileHeader header = {
+      .version = TRAJECTORY_VERSION,
+      .keyframe_interval = TRAJECTORY_KEYFRAME_INTERVAL,
+      .cell_size = cell_size,
+  };
+  memcpy(header.magic, TRAJECTORY_MAGIC, sizeof(header.magic));
+  if (fwrite(&header, sizeof(header), 1, file) != 1) {
+    fclose(file);
+    return NULL;
+  }
+
+  TrajectoryRecorder *recorder = calloc(1, sizeof(TrajectoryRecorder));
+  assert(recorder);
+  recorder->file = file;
+  recorder->interval = interval > 0 ? interval : 1;
+  recorder->codec.cell_size = cell_size;
+  // The first frame is always a keyframe
+  recorder->codec.frames_since_key = TRAJECTORY_KEYFRAME_INTERVAL;
+  recorder->stats.written_bytes = sizeof(header);
+  recorder->offset = sizeof(header);
+  for (uint32_t f = 0; f < TRAJECTORY_FRAME_BUFFERS; f++) {
+    recorder->free_frames[f] = &recorder->frames[f];
+  }
+  recorder->free_count = TRAJECTORY_FRAME_BUFFERS;
+  pthread_mutex_init(&recorder->lock, NULL);
+  pthread_cond_init(&recorder->frame_ready, NULL);
+  pthread_cond_init(&recorder->frame_done, NULL);
+
+  if (pthread_create(&recorder->thread, NULL, trajectory_recorder_run,
+                     recorder) != 0) {
+    pthread_cond_destroy(&recorder->frame_done);
+    pthread_cond_destroy(&recorder->frame_ready);
+    pthread_mutex_destroy(&recorder->lock);
+    fclose(file);
+    free(recorder);
+    return NULL;
+  }
+  return recorder;
+}
+
+// Hand the state after a step to the recording thread if the step is due
+void trajectory_recorder_offer(TrajectoryRecorder *recorder,
+                               const Simulation *simulation, uint64_t step) {
+  if (step % recorder->interval != 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&recorder->lock);
+  TrajectoryFrame *frame = NULL;
+  if (recorder->free_count > 0) {
+    frame = recorder->free_frames[--recorder->free_count];
+  } else {
+    recorder->stats.dropped++;
+  }
+  pthread_mutex_unlock(&recorder->lock);
+  if (frame == NULL) {
+    return;
+  }
+
+  // The buffers only grow, so after the first few frames this is a copy
+  uint64_t particle_count = simulation->particle_count;
+  uint64_t points = particle_count + simulation->tracers.count;
+  if (points > frame->position_capacity) {
+    frame->positions = realloc(frame->positions, sizeof(Vec2) * points);
+    assert(frame->positions);
+    frame->position_capacity = points;
+  }
+  if (particle_count > frame->radius_capacity) {
+    frame->radii = realloc(frame->radii, sizeof(float) * particle_count);
+    assert(frame->radii);
+    frame->radius_capacity = particle_count;
+  }
+  for (uint64_t i = 0; i < particle_count; i++) {
+    frame->positions[i] = simulation->particles[i].position;
+    frame->radii[i] = (float)simulation->particles[i].radius;
+  }
+  if (simulation->tracers.count > 0) {
+    memcpy(&frame->positions[particle_count], simulation->tracers.positions,
+           sizeof(Vec2) * simulation->tracers.count);
+  }
+  frame->step = step;
+  frame->particle_count = particle_count;
+  frame->tracer_count = simulation->tracers.count;
+
+  pthread_mutex_lock(&recorder->lock);
+  uint32_t slot = (recorder->queue_head + recorder->queue_count) %
+                  TRAJECTORY_FRAME_BUFFERS;
+  recorder->queue[slot] = frame;
+  recorder->queue_count++;
+  pthread_cond_signal(&recorder->frame_ready);
+  pthread_mutex_unlock(&recorder->lock);
+}
+
+// Wait until every offered frame is coded and written
+void trajectory_recorder_flush(TrajectoryRecorder *recorder) {
+  pthread_mutex_lock(&recorder->lock);
+  while (recorder->free_count < TRAJECTORY_FRAME_BUFFERS) {
+    pthread_cond_wait(&recorder->frame_done, &recorder->lock);
+  }
+  pthread_mutex_unlock(&recorder->lock);
+}
+
+// Code every waiting frame, close the file and release the recorder
+TrajectoryStats trajectory_recorder_stop(TrajectoryRecorder *recorder) {
+  pthread_mutex_lock(&recorder->lock);
+  recorder->stopping = true;
+  pthread_cond_signal(&recorder->frame_ready);
+  pthread_mutex_unlock(&recorder->lock);
+  pthread_join(recorder->thread, NULL);
+
+  TrajectoryStats stats = recorder->stats;
+  if (!stats.failed) {
+    stats.failed = !trajectory_write_index(recorder);
+    stats.written_bytes += sizeof(TrajectoryIndexEntry) *
+                               recorder->index_count +
+                           sizeof(TrajectoryFileFooter);
+  }
+  if (fclose(recorder->file) != 0) {
+    stats.failed = true;
+  }
+  free(recorder->index);
+  for (uint32_t f = 0; f < TRAJECTORY_FRAME_BUFFERS; f++) {
+    free(recorder->frames[f].positions);
+    free(recorder->frames[f].radii);
+  }
+  trajectory_codec_deinit(&recorder->codec);
+  pthread_cond_destroy(&recorder->frame_done);
+  pthread_cond_destroy(&recorder->frame_ready);
+  pthread_mutex_destroy(&recorder->lock);
+  free(recorder);
+  return stats;
+}
+
+// Decode one frame of the file into the reader's codec, checking that it
+// fits the file and follows the frame the codec holds
+static bool trajectory_reader_decode_frame(TrajectoryReader *reader,
+                                           uint64_t number) {
+  const TrajectoryIndexEntry *entry = &reader->index[number];
+  TrajectoryFrameHeader header;
+  if (entry->offset > reader->frames_end ||
+      reader->frames_end - entry->offset < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, reader->data + entry->offset, sizeof(header));
+  uint64_t count = header.particle_count + header.tracer_count;
+  bool is_key = (header.flags & TRAJECTORY_FRAME_KEY) != 0;
+  if (header.size > reader->frames_end - entry->offset - sizeof(header) ||
+      header.particle_count > UINT32_MAX ||
+      header.tracer_count > UINT32_MAX || count > UINT32_MAX ||
+      header.flags != entry->flags ||
+      (!is_key && (header.particle_count != reader->codec.particle_count ||
+                   header.tracer_count != reader->codec.tracer_count))) {
+    return false;
+  }
+  trajectory_decode(&reader->codec, &header,
+                    reader->data + entry->offset + sizeof(header));
+  reader->codec_frame = number;
+  return true;
+}
+
+// Decode a frame into a slot's buffers, continuing from the frame the codec
+// holds when that lies between the frame and the keyframe before it
+static bool trajectory_reader_decode(TrajectoryReader *reader, uint64_t number,
+                                     TrajectoryFrame *frame) {
+  uint64_t key = number;
+  while (key > 0 && !(reader->index[key].flags & TRAJECTORY_FRAME_KEY)) {
+    key--;
+  }
+  uint64_t first = key;
+  if (reader->codec_frame != UINT64_MAX && reader->codec_frame >= key &&
+      reader->codec_frame <= number) {
+    first = reader->codec_frame + 1;
+  }
+  for (uint64_t f = first; f <= number; f++) {
+    if (!trajectory_reader_decode_frame(reader, f)) {
+      reader->codec_frame = UINT64_MAX;
+      return false;
+    }
+  }
+
+  const TrajectoryCodec *codec = &reader->codec;
+  uint64_t count = codec->particle_count + codec->tracer_count;
+  if (count > frame->position_capacity) {
+    frame->positions = realloc(frame->positions, sizeof(Vec2) * count);
+    assert(frame->positions);
+    frame->position_capacity = count;
+  }
+  if (codec->particle_count > frame->radius_capacity) {
+    frame->radii =
+        realloc(frame->radii, sizeof(float) * codec->particle_count);
+    assert(frame->radii);
+    frame->radius_capacity = codec->particle_count;
+  }
+  for (uint64_t i = 0; i < count; i++) {
+    frame->positions[i] = (Vec2){codec->previous[2 * i] * codec->cell_size,
+                                 codec->previous[2 * i + 1] * codec->cell_size};
+  }
+  if (codec->particle_count > 0) {
+    memcpy(frame->radii, codec->radii, sizeof(float) * codec->particle_count);
+  }
+  frame->step = reader->index[number].step;
+  frame->particle_count = codec->particle_count;
+  frame->tracer_count = codec->tracer_count;
+  return true;
+}
+
+// Whether a slot holds the frame
+static bool trajectory_reader_holds(const TrajectoryReader *reader,
+                                    uint64_t number) {
+  for (uint32_t s = 0; s < TRAJECTORY_READER_SLOTS; s++) {
+    if (reader->slots[s].number == number) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Pick the first frame from the wanted one on that no slot holds, and a slot
+// to decode it into that holds nothing the client may still want. Returns
+// false when there is nothing to do.
+static bool trajectory_reader_next(TrajectoryReader *reader, uint64_t *number,
+                                   uint32_t *slot) {
+  uint64_t end = reader->wanted + TRAJECTORY_READER_SLOTS;
+  if (end > reader->frame_count) {
+    end = reader->frame_count;
+  }
+  for (uint64_t f = reader->wanted; f < end; f++) {
+    if (trajectory_reader_holds(reader, f)) {
+      continue;
+    }
+    for (uint32_t s = 0; s < TRAJECTORY_READER_SLOTS; s++) {
+      uint64_t held = reader->slots[s].number;
+      if (s != reader->pinned &&
+          (held == UINT64_MAX || held < reader->wanted || held >= end)) {
+        *number = f;
+        *slot = s;
+        return true;
+      }
+    }
+    return false;
+  }
+  return false;
+}
+
+// Decode the frames from the wanted one on until the reader closes
+static void *trajectory_reader_run(void *argument) {
+  TrajectoryReader *reader = argument;
+
+  pthread_mutex_lock(&reader->lock);
+  for (;;) {
+    uint64_t number;
+    uint32_t slot;
+    while (!reader->stopping &&
+           !trajectory_reader_next(reader, &number, &slot)) {
+      pthread_cond_wait(&reader->wanted_changed, &reader->lock);
+    }
+    if (reader->stopping) {
+      break;
+    }
+    reader->slots[slot].number = UINT64_MAX;
+    pthread_mutex_unlock(&reader->lock);
+
+    bool is_valid =
+        trajectory_reader_decode(reader, number, &reader->slots[slot].frame);
+
+    pthread_mutex_lock(&reader->lock);
+    reader->slots[slot].number = number;
+    reader->slots[slot].is_valid = is_valid;
+    pthread_cond_broadcast(&reader->frame_decoded);
+  }
+  pthread_mutex_unlock(&reader->lock);
+  return NULL;
+}
+
+// Take the index from the end of a finished file. Returns false when the
+// file has no valid index.
+static bool trajectory_reader_load_index(TrajectoryReader *reader) {
+  TrajectoryFileFooter footer;
+  if (reader->size < sizeof(TrajectoryFileHeader) + sizeof(footer)) {
+    return false;
+  }
+  memcpy(&footer, reader->data + reader->size - sizeof(footer),
+         sizeof(footer));
+  uint64_t index_end = reader->size - sizeof(footer);
+  if (memcmp(footer.magic, TRAJECTORY_INDEX_MAGIC, sizeof(footer.magic)) !=
+          0 ||
+      footer.index_offset < sizeof(TrajectoryFileHeader) ||
+      footer.index_offset > index_end ||
+      footer.frame_count != (index_end - footer.index_offset) /
+                                sizeof(TrajectoryIndexEntry) ||
+      (index_end - footer.index_offset) % sizeof(TrajectoryIndexEntry) != 0 ||
+      footer.frame_count == 0) {
+    return false;
+  }
+
+  reader->index = malloc(sizeof(TrajectoryIndexEntry) * footer.frame_count);
+  assert(reader->index);
+  memcpy(reader->index, reader->data + footer.index_offset,
+         sizeof(TrajectoryIndexEntry) * footer.frame_count);
+  reader->frame_count = footer.frame_count;
+  reader->frames_end = footer.index_offset;
+  return true;
+}
+
+// Build the index by walking the frame headers, for files whose recording
+// stopped before the index was written
+static void trajectory_reader_scan_index(TrajectoryReader *reader) {
+  uint64_t capacity = 0;
+  size_t offset = sizeof(TrajectoryFileHeader);
+  reader->frames_end = reader->size;
+  while (reader->size - offset >= sizeof(TrajectoryFrameHeader)) {
+    TrajectoryFrameHeader header;
+    memcpy(&header, reader->data + offset, sizeof(header));
+    if (header.size > reader->size - offset - sizeof(header)) {
+      break;
+    }
+    if (reader->frame_count == capacity) {
+      capacity = capacity ? capacity * 2 : 256;
+      reader->index =
+          realloc(reader->index, sizeof(TrajectoryIndexEntry) * capacity);
+      assert(reader->index);
+    }
+    reader->index[reader->frame_count++] = (TrajectoryIndexEntry){
+        .offset = offset,
+        .step = header.step,
+        .flags = header.flags,
+    };
+    offset += sizeof(header) + header.size;
+  }
+}
+
+// Open a trajectory file for reading
+TrajectoryReader *trajectory_reader_open(const char *path) {
+  int descriptor = open(path, O_RDONLY);
+  if (descriptor < 0) {
+    return NULL;
+  }
+  struct stat status;
+  if (fstat(descriptor, &status) != 0 ||
+      (size_t)status.st_size < sizeof(TrajectoryFileHeader)) {
+    close(descriptor);
+    return NULL;
+  }
+  size_t size = (size_t)status.st_size;
+  // The mapping stays valid after the descriptor is closed
+  void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+  close(descriptor);
+  if (data == MAP_FAILED) {
+    return NULL;
+  }
+
+  TrajectoryFileHeader header;
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, TRAJECTORY_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != TRAJECTORY_VERSION || !(header.cell_size > 0)) {
+    munmap(data, size);
+    return NULL;
+  }
+
+  TrajectoryReader *reader = calloc(1, sizeof(TrajectoryReader));
+  assert(reader);
+  reader->data = data;
+  reader->size = size;
+  reader->cell_size = header.cell_size;
+  reader->codec.cell_size = header.cell_size;
+  reader->codec_frame = UINT64_MAX;
+  reader->pinned = UINT32_MAX;
+  for (uint32_t s = 0; s < TRAJECTORY_READER_SLOTS; s++) {
+    reader->slots[s].number = UINT64_MAX;
+  }
+  if (!trajectory_reader_load_index(reader)) {
+    trajectory_reader_scan_index(reader);
+  }
+
+  // Every frame needs a keyframe before it
+  if (reader->frame_count == 0 ||
+      !(reader->index[0].flags & TRAJECTORY_FRAME_KEY)) {
+    free(reader->index);
+    munmap(data, size);
+    free(reader);
+    return NULL;
+  }
+
+  pthread_mutex_init(&reader->lock, NULL);
+  pthread_cond_init(&reader->wanted_changed, NULL);
+  pthread_cond_init(&reader->frame_decoded, NULL);
+  if (pthread_create(&reader->thread, NULL, trajectory_reader_run, reader) !=
+      0) {
+    pthread_cond_destroy(&reader->frame_decoded);
+    pthread_cond_destroy(&reader->wanted_changed);
+    pthread_mutex_destroy(&reader->lock);
+    free(reader->index);
+    munmap(data, size);
+    free(reader);
+    return NULL;
+  }
+  return reader;
+}
+
+// Decoded frame of the given number, waiting for it to be decoded if needed
+const TrajectoryFrame *trajectory_reader_frame(TrajectoryReader *reader,
+                                               uint64_t number) {
+  if (number >= reader->frame_count) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&reader->lock);
+  // The frame handed out before is no longer read
+  reader->pinned = UINT32_MAX;
+  reader->wanted = number;
+  pthread_cond_signal(&reader->wanted_changed);
+  uint32_t slot = UINT32_MAX;
+  for (;;) {
+    for (uint32_t s = 0; s < TRAJECTORY_READER_SLOTS; s++) {
+      if (reader->slots[s].number == number) {
+        slot = s;
+      }
+    }
+    if (slot != UINT32_MAX) {
+      break;
+    }
+    pthread_cond_wait(&reader->frame_decoded, &reader->lock);
+  }
+  reader->pinned = slot;
+  bool is_valid = reader->slots[slot].is_valid;
+  pthread_mutex_unlock(&reader->lock);
+  return is_valid ? &reader->slots[slot].frame : NULL;
+}
+
+// Stop the worker, unmap the file and release the reader
+void trajectory_reader_close(TrajectoryReader *reader) {
+  pthread_mutex_lock(&reader->lock);
+  reader->stopping = true;
+  pthread_cond_signal(&reader->wanted_changed);
+  pthread_mutex_unlock(&reader->lock);
+  pthread_join(reader->thread, NULL);
+
+  for (uint32_t s = 0; s < TRAJECTORY_READER_SLOTS; s++) {
+    free(reader->slots[s].frame.positions);
+    free(reader->slots[s].frame.radii);
+  }
+  trajectory_codec_deinit(&reader->codec);
+  free(reader->index);
+  munmap((void *)reader->data, reader->size);
+  pthread_cond_destroy(&reader->frame_decoded);
+  pthread_cond_destroy(&reader->wanted_changed);
+  pthread_mutex_destroy(&reader->lock);
+  free(reader);
+}
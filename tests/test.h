@@ -0,0 +1,18 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+// Failed checks of the test program, its exit status is whether any failed
+static int test_failures = 0;
+
+// Report a condition that does not hold and carry on with the test
+#define CHECK(condition)                                                       \
+    do {                                                                       \
+        if (!(condition)) {                                                    \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition);    \
+            test_failures++;                                                   \
+        }                                                                      \
+    } while (0)
+
+#endif // TEST_H
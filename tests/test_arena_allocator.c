@@ -0,0 +1,99 @@
+// Checks that the arena hands out allocations past its buffer, and that the
+// reset after them grows the buffer so the same allocations fit in it
+#include "test.h"
+
+#include "arena_allocator.h"
+
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define TEST_ARENA_SIZE 1024
+#define TEST_ALLOCATIONS 4
+
+// Size an allocation takes in the buffer
+static size_t test_rounded(size_t size) {
+  size_t alignment = alignof(max_align_t);
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+// Make the allocations of one step, filling each with its own byte, and
+// check that they are aligned and that none overwrote another. Returns
+// whether they followed each other in one buffer, and the first of them.
+static bool test_step(ArenaAllocator *arena, const size_t *sizes,
+                      unsigned char **first) {
+  unsigned char *allocations[TEST_ALLOCATIONS];
+  for (int i = 0; i < TEST_ALLOCATIONS; i++) {
+    allocations[i] = arena_alloc(arena, sizes[i]);
+    CHECK(allocations[i] != NULL);
+    if (allocations[i] == NULL) {
+      return false;
+    }
+    CHECK((uintptr_t)allocations[i] % alignof(max_align_t) == 0);
+    memset(allocations[i], i + 1, sizes[i]);
+  }
+
+  bool is_intact = true;
+  bool is_contiguous = true;
+  for (int i = 0; i < TEST_ALLOCATIONS; i++) {
+    for (size_t b = 0; b < sizes[i]; b++) {
+      is_intact = is_intact && allocations[i][b] == i + 1;
+    }
+    if (i > 0) {
+      is_contiguous = is_contiguous &&
+                      allocations[i] ==
+                          allocations[i - 1] + test_rounded(sizes[i - 1]);
+    }
+  }
+  CHECK(is_intact);
+  *first = allocations[0];
+  return is_contiguous;
+}
+
+int main(void) {
+  ArenaAllocator *arena = init_arena(TEST_ARENA_SIZE);
+  CHECK(arena != NULL);
+  if (arena == NULL) {
+    return 1;
+  }
+
+  // A step that fits keeps the buffer across resets
+  size_t small[TEST_ALLOCATIONS] = {100, 1, 200, 300};
+  unsigned char *buffer;
+  unsigned char *again;
+  CHECK(test_step(arena, small, &buffer));
+  reset_arena(arena);
+  CHECK(test_step(arena, small, &again));
+  CHECK(again == buffer);
+  reset_arena(arena);
+
+  // A step needing several times the buffer still gets all its memory, the
+  // allocations past the buffer lying outside it
+  size_t large[TEST_ALLOCATIONS] = {512, 4 * TEST_ARENA_SIZE, 3,
+                                    2 * TEST_ARENA_SIZE};
+  CHECK(!test_step(arena, large, &again));
+  CHECK(again == buffer);
+  reset_arena(arena);
+
+  // The reset grew the buffer, so the same step now fits in it, and keeps
+  // fitting
+  CHECK(test_step(arena, large, &buffer));
+  reset_arena(arena);
+  CHECK(test_step(arena, large, &again));
+  CHECK(again == buffer);
+  reset_arena(arena);
+
+  // Growing again once the steps outgrow the new buffer
+  for (int i = 0; i < TEST_ALLOCATIONS; i++) {
+    large[i] *= 4;
+  }
+  CHECK(!test_step(arena, large, &again));
+  reset_arena(arena);
+  CHECK(test_step(arena, large, &again));
+  reset_arena(arena);
+
+  deinit_arena(arena);
+  return test_failures > 0;
+}
@@ -0,0 +1,178 @@
+// Compares every bitset operation with the same operation on a bool array,
+// for counts on and off the 64 bit word boundaries and for sparse and dense
+// sets, and checks that the bits past the count stay clear
+#include "test.h"
+
+#include "bitset.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_SEED 5
+#define TEST_MAX_COUNT 1100
+
+static const uint64_t test_counts[] = {0,   1,   63,  64,   65,  127,
+                                       128, 130, 200, 1000, 1037};
+static const double test_densities[] = {0, 0.01, 0.5, 0.99, 1};
+
+// Fill a bool array and a bitset with the same random bits
+static void test_fill(Bitset *set, bool *bits, uint64_t count,
+                      double density) {
+  bitset_resize(set, count);
+  bitset_clear_all(set);
+  for (uint64_t i = 0; i < count; i++) {
+    bits[i] = rand() < density * RAND_MAX;
+    if (bits[i]) {
+      bitset_set(set, i);
+    }
+  }
+}
+
+// Whether no bit past the count is set in the last word
+static bool test_tail_clear(const Bitset *set) {
+  uint64_t tail = set->count % BITSET_WORD_BITS;
+  if (tail == 0) {
+    return true;
+  }
+  return (set->words[set->count / BITSET_WORD_BITS] >> tail) == 0;
+}
+
+// Whether the bitset holds exactly the bits of the array, read through
+// bitset_test, bitset_next and bitset_popcount
+static bool test_matches(const Bitset *set, const bool *bits,
+                         uint64_t count) {
+  if (set->count != count || !test_tail_clear(set)) {
+    return false;
+  }
+  uint64_t expected_count = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    if (bitset_test(set, i) != bits[i]) {
+      return false;
+    }
+    expected_count += bits[i];
+  }
+  if (bitset_popcount(set) != expected_count) {
+    return false;
+  }
+
+  // bitset_next visits the set bits in order and nothing else
+  uint64_t expected = 0;
+  for (uint64_t i = bitset_next(set, 0); i < count;
+       i = bitset_next(set, i + 1)) {
+    if (i < expected) {
+      return false; // Went backwards, and would never finish
+    }
+    while (expected < i) {
+      if (bits[expected++]) {
+        return false;
+      }
+    }
+    if (!bits[i]) {
+      return false;
+    }
+    expected = i + 1;
+  }
+  while (expected < count) {
+    if (bits[expected++]) {
+      return false;
+    }
+  }
+  return bitset_next(set, count) == count &&
+         bitset_next(set, count + 100) == count;
+}
+
+int main(void) {
+  srand(TEST_SEED);
+  bool a[TEST_MAX_COUNT];
+  bool b[TEST_MAX_COUNT];
+  bool expected[TEST_MAX_COUNT];
+  Bitset set = {0};
+  Bitset other = {0};
+
+  for (size_t c = 0; c < sizeof(test_counts) / sizeof(test_counts[0]); c++) {
+    uint64_t count = test_counts[c];
+    for (size_t d = 0;
+         d < sizeof(test_densities) / sizeof(test_densities[0]); d++) {
+      double density = test_densities[d];
+
+      // Set, test, next and popcount
+      test_fill(&set, a, count, density);
+      CHECK(test_matches(&set, a, count));
+
+      // Clear half of the set bits one at a time
+      for (uint64_t i = 0; i < count; i += 2) {
+        bitset_clear(&set, i);
+        a[i] = false;
+      }
+      CHECK(test_matches(&set, a, count));
+
+      // Union, intersect and subtract against a second random set
+      test_fill(&set, a, count, density);
+      test_fill(&other, b, count, 1 - density / 2);
+      bitset_union(&set, &other);
+      for (uint64_t i = 0; i < count; i++) {
+        expected[i] = a[i] || b[i];
+      }
+      CHECK(test_matches(&set, expected, count));
+
+      test_fill(&set, a, count, density);
+      bitset_intersect(&set, &other);
+      for (uint64_t i = 0; i < count; i++) {
+        expected[i] = a[i] && b[i];
+      }
+      CHECK(test_matches(&set, expected, count));
+
+      test_fill(&set, a, count, density);
+      bitset_subtract(&set, &other);
+      for (uint64_t i = 0; i < count; i++) {
+        expected[i] = a[i] && !b[i];
+      }
+      CHECK(test_matches(&set, expected, count));
+
+      // Setting a list of indices
+      bitset_clear_all(&set);
+      memset(expected, 0, sizeof(expected));
+      uint64_t indices[TEST_MAX_COUNT];
+      uint64_t index_count = 0;
+      for (uint64_t i = 0; i < count; i++) {
+        if (rand() < density * RAND_MAX) {
+          indices[index_count++] = i;
+          expected[i] = true;
+        }
+      }
+      bitset_set_indices(&set, indices, index_count);
+      CHECK(test_matches(&set, expected, count));
+    }
+
+    // Set all leaves the bits past the count clear, clear all empties
+    bitset_resize(&set, count);
+    bitset_set_all(&set);
+    for (uint64_t i = 0; i < count; i++) {
+      expected[i] = true;
+    }
+    CHECK(test_matches(&set, expected, count));
+    bitset_clear_all(&set);
+    memset(expected, 0, sizeof(expected));
+    CHECK(test_matches(&set, expected, count));
+  }
+
+  // Shrinking trims the bits past the new count, and growing again brings
+  // them back clear
+  test_fill(&set, a, 1000, 1);
+  bitset_resize(&set, 70);
+  CHECK(test_matches(&set, a, 70));
+  bitset_resize(&set, 1000);
+  memset(a + 70, 0, sizeof(bool) * (1000 - 70));
+  CHECK(test_matches(&set, a, 1000));
+  bitset_resize(&set, 5);
+  bitset_resize(&set, 64);
+  memset(a + 5, 0, sizeof(bool) * (64 - 5));
+  CHECK(test_matches(&set, a, 64));
+
+  bitset_deinit(&set);
+  bitset_deinit(&other);
+  CHECK(set.words == NULL && set.count == 0);
+  return test_failures > 0;
+}
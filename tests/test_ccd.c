@@ -0,0 +1,97 @@
+// Fires a small fast particle at a large one so that in a single step it
+// would cross the large one completely. With sweeping the contact is found
+// and resolved within the step, without it the small particle tunnels
+// through untouched.
+#include "test.h"
+
+#include "arena_allocator.h"
+#include "simulation.h"
+#include "vector.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TEST_ARENA_SIZE (64 * 1024)
+#define TEST_TIME_STEP (1.0 / 60.0)
+#define TEST_LARGE_RADIUS 10.0
+#define TEST_SMALL_RADIUS 1.0
+// Distance from the large particle's centre the small one starts at
+#define TEST_START 20.0
+
+// Result of one step of the shot
+typedef struct {
+  Vec2 small_position;
+  Vec2 small_velocity;
+  Vec2 large_position;
+} TestShot;
+
+// Shoot the small particle from TEST_START along direction at speed units
+// per second for one step, with at most max_events impacts swept
+static TestShot test_shoot(Vec2 direction, double speed,
+                           uint32_t max_events) {
+  // No gravity, so only the contact changes the velocities
+  Simulation simulation = simulation_init(0);
+  simulation.integrator = INTEGRATOR_EULER;
+  simulation.sleep_step_count = 0;
+  simulation.ccd_max_events = max_events;
+  simulation_new_particle(&simulation, (Particle){.position = {0, 0},
+                                                  .mass = 1000,
+                                                  .radius = TEST_LARGE_RADIUS});
+  simulation_new_particle(
+      &simulation,
+      (Particle){.position = vec2_scale(direction, -TEST_START),
+                 .velocity = vec2_scale(direction, speed),
+                 .mass = 1,
+                 .radius = TEST_SMALL_RADIUS});
+
+  ArenaAllocator *arena = init_arena(TEST_ARENA_SIZE);
+  CHECK(arena != NULL);
+  simulation_update(&simulation, arena, TEST_TIME_STEP);
+  TestShot shot = {
+      .small_position = simulation.particles[1].position,
+      .small_velocity = simulation.particles[1].velocity,
+      .large_position = simulation.particles[0].position,
+  };
+  deinit_arena(arena);
+  simulation_deinit(&simulation);
+  return shot;
+}
+
+// How far along the direction of the shot the small particle got past the
+// large one's centre
+static double test_progress(TestShot shot, Vec2 direction) {
+  return vec2_dot(vec2_sub(shot.small_position, shot.large_position),
+                  direction);
+}
+
+int main(void) {
+  Vec2 directions[] = {{1, 0}, {0, -1}, {0.6, 0.8}};
+  // Units per step of 3, 6 and 30 times the large particle's diameter
+  double speeds[] = {60 / TEST_TIME_STEP, 120 / TEST_TIME_STEP,
+                     600 / TEST_TIME_STEP};
+  double contact = TEST_LARGE_RADIUS + TEST_SMALL_RADIUS;
+
+  for (size_t d = 0; d < sizeof(directions) / sizeof(directions[0]); d++) {
+    for (size_t s = 0; s < sizeof(speeds) / sizeof(speeds[0]); s++) {
+      Vec2 direction = directions[d];
+      double speed = speeds[s];
+
+      // Without sweeping the small particle ends the step beyond the large
+      // one, out of contact, so no collision is ever seen
+      TestShot tunnel = test_shoot(direction, speed, 0);
+      CHECK(test_progress(tunnel, direction) > contact);
+      CHECK(fabs(vec2_dot(tunnel.small_velocity, direction) - speed) <
+            1e-6 * speed);
+
+      // With sweeping the impact stops it on the near side and turns it
+      // back, and pushes the large particle along the shot
+      TestShot swept =
+          test_shoot(direction, speed, SIMULATION_DEFAULT_CCD_MAX_EVENTS);
+      CHECK(test_progress(swept, direction) <= -contact + 1e-3);
+      CHECK(vec2_dot(swept.small_velocity, direction) < 0);
+      CHECK(vec2_dot(swept.large_position, direction) > 0);
+    }
+  }
+  return test_failures > 0;
+}
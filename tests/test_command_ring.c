@@ -0,0 +1,201 @@
+// Checks the command rings: commands run in push order, a full ring refuses
+// pushes until drained, indices wrap around the capacity many times, drains
+// stop at their budget, and with several producer threads every command runs
+// exactly once and in its producer's order
+#define _POSIX_C_SOURCE 200809L
+
+#include "test.h"
+
+#define COMMAND_IMPLEMENTATION
+#include "command.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TEST_CAPACITY 8
+#define TEST_WRAP_ROUNDS 1000
+#define TEST_SHARED_PRODUCERS 4
+// Four shared producers and one single producer, a million commands in all
+#define TEST_COMMANDS_PER_PRODUCER 200000
+#define TEST_THREAD_CAPACITY 256
+#define TEST_BUDGET 64
+
+typedef struct {
+  uint32_t producer;
+  uint64_t sequence;
+} TestCommand;
+
+// What the consumer saw, per producer
+typedef struct {
+  uint64_t next[TEST_SHARED_PRODUCERS + 1];
+  uint64_t out_of_order;
+  uint64_t executed;
+} TestConsumer;
+
+typedef struct {
+  SpscCommandRing *single;
+  MpscCommandRing *shared;
+  uint32_t producer;
+} TestProducer;
+
+// Record a command, counting it out of order unless it is the next one its
+// producer pushed
+static CommandStatus test_execute(void *context, const void *payload) {
+  TestConsumer *consumer = context;
+  const TestCommand *command = payload;
+  if (command->sequence != consumer->next[command->producer]) {
+    consumer->out_of_order++;
+  }
+  consumer->next[command->producer] = command->sequence + 1;
+  consumer->executed++;
+  return COMMAND_SUCCESS;
+}
+
+// Push a command, retrying while the ring is full
+static void test_push(const TestProducer *producer, uint64_t sequence) {
+  TestCommand command = {producer->producer, sequence};
+  for (;;) {
+    CommandStatus status =
+        producer->single
+            ? spsc_command_ring_push(producer->single, test_execute, &command,
+                                     sizeof(command))
+            : mpsc_command_ring_push(producer->shared, test_execute, &command,
+                                     sizeof(command));
+    if (status == COMMAND_SUCCESS) {
+      return;
+    }
+    sched_yield();
+  }
+}
+
+static void *test_produce(void *argument) {
+  const TestProducer *producer = argument;
+  for (uint64_t i = 0; i < TEST_COMMANDS_PER_PRODUCER; i++) {
+    test_push(producer, i);
+  }
+  return NULL;
+}
+
+// Fill a single producer ring, drain it in budgets of three and refill it,
+// so the indices wrap around the capacity
+static void test_single_wraparound(void) {
+  SpscCommandRing *ring = create_spsc_command_ring(TEST_CAPACITY - 3);
+  CHECK(ring != NULL);
+  if (ring == NULL) {
+    return;
+  }
+  CHECK(ring->mask == TEST_CAPACITY - 1);
+
+  TestConsumer consumer = {0};
+  unsigned char oversized[COMMAND_PAYLOAD_SIZE + 1] = {0};
+  CHECK(spsc_command_ring_push(ring, test_execute, oversized,
+                               sizeof(oversized)) == COMMAND_FAILURE);
+  uint64_t pushed = 0;
+  for (int round = 0; round < TEST_WRAP_ROUNDS; round++) {
+    while (spsc_command_ring_push(ring, test_execute,
+                                  &(TestCommand){0, pushed},
+                                  sizeof(TestCommand)) == COMMAND_SUCCESS) {
+      pushed++;
+    }
+    CHECK(pushed - consumer.executed == TEST_CAPACITY);
+    CHECK(spsc_command_ring_drain(ring, &consumer, 3) == 3);
+  }
+  CHECK(spsc_command_ring_drain(ring, &consumer, SIZE_MAX) ==
+        TEST_CAPACITY - 3);
+  CHECK(spsc_command_ring_drain(ring, &consumer, SIZE_MAX) == 0);
+  CHECK(consumer.executed == pushed);
+  CHECK(consumer.out_of_order == 0);
+  free_spsc_command_ring(ring);
+}
+
+// The same for a multiple producer ring
+static void test_shared_wraparound(void) {
+  MpscCommandRing *ring = create_mpsc_command_ring(TEST_CAPACITY - 3);
+  CHECK(ring != NULL);
+  if (ring == NULL) {
+    return;
+  }
+  CHECK(ring->mask == TEST_CAPACITY - 1);
+
+  TestConsumer consumer = {0};
+  unsigned char oversized[COMMAND_PAYLOAD_SIZE + 1] = {0};
+  CHECK(mpsc_command_ring_push(ring, test_execute, oversized,
+                               sizeof(oversized)) == COMMAND_FAILURE);
+  uint64_t pushed = 0;
+  for (int round = 0; round < TEST_WRAP_ROUNDS; round++) {
+    while (mpsc_command_ring_push(ring, test_execute,
+                                  &(TestCommand){0, pushed},
+                                  sizeof(TestCommand)) == COMMAND_SUCCESS) {
+      pushed++;
+    }
+    CHECK(pushed - consumer.executed == TEST_CAPACITY);
+    CHECK(mpsc_command_ring_drain(ring, &consumer, 3) == 3);
+  }
+  CHECK(mpsc_command_ring_drain(ring, &consumer, SIZE_MAX) ==
+        TEST_CAPACITY - 3);
+  CHECK(mpsc_command_ring_drain(ring, &consumer, SIZE_MAX) == 0);
+  CHECK(consumer.executed == pushed);
+  CHECK(consumer.out_of_order == 0);
+  free_mpsc_command_ring(ring);
+}
+
+// Four threads push into a shared ring and one into a single producer ring
+// while this thread drains both with a budget, the way the simulation thread
+// does before each step
+static void test_threads(void) {
+  SpscCommandRing *single = create_spsc_command_ring(TEST_THREAD_CAPACITY);
+  MpscCommandRing *shared = create_mpsc_command_ring(TEST_THREAD_CAPACITY);
+  CHECK(single && shared);
+  if (!single || !shared) {
+    return;
+  }
+
+  TestProducer producers[TEST_SHARED_PRODUCERS + 1];
+  pthread_t threads[TEST_SHARED_PRODUCERS + 1];
+  for (uint32_t p = 0; p <= TEST_SHARED_PRODUCERS; p++) {
+    producers[p] = (TestProducer){
+        .single = p == TEST_SHARED_PRODUCERS ? single : NULL,
+        .shared = shared,
+        .producer = p,
+    };
+    CHECK(pthread_create(&threads[p], NULL, test_produce, &producers[p]) ==
+          0);
+  }
+
+  TestConsumer consumer = {0};
+  uint64_t total = (uint64_t)TEST_COMMANDS_PER_PRODUCER *
+                   (TEST_SHARED_PRODUCERS + 1);
+  bool within_budget = true;
+  while (consumer.executed < total) {
+    size_t budget = TEST_BUDGET;
+    size_t executed = spsc_command_ring_drain(single, &consumer, budget);
+    executed += mpsc_command_ring_drain(shared, &consumer, budget - executed);
+    within_budget = within_budget && executed <= TEST_BUDGET;
+    if (executed == 0) {
+      sched_yield();
+    }
+  }
+  for (uint32_t p = 0; p <= TEST_SHARED_PRODUCERS; p++) {
+    pthread_join(threads[p], NULL);
+  }
+
+  CHECK(within_budget);
+  CHECK(consumer.out_of_order == 0);
+  CHECK(consumer.executed == total);
+  for (uint32_t p = 0; p <= TEST_SHARED_PRODUCERS; p++) {
+    CHECK(consumer.next[p] == TEST_COMMANDS_PER_PRODUCER);
+  }
+  CHECK(spsc_command_ring_drain(single, &consumer, SIZE_MAX) == 0);
+  CHECK(mpsc_command_ring_drain(shared, &consumer, SIZE_MAX) == 0);
+  free_spsc_command_ring(single);
+  free_mpsc_command_ring(shared);
+}
+
+int main(void) {
+  test_single_wraparound();
+  test_shared_wraparound();
+  test_threads();
+  return test_failures > 0;
+}
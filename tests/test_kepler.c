@@ -0,0 +1,124 @@
+// Drifts elliptic, near parabolic and hyperbolic orbits many times and checks
+// that energy and angular momentum hold, that the drifts add up to one long
+// drift, and that a drift of zero time changes nothing
+#include "test.h"
+
+#include "kepler.h"
+#include "vector.h"
+
+#include <math.h>
+#include <stdbool.h>
+
+#define TEST_MU 1.0
+#define TEST_DRIFTS 10000
+#define TEST_TIME_STEP 0.01
+#define TEST_TOLERANCE 1e-9
+
+typedef struct {
+  const char *name;
+  Vec2Acc position;
+  Vec2Acc velocity;
+} TestOrbit;
+
+static double test_energy(Vec2Acc position, Vec2Acc velocity) {
+  double v2 = velocity.x * velocity.x + velocity.y * velocity.y;
+  double r = sqrt(position.x * position.x + position.y * position.y);
+  return v2 / 2 - TEST_MU / r;
+}
+
+static double test_angular_momentum(Vec2Acc position, Vec2Acc velocity) {
+  return position.x * velocity.y - position.y * velocity.x;
+}
+
+// Scale of the energy terms, so near parabolic orbits with an energy close to
+// zero are not held to a relative error of it
+static double test_energy_scale(Vec2Acc position, Vec2Acc velocity) {
+  double v2 = velocity.x * velocity.x + velocity.y * velocity.y;
+  double r = sqrt(position.x * position.x + position.y * position.y);
+  return v2 / 2 + TEST_MU / r;
+}
+
+static bool test_close(Vec2Acc a, Vec2Acc b, double scale) {
+  return fabs(a.x - b.x) <= TEST_TOLERANCE * scale &&
+         fabs(a.y - b.y) <= TEST_TOLERANCE * scale;
+}
+
+int main(void) {
+  // Starting at distance one, where the escape speed is sqrt(2)
+  double escape = sqrt(2 * TEST_MU);
+  TestOrbit orbits[] = {
+      {"circular", {1, 0}, {0, 1}},
+      {"elliptic", {1, 0}, {0, 0.8}},
+      {"eccentric", {1, 0}, {0.3, 1.3}},
+      {"near parabolic bound", {1, 0}, {0, escape * (1 - 1e-7)}},
+      {"parabolic", {0, 1}, {-escape, 0}},
+      {"near parabolic unbound", {1, 0}, {0, escape * (1 + 1e-7)}},
+      {"hyperbolic", {1, 0}, {-0.5, 2}},
+      {"retrograde hyperbolic", {-3, 4}, {3, 1}},
+  };
+
+  for (size_t o = 0; o < sizeof(orbits) / sizeof(orbits[0]); o++) {
+    TestOrbit orbit = orbits[o];
+    int failures = test_failures;
+    double energy = test_energy(orbit.position, orbit.velocity);
+    double energy_scale = test_energy_scale(orbit.position, orbit.velocity);
+    double angular_momentum =
+        test_angular_momentum(orbit.position, orbit.velocity);
+
+    // A drift of zero time is the identity, to the bit
+    Vec2Acc position = orbit.position;
+    Vec2Acc velocity = orbit.velocity;
+    kepler_drift(&position, &velocity, TEST_MU, 0);
+    CHECK(position.x == orbit.position.x && position.y == orbit.position.y);
+    CHECK(velocity.x == orbit.velocity.x && velocity.y == orbit.velocity.y);
+
+    // Many short drifts
+    double worst_energy = 0;
+    double worst_angular_momentum = 0;
+    for (int i = 0; i < TEST_DRIFTS; i++) {
+      kepler_drift(&position, &velocity, TEST_MU, TEST_TIME_STEP);
+      worst_energy =
+          fmax(worst_energy, fabs(test_energy(position, velocity) - energy));
+      worst_angular_momentum = fmax(
+          worst_angular_momentum,
+          fabs(test_angular_momentum(position, velocity) - angular_momentum));
+    }
+    CHECK(worst_energy <= TEST_TOLERANCE * energy_scale);
+    CHECK(worst_angular_momentum <= TEST_TOLERANCE * fabs(angular_momentum));
+
+    // They end where a single drift over the whole time does
+    Vec2Acc long_position = orbit.position;
+    Vec2Acc long_velocity = orbit.velocity;
+    kepler_drift(&long_position, &long_velocity, TEST_MU,
+                 TEST_DRIFTS * TEST_TIME_STEP);
+    double distance = sqrt(position.x * position.x + position.y * position.y);
+    double speed = sqrt(velocity.x * velocity.x + velocity.y * velocity.y);
+    CHECK(test_close(position, long_position, distance));
+    CHECK(test_close(velocity, long_velocity, speed + 1));
+
+    // And drifting back over it returns to the start
+    kepler_drift(&long_position, &long_velocity, TEST_MU,
+                 -TEST_DRIFTS * TEST_TIME_STEP);
+    CHECK(test_close(long_position, orbit.position, distance));
+    CHECK(test_close(long_velocity, orbit.velocity, speed + 1));
+    if (test_failures > failures) {
+      fprintf(stderr, "  in the %s orbit\n", orbit.name);
+    }
+  }
+
+  // A drift over thousands of periods of an ellipse lands where a drift over
+  // the part past the whole periods does
+  Vec2Acc position = {1, 0};
+  Vec2Acc velocity = {0.3, 1.3};
+  double beta = 2 * TEST_MU - 0.3 * 0.3 - 1.3 * 1.3;
+  double period = 2 * acos(-1) * TEST_MU / (beta * sqrt(beta));
+  Vec2Acc long_position = position;
+  Vec2Acc long_velocity = velocity;
+  kepler_drift(&position, &velocity, TEST_MU, 0.3 * period);
+  kepler_drift(&long_position, &long_velocity, TEST_MU, 5000.3 * period);
+  CHECK(fabs(long_position.x - position.x) <= 1e-6 &&
+        fabs(long_position.y - position.y) <= 1e-6);
+  CHECK(fabs(long_velocity.x - velocity.x) <= 1e-6 &&
+        fabs(long_velocity.y - velocity.y) <= 1e-6);
+  return test_failures > 0;
+}
@@ -0,0 +1,202 @@
+// Writes a simulation whose every saved field and parameter differs from the
+// defaults, reads it back and compares them all exactly, then checks that
+// damaged files and files of another version are refused without touching
+// the simulation
+#define _POSIX_C_SOURCE 200809L
+
+#include "test.h"
+
+#include "save_state.h"
+#include "simulation.h"
+#include "vector.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_PARTICLES 1000
+#define TEST_TRACERS 3000
+// Offsets in the file: the version after the magic, the parameters after
+// the 48 byte header, and the first column on the first 64 byte boundary
+// after the parameters and the directory of 9 columns
+#define TEST_VERSION_OFFSET 8
+#define TEST_PARAMETERS_OFFSET 48
+#define TEST_FIRST_COLUMN_OFFSET 448
+
+// A value that is exact in either precision
+static VECTOR_T test_value(uint64_t i, double scale) {
+  return (VECTOR_T)((double)(i % 997) * scale - 100);
+}
+
+static Simulation test_simulation(void) {
+  Simulation simulation = simulation_init(12.5);
+  simulation.dominant_mass_ratio = 7;
+  simulation.respa_heavy_fraction = 0.25;
+  simulation.softening_length = 0.75;
+  simulation.sleep_energy_threshold = 3.5;
+  simulation.ccd_fast_ratio = 0.125;
+  simulation.integrator = INTEGRATOR_RESPA;
+  simulation.respa_interval = 6;
+  simulation.softening_kernel = SOFTENING_SPLINE;
+  simulation.sleep_step_count = 90;
+  simulation.ccd_max_events = 17;
+  simulation.static_field_resolution = 64;
+  simulation.trails.length = 32;
+  simulation.trails.stride = 3;
+  simulation.trails.capacity = 100;
+
+  for (uint64_t i = 0; i < TEST_PARTICLES; i++) {
+    simulation_new_particle(&simulation,
+                            (Particle){.position = {test_value(i, 1.5),
+                                                   test_value(i, -0.5)},
+                                       .mass = 1,
+                                       .radius = 1});
+    Particle *p = &simulation.particles[i];
+    p->velocity = (Vec2){test_value(i, 0.25), test_value(i, 0.75)};
+    p->mass = test_value(i, 2) + 300;
+    p->radius = test_value(i, 0.125) + 200;
+    p->is_static = i % 3 == 0;
+    p->is_sleeping = i % 5 == 1;
+    p->calm_steps = (uint32_t)(i * 7);
+    p->sleep_acceleration = (Vec2){test_value(i, 0.5), test_value(i, -2)};
+  }
+
+  TracerSet *tracers = &simulation.tracers;
+  tracers->positions = malloc(sizeof(Vec2) * TEST_TRACERS);
+  tracers->velocities = malloc(sizeof(Vec2) * TEST_TRACERS);
+  tracers->count = TEST_TRACERS;
+  tracers->capacity = TEST_TRACERS;
+  CHECK(tracers->positions && tracers->velocities);
+  for (uint64_t i = 0; i < TEST_TRACERS; i++) {
+    tracers->positions[i] = (Vec2){test_value(i, 3), test_value(i + 1, 1)};
+    tracers->velocities[i] = (Vec2){test_value(i, -1), test_value(i, 0.5)};
+  }
+  return simulation;
+}
+
+static bool test_same_vector(Vec2 a, Vec2 b) {
+  return a.x == b.x && a.y == b.y;
+}
+
+// Whether every saved field and parameter of the two simulations is equal
+static bool test_same(const Simulation *a, const Simulation *b) {
+  if (a->gravitational_constant != b->gravitational_constant ||
+      a->dominant_mass_ratio != b->dominant_mass_ratio ||
+      a->respa_heavy_fraction != b->respa_heavy_fraction ||
+      a->softening_length != b->softening_length ||
+      a->sleep_energy_threshold != b->sleep_energy_threshold ||
+      a->ccd_fast_ratio != b->ccd_fast_ratio ||
+      a->integrator != b->integrator ||
+      a->respa_interval != b->respa_interval ||
+      a->softening_kernel != b->softening_kernel ||
+      a->sleep_step_count != b->sleep_step_count ||
+      a->ccd_max_events != b->ccd_max_events ||
+      a->static_field_resolution != b->static_field_resolution ||
+      a->trails.length != b->trails.length ||
+      a->trails.stride != b->trails.stride ||
+      a->trails.capacity != b->trails.capacity ||
+      a->particle_count != b->particle_count ||
+      a->tracers.count != b->tracers.count) {
+    return false;
+  }
+  for (uint64_t i = 0; i < a->particle_count; i++) {
+    const Particle *p = &a->particles[i];
+    const Particle *q = &b->particles[i];
+    if (!test_same_vector(p->position, q->position) ||
+        !test_same_vector(p->velocity, q->velocity) || p->mass != q->mass ||
+        p->radius != q->radius || p->is_static != q->is_static ||
+        p->is_sleeping != q->is_sleeping || p->calm_steps != q->calm_steps ||
+        !test_same_vector(p->sleep_acceleration, q->sleep_acceleration)) {
+      return false;
+    }
+  }
+  for (uint64_t i = 0; i < a->tracers.count; i++) {
+    if (!test_same_vector(a->tracers.positions[i], b->tracers.positions[i]) ||
+        !test_same_vector(a->tracers.velocities[i],
+                          b->tracers.velocities[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Flip the bits of one byte of a file
+static void test_flip(const char *path, long offset) {
+  FILE *file = fopen(path, "r+b");
+  CHECK(file != NULL);
+  if (file == NULL) {
+    return;
+  }
+  fseek(file, offset, SEEK_SET);
+  int byte = fgetc(file);
+  fseek(file, offset, SEEK_SET);
+  fputc(byte ^ 0xff, file);
+  fclose(file);
+}
+
+// Number of entries in a directory besides . and ..
+static int test_entries(const char *path) {
+  DIR *directory = opendir(path);
+  if (directory == NULL) {
+    return -1;
+  }
+  int count = 0;
+  for (struct dirent *entry = readdir(directory); entry;
+       entry = readdir(directory)) {
+    count += strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..");
+  }
+  closedir(directory);
+  return count;
+}
+
+int main(void) {
+  char directory[] = "/tmp/test_save_state_XXXXXX";
+  CHECK(mkdtemp(directory) != NULL);
+  char path[sizeof(directory) + 16];
+  snprintf(path, sizeof(path), "%s/run.save", directory);
+
+  Simulation saved = test_simulation();
+  CHECK(save_state_write(&saved, path) == SAVE_STATE_OK);
+  // Writing over an existing save replaces it and leaves no temporary file
+  CHECK(save_state_write(&saved, path) == SAVE_STATE_OK);
+  CHECK(test_entries(directory) == 1);
+
+  Simulation loaded = simulation_init(1);
+  CHECK(save_state_read(&loaded, path) == SAVE_STATE_OK);
+  CHECK(test_same(&saved, &loaded));
+
+  // Damaged files are refused and the simulation is left as it was
+  test_flip(path, TEST_FIRST_COLUMN_OFFSET + 1);
+  CHECK(save_state_read(&loaded, path) == SAVE_STATE_CORRUPT);
+  test_flip(path, TEST_FIRST_COLUMN_OFFSET + 1);
+  test_flip(path, TEST_PARAMETERS_OFFSET + 3);
+  CHECK(save_state_read(&loaded, path) == SAVE_STATE_CORRUPT);
+  test_flip(path, TEST_PARAMETERS_OFFSET + 3);
+  test_flip(path, TEST_VERSION_OFFSET);
+  CHECK(save_state_read(&loaded, path) == SAVE_STATE_BAD_VERSION);
+  test_flip(path, TEST_VERSION_OFFSET);
+  CHECK(test_same(&saved, &loaded));
+
+  // With every byte restored the file loads again
+  simulation_deinit(&loaded);
+  loaded = simulation_init(1);
+  CHECK(save_state_read(&loaded, path) == SAVE_STATE_OK);
+  CHECK(test_same(&saved, &loaded));
+
+  // A save that cannot be written fails without leaving a file behind
+  char missing[sizeof(path) + 16];
+  snprintf(missing, sizeof(missing), "%s/missing/run.save", directory);
+  CHECK(save_state_write(&saved, missing) == SAVE_STATE_IO_ERROR);
+  CHECK(test_entries(directory) == 1);
+
+  simulation_deinit(&saved);
+  simulation_deinit(&loaded);
+  remove(path);
+  rmdir(directory);
+  return test_failures > 0;
+}
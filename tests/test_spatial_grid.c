@@ -0,0 +1,160 @@
+// Compares every spatial grid query with a brute force search over the
+// particles, on a crowd of small particles with a few oversized ones and
+// points reaching outside the grid
+#include "test.h"
+
+#include "simulation.h"
+#include "spatial_grid.h"
+#include "vector.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_PARTICLES 3000
+#define TEST_OVERSIZED 6
+#define TEST_QUERIES 400
+#define TEST_EXTENT 1000.0
+#define TEST_SEED 11
+
+// Random number from min to max
+static double test_uniform(double min, double max) {
+  return min + (max - min) * rand() / RAND_MAX;
+}
+
+// Random point around the particles, some of them past their edge
+static Vec2 test_point(void) {
+  return (Vec2){test_uniform(-0.2 * TEST_EXTENT, 1.2 * TEST_EXTENT),
+                test_uniform(-0.2 * TEST_EXTENT, 1.2 * TEST_EXTENT)};
+}
+
+static int test_compare_indices(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Whether the found indices are exactly those the brute force marked, in
+// any order
+static bool test_same_set(uint64_t *found, uint64_t found_count,
+                          const bool *expected, uint64_t count) {
+  qsort(found, found_count, sizeof(uint64_t), test_compare_indices);
+  uint64_t k = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    if (!expected[i]) {
+      continue;
+    }
+    if (k == found_count || found[k] != i) {
+      return false;
+    }
+    k++;
+  }
+  return k == found_count;
+}
+
+static double test_distance_squared(const Particle *p, Vec2 point) {
+  double dx = p->position.x - point.x;
+  double dy = p->position.y - point.y;
+  return dx * dx + dy * dy;
+}
+
+int main(void) {
+  srand(TEST_SEED);
+  Particle *particles = calloc(TEST_PARTICLES, sizeof(Particle));
+  uint64_t *found = malloc(sizeof(uint64_t) * TEST_PARTICLES);
+  bool *expected = malloc(sizeof(bool) * TEST_PARTICLES);
+  CHECK(particles && found && expected);
+  for (uint64_t i = 0; i < TEST_PARTICLES; i++) {
+    // A few particles far above the mean radius go to the oversized list
+    double radius =
+        i < TEST_OVERSIZED ? test_uniform(40, 90) : test_uniform(0.5, 3);
+    particles[i] = (Particle){
+        .position = {test_uniform(0, TEST_EXTENT),
+                     test_uniform(0, TEST_EXTENT)},
+        .mass = 1,
+        .radius = radius,
+    };
+  }
+  SpatialGrid grid = {0};
+  spatial_grid_build(&grid, particles, TEST_PARTICLES);
+  CHECK(grid.particle_count == TEST_PARTICLES);
+  CHECK(grid.oversized_count > 0);
+
+  for (int q = 0; q < TEST_QUERIES; q++) {
+    // Box, sometimes larger than the grid
+    Vec2 a = test_point();
+    Vec2 b = q % 10 == 0 ? test_point() : (Vec2){a.x + test_uniform(0, 150),
+                                                a.y + test_uniform(0, 150)};
+    Vec2 min = {fmin(a.x, b.x), fmin(a.y, b.y)};
+    Vec2 max = {fmax(a.x, b.x), fmax(a.y, b.y)};
+    uint64_t expected_count = 0;
+    for (uint64_t i = 0; i < TEST_PARTICLES; i++) {
+      Vec2 position = particles[i].position;
+      expected[i] = position.x >= min.x && position.x <= max.x &&
+                    position.y >= min.y && position.y <= max.y;
+      expected_count += expected[i];
+    }
+    uint64_t count = spatial_grid_query_box(&grid, particles, min, max, found,
+                                            TEST_PARTICLES);
+    CHECK(count == expected_count);
+    CHECK(count == expected_count &&
+          test_same_set(found, count, expected, TEST_PARTICLES));
+    // A short buffer still gets the total
+    if (expected_count > 1) {
+      CHECK(spatial_grid_query_box(&grid, particles, min, max, found, 1) ==
+            expected_count);
+    }
+
+    // Circle
+    Vec2 center = test_point();
+    double radius = q % 10 == 0 ? test_uniform(0, 800) : test_uniform(0, 80);
+    expected_count = 0;
+    for (uint64_t i = 0; i < TEST_PARTICLES; i++) {
+      expected[i] =
+          test_distance_squared(&particles[i], center) <= radius * radius;
+      expected_count += expected[i];
+    }
+    count = spatial_grid_query_circle(&grid, particles, center, radius, found,
+                                      TEST_PARTICLES);
+    CHECK(count == expected_count);
+    CHECK(count == expected_count &&
+          test_same_set(found, count, expected, TEST_PARTICLES));
+
+    // Nearest centre within a distance. Ties may pick either particle, so
+    // the distances are compared.
+    Vec2 point = test_point();
+    double max_distance = test_uniform(0, 60);
+    uint64_t nearest = TEST_PARTICLES;
+    double nearest_squared = max_distance * max_distance;
+    for (uint64_t i = 0; i < TEST_PARTICLES; i++) {
+      double distance_squared = test_distance_squared(&particles[i], point);
+      if (distance_squared <= nearest_squared) {
+        nearest = i;
+        nearest_squared = distance_squared;
+      }
+    }
+    uint64_t index =
+        spatial_grid_nearest(&grid, particles, point, max_distance);
+    CHECK((index == TEST_PARTICLES) == (nearest == TEST_PARTICLES));
+    CHECK(index == TEST_PARTICLES || nearest == TEST_PARTICLES ||
+          test_distance_squared(&particles[index], point) == nearest_squared);
+
+    // Overlap of a circle with any disk
+    double probe = test_uniform(0, 10);
+    bool overlaps = false;
+    for (uint64_t i = 0; i < TEST_PARTICLES && !overlaps; i++) {
+      double reach = probe + particles[i].radius;
+      overlaps = test_distance_squared(&particles[i], point) < reach * reach;
+    }
+    CHECK(spatial_grid_overlaps_circle(&grid, particles, point, probe) ==
+          overlaps);
+  }
+
+  spatial_grid_deinit(&grid);
+  free(particles);
+  free(found);
+  free(expected);
+  return test_failures > 0;
+}
@@ -0,0 +1,133 @@
+// Records a run of moving particles and tracers and checks that every
+// decoded position is within half a cell of the recorded one
+#define _POSIX_C_SOURCE 200809L
+
+#include "test.h"
+
+#include "scenario.h"
+#include "simulation.h"
+#include "trajectory.h"
+#include "vector.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define TEST_PARTICLES 500
+#define TEST_TRACERS 2000
+#define TEST_STEPS 200
+#define TEST_SEED 7
+#define TEST_CELL_SIZE 0.01
+// Slack for positions stored as floats, which round on top of the cells
+#define TEST_SLACK (sizeof(VECTOR_T) == sizeof(float) ? 1e-4 : 1e-9)
+
+// Random number from -1 to 1
+static double test_random(void) { return 2.0 * rand() / RAND_MAX - 1; }
+
+// Move every particle and tracer a small random step, with a shared drift
+// so that neighbours move alike as they do in a real run
+static void test_move(Simulation *simulation, Vec2 drift) {
+  for (uint64_t i = 0; i < simulation->particle_count; i++) {
+    Particle *p = &simulation->particles[i];
+    p->position.x += drift.x + 0.3 * test_random();
+    p->position.y += drift.y + 0.3 * test_random();
+  }
+  for (uint64_t i = 0; i < simulation->tracers.count; i++) {
+    Vec2 *t = &simulation->tracers.positions[i];
+    t->x += drift.x + 0.3 * test_random();
+    t->y += drift.y + 0.3 * test_random();
+  }
+}
+
+int main(void) {
+  char path[] = "/tmp/test_trajectory_XXXXXX";
+  int descriptor = mkstemp(path);
+  CHECK(descriptor >= 0);
+  if (descriptor < 0) {
+    return 1;
+  }
+  close(descriptor);
+
+  Simulation simulation = simulation_init(1);
+  scenario_random_disk(&simulation, TEST_PARTICLES, 300, 1, TEST_SEED);
+  scenario_dust(&simulation, (Vec2){0, 0}, 300, TEST_TRACERS, TEST_SEED);
+  srand(TEST_SEED);
+
+  // Every step is kept to compare with
+  uint64_t count = simulation.particle_count + simulation.tracers.count;
+  Vec2 *recorded = malloc(sizeof(Vec2) * count * TEST_STEPS);
+  float *radii = malloc(sizeof(float) * TEST_PARTICLES * TEST_STEPS);
+  CHECK(recorded && radii);
+
+  TrajectoryRecorder *recorder =
+      trajectory_recorder_start(path, 1, TEST_CELL_SIZE);
+  CHECK(recorder != NULL);
+  for (uint64_t step = 0; step < TEST_STEPS; step++) {
+    // A radius change halfway forces a keyframe outside the usual interval
+    if (step == TEST_STEPS / 2) {
+      simulation.particles[0].radius *= 2;
+    }
+    for (uint64_t i = 0; i < simulation.particle_count; i++) {
+      recorded[step * count + i] = simulation.particles[i].position;
+      float radius = (float)simulation.particles[i].radius;
+      radii[step * TEST_PARTICLES + i] = radius;
+    }
+    for (uint64_t i = 0; i < simulation.tracers.count; i++) {
+      recorded[step * count + simulation.particle_count + i] =
+          simulation.tracers.positions[i];
+    }
+    trajectory_recorder_offer(recorder, &simulation, step);
+    // Every step is coded before the next, so none is dropped
+    trajectory_recorder_flush(recorder);
+    test_move(&simulation, (Vec2){0.5 * test_random(), 0.5 * test_random()});
+  }
+  TrajectoryStats stats = trajectory_recorder_stop(recorder);
+  CHECK(!stats.failed);
+  CHECK(stats.frames == TEST_STEPS && stats.dropped == 0);
+  // Frames 0, 64, the radius change at 100 and 164
+  CHECK(stats.keyframes == 4);
+
+  TrajectoryReader *reader = trajectory_reader_open(path);
+  CHECK(reader != NULL);
+  double worst = 0;
+  uint64_t frames = 0;
+  for (uint64_t number = 0; reader; number++) {
+    const TrajectoryFrame *frame = trajectory_reader_frame(reader, number);
+    if (frame == NULL) {
+      break;
+    }
+    frames++;
+    CHECK(frame->step == number);
+    CHECK(frame->particle_count == TEST_PARTICLES);
+    CHECK(frame->tracer_count == TEST_TRACERS);
+    if (frame->step >= TEST_STEPS ||
+        frame->particle_count + frame->tracer_count != count) {
+      continue;
+    }
+    const Vec2 *expected = &recorded[frame->step * count];
+    for (uint64_t i = 0; i < count; i++) {
+      double error = fmax(fabs(frame->positions[i].x - expected[i].x),
+                          fabs(frame->positions[i].y - expected[i].y));
+      worst = fmax(worst, error);
+    }
+    for (uint64_t i = 0; i < frame->particle_count; i++) {
+      CHECK(frame->radii[i] == radii[frame->step * TEST_PARTICLES + i]);
+    }
+  }
+  CHECK(frames == stats.frames);
+  CHECK(worst <= TEST_CELL_SIZE / 2 + TEST_SLACK);
+  if (reader) {
+    trajectory_reader_close(reader);
+  }
+
+  printf("%llu frames, %llu keyframes, %llu bytes, worst error %g\n",
+         (unsigned long long)stats.frames,
+         (unsigned long long)stats.keyframes,
+         (unsigned long long)stats.written_bytes, worst);
+  free(recorded);
+  free(radii);
+  simulation_deinit(&simulation);
+  remove(path);
+  return test_failures > 0;
+}
@@ -0,0 +1,129 @@
+// Records a run whose positions follow a formula of the step, then reads its
+// frames out of order: jumping back and forth across keyframes, repeating
+// frames and stepping backwards, each checked against the formula
+#define _POSIX_C_SOURCE 200809L
+
+#include "test.h"
+
+#include "simulation.h"
+#include "trajectory.h"
+#include "vector.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define TEST_PARTICLES 300
+#define TEST_TRACERS 700
+// Five keyframes: frames 0, 64, 128, 192 and 256
+#define TEST_FRAMES 300
+#define TEST_CELL_SIZE 0.01
+#define TEST_SLACK (sizeof(VECTOR_T) == sizeof(float) ? 1e-4 : 1e-9)
+
+// Position of particle or tracer i at a step, tracers after the particles
+static Vec2 test_position(uint64_t step, uint64_t i) {
+  double phase = 0.05 * step + 0.1 * i;
+  return (Vec2){(double)(i % 40) * 7 + 4 * sin(phase) + 0.2 * step,
+                (double)(i / 40) * 7 + 4 * cos(1.3 * phase)};
+}
+
+// Read a frame and check it against the formula
+static void test_read(TrajectoryReader *reader, uint64_t number) {
+  const TrajectoryFrame *frame = trajectory_reader_frame(reader, number);
+  CHECK(frame != NULL);
+  if (frame == NULL) {
+    return;
+  }
+  CHECK(frame->step == number);
+  CHECK(frame->particle_count == TEST_PARTICLES);
+  CHECK(frame->tracer_count == TEST_TRACERS);
+  uint64_t count = frame->particle_count + frame->tracer_count;
+  if (count != TEST_PARTICLES + TEST_TRACERS) {
+    return;
+  }
+  double worst = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    Vec2 expected = test_position(frame->step, i);
+    worst = fmax(worst, fmax(fabs(frame->positions[i].x - expected.x),
+                             fabs(frame->positions[i].y - expected.y)));
+  }
+  CHECK(worst <= TEST_CELL_SIZE / 2 + TEST_SLACK);
+}
+
+int main(void) {
+  char path[] = "/tmp/test_trajectory_reader_XXXXXX";
+  int descriptor = mkstemp(path);
+  CHECK(descriptor >= 0);
+  if (descriptor < 0) {
+    return 1;
+  }
+  close(descriptor);
+
+  Simulation simulation = simulation_init(1);
+  for (uint64_t i = 0; i < TEST_PARTICLES; i++) {
+    simulation_new_particle(&simulation,
+                            (Particle){.position = test_position(0, i),
+                                       .mass = 1,
+                                       .radius = 1 + (double)(i % 3)});
+  }
+  TracerSet *tracers = &simulation.tracers;
+  tracers->positions = malloc(sizeof(Vec2) * TEST_TRACERS);
+  tracers->velocities = calloc(TEST_TRACERS, sizeof(Vec2));
+  tracers->count = TEST_TRACERS;
+  tracers->capacity = TEST_TRACERS;
+  CHECK(tracers->positions && tracers->velocities);
+
+  TrajectoryRecorder *recorder =
+      trajectory_recorder_start(path, 1, TEST_CELL_SIZE);
+  CHECK(recorder != NULL);
+  for (uint64_t step = 0; step < TEST_FRAMES; step++) {
+    for (uint64_t i = 0; i < TEST_PARTICLES; i++) {
+      simulation.particles[i].position = test_position(step, i);
+    }
+    for (uint64_t i = 0; i < TEST_TRACERS; i++) {
+      tracers->positions[i] = test_position(step, TEST_PARTICLES + i);
+    }
+    trajectory_recorder_offer(recorder, &simulation, step);
+    // Every step is coded before the next, so none is dropped
+    trajectory_recorder_flush(recorder);
+  }
+  TrajectoryStats stats = trajectory_recorder_stop(recorder);
+  CHECK(!stats.failed && stats.frames == TEST_FRAMES);
+  CHECK(stats.keyframes == 5);
+
+  TrajectoryReader *reader = trajectory_reader_open(path);
+  CHECK(reader != NULL);
+  if (reader) {
+    CHECK(reader->frame_count == TEST_FRAMES);
+
+    // Keyframes, the frames either side of them and the last frame, in an
+    // order that keeps jumping across them
+    uint64_t jumps[] = {299, 0,   128, 127, 63, 64, 65,  257, 1,
+                        256, 192, 191, 255, 2,  299, 130, 64, 0};
+    for (size_t j = 0; j < sizeof(jumps) / sizeof(jumps[0]); j++) {
+      test_read(reader, jumps[j]);
+    }
+
+    // Every frame once in a scrambled order: 97 is prime to 300, so the
+    // multiples of it modulo 300 visit each frame
+    for (uint64_t k = 0; k < TEST_FRAMES; k++) {
+      test_read(reader, k * 97 % TEST_FRAMES);
+    }
+
+    // Backwards through two keyframes, then the same frame twice
+    for (uint64_t number = 140; number-- > 50;) {
+      test_read(reader, number);
+    }
+    test_read(reader, 77);
+    test_read(reader, 77);
+
+    CHECK(trajectory_reader_frame(reader, TEST_FRAMES) == NULL);
+    trajectory_reader_close(reader);
+  }
+
+  simulation_deinit(&simulation);
+  remove(path);
+  return test_failures > 0;
+}